@@ -165,11 +165,26 @@ class EFSW_API FileWatcher
 
 		/// @return Returns if out of scope links are allowed
 		const bool& allowOutOfScopeLinks() const;
+
+		/** Limits the time the generic file watcher spends polling directories per cycle, in milliseconds.
+		* The directories that don't fit are polled in the next cycles, the longest waiting first.
+		* 0 disables the limit. The default is 100 ms per cycle of one second.
+		*/
+		void pollBudget( const unsigned long& ms );
+
+		/// @return The time the generic file watcher can spend polling per cycle, in milliseconds
+		const unsigned long& pollBudget() const;
+
+		/** @return The measured time a poll of the whole watched tree takes, in microseconds.
+		* Only the generic file watcher polls, the other backends return 0.
+		*/
+		unsigned long pollCost( WatchID watchid );
 	private:
 		/// The implementation
 		FileWatcherImpl	*	mImpl;
 		bool				mFollowSymlinks;
 		bool				mOutOfScopeLinks;
+		unsigned long		mPollBudget;
 };
 
 /// Basic interface for listening for file events.
@@ -189,6 +204,12 @@ class FileWatchListener
 		/// @param oldFilename The name of the file or directory moved
 		virtual void handleFileAction(WatchID watchid, const std::string& dir, const std::string& filename, Action action, std::string oldFilename = "" ) = 0;
 
+		/// Handles the loss of events, sent when the backend queue overflows.
+		/// Any change under the directory may have been missed, it should be rescanned.
+		/// @param watchid The watch id for the directory
+		/// @param dir The watched directory
+		virtual void handleMissedFileActions(WatchID /*watchid*/, const std::string& /*dir*/) {}
+
 };
 
 }
@@ -2,6 +2,7 @@
 #include <efsw/FileSystem.hpp>
 #include <efsw/Debug.hpp>
 #include <efsw/String.hpp>
+#include <efsw/System.hpp>
 
 namespace efsw {
 
@@ -9,11 +10,19 @@ DirWatcherGeneric::DirWatcherGeneric( DirWatcherGeneric * parent, WatcherGeneric
 	Parent( parent ),
 	Watch( ws ),
 	Recursive( recursive ),
-	Deleted( false )
+	Deleted( false ),
+	NextPoll( 0 ),
+	PollInterval( GENERIC_POLL_INTERVAL ),
+	PollCost( 0 )
 {
 	resetDirectory( directory );
 
+	Uint64 start = System::getTicks();
+
 	DirSnap.scan();
+
+	PollCost = System::getTicks() - start;
+	NextPoll = start + PollCost + PollInterval * 1000;
 }
 
 DirWatcherGeneric::~DirWatcherGeneric()
@@ -89,15 +98,15 @@ void DirWatcherGeneric::addChilds()
 		/// Create the subdirectories watchers
 		std::string dir;
 
-		for ( FileInfoMap::iterator it = DirSnap.Files.begin(); it != DirSnap.Files.end(); it++ )
+		for ( DirectorySnapshot::EntryList::iterator it = DirSnap.Files.begin(); it != DirSnap.Files.end(); it++ )
 		{
-			if ( it->second.isDirectory() && it->second.isReadable() )
+			if ( it->Info.isDirectory() && it->Info.isReadable() )
 			{
 				/// Check if the directory is a symbolic link
 				std::string curPath;
-				std::string link( FileSystem::getLinkRealPath( it->second.Filepath, curPath ) );
+				std::string link( FileSystem::getLinkRealPath( DirSnap.DirectoryInfo.Filepath + it->Name, curPath ) );
 
-				dir = it->first;
+				dir = it->Name;
 
 				if ( "" != link )
 				{
@@ -136,8 +145,84 @@ void DirWatcherGeneric::addChilds()
 
 void DirWatcherGeneric::watch( bool reportOwnChange )
 {
+	scan( reportOwnChange );
+
+	/// Process the subdirectories looking for changes
+	for ( DirWatchMap::iterator dit = Directories.begin(); dit != Directories.end(); dit++ )
+	{
+		/// Just watch
+		dit->second->watch();
+	}
+}
+
+void DirWatcherGeneric::poll( PollCycle& cycle )
+{
+	if ( NextPoll <= cycle.Cutoff && !cycle.exhausted() )
+	{
+		/// The parent reports the deletion of a removed subdirectory, it may not be due yet
+		if ( NULL != Parent && !FileSystem::isDirectory( DirSnap.DirectoryInfo.Filepath ) )
+		{
+			Parent->NextPoll = 0;
+			return;
+		}
+
+		scan( false );
+	}
+
+	for ( DirWatchMap::iterator dit = Directories.begin(); dit != Directories.end(); dit++ )
+	{
+		dit->second->poll( cycle );
+	}
+}
+
+void DirWatcherGeneric::schedule( const Uint64& now, PollList& due )
+{
+	if ( NextPoll <= now )
+	{
+		due.push_back( std::make_pair( NextPoll, PollCost ) );
+	}
+
+	for ( DirWatchMap::iterator dit = Directories.begin(); dit != Directories.end(); dit++ )
+	{
+		dit->second->schedule( now, due );
+	}
+}
+
+Uint64 DirWatcherGeneric::pollCost() const
+{
+	Uint64 cost = PollCost;
+
+	for ( DirWatchMap::const_iterator dit = Directories.begin(); dit != Directories.end(); dit++ )
+	{
+		cost += dit->second->pollCost();
+	}
+
+	return cost;
+}
+
+void DirWatcherGeneric::scan( bool reportOwnChange )
+{
+	Uint64 start = System::getTicks();
+
 	DirectorySnapshotDiff Diff = DirSnap.scan();
 
+	Uint64 end = System::getTicks();
+
+	/// Average the recent scans, one slow scan shouldn't hold back the directory
+	PollCost = ( PollCost + ( end - start ) ) / 2;
+
+	/// Poll often the directories that change, and back off from the ones that don't
+	if ( Diff.changed() || Diff.DirChanged )
+	{
+		PollInterval = GENERIC_POLL_INTERVAL;
+	}
+	else if ( PollInterval < GENERIC_POLL_MAX_INTERVAL )
+	{
+		PollInterval *= 2;
+	}
+
+	NextPoll = end + PollInterval * 1000;
+
 	if ( reportOwnChange && Diff.DirChanged && NULL != Parent )
 	{
 		Watch->Listener->handleFileAction( Watch->ID, FileSystem::pathRemoveFileName( DirSnap.DirectoryInfo.Filepath ), FileSystem::fileNameFromPath( DirSnap.DirectoryInfo.Filepath ), Actions::Modified );
@@ -179,6 +264,14 @@ void DirWatcherGeneric::watch( bool reportOwnChange )
 		DiffIterator( DirsModified )
 		{
 			handleAction( (*it).Filepath, Actions::Modified );
+
+			/// Its entries changed, don't wait for its interval
+			DirWatchMap::iterator dit = Directories.find( FileSystem::fileNameFromPath( (*it).Filepath ) );
+
+			if ( dit != Directories.end() )
+			{
+				dit->second->NextPoll = 0;
+			}
 		}
 
 		DiffIterator( DirsDeleted )
@@ -193,13 +286,6 @@ void DirWatcherGeneric::watch( bool reportOwnChange )
 			moveDirectory( (*mit).first, (*mit).second.Filepath );
 		}
 	}
-
-	/// Process the subdirectories looking for changes
-	for ( DirWatchMap::iterator dit = Directories.begin(); dit != Directories.end(); dit++ )
-	{
-		/// Just watch
-		dit->second->watch();
-	}
 }
 
 void DirWatcherGeneric::watchDir( std::string &dir )
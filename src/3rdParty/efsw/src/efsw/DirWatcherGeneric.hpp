@@ -23,8 +23,18 @@ class DirWatcherGeneric
 
 		~DirWatcherGeneric();
 
+		/// Polls the directory and the subdirectories now
 		void watch( bool reportOwnChange = false );
 
+		/// Polls the directory if it's due in the cycle, and the subdirectories
+		void poll( PollCycle& cycle );
+
+		/// Adds the directories due at the time to the list
+		void schedule( const Uint64& now, PollList& due );
+
+		/// Measured time a poll of the directory and the subdirectories takes, in microseconds
+		Uint64 pollCost() const;
+
 		void watchDir( std::string& dir );
 
 		static bool isDir( const std::string& directory );
@@ -39,6 +49,18 @@ class DirWatcherGeneric
 	protected:
 		bool				Deleted;
 
+		/// Time of the next poll, in microseconds
+		Uint64				NextPoll;
+
+		/// Interval between polls, reset when it changes and doubled otherwise, in milliseconds
+		Uint64				PollInterval;
+
+		/// Duration of the recent scans, in microseconds
+		Uint64				PollCost;
+
+		/// Scans the directory and reports the changes
+		void scan( bool reportOwnChange );
+
 		DirWatcherGeneric * createDirectory( std::string newdir );
 
 		void removeDirectory( std::string dir );
@@ -1,13 +1,36 @@
 ﻿#include <efsw/DirectorySnapshot.hpp>
 #include <efsw/FileSystem.hpp>
+#include <algorithm>
+#include <unordered_map>
 
 namespace efsw {
 
-DirectorySnapshot::DirectorySnapshot()
+/// Modification times have a resolution of a second, and the clock of a network share may differ
+#define SNAPSHOT_RACY_SECONDS 2
+
+static bool entryNameLess( const DirectorySnapshot::Entry& entry, const std::string& name )
+{
+	return entry.Name < name;
+}
+
+DirectorySnapshot::Entry::Entry()
 {
 }
 
-DirectorySnapshot::DirectorySnapshot( std::string directory )
+DirectorySnapshot::Entry::Entry( const std::string& name, const FileInfo& info ) :
+	Name( name ),
+	Info( info )
+{
+	Info.Filepath.clear();
+}
+
+DirectorySnapshot::DirectorySnapshot() :
+	ListedAt( 0 )
+{
+}
+
+DirectorySnapshot::DirectorySnapshot( std::string directory ) :
+	ListedAt( 0 )
 {
 	init( directory );
 }
@@ -29,48 +52,34 @@ bool DirectorySnapshot::exists()
 
 void DirectorySnapshot::deleteAll( DirectorySnapshotDiff& Diff )
 {
-	FileInfo fi;
-
-	for ( FileInfoMap::iterator it = Files.begin(); it != Files.end(); it++ )
+	for ( EntryList::iterator it = Files.begin(); it != Files.end(); it++ )
 	{
-		fi = it->second;
-
-		if ( fi.isDirectory() )
+		if ( it->Info.isDirectory() )
 		{
-			Diff.DirsDeleted.push_back( fi );
+			Diff.DirsDeleted.push_back( fileInfo( *it ) );
 		}
 		else
 		{
-			Diff.FilesDeleted.push_back( fi );
+			Diff.FilesDeleted.push_back( fileInfo( *it ) );
 		}
 	}
 }
 
 void DirectorySnapshot::setDirectoryInfo( std::string directory )
 {
+	/// The entry paths are the directory path plus the name
+	FileSystem::dirAddSlashAtEnd( directory );
+
 	DirectoryInfo = FileInfo( directory );
 }
 
 void DirectorySnapshot::initFiles()
 {
-	Files = FileSystem::filesInfoFromPath( DirectoryInfo.Filepath );
+	DirectorySnapshotDiff Diff;
 
-	FileInfoMap::iterator it = Files.begin();
-	std::list<std::string> eraseFiles;
+	Files.clear();
 
-	/// Remove all non regular files and non directories
-	for ( ; it != Files.end(); it++ )
-	{
-		if ( !it->second.isRegularFile() && !it->second.isDirectory() )
-		{
-			eraseFiles.push_back( it->first );
-		}
-	}
-
-	for ( std::list<std::string>::iterator eit = eraseFiles.begin(); eit != eraseFiles.end(); eit++ )
-	{
-		Files.erase( *eit );
-	}
+	listFiles( Diff );
 }
 
 DirectorySnapshotDiff DirectorySnapshot::scan()
@@ -96,152 +105,231 @@ DirectorySnapshotDiff DirectorySnapshot::scan()
 		return Diff;
 	}
 
-	FileInfoMap files = FileSystem::filesInfoFromPath( DirectoryInfo.Filepath );
-
-	if ( files.empty() && Files.empty() )
+	/// Entries are only created, deleted or renamed by changing the directory
+	if ( !Diff.DirChanged && !listingRacy() && updateFiles( Diff ) )
 	{
 		return Diff;
 	}
 
-	FileInfo fi;
-	FileInfoMap FilesCpy;
-	FileInfoMap::iterator it;
-	FileInfoMap::iterator fiIt;
+	listFiles( Diff );
 
-	if ( Diff.DirChanged )
+	return Diff;
+}
+
+bool DirectorySnapshot::listingRacy()
+{
+	/// A change done in the same second as the last listing doesn't change the modification time
+	return 0 == ListedAt || DirectoryInfo.ModificationTime + SNAPSHOT_RACY_SECONDS >= (Uint64)ListedAt;
+}
+
+bool DirectorySnapshot::updateFiles( DirectorySnapshotDiff& Diff )
+{
+	std::string path( DirectoryInfo.Filepath );
+	const std::size_t dirLength = path.size();
+
+	for ( EntryList::iterator it = Files.begin(); it != Files.end(); it++ )
 	{
-		FilesCpy = Files;
+		path.resize( dirLength );
+		path += it->Name;
+
+		FileInfo fi( path );
+
+		/// Failed to stat, the entry is gone
+		if ( 0 == fi.Permissions )
+		{
+			return false;
+		}
+
+		if ( it->Info != fi )
+		{
+			if ( fi.isDirectory() )
+			{
+				Diff.DirsModified.push_back( fi );
+			}
+			else
+			{
+				Diff.FilesModified.push_back( fi );
+			}
+
+			it->Info = fi;
+			it->Info.Filepath.clear();
+		}
 	}
 
-	for ( it = files.begin(); it != files.end(); it++ )
+	return true;
+}
+
+void DirectorySnapshot::listFiles( DirectorySnapshotDiff& Diff )
+{
+	FileInfoMap files = FileSystem::filesInfoFromPath( DirectoryInfo.Filepath );
+
+	ListedAt = time( NULL );
+
+	/// The map is sorted by name, so is the list
+	EntryList current;
+	current.reserve( files.size() );
+
+	for ( FileInfoMap::iterator it = files.begin(); it != files.end(); it++ )
 	{
-		fi	= it->second;
+		/// Only keep regular files or directories
+		if ( it->second.isRegularFile() || it->second.isDirectory() )
+		{
+			current.push_back( Entry( it->first, it->second ) );
+		}
+	}
+
+	files.clear();
 
-		/// File existed before?
-		fiIt = Files.find( it->first );
+	std::vector<std::size_t> created;
+	std::vector<std::size_t> vanished;
+	std::size_t o = 0;
+	std::size_t c = 0;
 
-		if ( fiIt != Files.end() )
+	/// Merge the known entries with the listed ones
+	while ( o < Files.size() || c < current.size() )
+	{
+		if ( c == current.size() || ( o < Files.size() && Files[ o ].Name < current[ c ].Name ) )
+		{
+			vanished.push_back( o++ );
+		}
+		else if ( o == Files.size() || current[ c ].Name < Files[ o ].Name )
 		{
-			/// Erase from the file list copy
-			FilesCpy.erase( it->first );
+			created.push_back( c++ );
+		}
+		else
+		{
+			Entry& entry = current[ c ];
 
-			/// File changed?
-			if ( (*fiIt).second != fi )
+			if ( Files[ o ].Info != entry.Info )
 			{
-				/// Update the new file info
-				Files[ it->first ] = fi;
-
-				/// handle modified event
-				if ( fi.isDirectory() )
+				if ( entry.Info.isDirectory() )
 				{
-					Diff.DirsModified.push_back( fi );
+					Diff.DirsModified.push_back( fileInfo( entry ) );
 				}
 				else
 				{
-					Diff.FilesModified.push_back( fi );
+					Diff.FilesModified.push_back( fileInfo( entry ) );
 				}
 			}
+
+			o++;
+			c++;
 		}
-		/// Only add regular files or directories
-		else if ( fi.isRegularFile() || fi.isDirectory() )
-		{
-			/// New file found
-			Files[ it->first ] = fi;
+	}
 
-			FileInfoMap::iterator fit;
-			std::string oldFile = "";
+	/// A created entry with the inode of a vanished one was moved
+	std::unordered_map<Uint64, std::size_t> inodes;
 
-			/// Check if the same inode already existed
-			if ( ( fit = nodeInFiles( fi ) ) != Files.end() )
-			{
-				oldFile = fit->first;
+	if ( !created.empty() && !vanished.empty() && FileInfo::inodeSupported() )
+	{
+		inodes.reserve( vanished.size() );
 
-				/// Avoid firing a Delete event
-				FilesCpy.erase( fit->first );
+		for ( std::size_t i = 0; i < vanished.size(); i++ )
+		{
+			inodes[ Files[ vanished[ i ] ].Info.Inode ] = vanished[ i ];
+		}
+	}
 
-				/// Delete the old file name
-				Files.erase( fit->first );
+	for ( std::size_t i = 0; i < created.size(); i++ )
+	{
+		Entry& entry = current[ created[ i ] ];
+		std::unordered_map<Uint64, std::size_t>::iterator found = inodes.find( entry.Info.Inode );
 
-				if ( fi.isDirectory() )
-				{
-					Diff.DirsMoved.push_back( std::make_pair( oldFile, fi ) );
-				}
-				else
-				{
-					Diff.FilesMoved.push_back( std::make_pair( oldFile, fi ) );
-				}
+		if ( found != inodes.end() )
+		{
+			Entry& old = Files[ found->second ];
+
+			if ( entry.Info.isDirectory() )
+			{
+				Diff.DirsMoved.push_back( std::make_pair( old.Name, fileInfo( entry ) ) );
 			}
 			else
 			{
-				if ( fi.isDirectory() )
-				{
-					Diff.DirsCreated.push_back( fi );
-				}
-				else
-				{
-					Diff.FilesCreated.push_back( fi );
-				}
+				Diff.FilesMoved.push_back( std::make_pair( old.Name, fileInfo( entry ) ) );
 			}
-		}
-	}
 
-	if ( !Diff.DirChanged )
-	{
-		return Diff;
+			/// Avoid firing a Delete event
+			old.Name.clear();
+			inodes.erase( found );
+		}
+		else if ( entry.Info.isDirectory() )
+		{
+			Diff.DirsCreated.push_back( fileInfo( entry ) );
+		}
+		else
+		{
+			Diff.FilesCreated.push_back( fileInfo( entry ) );
+		}
 	}
 
 	/// The files or directories that remains were deleted
-	for ( it = FilesCpy.begin(); it != FilesCpy.end(); it++ )
+	for ( std::size_t i = 0; i < vanished.size(); i++ )
 	{
-		fi = it->second;
+		Entry& entry = Files[ vanished[ i ] ];
 
-		if ( fi.isDirectory() )
+		if ( entry.Name.empty() )
 		{
-			Diff.DirsDeleted.push_back( fi );
+			continue;
+		}
+
+		if ( entry.Info.isDirectory() )
+		{
+			Diff.DirsDeleted.push_back( fileInfo( entry ) );
 		}
 		else
 		{
-			Diff.FilesDeleted.push_back( fi );
+			Diff.FilesDeleted.push_back( fileInfo( entry ) );
 		}
-
-		/// Remove the file or directory from the list of files
-		Files.erase( it->first );
 	}
 
-	return Diff;
+	Files.swap( current );
+}
+
+DirectorySnapshot::EntryList::iterator DirectorySnapshot::lowerBound( const std::string& name )
+{
+	return std::lower_bound( Files.begin(), Files.end(), name, entryNameLess );
 }
 
-FileInfoMap::iterator DirectorySnapshot::nodeInFiles( FileInfo& fi )
+DirectorySnapshot::Entry * DirectorySnapshot::find( const std::string& name )
 {
-	FileInfoMap::iterator it;
+	EntryList::iterator it = lowerBound( name );
 
-	if ( FileInfo::inodeSupported() )
+	if ( it != Files.end() && it->Name == name )
 	{
-		for ( it = Files.begin(); it != Files.end(); it++ )
-		{
-			if ( it->second.sameInode( fi ) && it->second.Filepath != fi.Filepath )
-			{
-				return it;
-			}
-		}
+		return &(*it);
 	}
 
-	return Files.end();
+	return NULL;
+}
+
+FileInfo DirectorySnapshot::fileInfo( const Entry& entry ) const
+{
+	FileInfo fi( entry.Info );
+	fi.Filepath = DirectoryInfo.Filepath + entry.Name;
+	return fi;
 }
 
 void DirectorySnapshot::addFile( std::string path )
 {
 	std::string name( FileSystem::fileNameFromPath( path ) );
-	Files[ name ] = FileInfo( path );
+	EntryList::iterator it = lowerBound( name );
+
+	if ( it != Files.end() && it->Name == name )
+	{
+		*it = Entry( name, FileInfo( path ) );
+	}
+	else
+	{
+		Files.insert( it, Entry( name, FileInfo( path ) ) );
+	}
 }
 
 void DirectorySnapshot::removeFile( std::string path )
 {
 	std::string name( FileSystem::fileNameFromPath( path ) );
+	EntryList::iterator it = lowerBound( name );
 
-	FileInfoMap::iterator it = Files.find( name );
-
-	if ( Files.end() != it )
+	if ( it != Files.end() && it->Name == name )
 	{
 		Files.erase( it );
 	}
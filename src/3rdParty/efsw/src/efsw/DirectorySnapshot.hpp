@@ -2,14 +2,33 @@
 #define EFSW_DIRECTORYSNAPSHOT_HPP
 
 #include <efsw/DirectorySnapshotDiff.hpp>
+#include <vector>
+#include <ctime>
 
 namespace efsw {
 
 class DirectorySnapshot
 {
 	public:
+		/// State of a directory entry, its path is the directory path plus the name
+		class Entry
+		{
+			public:
+				Entry();
+
+				Entry( const std::string& name, const FileInfo& info );
+
+				std::string		Name;
+
+				/// Without Filepath, to keep the snapshot compact
+				FileInfo		Info;
+		};
+
+		/// Entries sorted by name
+		typedef std::vector<Entry> EntryList;
+
 		FileInfo		DirectoryInfo;
-		FileInfoMap		Files;
+		EntryList		Files;
 
 		void setDirectoryInfo( std::string directory );
 
@@ -23,9 +42,15 @@ class DirectorySnapshot
 
 		bool exists();
 
+		/// Entries are only listed again if the directory modification time changed,
+		/// otherwise only the known entries are checked for modifications.
 		DirectorySnapshotDiff scan();
 
-		FileInfoMap::iterator nodeInFiles( FileInfo& fi );
+		/// @return The entry with the name, or NULL
+		Entry * find( const std::string& name );
+
+		/// @return The full file info of an entry
+		FileInfo fileInfo( const Entry& entry ) const;
 
 		void addFile( std::string path );
 
@@ -35,12 +60,26 @@ class DirectorySnapshot
 
 		void updateFile( std::string path );
 	protected:
+		/// Time of the last listing, 0 before the first one
+		time_t			ListedAt;
+
 		void initFiles();
 
 		void deleteAll( DirectorySnapshotDiff &Diff );
+
+		/// @return If the directory may have changed without its modification time showing it
+		bool listingRacy();
+
+		/// Lists the directory and merges the entries with the known ones
+		void listFiles( DirectorySnapshotDiff &Diff );
+
+		/// Checks the known entries without listing the directory
+		/// @return false if an entry is gone, the directory must be listed
+		bool updateFiles( DirectorySnapshotDiff &Diff );
+
+		EntryList::iterator lowerBound( const std::string& name );
 };
 
 }
 
 #endif
-
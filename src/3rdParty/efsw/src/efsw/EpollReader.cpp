@@ -0,0 +1,179 @@
+﻿#include <efsw/EpollReader.hpp>
+
+#if EFSW_PLATFORM == EFSW_PLATFORM_INOTIFY
+
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <efsw/Debug.hpp>
+
+/// Free space kept for every read, larger than any single event
+#define EPOLLREADER_READ_SIZE (64 * 1024)
+
+/// Events beyond this are left in the kernel queue for the next batch
+#define EPOLLREADER_ARENA_MAX (16 * 1024 * 1024)
+
+#define EPOLLREADER_TAG_EVENTS 1
+#define EPOLLREADER_TAG_WAKE 2
+
+namespace efsw
+{
+
+EpollReader::EpollReader() :
+	mFD(-1),
+	mEpollFD(-1),
+	mWakeFD(-1),
+	mArena( 4 * EPOLLREADER_READ_SIZE ),
+	mSize(0)
+{
+}
+
+EpollReader::~EpollReader()
+{
+	if ( mEpollFD != -1 )
+	{
+		close( mEpollFD );
+	}
+
+	if ( mWakeFD != -1 )
+	{
+		close( mWakeFD );
+	}
+}
+
+bool EpollReader::init( int fd )
+{
+	mFD			= fd;
+	mEpollFD	= epoll_create1( EPOLL_CLOEXEC );
+	mWakeFD		= eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+
+	if ( mEpollFD < 0 || mWakeFD < 0 )
+	{
+		efDEBUG( "Error: %s\n", strerror(errno) );
+		return false;
+	}
+
+	struct epoll_event ev;
+	memset( &ev, 0, sizeof(ev) );
+
+	ev.events	= EPOLLIN;
+	ev.data.u32	= EPOLLREADER_TAG_EVENTS;
+
+	if ( epoll_ctl( mEpollFD, EPOLL_CTL_ADD, mFD, &ev ) != 0 )
+	{
+		efDEBUG( "Error: %s\n", strerror(errno) );
+		return false;
+	}
+
+	ev.data.u32 = EPOLLREADER_TAG_WAKE;
+
+	if ( epoll_ctl( mEpollFD, EPOLL_CTL_ADD, mWakeFD, &ev ) != 0 )
+	{
+		efDEBUG( "Error: %s\n", strerror(errno) );
+		return false;
+	}
+
+	return true;
+}
+
+bool EpollReader::wait()
+{
+	struct epoll_event events[2];
+
+	for (;;)
+	{
+		int count = epoll_wait( mEpollFD, events, 2, -1 );
+
+		if ( count < 0 )
+		{
+			if ( EINTR == errno )
+			{
+				continue;
+			}
+
+			efDEBUG( "Error: %s\n", strerror(errno) );
+			return false;
+		}
+
+		bool readable = false;
+
+		for ( int i = 0; i < count; i++ )
+		{
+			if ( EPOLLREADER_TAG_WAKE == events[i].data.u32 )
+			{
+				return false;
+			}
+
+			readable = true;
+		}
+
+		if ( readable )
+		{
+			return true;
+		}
+	}
+}
+
+bool EpollReader::read()
+{
+	mSize = 0;
+
+	for (;;)
+	{
+		if ( mArena.size() - mSize < EPOLLREADER_READ_SIZE )
+		{
+			if ( mArena.size() >= EPOLLREADER_ARENA_MAX )
+			{
+				/// epoll is level triggered, the rest comes with the next wake up
+				break;
+			}
+
+			mArena.resize( mArena.size() * 2 );
+		}
+
+		ssize_t len = ::read( mFD, &mArena[mSize], mArena.size() - mSize );
+
+		if ( len > 0 )
+		{
+			mSize += len;
+		}
+		else if ( len < 0 && EINTR == errno )
+		{
+			continue;
+		}
+		else
+		{
+			/// EAGAIN once the queue is empty
+			break;
+		}
+	}
+
+	return mSize > 0;
+}
+
+void EpollReader::stop()
+{
+	uint64_t value = 1;
+
+	if ( mWakeFD != -1 && write( mWakeFD, &value, sizeof(value) ) != sizeof(value) )
+	{
+		efDEBUG( "Error: %s\n", strerror(errno) );
+	}
+}
+
+const char * EpollReader::data() const
+{
+	return &mArena[0];
+}
+
+std::size_t EpollReader::size() const
+{
+	return mSize;
+}
+
+}
+
+#endif
@@ -0,0 +1,63 @@
+﻿#ifndef EFSW_EPOLLREADER_HPP
+#define EFSW_EPOLLREADER_HPP
+
+#include <efsw/base.hpp>
+
+#if EFSW_PLATFORM == EFSW_PLATFORM_INOTIFY
+
+#include <vector>
+#include <cstddef>
+
+namespace efsw
+{
+
+/// Readiness driven reader of a non blocking event descriptor ( inotify or fanotify ).
+/// The descriptor is waited on with epoll together with an eventfd, so the reading thread
+/// can be woken up and stopped at any time.
+/// Every wake up drains all the pending events into an arena that is reused between reads,
+/// they are handled as one batch.
+/// @class EpollReader
+class EpollReader
+{
+	public:
+		EpollReader();
+
+		~EpollReader();
+
+		/// Registers the descriptor, it must be non blocking
+		/// @return false if epoll or eventfd are not available
+		bool init( int fd );
+
+		/// Blocks until there are events to read
+		/// @return false once stop() has been called
+		bool wait();
+
+		/// Reads all the pending events into the arena
+		/// @return false if there was nothing to read
+		bool read();
+
+		/// Wakes up the reading thread and makes wait() return false, callable from any thread
+		void stop();
+
+		/// Events read by the last read()
+		const char * data() const;
+
+		/// Size in bytes of the events read by the last read()
+		std::size_t size() const;
+	protected:
+		int mFD;
+
+		int mEpollFD;
+
+		int mWakeFD;
+
+		std::vector<char> mArena;
+
+		std::size_t mSize;
+};
+
+}
+
+#endif
+
+#endif
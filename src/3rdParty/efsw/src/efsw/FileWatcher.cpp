@@ -8,6 +8,7 @@
 #	define BACKEND_NAME "Win32"
 #elif EFSW_PLATFORM == EFSW_PLATFORM_INOTIFY
 #	include <efsw/FileWatcherInotify.hpp>
+#	include <efsw/FileWatcherFanotify.hpp>
 #	define FILEWATCHER_IMPL FileWatcherInotify
 #	define BACKEND_NAME "Inotify"
 #elif EFSW_PLATFORM == EFSW_PLATFORM_KQUEUE
@@ -27,13 +28,33 @@
 
 namespace efsw {
 
-FileWatcher::FileWatcher() :
-	mFollowSymlinks(false),
-	mOutOfScopeLinks(false)
+static FileWatcherImpl * createPlatformImpl( FileWatcher * parent )
 {
+#ifdef EFSW_FANOTIFY
+	/// fanotify needs Linux 5.9, otherwise keep the per directory inotify watches
+	FileWatcherImpl * impl = new FileWatcherFanotify( parent );
+
+	if ( impl->initOK() )
+	{
+		efDEBUG( "Using backend: Fanotify\n" );
+
+		return impl;
+	}
+
+	efSAFE_DELETE( impl );
+#endif
+
 	efDEBUG( "Using backend: %s\n", BACKEND_NAME );
 
-	mImpl = new FILEWATCHER_IMPL( this );
+	return new FILEWATCHER_IMPL( parent );
+}
+
+FileWatcher::FileWatcher() :
+	mFollowSymlinks(false),
+	mOutOfScopeLinks(false),
+	mPollBudget(100)
+{
+	mImpl = createPlatformImpl( this );
 
 	if ( !mImpl->initOK() )
 	{
@@ -47,7 +68,8 @@ FileWatcher::FileWatcher() :
 
 FileWatcher::FileWatcher( bool useGenericFileWatcher ) :
 	mFollowSymlinks(false),
-	mOutOfScopeLinks(false)
+	mOutOfScopeLinks(false),
+	mPollBudget(100)
 {
 	if ( useGenericFileWatcher )
 	{
@@ -57,9 +79,7 @@ FileWatcher::FileWatcher( bool useGenericFileWatcher ) :
 	}
 	else
 	{
-		efDEBUG( "Using backend: %s\n", BACKEND_NAME );
-
-		mImpl = new FILEWATCHER_IMPL( this );
+		mImpl = createPlatformImpl( this );
 
 		if ( !mImpl->initOK() )
 		{
@@ -127,4 +147,19 @@ const bool& FileWatcher::allowOutOfScopeLinks() const
 	return mOutOfScopeLinks;
 }
 
+void FileWatcher::pollBudget( const unsigned long& ms )
+{
+	mPollBudget = ms;
+}
+
+const unsigned long& FileWatcher::pollBudget() const
+{
+	return mPollBudget;
+}
+
+unsigned long FileWatcher::pollCost( WatchID watchid )
+{
+	return mImpl->pollCost( watchid );
+}
+
 }
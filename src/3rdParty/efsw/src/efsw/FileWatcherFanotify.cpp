@@ -0,0 +1,653 @@
+﻿#include <efsw/FileWatcherFanotify.hpp>
+
+#ifdef EFSW_FANOTIFY
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <efsw/FileWatcherInotify.hpp>
+#include <efsw/FileSystem.hpp>
+#include <efsw/System.hpp>
+#include <efsw/Debug.hpp>
+
+#define FANOTIFY_EVENTS (FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_CLOSE_WRITE | FAN_ONDIR)
+
+/// inotify descriptors count up from 1, fanotify watches are numbered far above them
+/// so the ids of the delegated watches can be handed out unchanged
+#define FANOTIFY_FIRST_WATCHID (1 << 30)
+
+#define FANOTIFY_DIRECTORY_CACHE_SIZE 16384
+
+namespace efsw
+{
+
+FileWatcherFanotify::FileWatcherFanotify( FileWatcher * parent ) :
+	FileWatcherImpl( parent ),
+	mFD(-1),
+	mThread(NULL),
+	mFallback(NULL),
+	mLastWatchID( FANOTIFY_FIRST_WATCHID - 1 ),
+	mMovedFrom(NULL)
+{
+	mFD = fanotify_init( FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK | FAN_REPORT_DFID_NAME, O_RDONLY | O_CLOEXEC | O_LARGEFILE );
+
+	if (mFD < 0)
+	{
+		efDEBUG( "Error: %s\n", strerror(errno) );
+	}
+	else
+	{
+		mInitOK = mReader.init( mFD );
+	}
+}
+
+FileWatcherFanotify::~FileWatcherFanotify()
+{
+	/// Wakes the reader up, it's joined before anything it uses goes away
+	mReader.stop();
+
+	efSAFE_DELETE( mThread );
+
+	WatchMap::iterator iter = mWatches.begin();
+	WatchMap::iterator end = mWatches.end();
+
+	for(; iter != end; ++iter)
+	{
+		efSAFE_DELETE( iter->second );
+	}
+
+	mWatches.clear();
+
+	for ( MarkMap::iterator it = mMarks.begin(); it != mMarks.end(); ++it )
+	{
+		close( it->second.MountFD );
+	}
+
+	mMarks.clear();
+
+	if ( mFD != -1 )
+	{
+		close(mFD);
+		mFD = -1;
+	}
+
+	efSAFE_DELETE( mFallback );
+}
+
+WatchID FileWatcherFanotify::addWatch( const std::string& directory, FileWatchListener* watcher, bool recursive )
+{
+	std::string dir( directory );
+
+	FileSystem::dirAddSlashAtEnd( dir );
+
+	FileInfo fi( dir );
+
+	if ( !fi.isDirectory() )
+	{
+		return Errors::Log::createLastError( Errors::FileNotFound, dir );
+	}
+	else if ( !fi.isReadable() )
+	{
+		return Errors::Log::createLastError( Errors::FileNotReadable, dir );
+	}
+	else if ( pathInWatches( dir ) )
+	{
+		return Errors::Log::createLastError( Errors::FileRepeated, directory );
+	}
+
+	/// Check if the directory is a symbolic link
+	std::string curPath;
+	std::string link( FileSystem::getLinkRealPath( dir, curPath ) );
+
+	if ( "" != link )
+	{
+		if ( pathInWatches( link ) )
+		{
+			return Errors::Log::createLastError( Errors::FileRepeated, directory );
+		}
+		else if ( !linkAllowed( curPath, link ) )
+		{
+			return Errors::Log::createLastError( Errors::FileOutOfScope, dir );
+		}
+		else
+		{
+			dir = link;
+		}
+	}
+
+	/// Symlinked subdirectories lead out of the marked tree, only per directory watches can follow them
+	if ( recursive && mFileWatcher->followSymlinks() )
+	{
+		return addFallbackWatch( directory, watcher, recursive );
+	}
+
+	char * real = realpath( dir.c_str(), NULL );
+
+	if ( NULL == real )
+	{
+		return Errors::Log::createLastError( Errors::Unspecified, std::string(strerror(errno)) );
+	}
+
+	std::string realDir( real );
+
+	free( real );
+
+	FileSystem::dirAddSlashAtEnd( realDir );
+
+	std::string fsid;
+
+	mWatchesLock.lock();
+
+	if ( !addMark( realDir, fsid ) )
+	{
+		mWatchesLock.unlock();
+
+		return addFallbackWatch( directory, watcher, recursive );
+	}
+
+	WatcherFanotify * pWatch	= new WatcherFanotify( ++mLastWatchID, dir, watcher, recursive );
+	pWatch->RealDirectory	= realDir;
+	pWatch->FsID			= fsid;
+
+	mWatches.insert(std::make_pair(pWatch->ID, pWatch));
+
+	mWatchesLock.unlock();
+
+	efDEBUG( "Added watch %s with id: %ld\n", dir.c_str(), pWatch->ID );
+
+	return pWatch->ID;
+}
+
+WatchID FileWatcherFanotify::addFallbackWatch( const std::string& directory, FileWatchListener* watcher, bool recursive )
+{
+	if ( NULL == mFallback )
+	{
+		mFallback = new FileWatcherInotify( mFileWatcher );
+	}
+
+	efDEBUG( "Watching %s through inotify\n", directory.c_str() );
+
+	WatchID wd = mFallback->addWatch( directory, watcher, recursive );
+
+	if ( wd > 0 && NULL != mThread )
+	{
+		mFallback->watch();
+	}
+
+	return wd;
+}
+
+bool FileWatcherFanotify::addMark( const std::string& dir, std::string& fsid )
+{
+	int fd = open( dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+
+	if ( fd < 0 )
+	{
+		return false;
+	}
+
+	struct statfs st;
+
+	if ( fstatfs( fd, &st ) != 0 )
+	{
+		close( fd );
+
+		return false;
+	}
+
+	fsid.assign( (const char*)&st.f_fsid, sizeof(st.f_fsid) );
+
+	MarkMap::iterator it = mMarks.find( fsid );
+
+	if ( it != mMarks.end() )
+	{
+		close( fd );
+
+		it->second.Refs++;
+
+		return true;
+	}
+
+	/// Fails without CAP_SYS_ADMIN, on filesystems that can't encode file handles
+	/// and on subvolumes whose fsid differs from their superblock
+	if ( fanotify_mark( mFD, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, FANOTIFY_EVENTS, fd, NULL ) != 0 )
+	{
+		efDEBUG( "Can't mark the filesystem of %s: %s\n", dir.c_str(), strerror(errno) );
+
+		close( fd );
+
+		return false;
+	}
+
+	Mark mark;
+	mark.MountFD	= fd;
+	mark.Refs		= 1;
+
+	mMarks[ fsid ] = mark;
+
+	efDEBUG( "Marked the filesystem of %s\n", dir.c_str() );
+
+	return true;
+}
+
+void FileWatcherFanotify::releaseMark( const std::string& fsid )
+{
+	MarkMap::iterator it = mMarks.find( fsid );
+
+	if ( it == mMarks.end() || --it->second.Refs > 0 )
+	{
+		return;
+	}
+
+	if ( fanotify_mark( mFD, FAN_MARK_REMOVE | FAN_MARK_FILESYSTEM, FANOTIFY_EVENTS, it->second.MountFD, NULL ) != 0 )
+	{
+		efDEBUG( "Error removing filesystem mark: %s\n", strerror(errno) );
+	}
+
+	close( it->second.MountFD );
+
+	mMarks.erase( it );
+
+	mDirectories.clear();
+}
+
+void FileWatcherFanotify::removeWatchLocked( WatchID watchid )
+{
+	WatchMap::iterator iter = mWatches.find( watchid );
+
+	if ( iter == mWatches.end() )
+	{
+		return;
+	}
+
+	WatcherFanotify * watch = iter->second;
+
+	mWatches.erase( iter );
+
+	releaseMark( watch->FsID );
+
+	efDEBUG( "Removed watch %s with id: %ld\n", watch->Directory.c_str(), watchid );
+
+	efSAFE_DELETE( watch );
+}
+
+void FileWatcherFanotify::removeWatch( const std::string& directory )
+{
+	bool found = false;
+
+	mWatchesLock.lock();
+
+	for ( WatchMap::iterator iter = mWatches.begin(); iter != mWatches.end(); ++iter )
+	{
+		if ( directory == iter->second->Directory )
+		{
+			removeWatchLocked( iter->first );
+
+			found = true;
+
+			break;
+		}
+	}
+
+	mWatchesLock.unlock();
+
+	if ( !found && NULL != mFallback )
+	{
+		mFallback->removeWatch( directory );
+	}
+}
+
+void FileWatcherFanotify::removeWatch( WatchID watchid )
+{
+	if ( watchid < FANOTIFY_FIRST_WATCHID )
+	{
+		if ( NULL != mFallback )
+		{
+			mFallback->removeWatch( watchid );
+		}
+
+		return;
+	}
+
+	mWatchesLock.lock();
+
+	removeWatchLocked( watchid );
+
+	mWatchesLock.unlock();
+}
+
+void FileWatcherFanotify::watch()
+{
+	if ( NULL == mThread )
+	{
+		mThread = new Thread( &FileWatcherFanotify::run, this );
+		mThread->launch();
+	}
+
+	if ( NULL != mFallback )
+	{
+		mFallback->watch();
+	}
+}
+
+void FileWatcherFanotify::run()
+{
+	while ( mReader.wait() )
+	{
+		/// Everything pending is handled as one batch, under one lock
+		if ( mReader.read() )
+		{
+			size_t len = mReader.size();
+			const struct fanotify_event_metadata * event = (const struct fanotify_event_metadata *)mReader.data();
+
+			mWatchesLock.lock();
+
+			for ( ; FAN_EVENT_OK( event, len ); event = FAN_EVENT_NEXT( event, len ) )
+			{
+				if ( event->vers == FANOTIFY_METADATA_VERSION )
+				{
+					handleEvent( event );
+				}
+			}
+
+			/// A moved from event without its moved to counterpart means that the file was moved outside of the watches
+			flushMovedFrom();
+
+			mWatchesLock.unlock();
+		}
+	}
+}
+
+void FileWatcherFanotify::handleEvent( const struct fanotify_event_metadata * event )
+{
+	if ( event->mask & FAN_Q_OVERFLOW )
+	{
+		efDEBUG( "fanotify event queue overflow\n" );
+
+		/// Pending moves may have lost their counterpart
+		flushMovedFrom();
+
+		for ( WatchMap::iterator it = mWatches.begin(); it != mWatches.end(); ++it )
+		{
+			if ( it->second->Listener )
+			{
+				it->second->Listener->handleMissedFileActions( it->second->ID, it->second->Directory );
+			}
+		}
+
+		return;
+	}
+
+	const struct fanotify_event_info_fid * info = NULL;
+	const char * cur = (const char *)event + event->metadata_len;
+	const char * end = (const char *)event + event->event_len;
+
+	while ( cur + sizeof(struct fanotify_event_info_header) <= end )
+	{
+		const struct fanotify_event_info_header * header = (const struct fanotify_event_info_header *)cur;
+
+		if ( header->info_type == FAN_EVENT_INFO_TYPE_DFID_NAME )
+		{
+			info = (const struct fanotify_event_info_fid *)cur;
+			break;
+		}
+
+		if ( 0 == header->len )
+		{
+			break;
+		}
+
+		cur += header->len;
+	}
+
+	if ( NULL == info )
+	{
+		return;
+	}
+
+	/// The entry name follows the directory file handle
+	const struct file_handle * handle = (const struct file_handle *)info->handle;
+	std::string name( (const char *)handle->f_handle + handle->handle_bytes );
+	std::string dir;
+
+	if ( "." == name || !resolveDirectory( info, dir ) )
+	{
+		return;
+	}
+
+	WatcherFanotify * watch = NULL;
+	std::string relative;
+
+	for ( WatchMap::iterator it = mWatches.begin(); it != mWatches.end(); ++it )
+	{
+		if ( it->second->contains( dir, relative ) )
+		{
+			watch = it->second;
+			break;
+		}
+	}
+
+	if ( NULL != watch )
+	{
+		std::string filename( relative + name );
+
+		if ( event->mask & FAN_CREATE )
+		{
+			handleAction( watch, filename, FAN_CREATE );
+		}
+
+		if ( event->mask & FAN_MOVED_TO )
+		{
+			/// Moves inside the same directory are reported as such, like in the inotify backend
+			/// moves between directories are reported as a delete and an add
+			if ( mMovedFrom == watch &&
+				 watch->OldFileName.substr( 0, watch->OldFileName.find_last_of( '/' ) + 1 ) == relative )
+			{
+				handleAction( watch, filename, FAN_MOVED_TO, watch->OldFileName );
+
+				watch->OldFileName = "";
+				mMovedFrom = NULL;
+			}
+			else
+			{
+				flushMovedFrom();
+
+				handleAction( watch, filename, FAN_MOVED_TO );
+			}
+		}
+
+		if ( event->mask & FAN_CLOSE_WRITE )
+		{
+			handleAction( watch, filename, FAN_CLOSE_WRITE );
+		}
+
+		if ( event->mask & FAN_MOVED_FROM )
+		{
+			flushMovedFrom();
+
+			watch->OldFileName = filename;
+			mMovedFrom = watch;
+		}
+
+		if ( event->mask & FAN_DELETE )
+		{
+			handleAction( watch, filename, FAN_DELETE );
+		}
+	}
+	else if ( event->mask & FAN_MOVED_TO )
+	{
+		/// Moved outside of the watches
+		flushMovedFrom();
+	}
+
+	/// Paths cached below a moved or deleted directory are stale
+	if ( ( event->mask & FAN_ONDIR ) && ( event->mask & ( FAN_MOVE | FAN_DELETE ) ) )
+	{
+		mDirectories.clear();
+	}
+}
+
+void FileWatcherFanotify::flushMovedFrom()
+{
+	if ( NULL != mMovedFrom )
+	{
+		handleAction( mMovedFrom, mMovedFrom->OldFileName, FAN_DELETE );
+
+		mMovedFrom->OldFileName = "";
+		mMovedFrom = NULL;
+	}
+}
+
+bool FileWatcherFanotify::resolveDirectory( const struct fanotify_event_info_fid * info, std::string& path )
+{
+	std::string fsid( (const char *)&info->fsid, sizeof(info->fsid) );
+
+	MarkMap::iterator mark = mMarks.find( fsid );
+
+	if ( mark == mMarks.end() )
+	{
+		return false;
+	}
+
+	struct file_handle * handle = (struct file_handle *)info->handle;
+
+	std::string key( fsid );
+	key.append( (const char *)&handle->handle_type, sizeof(handle->handle_type) );
+	key.append( (const char *)handle->f_handle, handle->handle_bytes );
+
+	DirectoryCache::iterator it = mDirectories.find( key );
+
+	if ( it != mDirectories.end() )
+	{
+		path = it->second;
+
+		return !path.empty();
+	}
+
+	path = "";
+
+	int fd = open_by_handle_at( mark->second.MountFD, handle, O_PATH | O_CLOEXEC );
+
+	if ( fd < 0 )
+	{
+		/// Stale handles belong to directories already removed, anything else may be transient
+		if ( ESTALE != errno )
+		{
+			efDEBUG( "Error opening directory handle: %s\n", strerror(errno) );
+
+			return false;
+		}
+	}
+	else
+	{
+		char fdPath[64];
+		char buff[PATH_MAX];
+		struct stat st;
+
+		snprintf( fdPath, sizeof(fdPath), "/proc/self/fd/%d", fd );
+
+		ssize_t len = readlink( fdPath, buff, sizeof(buff) - 1 );
+
+		/// Removed directories still resolve, to a path suffixed with " (deleted)"
+		if ( len > 0 && '/' == buff[0] && fstat( fd, &st ) == 0 && st.st_nlink > 0 )
+		{
+			path.assign( buff, len );
+
+			FileSystem::dirAddSlashAtEnd( path );
+		}
+
+		close( fd );
+	}
+
+	if ( mDirectories.size() >= FANOTIFY_DIRECTORY_CACHE_SIZE )
+	{
+		mDirectories.clear();
+	}
+
+	mDirectories[ key ] = path;
+
+	return !path.empty();
+}
+
+void FileWatcherFanotify::handleAction( Watcher* watch, const std::string& filename, unsigned long action, std::string oldFilename )
+{
+	if ( !watch || !watch->Listener )
+	{
+		return;
+	}
+
+	/// Split the path relative to the watch into the directory reported and the file name ( npos + 1 wraps to 0 )
+	std::string::size_type pos = filename.find_last_of( '/' ) + 1;
+	std::string dir( watch->Directory + filename.substr( 0, pos ) );
+	std::string name( filename.substr( pos ) );
+
+	if( FAN_CLOSE_WRITE & action )
+	{
+		watch->Listener->handleFileAction( watch->ID, dir, name, Actions::Modified );
+	}
+	else if( FAN_MOVED_TO & action )
+	{
+		if ( oldFilename.empty() )
+		{
+			watch->Listener->handleFileAction( watch->ID, dir, name, Actions::Add );
+		}
+		else
+		{
+			watch->Listener->handleFileAction( watch->ID, dir, name, Actions::Moved, oldFilename.substr( oldFilename.find_last_of( '/' ) + 1 ) );
+		}
+	}
+	else if( FAN_CREATE & action )
+	{
+		watch->Listener->handleFileAction( watch->ID, dir, name, Actions::Add );
+	}
+	else if( FAN_DELETE & action )
+	{
+		watch->Listener->handleFileAction( watch->ID, dir, name, Actions::Delete );
+	}
+}
+
+std::list<std::string> FileWatcherFanotify::directories()
+{
+	std::list<std::string> dirs;
+
+	mWatchesLock.lock();
+
+	for ( WatchMap::iterator it = mWatches.begin(); it != mWatches.end(); it++ )
+	{
+		dirs.push_back( it->second->Directory );
+	}
+
+	mWatchesLock.unlock();
+
+	if ( NULL != mFallback )
+	{
+		std::list<std::string> fallbackDirs( mFallback->directories() );
+
+		dirs.splice( dirs.end(), fallbackDirs );
+	}
+
+	return dirs;
+}
+
+bool FileWatcherFanotify::pathInWatches( const std::string& path )
+{
+	for ( WatchMap::iterator it = mWatches.begin(); it != mWatches.end(); it++ )
+	{
+		if ( it->second->Directory == path )
+		{
+			return true;
+		}
+	}
+
+	return NULL != mFallback && mFallback->pathInWatches( path );
+}
+
+}
+
+#endif
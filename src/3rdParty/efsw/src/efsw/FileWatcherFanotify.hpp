@@ -0,0 +1,127 @@
+﻿#ifndef EFSW_FILEWATCHERFANOTIFY_HPP
+#define EFSW_FILEWATCHERFANOTIFY_HPP
+
+#include <efsw/FileWatcherImpl.hpp>
+
+#if EFSW_PLATFORM == EFSW_PLATFORM_INOTIFY
+
+#include <sys/fanotify.h>
+
+/// Directory file handles with names are reported since Linux 5.9 and filesystem marks since 4.20,
+/// building against older kernel headers leaves only the inotify backend.
+#if defined( FAN_REPORT_DFID_NAME ) && defined( FAN_MARK_FILESYSTEM )
+#define EFSW_FANOTIFY
+#endif
+
+#endif
+
+#ifdef EFSW_FANOTIFY
+
+#include <efsw/WatcherFanotify.hpp>
+#include <efsw/EpollReader.hpp>
+#include <map>
+
+namespace efsw
+{
+
+/// Implementation for Linux based on fanotify.
+/// A single filesystem mark covers every directory of the watched tree, so adding a recursive watch
+/// costs the same for any tree size and new subdirectories never need to be registered.
+/// Events carry the file handle of the parent directory and the entry name, the handle is resolved
+/// to a path and matched against the watched roots.
+/// Roots that can't be marked ( missing privileges, filesystems without file handle support, btrfs subvolumes )
+/// are delegated to an inotify watcher, whose WatchIDs are returned unchanged.
+/// @class FileWatcherFanotify
+class FileWatcherFanotify : public FileWatcherImpl
+{
+	public:
+		/// type for a map from WatchID to WatchStruct pointer
+		typedef std::map<WatchID, WatcherFanotify*> WatchMap;
+
+		FileWatcherFanotify( FileWatcher * parent );
+
+		virtual ~FileWatcherFanotify();
+
+		/// Add a directory watch
+		/// On error returns WatchID with Error type.
+		WatchID addWatch(const std::string& directory, FileWatchListener* watcher, bool recursive);
+
+		/// Remove a directory watch. This is a brute force lazy search O(nlogn).
+		void removeWatch(const std::string& directory);
+
+		/// Remove a directory watch. This is a map lookup O(logn).
+		void removeWatch(WatchID watchid);
+
+		/// Updates the watcher. Must be called often.
+		void watch();
+
+		/// Handles the action, filename is relative to the watched directory
+		void handleAction(Watcher * watch, const std::string& filename, unsigned long action, std::string oldFilename = "");
+
+		/// @return Returns a list of the directories that are being watched
+		std::list<std::string> directories();
+	protected:
+		/// One filesystem mark, shared by all the watches on that filesystem
+		struct Mark
+		{
+			/// Descriptor of the first watched directory, used to mark the filesystem and to open file handles
+			int MountFD;
+
+			/// Number of watches using the mark
+			int Refs;
+		};
+
+		typedef std::map<std::string, Mark> MarkMap;
+
+		/// Map of directory file handles to their canonical path ( empty if it can't be resolved )
+		typedef std::map<std::string, std::string> DirectoryCache;
+
+		/// Map of WatchID to WatchStruct pointers
+		WatchMap mWatches;
+
+		/// Filesystem marks by filesystem id
+		MarkMap mMarks;
+
+		DirectoryCache mDirectories;
+
+		/// fanotify file descriptor
+		int mFD;
+
+		Thread * mThread;
+
+		EpollReader mReader;
+
+		Mutex mWatchesLock;
+
+		/// Watcher for the roots that can't be marked
+		FileWatcherImpl * mFallback;
+
+		WatchID mLastWatchID;
+
+		/// Watch with a pending moved from event waiting for its moved to counterpart
+		WatcherFanotify * mMovedFrom;
+
+		bool pathInWatches( const std::string& path );
+	private:
+		void run();
+
+		void removeWatchLocked( WatchID watchid );
+
+		WatchID addFallbackWatch( const std::string& directory, FileWatchListener* watcher, bool recursive );
+
+		bool addMark( const std::string& dir, std::string& fsid );
+
+		void releaseMark( const std::string& fsid );
+
+		bool resolveDirectory( const struct fanotify_event_info_fid * info, std::string& path );
+
+		void handleEvent( const struct fanotify_event_metadata * event );
+
+		void flushMovedFrom();
+};
+
+}
+
+#endif
+
+#endif
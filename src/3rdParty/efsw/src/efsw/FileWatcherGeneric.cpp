@@ -1,6 +1,7 @@
 ﻿#include <efsw/FileWatcherGeneric.hpp>
 #include <efsw/FileSystem.hpp>
 #include <efsw/System.hpp>
+#include <algorithm>
 
 namespace efsw
 {
@@ -138,20 +139,55 @@ void FileWatcherGeneric::watch()
 
 void FileWatcherGeneric::run()
 {
+	PollList due;
+
 	do
 	{
 		mWatchesLock.lock();
 
-		WatchList::iterator it = mWatches.begin();
+		Uint64 now = System::getTicks();
+		Uint64 budget = static_cast<Uint64>( mFileWatcher->pollBudget() ) * 1000;
+		WatchList::iterator it;
+
+		due.clear();
 
-		for ( ; it != mWatches.end(); it++ )
+		for ( it = mWatches.begin(); it != mWatches.end(); it++ )
 		{
-			(*it)->watch();
+			(*it)->schedule( now, due );
+		}
+
+		PollCycle cycle( now, 0 );
+
+		/// Poll the longest waiting directories whose measured cost fits in the budget
+		if ( 0 != budget )
+		{
+			std::sort( due.begin(), due.end() );
+
+			Uint64 cost = 0;
+
+			for ( std::size_t i = 0; i < due.size(); i++ )
+			{
+				cost += due[i].second;
+
+				if ( cost > budget )
+				{
+					cycle.Cutoff = due[ i > 0 ? i - 1 : 0 ].first;
+					break;
+				}
+			}
+
+			/// The costs are estimates, stop anyway once the budget is spent
+			cycle.Deadline = System::getTicks() + budget;
+		}
+
+		for ( it = mWatches.begin(); it != mWatches.end(); it++ )
+		{
+			(*it)->poll( cycle );
 		}
 
 		mWatchesLock.unlock();
 
-		if ( mInitOK ) System::sleep( 1000 );
+		if ( mInitOK ) System::sleep( GENERIC_POLL_INTERVAL );
 	} while ( mInitOK );
 }
 
@@ -178,6 +214,28 @@ std::list<std::string> FileWatcherGeneric::directories()
 	return dirs;
 }
 
+unsigned long FileWatcherGeneric::pollCost( WatchID watchid )
+{
+	Uint64 cost = 0;
+
+	mWatchesLock.lock();
+
+	WatchList::iterator it = mWatches.begin();
+
+	for ( ; it != mWatches.end(); it++ )
+	{
+		if ( (*it)->ID == watchid )
+		{
+			cost = (*it)->pollCost();
+			break;
+		}
+	}
+
+	mWatchesLock.unlock();
+
+	return static_cast<unsigned long>( cost );
+}
+
 bool FileWatcherGeneric::pathInWatches( const std::string& path )
 {
 	WatchList::iterator it = mWatches.begin();
@@ -38,6 +38,9 @@ class FileWatcherGeneric : public FileWatcherImpl
 
 		/// @return Returns a list of the directories that are being watched
 		std::list<std::string> directories();
+
+		/// @return The measured time a poll of the watch takes, in microseconds
+		unsigned long pollCost( WatchID watchid );
 	protected:
 		Thread * mThread;
 
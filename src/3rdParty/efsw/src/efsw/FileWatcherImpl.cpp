@@ -20,6 +20,11 @@ bool FileWatcherImpl::initOK()
 	return mInitOK;
 }
 
+unsigned long FileWatcherImpl::pollCost( WatchID )
+{
+	return 0;
+}
+
 bool FileWatcherImpl::linkAllowed( const std::string& curPath, const std::string& link )
 {
 	return ( mFileWatcher->followSymlinks() && mFileWatcher->allowOutOfScopeLinks() ) || -1 != String::strStartsWith( curPath, link );
@@ -44,6 +44,9 @@ class FileWatcherImpl
 		/// Search if a directory already exists in the watches
 		virtual bool pathInWatches( const std::string& path ) = 0;
 
+		/// @return The measured time a poll of the watch takes, in microseconds, 0 if it isn't polled
+		virtual unsigned long pollCost( WatchID watchid );
+
 		FileWatcher *	mFileWatcher;
 		bool			mInitOK;
 };
@@ -13,8 +13,6 @@
 #include <efsw/System.hpp>
 #include <efsw/Debug.hpp>
 
-#define BUFF_SIZE ((sizeof(struct inotify_event)+FILENAME_MAX)*1024)
-
 namespace efsw
 {
 
@@ -23,7 +21,7 @@ FileWatcherInotify::FileWatcherInotify( FileWatcher * parent ) :
 	mFD(-1),
 	mThread(NULL)
 {
-	mFD = inotify_init();
+	mFD = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
 
 	if (mFD < 0)
 	{
@@ -31,12 +29,17 @@ FileWatcherInotify::FileWatcherInotify( FileWatcher * parent ) :
 	}
 	else
 	{
-		mInitOK = true;
+		mInitOK = mReader.init( mFD );
 	}
 }
 
 FileWatcherInotify::~FileWatcherInotify()
 {
+	/// Wakes the reader up, it's joined before anything it uses goes away
+	mReader.stop();
+
+	efSAFE_DELETE( mThread );
+
 	WatchMap::iterator iter = mWatches.begin();
 	WatchMap::iterator end = mWatches.end();
 
@@ -52,13 +55,6 @@ FileWatcherInotify::~FileWatcherInotify()
 		close(mFD);
 		mFD = -1;
 	}
-
-	if ( mThread )
-	{
-		mThread->terminate();
-	}
-
-	efSAFE_DELETE( mThread );
 }
 
 WatchID FileWatcherInotify::addWatch( const std::string& directory, FileWatchListener* watcher, bool recursive )
@@ -311,39 +307,44 @@ void FileWatcherInotify::watch()
 
 void FileWatcherInotify::run()
 {
-	static char buff[BUFF_SIZE] = {0};
 	WatchMap::iterator wit;
 	std::list<WatcherInotify*> movedOutsideWatches;
 
-	do
+	while ( mReader.wait() )
 	{
-		ssize_t len, i = 0;
+		/// Everything pending is handled as one batch, under one lock
+		if ( mReader.read() )
+		{
+			const char * buff = mReader.data();
+			size_t len = mReader.size();
+			size_t i = 0;
 
-		len = read (mFD, buff, BUFF_SIZE);
+			mWatchesLock.lock();
 
-		if (len != -1)
-		{
 			while (i < len)
 			{
-				struct inotify_event *pevent = (struct inotify_event *)&buff[i];
+				const struct inotify_event *pevent = (const struct inotify_event *)&buff[i];
 
-				mWatchesLock.lock();
-
-				wit = mWatches.find( pevent->wd );
-
-				if ( wit != mWatches.end() )
+				if ( pevent->mask & IN_Q_OVERFLOW )
 				{
-					handleAction(wit->second, pevent->name, pevent->mask);
+					handleOverflow();
+				}
+				else
+				{
+					wit = mWatches.find( pevent->wd );
 
-					/// Keep track of the IN_MOVED_FROM events to known if the IN_MOVED_TO event is also fired
-					if ( !wit->second->OldFileName.empty() )
+					if ( wit != mWatches.end() )
 					{
-						movedOutsideWatches.push_back( wit->second );
+						handleAction(wit->second, pevent->name, pevent->mask);
+
+						/// Keep track of the IN_MOVED_FROM events to known if the IN_MOVED_TO event is also fired
+						if ( !wit->second->OldFileName.empty() )
+						{
+							movedOutsideWatches.push_back( wit->second );
+						}
 					}
 				}
 
-				mWatchesLock.unlock();
-
 				i += sizeof(struct inotify_event) + pevent->len;
 			}
 
@@ -364,8 +365,24 @@ void FileWatcherInotify::run()
 
 				movedOutsideWatches.clear();
 			}
+
+			mWatchesLock.unlock();
 		}
-	} while( mFD > 0 );
+	}
+}
+
+void FileWatcherInotify::handleOverflow()
+{
+	efDEBUG( "inotify event queue overflow\n" );
+
+	/// The events lost can't be attributed to a directory
+	for ( WatchMap::iterator it = mRealWatches.begin(); it != mRealWatches.end(); it++ )
+	{
+		if ( it->second->Listener )
+		{
+			it->second->Listener->handleMissedFileActions( it->second->ID, it->second->Directory );
+		}
+	}
 }
 
 void FileWatcherInotify::checkForNewWatcher( Watcher* watch, std::string fpath )
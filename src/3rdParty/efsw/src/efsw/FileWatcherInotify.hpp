@@ -6,6 +6,7 @@
 #if EFSW_PLATFORM == EFSW_PLATFORM_INOTIFY
 
 #include <efsw/WatcherInotify.hpp>
+#include <efsw/EpollReader.hpp>
 #include <map>
 
 namespace efsw
@@ -53,6 +54,8 @@ class FileWatcherInotify : public FileWatcherImpl
 
 		Thread * mThread;
 
+		EpollReader mReader;
+
 		Mutex mWatchesLock;
 
 		WatchID addWatch(const std::string& directory, FileWatchListener* watcher, bool recursive, WatcherInotify * parent = NULL );
@@ -64,6 +67,9 @@ class FileWatcherInotify : public FileWatcherImpl
 		void removeWatchLocked(WatchID watchid);
 
 		void checkForNewWatcher( Watcher* watch, std::string fpath );
+
+		/// Tells the listeners of every watch that events were lost
+		void handleOverflow();
 };
 
 }
@@ -23,4 +23,9 @@ Uint64 System::getMaxFD()
 	return Platform::System::getMaxFD();
 }
 
+Uint64 System::getTicks()
+{
+	return Platform::System::getTicks();
+}
+
 } 
@@ -19,6 +19,9 @@ class System
 
 		/// @return The number of supported file descriptors for the process
 		static Uint64 getMaxFD();
+
+		/// @return Monotonic time in microseconds, to measure durations
+		static Uint64 getTicks();
 };
 	
 }
@@ -0,0 +1,40 @@
+﻿#include <efsw/WatcherFanotify.hpp>
+
+namespace efsw {
+
+WatcherFanotify::WatcherFanotify() :
+	Watcher()
+{
+}
+
+WatcherFanotify::WatcherFanotify( WatchID id, std::string directory, FileWatchListener * listener, bool recursive ) :
+	Watcher( id, directory, listener, recursive )
+{
+}
+
+bool WatcherFanotify::contains( const std::string& realDirectory, std::string& relative ) const
+{
+	if ( realDirectory.size() < RealDirectory.size() ||
+		 realDirectory.compare( 0, RealDirectory.size(), RealDirectory ) != 0 )
+	{
+		return false;
+	}
+
+	if ( realDirectory.size() == RealDirectory.size() )
+	{
+		relative.clear();
+
+		return true;
+	}
+
+	if ( !Recursive )
+	{
+		return false;
+	}
+
+	relative = realDirectory.substr( RealDirectory.size() );
+
+	return true;
+}
+
+}
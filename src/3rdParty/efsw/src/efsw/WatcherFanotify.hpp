@@ -0,0 +1,28 @@
+﻿#ifndef EFSW_WATCHERFANOTIFY_HPP
+#define EFSW_WATCHERFANOTIFY_HPP
+
+#include <efsw/FileWatcherImpl.hpp>
+
+namespace efsw {
+
+class WatcherFanotify : public Watcher
+{
+	public:
+		WatcherFanotify();
+
+		WatcherFanotify( WatchID id, std::string directory, FileWatchListener * listener, bool recursive );
+
+		/// @return true if events reported for the canonical directory path belong to this watch.
+		/// relative receives the path of the directory relative to the watch root ( with slash at end ).
+		bool contains( const std::string& realDirectory, std::string& relative ) const;
+
+		/// Canonical path of the watched directory, as the kernel resolves file handles
+		std::string RealDirectory;
+
+		/// Key of the filesystem mark the watch depends on
+		std::string FsID;
+};
+
+}
+
+#endif
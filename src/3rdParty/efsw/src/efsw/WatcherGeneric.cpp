@@ -1,10 +1,22 @@
 ﻿#include <efsw/WatcherGeneric.hpp>
 #include <efsw/FileSystem.hpp>
 #include <efsw/DirWatcherGeneric.hpp>
+#include <efsw/System.hpp>
 
 namespace efsw
 {
 
+PollCycle::PollCycle( const Uint64& cutoff, const Uint64& deadline ) :
+	Cutoff( cutoff ),
+	Deadline( deadline )
+{
+}
+
+bool PollCycle::exhausted()
+{
+	return 0 != Deadline && System::getTicks() > Deadline;
+}
+
 WatcherGeneric::WatcherGeneric( WatchID id, const std::string& directory, FileWatchListener * fwl, FileWatcherImpl * fw, bool recursive ) :
 	Watcher( id, directory, fwl, recursive ),
 	WatcherImpl( fw ),
@@ -27,6 +39,21 @@ void WatcherGeneric::watch()
 	DirWatch->watch();
 }
 
+void WatcherGeneric::poll( PollCycle& cycle )
+{
+	DirWatch->poll( cycle );
+}
+
+void WatcherGeneric::schedule( const Uint64& now, PollList& due )
+{
+	DirWatch->schedule( now, due );
+}
+
+Uint64 WatcherGeneric::pollCost() const
+{
+	return DirWatch->pollCost();
+}
+
 void WatcherGeneric::watchDir( std::string dir )
 {
 	DirWatch->watchDir( dir );
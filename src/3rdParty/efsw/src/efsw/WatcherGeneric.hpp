@@ -2,10 +2,35 @@
 #define EFSW_WATCHERGENERIC_HPP
 
 #include <efsw/FileWatcherImpl.hpp>
+#include <vector>
 
 namespace efsw
 {
 
+/// Time between poll cycles, and the interval of a directory that changed, in milliseconds
+#define GENERIC_POLL_INTERVAL 1000
+
+/// Longest interval of a directory that doesn't change, in milliseconds
+#define GENERIC_POLL_MAX_INTERVAL 32000
+
+/// Directories polled in a poll cycle
+class PollCycle
+{
+	public:
+		/// Directories due at this time or before are polled
+		Uint64	Cutoff;
+
+		/// Polling stops after this time, 0 for no limit
+		Uint64	Deadline;
+
+		PollCycle( const Uint64& cutoff, const Uint64& deadline );
+
+		bool exhausted();
+};
+
+/// Due time and measured cost of a directory, in microseconds
+typedef std::vector< std::pair<Uint64, Uint64> > PollList;
+
 class DirWatcherGeneric;
 
 class WatcherGeneric : public Watcher
@@ -20,6 +45,13 @@ class WatcherGeneric : public Watcher
 
 		void watch();
 
+		void poll( PollCycle& cycle );
+
+		void schedule( const Uint64& now, PollList& due );
+
+		/// Measured time a poll of the whole tree takes, in microseconds
+		Uint64 pollCost() const;
+
 		void watchDir( std::string dir );
 
 		bool pathInWatches( std::string path );
@@ -4,6 +4,7 @@
 
 #include <pthread.h>
 #include <sys/time.h>
+#include <time.h>
 #include <limits.h>
 #include <sys/resource.h>
 
@@ -174,6 +175,21 @@ Uint64 System::getMaxFD()
 	return max_fd;
 }
 
+Uint64 System::getTicks()
+{
+#if defined( CLOCK_MONOTONIC )
+	timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return static_cast<Uint64>( ts.tv_sec ) * 1000000 + ts.tv_nsec / 1000;
+#else
+	timeval tv;
+	gettimeofday( &tv, NULL );
+
+	return static_cast<Uint64>( tv.tv_sec ) * 1000000 + tv.tv_usec;
+#endif
+}
+
 }}
 
 #endif
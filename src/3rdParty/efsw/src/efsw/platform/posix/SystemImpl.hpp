@@ -17,6 +17,8 @@ class System
 		static void maxFD();
 
 		static Uint64 getMaxFD();
+
+		static Uint64 getTicks();
 };
 
 }}
@@ -45,6 +45,22 @@ Uint64 System::getMaxFD()
 	return 60;
 }
 
+Uint64 System::getTicks()
+{
+	static LARGE_INTEGER frequency = { 0 };
+	LARGE_INTEGER counter;
+
+	if ( 0 == frequency.QuadPart )
+	{
+		QueryPerformanceFrequency( &frequency );
+	}
+
+	QueryPerformanceCounter( &counter );
+
+	return static_cast<Uint64>( counter.QuadPart / frequency.QuadPart ) * 1000000 +
+			static_cast<Uint64>( counter.QuadPart % frequency.QuadPart ) * 1000000 / frequency.QuadPart;
+}
+
 }}
 
 #endif
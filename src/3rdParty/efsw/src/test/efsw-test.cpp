@@ -1,8 +1,21 @@
 ﻿#include <efsw/efsw.hpp>
 #include <efsw/System.hpp>
 #include <efsw/FileSystem.hpp>
+#include <efsw/Mutex.hpp>
+#include <efsw/FileWatcherInotify.hpp>
+#include <efsw/FileWatcherFanotify.hpp>
 #include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
 #include <iostream>
+#include <sstream>
+#include <vector>
+
+#if EFSW_PLATFORM == EFSW_PLATFORM_INOTIFY
+#include <errno.h>
+#include <sys/stat.h>
+#endif
 
 bool STOP = false;
 
@@ -36,6 +49,335 @@ class UpdateListener : public efsw::FileWatchListener
 		}
 };
 
+/// Counts the events received by the stress test
+class StressListener : public efsw::FileWatchListener
+{
+	public:
+		StressListener() : mEvents(0), mOverflows(0) {}
+
+		void handleFileAction( efsw::WatchID watchid, const std::string& dir, const std::string& filename, efsw::Action action, std::string oldFilename = ""  )
+		{
+			mLock.lock();
+			mEvents++;
+			mLast = std::chrono::steady_clock::now();
+			mLock.unlock();
+		}
+
+		void handleMissedFileActions( efsw::WatchID watchid, const std::string& dir )
+		{
+			mLock.lock();
+			mOverflows++;
+			mLock.unlock();
+		}
+
+		long events( std::chrono::steady_clock::time_point * last = NULL )
+		{
+			mLock.lock();
+			long events = mEvents;
+			if ( last ) *last = mLast;
+			mLock.unlock();
+			return events;
+		}
+
+		long overflows()
+		{
+			mLock.lock();
+			long overflows = mOverflows;
+			mLock.unlock();
+			return overflows;
+		}
+	protected:
+		efsw::Mutex mLock;
+		long mEvents;
+		long mOverflows;
+		std::chrono::steady_clock::time_point mLast;
+};
+
+/// Creates, writes, renames and deletes files in the directory, one event is expected per operation.
+/// Reports the events per second delivered and the events lost.
+int stressTest( std::string path, long operations, bool useGeneric )
+{
+	if ( !efsw::FileSystem::isDirectory( path ) )
+	{
+		std::cout << "Not a directory: " << path.c_str() << std::endl;
+		return 1;
+	}
+
+	efsw::FileSystem::dirAddSlashAtEnd( path );
+
+	StressListener listener;
+	efsw::FileWatcher fileWatcher( useGeneric );
+
+	if ( fileWatcher.addWatch( path, &listener, true ) < 0 )
+	{
+		std::cout << efsw::Errors::Log::getLastErrorLog().c_str() << std::endl;
+		return 1;
+	}
+
+	fileWatcher.watch();
+
+	efsw::System::sleep( 100 );
+
+	/// Create + close after write, rename, delete
+	const long cycles = operations / 4;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for ( long i = 0; i < cycles && !STOP; i++ )
+	{
+		std::ostringstream name;
+		name << path << "stress-" << i;
+
+		FILE * file = fopen( name.str().c_str(), "wb" );
+
+		if ( NULL == file )
+		{
+			std::cout << "Can't create " << name.str().c_str() << std::endl;
+			return 1;
+		}
+
+		fputc( 'x', file );
+		fclose( file );
+
+		rename( name.str().c_str(), ( name.str() + ".moved" ).c_str() );
+		remove( ( name.str() + ".moved" ).c_str() );
+	}
+
+	std::chrono::steady_clock::time_point generated = std::chrono::steady_clock::now();
+
+	/// Wait until the events stop coming
+	long received = listener.events();
+
+	for ( int idle = 0; idle < 10 && !STOP; )
+	{
+		efsw::System::sleep( 100 );
+
+		long now = listener.events();
+		idle = now == received ? idle + 1 : 0;
+		received = now;
+	}
+
+	std::chrono::steady_clock::time_point last;
+	received = listener.events( &last );
+
+	const long expected = cycles * 4;
+	double generateSecs = std::chrono::duration<double>( generated - start ).count();
+	double deliverSecs = std::chrono::duration<double>( last - start ).count();
+
+	std::cout << "Operations: " << expected << " in " << generateSecs << " s" << std::endl;
+	std::cout << "Events received: " << received << ", " << ( deliverSecs > 0 ? received / deliverSecs : 0 ) << " events/s" << std::endl;
+	std::cout << "Events lost: " << ( expected > received ? expected - received : 0 ) << ", queue overflows: " << listener.overflows() << std::endl;
+
+	return 0;
+}
+
+#if EFSW_PLATFORM == EFSW_PLATFORM_INOTIFY
+
+/// Files created per backend by the latency test
+#define LATENCY_SAMPLES 50
+
+/// Longest wait for a file to be reported, in milliseconds
+#define LATENCY_TIMEOUT 2000
+
+/// Records when the file the latency test waits for is reported
+class LatencyListener : public efsw::FileWatchListener
+{
+	public:
+		LatencyListener() : mReported(false) {}
+
+		void expect( const std::string& filename )
+		{
+			mLock.lock();
+			mFilename = filename;
+			mReported = false;
+			mLock.unlock();
+		}
+
+		bool reported( std::chrono::steady_clock::time_point& when )
+		{
+			mLock.lock();
+			bool reported = mReported;
+			when = mWhen;
+			mLock.unlock();
+			return reported;
+		}
+
+		void handleFileAction( efsw::WatchID watchid, const std::string& dir, const std::string& filename, efsw::Action action, std::string oldFilename = ""  )
+		{
+			mLock.lock();
+			if ( !mReported && efsw::Actions::Add == action && filename == mFilename )
+			{
+				mReported = true;
+				mWhen = std::chrono::steady_clock::now();
+			}
+			mLock.unlock();
+		}
+	protected:
+		efsw::Mutex mLock;
+		std::string mFilename;
+		bool mReported;
+		std::chrono::steady_clock::time_point mWhen;
+};
+
+/// Creates the directories of the latency test under the path, a thousand to each parent
+bool createTree( const std::string& path, long count, std::vector<std::string>& dirs )
+{
+	for ( long i = 0; i < count && !STOP; i++ )
+	{
+		std::ostringstream parent;
+		parent << path << "d" << i / 1000 << "/";
+
+		std::ostringstream dir;
+		dir << parent.str() << "d" << i << "/";
+
+		if ( ( 0 != mkdir( parent.str().c_str(), 0755 ) && EEXIST != errno ) ||
+			 ( 0 != mkdir( dir.str().c_str(), 0755 ) && EEXIST != errno ) )
+		{
+			std::cout << "Can't create " << dir.str().c_str() << std::endl;
+			return false;
+		}
+
+		dirs.push_back( dir.str() );
+	}
+
+	return true;
+}
+
+/// Adds a recursive watch of the path to the backend, and reports the time it took
+/// and the time it takes to report a file created in random directories of the tree.
+/// The watch is left to the destructor of the backend, removing a large inotify tree one by one is slow.
+void latencyTest( efsw::FileWatcherImpl * impl, const char * backend, const std::string& path, const std::vector<std::string>& dirs )
+{
+	LatencyListener listener;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	efsw::WatchID watchid = impl->addWatch( path, &listener, true );
+
+	double registerMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+
+	if ( watchid < 0 )
+	{
+		std::cout << backend << ": " << efsw::Errors::Log::getLastErrorLog().c_str() << std::endl;
+		return;
+	}
+
+	impl->watch();
+
+	efsw::System::sleep( 100 );
+
+	double totalMs = 0;
+	double maxMs = 0;
+	int reported = 0;
+	int samples = 0;
+
+	srand( 1 );
+
+	for ( ; samples < LATENCY_SAMPLES && !STOP; samples++ )
+	{
+		std::ostringstream name;
+		name << "latency-" << samples;
+
+		std::string dir( dirs[ rand() % dirs.size() ] );
+		std::string file( dir + name.str() );
+
+		listener.expect( name.str() );
+
+		std::chrono::steady_clock::time_point created = std::chrono::steady_clock::now();
+
+		FILE * f = fopen( file.c_str(), "wb" );
+
+		if ( NULL == f )
+		{
+			std::cout << "Can't create " << file.c_str() << std::endl;
+			break;
+		}
+
+		fclose( f );
+
+		std::chrono::steady_clock::time_point when;
+
+		for ( int waited = 0; waited < LATENCY_TIMEOUT && !listener.reported( when ); waited++ )
+		{
+			efsw::System::sleep( 1 );
+		}
+
+		if ( listener.reported( when ) )
+		{
+			double ms = std::chrono::duration<double, std::milli>( when - created ).count();
+			totalMs += ms;
+			maxMs = ms > maxMs ? ms : maxMs;
+			reported++;
+		}
+
+		remove( file.c_str() );
+	}
+
+	std::cout << backend << ": addWatch " << registerMs << " ms, "
+			  << "latency " << ( reported > 0 ? totalMs / reported : 0 ) << " ms average, " << maxMs << " ms max, "
+			  << "reported " << reported << " of " << samples << std::endl;
+}
+
+/// Compares the fanotify and inotify backends on a directory tree, creating it first if a count is given.
+/// A root fanotify can't mark is delegated to inotify, then both report alike.
+int latencyTests( std::string path, long count )
+{
+	if ( !efsw::FileSystem::isDirectory( path ) )
+	{
+		std::cout << "Not a directory: " << path.c_str() << std::endl;
+		return 1;
+	}
+
+	efsw::FileSystem::dirAddSlashAtEnd( path );
+
+	std::vector<std::string> dirs;
+
+	if ( count > 0 )
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		if ( !createTree( path, count, dirs ) )
+		{
+			return 1;
+		}
+
+		std::cout << "Created " << count << " directories in " << std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() << " s" << std::endl;
+	}
+	else
+	{
+		dirs.push_back( path );
+	}
+
+	/// The backends take their settings from a file watcher, one that isn't started
+	efsw::FileWatcher owner;
+
+#ifdef EFSW_FANOTIFY
+	{
+		efsw::FileWatcherFanotify fanotify( &owner );
+
+		if ( fanotify.initOK() )
+		{
+			latencyTest( &fanotify, "fanotify", path, dirs );
+		}
+		else
+		{
+			std::cout << "fanotify: not available, it needs Linux 5.9 and CAP_SYS_ADMIN" << std::endl;
+		}
+	}
+#else
+	std::cout << "fanotify: not built, the kernel headers are older than Linux 5.9" << std::endl;
+#endif
+
+	{
+		efsw::FileWatcherInotify inotify( &owner );
+
+		latencyTest( &inotify, "inotify", path, dirs );
+	}
+
+	return 0;
+}
+
+#endif
+
 efsw::WatchID handleWatchID( efsw::WatchID watchid )
 {
 	switch ( watchid )
@@ -63,6 +405,23 @@ int main(int argc, char **argv)
 	signal( SIGINT	,	sigend );
 	signal( SIGTERM	,	sigend );
 
+	/// efsw-test --stress <directory> [operations] [true to use the generic watcher]
+	if ( argc >= 3 && std::string( argv[1] ) == "--stress" )
+	{
+		long operations = argc >= 4 ? atol( argv[3] ) : 1000000;
+		bool generic = argc >= 5 && std::string( argv[4] ) == "true";
+
+		return stressTest( argv[2], operations, generic );
+	}
+
+#if EFSW_PLATFORM == EFSW_PLATFORM_INOTIFY
+	/// efsw-test --latency <directory> [directories to create]
+	if ( argc >= 3 && std::string( argv[1] ) == "--latency" )
+	{
+		return latencyTests( argv[2], argc >= 4 ? atol( argv[3] ) : 0 );
+	}
+#endif
+
 	std::cout << "Press ^C to exit demo" << std::endl;
 
 	bool commonTest = true;
@@ -3,6 +3,7 @@
 #include "Application/AppController.h"
 #include "QsLog/QsLog.h"
 
+#include <QtCore/QDateTime>
 #include <QtCore/QMap>
 #include <QtCore/QJsonDocument>
 #include <QtCore/QJsonObject>
@@ -458,6 +459,20 @@ RemoteFileEvent RemoteFileEvent::fromJson(const QJsonObject& jsonObject)
 	return remoteEvent;
 }
 
+RemoteFileEvent RemoteFileEvent::syncEvent(const RemoteFileDesc& fileDesc)
+{
+	RemoteFileEvent event;
+	event.type = fileDesc.type == RemoteFileDesc::Dir
+		? RemoteFileEvent::Created
+		: RemoteFileEvent::Uploaded;
+	event.fileDesc = fileDesc;
+	event.unixtime = QDateTime::currentDateTimeUtc().toTime_t();
+	event.timestamp = QString::number(event.unixtime);
+	event.projectId = "turbodrive"; //TODO: add to defines
+
+	return event;
+}
+
 bool RemoteFileEvent::isValid() const
 {
 	return (type != EventType::Undefined)
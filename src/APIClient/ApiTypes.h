@@ -141,6 +141,9 @@ struct RemoteFileEvent
 	};
 
 	static RemoteFileEvent fromJson(const QJsonObject& jsonObject);
+	// The event a sync fetches the file with: Created for a folder,
+	// Uploaded for a file, stamped with the current time.
+	static RemoteFileEvent syncEvent(const RemoteFileDesc& fileDesc);
 	bool isValid() const;
 	void log() const;
 	void logCompact() const;
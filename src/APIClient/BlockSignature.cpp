@@ -0,0 +1,184 @@
+﻿#include "BlockSignature.h"
+
+#include "QsLog/QsLog.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QRunnable>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QThreadPool>
+
+namespace Drive
+{
+
+namespace
+{
+
+const quint32 s_magic = 0x54445347; // "TDSG"
+const quint16 s_version = 1;
+
+class UpdateSignatureTask : public QRunnable
+{
+public:
+	UpdateSignatureTask(const QString& localPath,
+			const int fileId, const QString& checkSum)
+		: m_localPath(localPath)
+		, m_fileId(fileId)
+		, m_checkSum(checkSum)
+	{
+	}
+
+	virtual void run() override
+	{
+		QFile file(m_localPath);
+		if (!file.open(QIODevice::ReadOnly))
+		{
+			return;
+		}
+
+		BlockSignature signature;
+		QString fileHash;
+		if (!ContentChunker::split(file, signature.blocks, &fileHash))
+		{
+			return;
+		}
+
+		// The file has been changed since it was uploaded, a signature of
+		// the local content would describe the remote file wrong
+		if (fileHash.compare(m_checkSum, Qt::CaseInsensitive) != 0)
+		{
+			QLOG_DEBUG() << "Skipping signature of the changed file" << m_localPath;
+			return;
+		}
+
+		signature.fileId = m_fileId;
+		signature.checkSum = m_checkSum;
+		signature.save(m_localPath);
+	}
+
+private:
+	const QString m_localPath;
+	const int m_fileId;
+	const QString m_checkSum;
+};
+
+}
+
+const qint64 BlockSignature::minFileSize;
+
+BlockSignature::BlockSignature()
+	: fileId(0)
+{
+}
+
+bool BlockSignature::isValid() const
+{
+	return fileId != 0 && !blocks.isEmpty();
+}
+
+BlockSignature BlockSignature::load(const QString& localPath,
+	const int fileId, const QString& checkSum)
+{
+	QFile file(signatureFilePath(localPath));
+	if (checkSum.isEmpty() || !file.open(QIODevice::ReadOnly))
+	{
+		return BlockSignature();
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_0);
+
+	quint32 magic = 0;
+	quint16 version = 0;
+	stream >> magic >> version;
+	if (magic != s_magic || version != s_version)
+	{
+		return BlockSignature();
+	}
+
+	BlockSignature signature;
+	quint32 count = 0;
+	stream >> signature.fileId >> signature.checkSum >> count;
+
+	if (signature.fileId != fileId
+		|| signature.checkSum.compare(checkSum, Qt::CaseInsensitive) != 0)
+	{
+		return BlockSignature();
+	}
+
+	signature.blocks.reserve(count);
+	for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i)
+	{
+		ContentChunker::Block block;
+		stream >> block.offset >> block.size >> block.hash;
+		signature.blocks.append(block);
+	}
+
+	if (stream.status() != QDataStream::Ok)
+	{
+		QLOG_ERROR() << "Block signature of" << localPath << "is corrupted";
+		return BlockSignature();
+	}
+
+	return signature;
+}
+
+void BlockSignature::update(const QString& localPath,
+	const int fileId, const QString& checkSum)
+{
+	if (checkSum.isEmpty())
+	{
+		remove(localPath);
+		return;
+	}
+
+	QThreadPool::globalInstance()->start(
+			new UpdateSignatureTask(localPath, fileId, checkSum));
+}
+
+void BlockSignature::remove(const QString& localPath)
+{
+	QFile::remove(signatureFilePath(localPath));
+}
+
+bool BlockSignature::save(const QString& localPath) const
+{
+	Q_ASSERT(isValid());
+
+	QSaveFile file(signatureFilePath(localPath));
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		QLOG_ERROR() << "Can't save block signature:" << file.errorString();
+		return false;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_0);
+	stream << s_magic << s_version
+		<< fileId << checkSum << static_cast<quint32>(blocks.size());
+
+	for (const ContentChunker::Block& block : blocks)
+	{
+		stream << block.offset << block.size << block.hash;
+	}
+
+	return file.commit();
+}
+
+QString BlockSignature::signatureFilePath(const QString& localPath)
+{
+	const QString dirPath = QDir(QStandardPaths::writableLocation(
+		QStandardPaths::DataLocation)).filePath(QLatin1String("signatures"));
+	QDir dir;
+	dir.mkpath(dirPath);
+
+	const QByteArray key = QCryptographicHash::hash(
+		localPath.toUtf8(), QCryptographicHash::Md5).toHex();
+
+	return QDir(dirPath).filePath(QString::fromLatin1(key) + ".sig");
+}
+
+}
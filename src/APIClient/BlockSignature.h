@@ -0,0 +1,50 @@
+﻿#ifndef BLOCK_SIGNATURE_H
+#define BLOCK_SIGNATURE_H
+
+#include "Util/ContentChunker.h"
+
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+namespace Drive
+{
+
+//
+// Content-defined block list of a file as it has been uploaded, kept next
+// to the other local metadata. A later version of the file is uploaded as
+// a delta against it: only the blocks missing from the signature are sent.
+//
+struct BlockSignature
+{
+	BlockSignature();
+
+	bool isValid() const;
+
+	// Returns an invalid signature if there is none for the path or it
+	// doesn't describe the given version of the remote file.
+	static BlockSignature load(const QString& localPath,
+			int fileId, const QString& checkSum);
+
+	// Builds the signature of the local file in the thread pool and saves
+	// it if the file still has the content of the given remote file.
+	static void update(const QString& localPath,
+			int fileId, const QString& checkSum);
+
+	static void remove(const QString& localPath);
+
+	bool save(const QString& localPath) const;
+
+	// Files smaller than this are always uploaded as a whole
+	static const qint64 minFileSize = 16 * 1024 * 1024;
+
+	int fileId;
+	QString checkSum;
+	QVector<ContentChunker::Block> blocks;
+
+private:
+	static QString signatureFilePath(const QString& localPath);
+};
+
+}
+
+#endif // BLOCK_SIGNATURE_H
@@ -0,0 +1,203 @@
+﻿#include "DownloadSession.h"
+
+#include "QsLog/QsLog.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+
+namespace Drive
+{
+
+namespace
+{
+
+const QString s_localPath = QLatin1String("localPath");
+const QString s_fileId = QLatin1String("fileId");
+const QString s_fileSize = QLatin1String("fileSize");
+const QString s_modifiedAt = QLatin1String("modifiedAt");
+const QString s_segmentSize = QLatin1String("segmentSize");
+const QString s_segmentsDone = QLatin1String("segmentsDone");
+
+const QString s_tempFileSuffix = QLatin1String(".tdpart");
+
+}
+
+DownloadSession::DownloadSession()
+	: m_fileId(0)
+	, m_fileSize(0)
+	, m_modifiedAt(0)
+	, m_segmentSize(0)
+{
+}
+
+DownloadSession DownloadSession::load(const QString& localPath, const int fileId,
+	const qint64 fileSize, const uint modifiedAt)
+{
+	QFile file(sessionFilePath(localPath));
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		return DownloadSession();
+	}
+
+	const QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+	if (!doc.isObject())
+	{
+		return DownloadSession();
+	}
+
+	const QJsonObject obj = doc.object();
+
+	DownloadSession session;
+	session.m_localPath = obj.value(s_localPath).toString();
+	session.m_fileId = obj.value(s_fileId).toInt();
+	session.m_fileSize = static_cast<qint64>(obj.value(s_fileSize).toDouble());
+	session.m_modifiedAt = static_cast<uint>(obj.value(s_modifiedAt).toDouble());
+	session.m_segmentSize = static_cast<qint64>(obj.value(s_segmentSize).toDouble());
+
+	Q_FOREACH(const QJsonValue& value, obj.value(s_segmentsDone).toArray())
+	{
+		session.m_segmentsDone.insert(value.toInt());
+	}
+
+	const QFileInfo tempFileInfo(tempFilePath(localPath));
+
+	if (session.m_localPath != localPath
+		|| session.m_fileId != fileId
+		|| session.m_fileSize != fileSize
+		|| session.m_modifiedAt != modifiedAt
+		|| !session.isValid()
+		|| !tempFileInfo.isFile()
+		|| tempFileInfo.size() != fileSize)
+	{
+		// Another version of the file, the written segments are useless
+		session.remove();
+		QFile::remove(tempFilePath(localPath));
+		return DownloadSession();
+	}
+
+	return session;
+}
+
+DownloadSession DownloadSession::create(const QString& localPath, const int fileId,
+	const qint64 fileSize, const uint modifiedAt, const qint64 segmentSize)
+{
+	Q_ASSERT(segmentSize > 0);
+
+	DownloadSession session;
+	session.m_localPath = localPath;
+	session.m_fileId = fileId;
+	session.m_fileSize = fileSize;
+	session.m_modifiedAt = modifiedAt;
+	session.m_segmentSize = segmentSize;
+	return session;
+}
+
+QString DownloadSession::tempFilePath(const QString& localPath)
+{
+	const QFileInfo info(localPath);
+	return info.dir().filePath(
+		QLatin1Char('.') + info.fileName() + s_tempFileSuffix);
+}
+
+bool DownloadSession::isTempFileName(const QString& fileName)
+{
+	return fileName.endsWith(s_tempFileSuffix);
+}
+
+bool DownloadSession::isValid() const
+{
+	return m_fileId != 0 && m_segmentSize > 0;
+}
+
+qint64 DownloadSession::segmentSize() const
+{
+	return m_segmentSize;
+}
+
+int DownloadSession::segmentsTotal() const
+{
+	Q_ASSERT(m_segmentSize > 0);
+
+	return qMax<qint64>(1, (m_fileSize + m_segmentSize - 1) / m_segmentSize);
+}
+
+qint64 DownloadSession::segmentOffset(const int segmentIndex) const
+{
+	return segmentIndex * m_segmentSize;
+}
+
+qint64 DownloadSession::segmentLength(const int segmentIndex) const
+{
+	return qMin(m_segmentSize, m_fileSize - segmentOffset(segmentIndex));
+}
+
+bool DownloadSession::isSegmentDone(const int segmentIndex) const
+{
+	return m_segmentsDone.contains(segmentIndex);
+}
+
+void DownloadSession::setSegmentDone(const int segmentIndex)
+{
+	m_segmentsDone.insert(segmentIndex);
+}
+
+int DownloadSession::segmentsDone() const
+{
+	return m_segmentsDone.size();
+}
+
+bool DownloadSession::save() const
+{
+	Q_ASSERT(isValid());
+
+	QJsonArray segmentsDone;
+	Q_FOREACH(const int segmentIndex, m_segmentsDone)
+	{
+		segmentsDone.append(segmentIndex);
+	}
+
+	QJsonObject obj;
+	obj.insert(s_localPath, m_localPath);
+	obj.insert(s_fileId, m_fileId);
+	obj.insert(s_fileSize, static_cast<double>(m_fileSize));
+	obj.insert(s_modifiedAt, static_cast<double>(m_modifiedAt));
+	obj.insert(s_segmentSize, static_cast<double>(m_segmentSize));
+	obj.insert(s_segmentsDone, segmentsDone);
+
+	QSaveFile file(sessionFilePath(m_localPath));
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		QLOG_ERROR() << "Can't save download session: " << file.errorString();
+		return false;
+	}
+
+	file.write(QJsonDocument(obj).toJson(QJsonDocument::Compact));
+	return file.commit();
+}
+
+void DownloadSession::remove() const
+{
+	QFile::remove(sessionFilePath(m_localPath));
+}
+
+QString DownloadSession::sessionFilePath(const QString& localPath)
+{
+	const QString dirPath = QDir(QStandardPaths::writableLocation(
+		QStandardPaths::DataLocation)).filePath(QLatin1String("downloads"));
+	QDir dir;
+	dir.mkpath(dirPath);
+
+	const QByteArray key = QCryptographicHash::hash(
+		localPath.toUtf8(), QCryptographicHash::Md5).toHex();
+
+	return QDir(dirPath).filePath(QString::fromLatin1(key) + ".json");
+}
+
+}
@@ -0,0 +1,63 @@
+﻿#ifndef DOWNLOAD_SESSION_H
+#define DOWNLOAD_SESSION_H
+
+#include <QtCore/QString>
+#include <QtCore/QSet>
+
+namespace Drive
+{
+
+//
+// Persistent state of a segmented download: the segment size and the
+// indexes of the segments written to the temporary file. An interrupted
+// download of an unchanged remote file resumes from the written segments.
+//
+// The content is downloaded into a hidden ".<name>.tdpart" file next to
+// the target, which replaces the target once the download is complete.
+//
+class DownloadSession
+{
+public:
+	DownloadSession();
+
+	// Returns an invalid session if there is no saved session for the file,
+	// the remote file has been changed or the temporary file is gone.
+	static DownloadSession load(const QString& localPath, int fileId,
+			qint64 fileSize, uint modifiedAt);
+
+	static DownloadSession create(const QString& localPath, int fileId,
+			qint64 fileSize, uint modifiedAt, qint64 segmentSize);
+
+	static QString tempFilePath(const QString& localPath);
+	static bool isTempFileName(const QString& fileName);
+
+	bool isValid() const;
+
+	qint64 segmentSize() const;
+	int segmentsTotal() const;
+	qint64 segmentOffset(int segmentIndex) const;
+	qint64 segmentLength(int segmentIndex) const;
+
+	bool isSegmentDone(int segmentIndex) const;
+	void setSegmentDone(int segmentIndex);
+	int segmentsDone() const;
+
+	bool save() const;
+	// Removes the saved state, the temporary file is kept.
+	void remove() const;
+
+private:
+	static QString sessionFilePath(const QString& localPath);
+
+	QString m_localPath;
+	int m_fileId;
+	qint64 m_fileSize;
+	uint m_modifiedAt;
+
+	qint64 m_segmentSize;
+	QSet<int> m_segmentsDone;
+};
+
+}
+
+#endif // DOWNLOAD_SESSION_H
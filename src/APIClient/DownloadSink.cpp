@@ -0,0 +1,414 @@
+﻿#include "DownloadSink.h"
+
+#include "Util/FileUtils.h"
+#include "QsLog/QsLog.h"
+
+#include <QtCore/QMutexLocker>
+#include <QtCore/QQueue>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+#include <QtCore/QWaitCondition>
+
+namespace Drive
+{
+
+namespace
+{
+
+const int s_bufferSize = 64 * 1024;
+const int s_maxPooledBuffers = 64;
+
+// A sink with this much data queued is full, it has room
+// again when half of it is written
+const qint64 s_maxPendingSize = 4 * 1024 * 1024;
+
+typedef QSharedPointer<DownloadSinkState> StateRef;
+
+struct Job
+{
+	enum Type
+	{
+		Open,
+		Write,
+		Flush,
+		Close,
+		Abort
+	};
+
+	Job(const Type type, const StateRef& state)
+		: type(type)
+		, state(state)
+		, offset(0)
+		, size(-1)
+		, tag(0)
+		, flag(false)
+	{
+	}
+
+	Type type;
+	StateRef state;
+	qint64 offset;
+	// Open: the size to resize the file to
+	qint64 size;
+	QByteArray data;
+	int tag;
+	// Open: truncate, Abort: remove the file
+	bool flag;
+};
+
+QString writeError(const QString& filePath)
+{
+	return QString(DownloadSink::tr("Failed to write to file: %1")).arg(filePath);
+}
+
+}
+
+DownloadSinkState::DownloadSinkState(const QString& filePath)
+	: filePath(filePath)
+	, pending(0)
+	, starved(false)
+	, hasFailed(false)
+	, aborted(false)
+{
+}
+
+class DownloadSink::Writer : public QThread
+{
+public:
+	static Writer& instance()
+	{
+		static Writer s_instance;
+		return s_instance;
+	}
+
+	virtual ~Writer()
+	{
+		{
+			QMutexLocker locker(&m_mutex);
+			m_stopped = true;
+			m_wakeUp.wakeOne();
+		}
+
+		wait();
+	}
+
+	void enqueue(const Job& job)
+	{
+		QMutexLocker locker(&m_mutex);
+		m_jobs.enqueue(job);
+		m_wakeUp.wakeOne();
+	}
+
+	QByteArray takeBuffer()
+	{
+		QMutexLocker locker(&m_mutex);
+		if (m_buffers.isEmpty())
+		{
+			return QByteArray(s_bufferSize, Qt::Uninitialized);
+		}
+
+		QByteArray buffer = m_buffers.takeLast();
+		locker.unlock();
+
+		// Shrinking keeps the allocation, nothing is allocated here
+		buffer.resize(s_bufferSize);
+		return buffer;
+	}
+
+	void releaseBuffer(QByteArray& buffer)
+	{
+		QMutexLocker locker(&m_mutex);
+		if (m_buffers.size() < s_maxPooledBuffers)
+		{
+			m_buffers.append(buffer);
+		}
+		buffer = QByteArray();
+	}
+
+protected:
+	virtual void run() override
+	{
+		forever
+		{
+			QMutexLocker locker(&m_mutex);
+			while (m_jobs.isEmpty() && !m_stopped)
+			{
+				m_wakeUp.wait(&m_mutex);
+			}
+
+			if (m_stopped)
+			{
+				return;
+			}
+
+			Job job = m_jobs.dequeue();
+			locker.unlock();
+
+			process(job);
+		}
+	}
+
+private:
+	Writer()
+		: m_stopped(false)
+	{
+		start();
+	}
+
+	void process(Job& job)
+	{
+		DownloadSinkState& state = *job.state;
+
+		bool skip = false;
+		{
+			QMutexLocker locker(&state.mutex);
+			skip = state.hasFailed || (state.aborted && job.type != Job::Abort);
+		}
+
+		if (skip)
+		{
+			if (job.type == Job::Write)
+			{
+				written(state, job.data.size());
+				releaseBuffer(job.data);
+			}
+			return;
+		}
+
+		switch (job.type)
+		{
+		case Job::Open:
+			open(state, job.flag, job.size);
+			break;
+
+		case Job::Write:
+			if (!state.file.seek(job.offset)
+				|| state.file.write(job.data) != job.data.size())
+			{
+				fail(state);
+			}
+			written(state, job.data.size());
+			releaseBuffer(job.data);
+			break;
+
+		case Job::Flush:
+			if (state.file.flush())
+			{
+				Q_EMIT state.flushed(job.tag);
+			}
+			else
+			{
+				fail(state);
+			}
+			break;
+
+		case Job::Close:
+			if (state.file.flush() && FileSystemHelper::syncFile(state.file))
+			{
+				state.file.close();
+				Q_EMIT state.closed();
+			}
+			else
+			{
+				fail(state);
+			}
+			break;
+
+		case Job::Abort:
+			state.file.close();
+			if (job.flag && QFile::exists(state.filePath)
+				&& !QFile::remove(state.filePath))
+			{
+				QLOG_ERROR() << "File removing failed:" << state.filePath;
+			}
+			break;
+		}
+	}
+
+	void open(DownloadSinkState& state, const bool truncate, const qint64 size)
+	{
+		state.file.setFileName(state.filePath);
+
+		const QIODevice::OpenMode mode = truncate
+				? QIODevice::ReadWrite | QIODevice::Truncate
+				: QIODevice::ReadWrite;
+		if (!state.file.open(mode)
+			|| (size >= 0 && state.file.size() != size && !state.file.resize(size)))
+		{
+			fail(state);
+		}
+	}
+
+	void written(DownloadSinkState& state, const qint64 size)
+	{
+		QMutexLocker locker(&state.mutex);
+		state.pending -= size;
+		if (state.starved && state.pending <= s_maxPendingSize / 2)
+		{
+			state.starved = false;
+			locker.unlock();
+			Q_EMIT state.drained();
+		}
+	}
+
+	void fail(DownloadSinkState& state)
+	{
+		QLOG_ERROR() << "Failed to write" << state.filePath << ":"
+			<< state.file.errorString();
+
+		state.file.close();
+		{
+			QMutexLocker locker(&state.mutex);
+			state.hasFailed = true;
+		}
+		Q_EMIT state.failed(writeError(state.filePath));
+	}
+
+private:
+	QMutex m_mutex;
+	QWaitCondition m_wakeUp;
+	QQueue<Job> m_jobs;
+	QVector<QByteArray> m_buffers;
+	bool m_stopped;
+};
+
+DownloadSink::DownloadSink(const QString& filePath, QObject* parent)
+	: QObject(parent)
+	, m_filePath(filePath)
+{
+}
+
+DownloadSink::~DownloadSink()
+{
+	if (m_state)
+	{
+		abort(false);
+	}
+}
+
+void DownloadSink::open(const bool truncate, const qint64 size)
+{
+	if (m_state)
+	{
+		abort(false);
+	}
+
+	// The state is deleted in the main thread once the writer is done with it
+	m_state = StateRef(new DownloadSinkState(m_filePath), &QObject::deleteLater);
+
+	connect(m_state.data(), &DownloadSinkState::drained,
+			this, &DownloadSink::drained);
+	connect(m_state.data(), &DownloadSinkState::flushed,
+			this, &DownloadSink::flushed);
+	connect(m_state.data(), &DownloadSinkState::closed,
+			this, &DownloadSink::closed);
+	connect(m_state.data(), &DownloadSinkState::failed,
+			this, &DownloadSink::failed);
+
+	Job job(Job::Open, m_state);
+	job.size = size;
+	job.flag = truncate;
+	Writer::instance().enqueue(job);
+}
+
+qint64 DownloadSink::capacity() const
+{
+	if (!m_state)
+	{
+		return 0;
+	}
+
+	QMutexLocker locker(&m_state->mutex);
+	const qint64 capacity = qMax<qint64>(0, s_maxPendingSize - m_state->pending);
+	if (capacity == 0)
+	{
+		m_state->starved = true;
+	}
+
+	return capacity;
+}
+
+qint64 DownloadSink::write(const qint64 offset, QIODevice* device, const qint64 maxSize)
+{
+	if (!m_state)
+	{
+		return -1;
+	}
+
+	{
+		QMutexLocker locker(&m_state->mutex);
+		if (m_state->hasFailed)
+		{
+			return -1;
+		}
+	}
+
+	Writer& writer = Writer::instance();
+
+	qint64 total = 0;
+	while (total < maxSize)
+	{
+		QByteArray buffer = writer.takeBuffer();
+		const qint64 size = device->read(buffer.data(),
+				qMin<qint64>(buffer.size(), maxSize - total));
+		if (size <= 0)
+		{
+			writer.releaseBuffer(buffer);
+			break;
+		}
+
+		buffer.resize(static_cast<int>(size));
+		{
+			QMutexLocker locker(&m_state->mutex);
+			m_state->pending += size;
+		}
+
+		Job job(Job::Write, m_state);
+		job.offset = offset + total;
+		job.data = buffer;
+		buffer = QByteArray();
+		writer.enqueue(job);
+
+		total += size;
+	}
+
+	return total;
+}
+
+void DownloadSink::flush(const int tag)
+{
+	Q_ASSERT(m_state);
+
+	Job job(Job::Flush, m_state);
+	job.tag = tag;
+	Writer::instance().enqueue(job);
+}
+
+void DownloadSink::close()
+{
+	Q_ASSERT(m_state);
+
+	Writer::instance().enqueue(Job(Job::Close, m_state));
+}
+
+void DownloadSink::abort(const bool remove)
+{
+	if (!m_state)
+	{
+		return;
+	}
+
+	m_state->disconnect(this);
+	{
+		QMutexLocker locker(&m_state->mutex);
+		m_state->aborted = true;
+	}
+
+	Job job(Job::Abort, m_state);
+	job.flag = remove;
+	Writer::instance().enqueue(job);
+
+	m_state.clear();
+}
+
+}
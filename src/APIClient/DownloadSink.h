@@ -0,0 +1,100 @@
+﻿#ifndef DOWNLOAD_SINK_H
+#define DOWNLOAD_SINK_H
+
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QSharedPointer>
+
+class QIODevice;
+
+namespace Drive
+{
+
+//
+// State of a DownloadSink shared with the writer thread
+//
+class DownloadSinkState : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit DownloadSinkState(const QString& filePath);
+
+	const QString filePath;
+	// Used by the writer thread only
+	QFile file;
+
+	QMutex mutex;
+	// Bytes queued and not written yet
+	qint64 pending;
+	// The sink has been found full, drained() is expected
+	bool starved;
+	bool hasFailed;
+	bool aborted;
+
+	Q_SIGNAL void drained();
+	Q_SIGNAL void flushed(int tag);
+	Q_SIGNAL void closed();
+	Q_SIGNAL void failed(const QString& error);
+};
+
+//
+// Writes a download into a file off the main thread. The data read from
+// a reply is copied into a pooled buffer and queued, a single writer
+// thread shared by all the sinks writes the buffers in the order queued.
+//
+// The data queued by a sink is bounded: a full sink reports no capacity
+// and its owner stops reading the reply until drained(). The file is
+// synced once, when the sink is closed.
+//
+// The signals are emitted in the main thread. Must be used from the main
+// thread only.
+//
+class DownloadSink : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit DownloadSink(const QString& filePath, QObject* parent = nullptr);
+	virtual ~DownloadSink();
+
+	// Opens the file, an open file is aborted first. The file is resized
+	// to size unless it is negative.
+	void open(bool truncate, qint64 size = -1);
+
+	// Bytes that may be queued now. Zero means the sink is full,
+	// drained() is emitted once it has room again.
+	qint64 capacity() const;
+
+	// Reads up to maxSize bytes of the device and queues them to be written
+	// at offset. Returns the bytes queued, -1 if the sink has failed.
+	// The capacity isn't checked, the data read is always queued.
+	qint64 write(qint64 offset, QIODevice* device, qint64 maxSize);
+
+	// flushed(tag) is emitted once the data queued before is written
+	void flush(int tag);
+
+	// Writes the data queued and syncs the file to disk, closed() is
+	// emitted then
+	void close();
+
+	// Drops the data queued and closes the file, the file is removed
+	// if remove is set. No signals are emitted after it.
+	void abort(bool remove);
+
+	Q_SIGNAL void drained();
+	Q_SIGNAL void flushed(int tag);
+	Q_SIGNAL void closed();
+	Q_SIGNAL void failed(const QString& error);
+
+private:
+	class Writer;
+
+	const QString m_filePath;
+	QSharedPointer<DownloadSinkState> m_state;
+};
+
+}
+
+#endif // DOWNLOAD_SINK_H
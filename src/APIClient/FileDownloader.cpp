@@ -1,42 +1,155 @@
 ﻿#include "FileDownloader.h"
+#include "DownloadSink.h"
 
 #include "Application/AppController.h"
 #include "Network/RestResource.h"
 #include "Util/FileUtils.h"
+#include "Util/RateLimiter.h"
 #include "QsLog/QsLog.h"
 
 #include <QtCore/QFile>
+#include <QtCore/QFileInfo>
 #include <QtCore/QDir>
 #include <QtCore/QThread>
+#include <QtCore/QTimer>
 #include <QtNetwork/QSslError>
 #include <QtNetwork/QNetworkCookieJar>
 
 namespace Drive
 {
 
-FileDownloader::FileDownloader(int fileId, const QString& localPath, uint modifiedAt, QObject *parent)
+namespace
+{
+
+// Smaller files are downloaded by a single request
+const qint64 s_minSegmentedSize = 8 * 1024 * 1024;
+const qint64 s_segmentSize = 4 * 1024 * 1024;
+const int s_maxParallelSegments = 4;
+
+const int s_maxAttempts = 3;
+const int s_retryDelayMSec = 2000;
+
+// Bounds the data buffered by a reply, a reply read slower than the
+// network delivers, e.g. under the rate limit, stops the socket reads
+const qint64 s_readBufferSize = 256 * 1024;
+
+}
+
+class FileDownloader::Segment
+{
+public:
+	Segment(const int index, const qint64 offset, const qint64 length,
+		QNetworkReply* reply)
+		: index(index)
+		, offset(offset)
+		, length(length)
+		, written(0)
+		, reply(reply)
+		, watchDog([reply] { QLOG_ERROR() << "Connection has been lost."; reply->abort(); })
+	{
+	}
+
+	const int index;
+	const qint64 offset;
+	// -1 if unknown
+	const qint64 length;
+	qint64 written;
+	QNetworkReply* reply;
+	WatchDog watchDog;
+};
+
+FileDownloader::FileDownloader(int fileId, const QString& localPath,
+	uint modifiedAt, qint64 fileSize, QObject *parent)
 	: QObject(parent)
+	, nam(new QNetworkAccessManager(this))
 	, fileId(fileId)
 	, localPath(localPath)
+	, tempPath(DownloadSession::tempFilePath(localPath))
 	, modifiedAt(modifiedAt)
-	, file(0)
-	, speedLimit(0)
-	, m_watchDog([this] { QLOG_ERROR() << "Connection has been lost."; reply->abort(); })
+	, fileSize(fileSize)
+	, sink(new DownloadSink(tempPath, this))
+	, totalSize(0)
+	, m_segmented(false)
+	, m_retryingSegments(0)
+	, m_flushingSegments(0)
+	, m_failed(false)
 {
+	connect(nam, &QNetworkAccessManager::sslErrors,
+			this, &FileDownloader::onSslErrors);
+
+	connect(sink, &DownloadSink::drained,
+			this, &FileDownloader::readSegments);
+	connect(sink, &DownloadSink::flushed,
+			this, &FileDownloader::onSegmentFlushed);
+	connect(sink, &DownloadSink::closed,
+			this, &FileDownloader::complete);
+	connect(sink, &DownloadSink::failed,
+			this, &FileDownloader::fail);
+
+	connect(&RateLimiter::downloads(), &RateLimiter::refilled,
+			this, &FileDownloader::readSegments);
+}
+
+FileDownloader::~FileDownloader()
+{
+	abortSegments();
+	RateLimiter::downloads().detach(this);
 }
 
 void FileDownloader::download()
 {
-	file = new QFile(localPath, this);
-	bool opened = file->open(QIODevice::WriteOnly);
+	elapsedTimer.start();
+	totalSize = 0;
+	RateLimiter::downloads().attach(this);
 
-	if (!opened)
+	if (fileSize >= s_minSegmentedSize)
 	{
-		emit failed(QString(tr("Failed to write to file: %1")).arg(localPath));
+		m_session = DownloadSession::load(localPath, fileId, fileSize, modifiedAt);
+		if (m_session.isValid())
+		{
+			QLOG_INFO() << "Resuming download of" << localPath << ":"
+				<< m_session.segmentsDone() << "of"
+				<< m_session.segmentsTotal() << "segments written.";
+		}
+		else
+		{
+			m_session = DownloadSession::create(localPath, fileId,
+				fileSize, modifiedAt, s_segmentSize);
+		}
+
+		m_segmented = true;
+	}
+
+	openTempFile();
+
+	if (!m_segmented)
+	{
+		m_pendingSegments << 0;
+		startSegments();
+		return;
+	}
+
+	m_session.save();
+
+	for (int i = 0; i < m_session.segmentsTotal(); ++i)
+	{
+		if (!m_session.isSegmentDone(i))
+		{
+			m_pendingSegments << i;
+		}
+	}
+
+	if (m_pendingSegments.isEmpty())
+	{
+		sink->close();
 		return;
 	}
 
-	nam = new QNetworkAccessManager(this);
+	startSegments();
+}
+
+QNetworkRequest FileDownloader::createRequest() const
+{
 	QNetworkRequest request(QString(DISK_DOWNLOAD_URL).arg(fileId));
 
 	request.setRawHeader(RestResource::authTokenHeader,
@@ -46,76 +159,310 @@ void FileDownloader::download()
 		QString::number(
 		AppController::instance().profileData().defaultWorkspace().id).toUtf8());
 
-	connect(nam, &QNetworkAccessManager::sslErrors,
-			this, &FileDownloader::onSslErrors);
+	return request;
+}
+
+void FileDownloader::openTempFile()
+{
+	// Preallocated, the segments are written at their offsets
+	sink->open(!m_segmented || m_session.segmentsDone() == 0,
+		m_segmented ? fileSize : -1);
+}
+
+void FileDownloader::startSegments()
+{
+	while (!m_pendingSegments.isEmpty()
+		&& m_activeSegments.size() < s_maxParallelSegments)
+	{
+		startSegment(m_pendingSegments.takeFirst());
+	}
+}
+
+void FileDownloader::startSegment(const int index)
+{
+	QNetworkRequest request = createRequest();
 
-	QLOG_TRACE() << "Downloading file:" << request.url();
+	qint64 offset = 0;
+	qint64 length = -1;
+	if (m_segmented)
+	{
+		offset = m_session.segmentOffset(index);
+		length = m_session.segmentLength(index);
+		request.setRawHeader("Range", QString("bytes=%1-%2")
+			.arg(offset).arg(offset + length - 1).toLatin1());
+	}
 
-	reply = nam->get(request);
+	QLOG_TRACE() << "Downloading file:" << request.url()
+		<< "segment:" << index << "offset:" << offset << "length:" << length;
+
+	QNetworkReply* reply = nam->get(request);
 	reply->setParent(nam);
+	reply->setReadBufferSize(s_readBufferSize);
 
-	elapsedTimer.start();
-	totalSize = 0;
+	Segment* segment = new Segment(index, offset, length, reply);
+	m_activeSegments.insert(index, segment);
+
+	connect(reply, &QNetworkReply::readyRead,
+			this, [this, segment] { readSegment(segment, true); });
 
-	Q_ASSERT(connect(reply, &QNetworkReply::finished,
-			this, &FileDownloader::onReplyFinished));
+	connect(reply, &QNetworkReply::finished,
+			this, [this, segment] { onSegmentFinished(segment); });
 
-	Q_ASSERT(connect(reply, static_cast<void (QNetworkReply::*)(QNetworkReply::NetworkError)>(&QNetworkReply::error),
-			this, &FileDownloader::onError));
+	connect(reply, &QNetworkReply::downloadProgress,
+			&segment->watchDog, &WatchDog::restart);
 
-	Q_ASSERT(connect(reply, &QNetworkReply::readyRead,
-			this, &FileDownloader::onReadyRead));
+	segment->watchDog.restart();
+}
 
-	Q_ASSERT(connect(reply, &QNetworkReply::finished,
-			&m_watchDog, &WatchDog::stop));
+void FileDownloader::readSegments()
+{
+	// A segment read may fail the download or restart it
+	Q_FOREACH(const int index, m_activeSegments.keys())
+	{
+		Segment* segment = m_activeSegments.value(index);
+		if (!m_failed && segment && segment->reply->bytesAvailable() > 0)
+		{
+			readSegment(segment, true);
+		}
+	}
+}
+
+void FileDownloader::readSegment(Segment* segment, const bool throttled)
+{
+	QNetworkReply* reply = segment->reply;
+
+	if (m_segmented && segment->written == 0
+		&& reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 200)
+	{
+		// The Range header has been ignored, the whole content is coming
+		QLOG_INFO() << "Range requests are not supported, downloading"
+			<< localPath << "by a single request.";
+		downloadWhole();
+		return;
+	}
 
-	Q_ASSERT(connect(reply, static_cast<void (QNetworkReply::*)(QNetworkReply::NetworkError)>(&QNetworkReply::error),
-			&m_watchDog, &WatchDog::stop));
+	qint64 size = reply->bytesAvailable();
+	if (segment->length >= 0)
+	{
+		size = qMin(size, segment->length - segment->written);
+	}
 
-	Q_ASSERT(connect(reply, &QNetworkReply::downloadProgress,
-			&m_watchDog, &WatchDog::restart));
+	RateLimiter& limiter = RateLimiter::downloads();
+	if (throttled)
+	{
+		size = qMin(size, qMin(limiter.available(this), sink->capacity()));
+	}
 
-	m_watchDog.restart();
+	if (size <= 0)
+	{
+		// The rest is read on the next refill or once the sink is drained
+		return;
+	}
+
+	// A failure is reported by the sink
+	const qint64 written = sink->write(segment->offset + segment->written, reply, size);
+	if (written <= 0)
+	{
+		return;
+	}
+
+	limiter.consume(this, written);
+	segment->written += written;
+	totalSize += written;
 }
 
-void FileDownloader::limitSpeed(int kbPerSecond)
+void FileDownloader::onSegmentFinished(Segment* segment)
 {
-	speedLimit = kbPerSecond;
+	QNetworkReply* reply = segment->reply;
+	const int index = segment->index;
+
+	segment->watchDog.stop();
+	m_activeSegments.remove(index);
+	reply->disconnect(this);
+	reply->deleteLater();
+
+	const QNetworkReply::NetworkError error = reply->error();
+	const int httpStatus =
+		reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+	if (m_segmented && httpStatus == 200)
+	{
+		delete segment;
+		downloadWhole();
+		return;
+	}
+
+	// The data buffered is read at once, the allowance overdrawn
+	// delays the other segments and the sink may go over its capacity
+	if (reply->bytesAvailable() > 0 && error == QNetworkReply::NoError)
+	{
+		readSegment(segment, false);
+	}
+	const bool complete = segment->length < 0
+		|| segment->written == segment->length;
+	delete segment;
+
+	if (m_failed)
+	{
+		return;
+	}
+
+	if (error != QNetworkReply::NoError || !complete)
+	{
+		QLOG_ERROR() << "Download of" << localPath << "segment" << index
+			<< "failed, network error:" << error << "HTTP status:" << httpStatus;
+
+		// Nothing to expect from a retry of a rejected request
+		if (httpStatus >= 400 && httpStatus < 500
+			&& httpStatus != 408 && httpStatus != 429)
+		{
+			fail(QString(tr("Network error: %1")).arg(error));
+			return;
+		}
+
+		retrySegment(index, QString(tr("Network error: %1")).arg(error));
+		return;
+	}
+
+	if (m_segmented)
+	{
+		// The segment is marked as written once it is in the file
+		++m_flushingSegments;
+		sink->flush(index);
+	}
+
+	if (isDone())
+	{
+		sink->close();
+		return;
+	}
+
+	startSegments();
 }
 
-void FileDownloader::onReplyFinished()
+void FileDownloader::onSegmentFlushed(const int index)
 {
-	const auto elapsed = elapsedTimer.elapsed();
+	--m_flushingSegments;
+	m_session.setSegmentDone(index);
+	m_session.save();
+
+	if (isDone())
+	{
+		sink->close();
+	}
+}
+
+bool FileDownloader::isDone() const
+{
+	return m_pendingSegments.isEmpty() && m_activeSegments.isEmpty()
+		&& !m_retryingSegments && !m_flushingSegments;
+}
+
+void FileDownloader::retrySegment(const int index, const QString& error)
+{
+	const int attempts = ++m_attempts[index];
+	if (attempts >= s_maxAttempts)
+	{
+		fail(error);
+		return;
+	}
+
+	++m_retryingSegments;
+	QTimer::singleShot(s_retryDelayMSec * attempts, this, [this, index]
+	{
+		--m_retryingSegments;
+		if (m_failed)
+		{
+			return;
+		}
+
+		m_pendingSegments.prepend(index);
+		startSegments();
+	});
+}
+
+void FileDownloader::downloadWhole()
+{
+	abortSegments();
+
+	m_session.remove();
+	m_session = DownloadSession();
+	m_segmented = false;
+	m_pendingSegments.clear();
+	m_attempts.clear();
+	m_flushingSegments = 0;
+
+	openTempFile();
+
+	m_pendingSegments << 0;
+	startSegments();
+}
+
+void FileDownloader::complete()
+{
+	const auto elapsed = qMax<qint64>(1, elapsedTimer.elapsed());
 
 	QLOG_TRACE() << "DOWNLOAD FINISHED in " << elapsed << "ms"
 		<< ". File:" << localPath << ", size:" << totalSize
 		<< ". Speed:" << float(totalSize) * 1000.0 / elapsed / 1024.0 << "Kb/s";
 
-	file->close();
-	file->deleteLater();
+	RateLimiter::downloads().detach(this);
 
-	FileSystemHelper::setFileModificationTimestamp(localPath, modifiedAt);
+	if (m_segmented && QFileInfo(tempPath).size() != fileSize)
+	{
+		m_session.remove();
+		QFile::remove(tempPath);
+		emit failed(QString(tr("Downloaded file size mismatch: %1")).arg(localPath));
+		return;
+	}
+
+	// Stamped before the rename, the watcher ignores the temp file
+	FileSystemHelper::setFileModificationTimestamp(tempPath, modifiedAt);
+
+	if (!FileSystemHelper::replaceFile(tempPath, localPath))
+	{
+		emit failed(QString(tr("Failed to write to file: %1")).arg(localPath));
+		return;
+	}
+
+	if (m_segmented)
+	{
+		m_session.remove();
+	}
 
 	emit succeeded();
 }
 
-void FileDownloader::onError(QNetworkReply::NetworkError error)
+void FileDownloader::fail(const QString& error)
 {
-	if (!file->remove())
+	if (m_failed)
 	{
-		static const auto s_message = QString::fromUtf8("File removing failed: %1.");
-		QLOG_ERROR() << s_message.arg(file->fileName());
+		return;
 	}
 
-	QLOG_TRACE() << "Network error: " << error;
-	emit failed(QString(tr("Network error: %1")).arg(error));
+	m_failed = true;
+	abortSegments();
+	RateLimiter::downloads().detach(this);
+
+	// Segments written are kept for the next attempt
+	sink->abort(!m_segmented);
+
+	QLOG_TRACE() << "Download failed: " << error;
+	emit failed(error);
 }
 
-void FileDownloader::onReadyRead()
+void FileDownloader::abortSegments()
 {
-	QByteArray data(reply->readAll());
-	totalSize += data.size();
-	file->write(data);
+	const QList<Segment*> segments = m_activeSegments.values();
+	m_activeSegments.clear();
+
+	Q_FOREACH(Segment* segment, segments)
+	{
+		segment->reply->disconnect(this);
+		segment->reply->abort();
+		segment->reply->deleteLater();
+		delete segment;
+	}
 }
 
 void FileDownloader::onSslErrors(QNetworkReply* reply, const QList<QSslError>& errors)
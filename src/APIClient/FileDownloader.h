@@ -1,12 +1,15 @@
 ﻿#ifndef FILE_DOWNLOADER_H
 #define FILE_DOWNLOADER_H
 
+#include "DownloadSession.h"
 #include "watchdog.h"
 
 #include <QtNetwork/QNetworkReply>
 #include <QtCore/QElapsedTimer>
 #include <QtCore/QTime>
 #include <QtCore/QSet>
+#include <QtCore/QHash>
+#include <QtCore/QList>
 
 //#define DISK_DOWNLOAD_URL "http://files.assistent.th/api/v1/content/%1"
 //#define DISK_DOWNLOAD_URL "http://disk.new.assistent.by/api/v1/content/%1"
@@ -16,21 +19,39 @@
 #define DISK_DOWNLOAD_URL "http://disk.mts.by/api/v1/content/%1"
 
 class QNetworkAccessManager;
-class QFile;
 class QByteArray;
 
 namespace Drive
 {
 
+class DownloadSink;
+
+//
+// Downloads a file into a temporary file next to it, which replaces the
+// file once the whole content is received.
+//
+// Large files are fetched as fixed size segments by several Range requests
+// in parallel, the segments written are saved in a DownloadSession so an
+// interrupted download resumes from them. A failed segment is retried a few
+// times before the whole download fails. If the server ignores the Range
+// header, the file is downloaded by a single request.
+//
+// The replies are read no faster than RateLimiter::downloads() allows,
+// the data not read yet stays in the bounded reply buffers and holds the
+// sender back by the TCP flow control.
+//
+// The data is written by a DownloadSink off the main thread, a full sink
+// holds the replies back the same way.
+//
 class FileDownloader : public QObject
 {
 	Q_OBJECT
 public:
 	FileDownloader(int fileId, const QString& localPath,
-		uint modifiedAt, QObject *parent = 0);
+		uint modifiedAt, qint64 fileSize, QObject *parent = 0);
+	virtual ~FileDownloader();
 
 	void download();
-	void limitSpeed(int kbPerSecond);
 
 signals:
 	void succeeded();
@@ -38,22 +59,47 @@ signals:
 	void downloadSpeed(int kbPerSecond);
 
 private slots:
-	void onError(QNetworkReply::NetworkError error);
-	void onReplyFinished();
-	void onReadyRead();
 	void onSslErrors(QNetworkReply* reply, const QList<QSslError>& errors);
 
+private:
+	class Segment;
+
+	QNetworkRequest createRequest() const;
+	void openTempFile();
+	void startSegments();
+	void startSegment(int index);
+	void readSegments();
+	void readSegment(Segment* segment, bool throttled);
+	void onSegmentFinished(Segment* segment);
+	void onSegmentFlushed(int index);
+	bool isDone() const;
+	void retrySegment(int index, const QString& error);
+	void downloadWhole();
+	void complete();
+	void fail(const QString& error);
+	void abortSegments();
+
 private:
 	QNetworkAccessManager *nam;
-	QNetworkReply *reply;
 	int fileId;
 	QString localPath;
+	QString tempPath;
 	uint modifiedAt;
-	QFile* file;
-	uint totalSize;
+	qint64 fileSize;
+	DownloadSink* sink;
+	qint64 totalSize;
 	QElapsedTimer elapsedTimer;
-	int speedLimit;
-	WatchDog m_watchDog;
+
+	DownloadSession m_session;
+	// Range requests are used
+	bool m_segmented;
+	QList<int> m_pendingSegments;
+	QHash<int, Segment*> m_activeSegments;
+	QHash<int, int> m_attempts;
+	int m_retryingSegments;
+	// Segments received and not in the file yet
+	int m_flushingSegments;
+	bool m_failed;
 };
 
 //
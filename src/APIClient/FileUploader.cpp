@@ -1,63 +1,492 @@
 ﻿#include "FileUploader.h"
 
 #include "chunkuploader.h"
+#include "BlockSignature.h"
+
+#include "Application/AppController.h"
+#include "Util/RateLimiter.h"
 
 #include "QsLog/QsLog.h"
 
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QDateTime>
 #include <QtCore/QJsonDocument>
 #include <QtCore/QJsonObject>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+#include <QtCore/QTimer>
 #include <QtCore/QUuid>
 
-#include <cmath>
-
 namespace Drive
 {
 
+namespace
+{
+
+const int s_maxParallelChunks = 4;
+const int s_maxAttempts = 3;
+const int s_retryDelayMSec = 1000;
+
+const qint64 s_defaultChunkSize = 2048 * 1024;
+const qint64 s_minChunkSize = 512 * 1024;
+const qint64 s_maxChunkSize = 8192 * 1024;
+const qint64 s_chunkSizeGranularity = 256 * 1024;
+
+// The chunk size is chosen to upload a chunk in about this time: big enough
+// to amortize the request overhead, small enough to retry cheaply
+const qint64 s_targetChunkTimeMSec = 4000;
+
+// A chunk body can't be throttled while it is sent, so a rate limited
+// upload is paced by whole chunks. Chunks of about this time at the
+// limit keep the pace even.
+const qint64 s_limitedChunkTimeMSec = 2000;
+
+// Under a low limit the chunks go below s_minChunkSize rather than
+// stalling for many seconds each, down to this size
+const qint64 s_minLimitedChunkSize = 16 * 1024;
+
+// Exponential moving average of a chunk upload throughput, bytes per second
+double s_throughput = 0;
+const double s_throughputWeight = 0.3;
+
+void updateThroughput(const qint64 size, const qint64 elapsedMSec)
+{
+	// Too small chunks are dominated by the request latency
+	if (size < s_minChunkSize || elapsedMSec <= 0)
+	{
+		return;
+	}
+
+	const double throughput = size * 1000.0 / elapsedMSec;
+	s_throughput = s_throughput > 0
+			? s_throughputWeight * throughput + (1 - s_throughputWeight) * s_throughput
+			: throughput;
+}
+
+qint64 chooseChunkSize()
+{
+	qint64 chunkSize = s_throughput > 0
+			? static_cast<qint64>(s_throughput * s_targetChunkTimeMSec / 1000)
+			: s_defaultChunkSize;
+
+	const qint64 limit = RateLimiter::uploads().limit();
+	if (limit > 0)
+	{
+		chunkSize = qMin(chunkSize, limit * s_limitedChunkTimeMSec / 1000);
+		if (chunkSize < s_minChunkSize)
+		{
+			return qMax(s_minLimitedChunkSize,
+					chunkSize / s_minLimitedChunkSize * s_minLimitedChunkSize);
+		}
+	}
+
+	return qBound(s_minChunkSize,
+			chunkSize / s_chunkSizeGranularity * s_chunkSizeGranularity,
+			s_maxChunkSize);
+}
+
+const QString s_deltaUploadFeature = QLatin1String("delta_upload");
+
+// Parts of a delta upload merge adjacent blocks up to this size
+const qint64 s_maxDeltaPartSize = s_maxChunkSize;
+
+class DeltaPlanTask : public QRunnable
+{
+public:
+	DeltaPlanTask(const QString& filePath, const BlockSignature& baseSignature,
+			const QSharedPointer<DeltaPlan>& plan)
+		: m_filePath(filePath)
+		, m_baseSignature(baseSignature)
+		, m_plan(plan)
+	{
+	}
+
+	virtual void run() override
+	{
+		QFile file(m_filePath);
+		QVector<ContentChunker::Block> blocks;
+		if (file.open(QIODevice::ReadOnly) && ContentChunker::split(file, blocks))
+		{
+			buildParts(blocks);
+			m_plan->ok = true;
+		}
+
+		Q_EMIT m_plan->ready();
+	}
+
+private:
+	void buildParts(const QVector<ContentChunker::Block>& blocks)
+	{
+		QHash<QByteArray, const ContentChunker::Block*> baseBlocks;
+		for (const ContentChunker::Block& block : m_baseSignature.blocks)
+		{
+			baseBlocks.insert(block.hash, &block);
+		}
+
+		QVector<DeltaPlan::Part>& parts = m_plan->parts;
+		for (const ContentChunker::Block& block : blocks)
+		{
+			const ContentChunker::Block* baseBlock = baseBlocks.value(block.hash);
+			const qint64 baseOffset = baseBlock && baseBlock->size == block.size
+					? baseBlock->offset : -1;
+
+			if (!parts.isEmpty())
+			{
+				DeltaPlan::Part& last = parts.last();
+				const bool mergeable = baseOffset < 0
+						? last.baseOffset < 0
+						: last.baseOffset >= 0 && last.baseOffset + last.size == baseOffset;
+
+				// References are cheap, only the data parts are limited
+				if (mergeable && (baseOffset >= 0
+					|| last.size + block.size <= s_maxDeltaPartSize))
+				{
+					last.size += block.size;
+					continue;
+				}
+			}
+
+			DeltaPlan::Part part;
+			part.offset = block.offset;
+			part.size = block.size;
+			part.baseOffset = baseOffset;
+			parts.append(part);
+		}
+	}
+
+	const QString m_filePath;
+	const BlockSignature m_baseSignature;
+	const QSharedPointer<DeltaPlan> m_plan;
+};
+
+}
+
 FileUploader::FileUploader(const int folderId, const QString& filePath, QObject* parent)
 	: QObject(parent)
-	, m_file(new QFile(filePath, this))
+	, m_filePath(filePath)
+	, m_folderId(folderId)
+	, m_fileSize(0)
+	, m_chunkSize(0)
+	, m_chunksTotal(0)
+	, m_lastChunkIndex(0)
+	, m_lastChunkStarted(false)
+	, m_failed(false)
 {
-	Q_ASSERT(m_file->exists());
+	if (init())
+	{
+		startFixedChunks();
+	}
+}
+
+FileUploader::FileUploader(const int folderId, const QString& filePath,
+	const RemoteFileDesc& baseFile, QObject* parent)
+	: QObject(parent)
+	, m_filePath(filePath)
+	, m_folderId(folderId)
+	, m_fileSize(0)
+	, m_chunkSize(0)
+	, m_chunksTotal(0)
+	, m_lastChunkIndex(0)
+	, m_lastChunkStarted(false)
+	, m_failed(false)
+	, m_baseFile(baseFile)
+{
+	if (!init())
+	{
+		return;
+	}
 
-	// FIXME: get rid of this terrible solution
-	while(!m_file->open(QIODevice::ReadOnly))
+	const BlockSignature signature =
+			BlockSignature::load(m_filePath, m_baseFile.id, m_baseFile.checkSum);
+	if (!signature.isValid())
 	{
-		QLOG_ERROR() << m_file->errorString();
+		startFixedChunks();
+		return;
 	}
 
-	static const qint64 s_maxChunkSize = 2048 * 1024;
+	// The blocks of the new version are found in the thread pool,
+	// a large file mustn't block the event loop
+	m_deltaPlan = QSharedPointer<DeltaPlan>(new DeltaPlan, &QObject::deleteLater);
+	connect(m_deltaPlan.data(), &DeltaPlan::ready,
+			this, &FileUploader::onDeltaPlanReady, Qt::QueuedConnection);
 
-	const QString uuid = QUuid::createUuid().toString();
-	const int chunksTotal = std::ceil(m_file->size() / s_maxChunkSize);
-	std::vector<ChunkUploader*> uploaders;
+	QThreadPool::globalInstance()->start(
+			new DeltaPlanTask(m_filePath, signature, m_deltaPlan));
+}
 
-	for (int chunkIndex = 0, offset = 0;;)
+FileUploader::~FileUploader()
+{
+	RateLimiter::uploads().detach(this);
+}
+
+bool FileUploader::canUploadDelta(const QString& filePath,
+	const RemoteFileDesc& baseFile)
+{
+	return AppController::instance().hasRemoteFeature(s_deltaUploadFeature)
+		&& QFileInfo(filePath).size() >= BlockSignature::minFileSize
+		&& BlockSignature::load(filePath, baseFile.id, baseFile.checkSum).isValid();
+}
+
+bool FileUploader::init()
+{
+	const QFileInfo fileInfo(m_filePath);
+	if (!fileInfo.isFile() || !fileInfo.isReadable())
+	{
+		QLOG_ERROR() << "Can't upload" << m_filePath << ": the file isn't readable";
+
+		// Let the owner connect to the signals before the failure
+		m_failed = true;
+		QTimer::singleShot(0, this, [this]
+			{
+				onError(QNetworkReply::ContentAccessDenied);
+			});
+		return false;
+	}
+
+	// A file still locked by a writer fails to open in ChunkUploader,
+	// the chunk is retried then
+	m_fileSize = fileInfo.size();
+
+	RateLimiter& limiter = RateLimiter::uploads();
+	limiter.attach(this);
+	connect(&limiter, &RateLimiter::refilled, this, &FileUploader::scheduleNext);
+	return true;
+}
+
+void FileUploader::startFixedChunks()
+{
+	const uint modifiedAt = QFileInfo(m_filePath).lastModified().toTime_t();
+
+	m_session = UploadSession::load(m_filePath, m_folderId, m_fileSize, modifiedAt);
+	if (m_session.isValid())
+	{
+		QLOG_INFO() << "Resuming upload of" << m_filePath << ":"
+			<< m_session.chunksDone() << "of" << m_session.chunksTotal()
+			<< "chunks have been uploaded already";
+	}
+	else
 	{
-		const int size = std::min(m_file->size() - offset, s_maxChunkSize);
-		auto nextUploader = new ChunkUploader(uuid, *m_file, offset, size,
-				chunkIndex, chunksTotal, folderId, this);
-		if (!uploaders.empty())
+		m_session = UploadSession::create(m_filePath, m_folderId,
+				m_fileSize, modifiedAt, chooseChunkSize());
+	}
+
+	m_uuid = m_session.uuid();
+	m_chunkSize = m_session.chunkSize();
+	m_chunksTotal = m_session.chunksTotal();
+	m_lastChunkIndex = m_chunksTotal - 1;
+	for (int chunkIndex = 0; chunkIndex < m_lastChunkIndex; ++chunkIndex)
+	{
+		if (!m_session.isChunkDone(chunkIndex))
 		{
-			connect(uploaders.back(), &ChunkUploader::finished,
-					nextUploader, &ChunkUploader::start);
+			m_pendingChunks.append(chunkIndex);
 		}
-		connect(nextUploader, &ChunkUploader::error,
-				this, &FileUploader::onError);
-		uploaders.push_back(nextUploader);
+	}
 
-		++chunkIndex;
-		offset += s_maxChunkSize;
-		if (offset >= m_file->size())
+	scheduleNext();
+}
+
+void FileUploader::onDeltaPlanReady()
+{
+	Q_ASSERT(m_deltaPlan);
+
+	if (!m_deltaPlan->ok || m_deltaPlan->parts.isEmpty())
+	{
+		QLOG_ERROR() << "Can't build delta of" << m_filePath << ", uploading it as a whole";
+		m_deltaPlan.reset();
+		startFixedChunks();
+		return;
+	}
+
+	qint64 dataSize = 0;
+	for (const DeltaPlan::Part& part : m_deltaPlan->parts)
+	{
+		if (part.baseOffset < 0)
 		{
-			break;
+			dataSize += part.size;
 		}
 	}
 
-	Q_ASSERT(!uploaders.empty());
-	connect(uploaders.back(), &ChunkUploader::finished,
-			this, &FileUploader::onFinished);
+	QLOG_INFO() << "Uploading" << m_filePath << "as a delta against remote file"
+		<< m_baseFile.id << ":" << dataSize << "of" << m_fileSize << "bytes to send";
+
+	m_uuid = QUuid::createUuid().toString();
+	m_chunksTotal = m_deltaPlan->parts.size();
+	m_lastChunkIndex = m_chunksTotal - 1;
+	for (int chunkIndex = 0; chunkIndex < m_lastChunkIndex; ++chunkIndex)
+	{
+		m_pendingChunks.append(chunkIndex);
+	}
 
-	uploaders.front()->start();
+	scheduleNext();
+}
+
+void FileUploader::scheduleNext()
+{
+	if (m_failed)
+	{
+		return;
+	}
+
+	// Under the rate limit a chunk starts once the previous ones are
+	// paid for, the refills call this again
+	const RateLimiter& limiter = RateLimiter::uploads();
+
+	while (!m_pendingChunks.isEmpty()
+		&& m_activeChunks.size() + m_retryingChunks.size() < s_maxParallelChunks
+		&& limiter.available(this) > 0)
+	{
+		startChunk(m_pendingChunks.takeFirst());
+	}
+
+	if (!m_lastChunkStarted
+		&& limiter.available(this) > 0
+		&& m_pendingChunks.isEmpty()
+		&& m_activeChunks.isEmpty()
+		&& m_retryingChunks.isEmpty())
+	{
+		m_lastChunkStarted = true;
+		startChunk(m_lastChunkIndex);
+	}
+}
+
+void FileUploader::startChunk(const int chunkIndex)
+{
+	ChunkUploader* uploader = nullptr;
+
+	if (m_deltaPlan)
+	{
+		const DeltaPlan::Part& part = m_deltaPlan->parts.at(chunkIndex);
+		uploader = new ChunkUploader(m_uuid, m_filePath, m_fileSize,
+				part.offset, part.size, chunkIndex, m_chunksTotal, m_folderId, this);
+		uploader->setBase(m_baseFile.id, part.baseOffset);
+
+		// References to the base file carry no data
+		if (part.baseOffset < 0)
+		{
+			RateLimiter::uploads().consume(this, part.size);
+		}
+	}
+	else
+	{
+		const qint64 offset = chunkIndex * m_chunkSize;
+		const qint64 size = qMin(m_fileSize - offset, m_chunkSize);
+		uploader = new ChunkUploader(m_uuid, m_filePath, m_fileSize,
+				offset, size, chunkIndex, m_chunksTotal, m_folderId, this);
+		RateLimiter::uploads().consume(this, size);
+	}
+
+	connect(uploader, &ChunkUploader::finished,
+			this, [this, chunkIndex, uploader] (const QByteArray& data)
+			{
+				onChunkFinished(chunkIndex, uploader, data);
+			});
+
+	connect(uploader, &ChunkUploader::error,
+			this, [this, chunkIndex, uploader] (QNetworkReply::NetworkError code)
+			{
+				onChunkError(chunkIndex, uploader, code);
+			});
+
+	m_activeChunks.insert(chunkIndex, uploader);
+	uploader->start();
+}
+
+void FileUploader::onChunkFinished(const int chunkIndex,
+	ChunkUploader* uploader, const QByteArray& data)
+{
+	m_activeChunks.remove(chunkIndex);
+	if (!m_deltaPlan)
+	{
+		// References to the base file don't tell the throughput
+		updateThroughput(uploader->size(), uploader->elapsed());
+	}
+	uploader->deleteLater();
+
+	if (m_failed)
+	{
+		return;
+	}
+
+	if (chunkIndex == m_lastChunkIndex)
+	{
+		if (m_session.isValid())
+		{
+			m_session.remove();
+		}
+		RateLimiter::uploads().detach(this);
+		onFinished(data);
+		return;
+	}
+
+	if (m_session.isValid())
+	{
+		m_session.setChunkDone(chunkIndex);
+		m_session.save();
+	}
+
+	scheduleNext();
+}
+
+void FileUploader::onChunkError(const int chunkIndex,
+	ChunkUploader* uploader, const QNetworkReply::NetworkError code)
+{
+	m_activeChunks.remove(chunkIndex);
+	const int httpStatus = uploader->httpStatus();
+	uploader->deleteLater();
+
+	if (m_failed)
+	{
+		return;
+	}
+
+	// The server has rejected the assembled file, the saved chunks
+	// are likely to be rejected again
+	if (chunkIndex == m_lastChunkIndex && httpStatus != 0)
+	{
+		if (m_session.isValid())
+		{
+			m_session.remove();
+		}
+		fail(code);
+		return;
+	}
+
+	const int attempts = ++m_attempts[chunkIndex];
+	if (attempts >= s_maxAttempts)
+	{
+		fail(code);
+		return;
+	}
+
+	QLOG_INFO() << "Retrying chunk" << chunkIndex << "of" << m_filePath
+		<< ", attempt" << attempts + 1;
+
+	m_retryingChunks.insert(chunkIndex);
+	QTimer::singleShot(s_retryDelayMSec * attempts, this, [this, chunkIndex]
+		{
+			m_retryingChunks.remove(chunkIndex);
+			if (!m_failed)
+			{
+				startChunk(chunkIndex);
+			}
+		});
+}
+
+void FileUploader::fail(const QNetworkReply::NetworkError code)
+{
+	m_failed = true;
+
+	for (ChunkUploader* uploader : m_activeChunks)
+	{
+		uploader->abort();
+		uploader->deleteLater();
+	}
+	m_activeChunks.clear();
+	m_pendingChunks.clear();
+	RateLimiter::uploads().detach(this);
+
+	onError(code);
 }
 
 void FileUploader::onFinished(const QByteArray& data)
@@ -100,23 +529,22 @@ void FileUploader::onFinished(const QByteArray& data)
 
     const QJsonObject dataObj = dataValue.toObject();
 
-	Q_EMIT succeeded(RemoteFileDesc::fromJson(dataObj));
+	const RemoteFileDesc fileDesc = RemoteFileDesc::fromJson(dataObj);
 
-	if (m_file)
+	// Keep the blocks of the uploaded version for the next delta upload
+	if (AppController::instance().hasRemoteFeature(s_deltaUploadFeature)
+		&& m_fileSize >= BlockSignature::minFileSize)
 	{
-		m_file->close();
+		BlockSignature::update(m_filePath, fileDesc.id, fileDesc.checkSum);
 	}
+
+	Q_EMIT succeeded(fileDesc);
 }
 
 void FileUploader::onError(QNetworkReply::NetworkError code)
 {
 	QLOG_ERROR() << "Uploader error:" << code;
 	Q_EMIT failed(QString::number(code));
-
-    /* if (m_file)
-	{
-		m_file->close();
-    } */
 }
 
 }
@@ -2,14 +2,57 @@
 #define FILE_UPLOADER_H
 
 #include "APIClient/ApiTypes.h"
+#include "APIClient/UploadSession.h"
 
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QSet>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QVector>
 #include <QtNetwork/QNetworkReply>
 
-class QFile;
-
 namespace Drive
 {
 
+class ChunkUploader;
+
+//
+// Parts of a delta upload, built in the thread pool
+//
+class DeltaPlan : public QObject
+{
+	Q_OBJECT
+
+public:
+	struct Part
+	{
+		qint64 offset;
+		qint64 size;
+		// Offset of the same data in the base file, -1 if the data is sent
+		qint64 baseOffset;
+	};
+
+	DeltaPlan() : ok(false) {}
+
+	bool ok;
+	QVector<Part> parts;
+
+	Q_SIGNAL void ready();
+};
+
+//
+// Uploads a file by chunks, several chunks at once. The server assembles
+// the file when the last chunk is received, so the last chunk is sent
+// after all the others have been acknowledged. The acknowledged chunks are
+// saved in an UploadSession to resume the upload after a failure.
+//
+// A new version of a large file may be uploaded as a delta against the
+// current remote version: the blocks already present in the remote file
+// are sent as references to it, only the changed blocks carry data.
+//
+// Uploads share the rate of RateLimiter::uploads(), a chunk is started
+// when the data of the previous chunks is paid for.
+//
 class FileUploader : public QObject
 {
 	Q_OBJECT
@@ -17,15 +60,58 @@ class FileUploader : public QObject
 public:
 	FileUploader(int folderId, const QString& filePath, QObject* parent = nullptr);
 
+	// Uploads the file as a delta against baseFile,
+	// see canUploadDelta()
+	FileUploader(int folderId, const QString& filePath,
+			const RemoteFileDesc& baseFile, QObject* parent = nullptr);
+
+	virtual ~FileUploader();
+
+	// The server supports delta uploads and the block signature of the
+	// remote file is known
+	static bool canUploadDelta(const QString& filePath,
+			const RemoteFileDesc& baseFile);
+
 	Q_SIGNAL void succeeded(Drive::RemoteFileDesc fileDesc);
 	Q_SIGNAL void failed(const QString& error);
 
 private:
+	bool init();
+	void startFixedChunks();
+	Q_SLOT void onDeltaPlanReady();
+
+	void scheduleNext();
+	void startChunk(int chunkIndex);
+	void fail(QNetworkReply::NetworkError code);
+
+	void onChunkFinished(int chunkIndex, ChunkUploader* uploader,
+			const QByteArray& data);
+	void onChunkError(int chunkIndex, ChunkUploader* uploader,
+			QNetworkReply::NetworkError code);
+
 	Q_SLOT void onFinished(const QByteArray& data);
 	Q_SLOT void onError(QNetworkReply::NetworkError code);
 
 private:
-	QFile* m_file;
+	const QString m_filePath;
+	const int m_folderId;
+	qint64 m_fileSize;
+
+	UploadSession m_session;
+	QString m_uuid;
+	qint64 m_chunkSize;
+	int m_chunksTotal;
+	int m_lastChunkIndex;
+	bool m_lastChunkStarted;
+	bool m_failed;
+
+	QList<int> m_pendingChunks;
+	QSet<int> m_retryingChunks;
+	QHash<int, ChunkUploader*> m_activeChunks;
+	QHash<int, int> m_attempts;
+
+	RemoteFileDesc m_baseFile;
+	QSharedPointer<DeltaPlan> m_deltaPlan;
 };
 
 }
@@ -1,6 +1,7 @@
 ﻿#include "FilesService.h"
 
 #include "Settings/settings.h"
+#include "Application/AppController.h"
 #include "APIClient/ApiTypes.h"
 #include <Util/FileUtils.h>
 
@@ -277,11 +278,18 @@ bool CreateRestResource::processPostResponse(int status,
 
 //----------------------------------------------------------------------------
 
+GetChildrenResource::PathResolver GetChildrenResource::s_pathResolver;
+
 GetChildrenResourceRef GetChildrenResource::create()
 {
 	return RestResource::create<GetChildrenResource>();
 }
 
+void GetChildrenResource::setPathResolver(const PathResolver& resolver)
+{
+	s_pathResolver = resolver;
+}
+
 
 void GetChildrenResource::getChildren(int parentId)
 {
@@ -312,6 +320,27 @@ void GetChildrenResource::getFileObjectId(const QString& remotePath)
 		return;
 	}
 
+	if (s_pathResolver)
+	{
+		// Look up only the part of the path below the deepest known folder
+		for (int size = list.size(); size >= 2; --size)
+		{
+			int id = 0;
+			if (s_pathResolver(QStringList(list.mid(0, size)).join("/"), id))
+			{
+				if (size == list.size())
+				{
+					emit getFileObjectIdSucceeded(id);
+					return;
+				}
+
+				currentItem = size - 1;
+				getNextChildId(id);
+				return;
+			}
+		}
+	}
+
 	getFirstChildId();
 }
 
@@ -424,6 +453,7 @@ void GetChildrenResource::getNextChildId(int parentId)
 	{
 		QLOG_ERROR() << "Failed to get file object id for" << remotePath;
 		emit getFileObjectIdFailed();
+		return;
 	}
 
 	GetChildIdResourceRef getChildIdResource = GetChildIdResource::create();
@@ -479,6 +509,31 @@ void GetChildIdResource::getChildId(int parentId,
 	getChildId(QString::number(parentId), fileObjectName);
 }
 
+QHash<QString, GetChildIdResource::PendingLookups>
+	GetChildIdResource::s_pendingLookups;
+
+namespace
+{
+
+// A listing which hasn't finished for so long is considered lost
+const qint64 s_pendingLookupTimeoutMSec = 60 * 1000;
+
+}
+
+GetChildIdResource::GetChildIdResource()
+	: listingRequested(false)
+{
+}
+
+GetChildIdResource::~GetChildIdResource()
+{
+	// The lookups waiting for the listing of this resource would never finish
+	if (listingRequested)
+	{
+		finishLookups(parentId, QHash<QString, int>(), false);
+	}
+}
+
 void GetChildIdResource::getChildId(const QString& parentId,
 									const QString& fileObjectName)
 {
@@ -488,6 +543,20 @@ void GetChildIdResource::getChildId(const QString& parentId,
 	this->parentId = parentId;
 	this->fileObjectName = fileObjectName;
 
+	auto pendingIt = s_pendingLookups.find(parentId);
+	if (pendingIt != s_pendingLookups.end()
+		&& !pendingIt->timer.hasExpired(s_pendingLookupTimeoutMSec))
+	{
+		// The listing of the parent is requested already
+		pendingIt->lookups.append(this);
+		return;
+	}
+
+	PendingLookups& pending = s_pendingLookups[parentId];
+	pending.timer.start();
+	pending.lookups.append(this);
+	listingRequested = true;
+
 	HeaderList headers;
 	QByteArray data;
 
@@ -513,33 +582,28 @@ bool GetChildIdResource::processGetResponse(int status,
 											const QByteArray& data,
 											const HeaderList&)
 {
-//	QLOG_TRACE() << "get child id get: " << status << "."
-//		<< headers << data;
+	QHash<QString, int> children;
+	listingRequested = false;
 
 	if (status != 200)
 	{
 		QLOG_ERROR() << "GetChildIdResource failed to getChildren";
-		emit failed();
+		finishLookups(parentId, children, false);
 		return true;
 	}
 
 	QString json = getDataFromJson(data);
 	QJsonDocument jsonDoc = QJsonDocument::fromJson(json.toUtf8());
 
-	QString parsingError = "Failed to parse getChildren JSON";
-	QString searchError =
-		"Failed to find " + fileObjectName + " in " + parentId;
-
 	if (!jsonDoc.isArray())
 	{
-		QLOG_ERROR() << parsingError;
-		emit failed();
+		QLOG_ERROR() << "Failed to parse getChildren JSON";
+		finishLookups(parentId, children, false);
+		return true;
 	}
 
 	QJsonArray jsonArray = jsonDoc.array();
 
-	int id = 0;
-
 	for (int i = 0; i < jsonArray.size(); i++)
 	{
 		QJsonValue value = jsonArray.at(i);
@@ -550,16 +614,36 @@ bool GetChildIdResource::processGetResponse(int status,
 
 			if (remoteFileDesc.isValid())
 			{
-//				QLOG_TRACE() << "!!!fileObjectName: " << fileObjectName;
-//				remoteFileDesc.log();
-				if (remoteFileDesc.name == fileObjectName)
-				{
-					id = remoteFileDesc.id;
-				}
+				children.insert(remoteFileDesc.name, remoteFileDesc.id);
 			}
 		}
 	}
 
+	finishLookups(parentId, children, true);
+
+	return true;
+}
+
+void GetChildIdResource::finishLookups(const QString& parentId,
+	const QHash<QString, int>& children, const bool ok)
+{
+	const QList<QPointer<GetChildIdResource> > lookups =
+		s_pendingLookups.take(parentId).lookups;
+
+	for (const QPointer<GetChildIdResource>& lookup : lookups)
+	{
+		if (lookup)
+		{
+			lookup->finishLookup(children, ok);
+		}
+	}
+}
+
+void GetChildIdResource::finishLookup(const QHash<QString, int>& children,
+	const bool ok)
+{
+	const int id = ok ? children.value(fileObjectName) : 0;
+
 	if (id)
 	{
 		QLOG_TRACE() << this << "GetChildIdResource id found:" << id;
@@ -567,9 +651,106 @@ bool GetChildIdResource::processGetResponse(int status,
 	}
 	else
 	{
-		QLOG_ERROR() << searchError;
+		QLOG_ERROR() << "Failed to find " + fileObjectName + " in " + parentId;
 		emit failed();
 	}
+}
+
+//----------------------------------------------------------------------------
+
+bool GetChildrenBatchResource::s_rejected = false;
+
+GetChildrenBatchResourceRef GetChildrenBatchResource::create()
+{
+	return RestResource::create<GetChildrenBatchResource>();
+}
+
+bool GetChildrenBatchResource::isSupported()
+{
+	return !s_rejected
+		&& AppController::instance().hasRemoteFeature("batch_children");
+}
+
+void GetChildrenBatchResource::getChildren(const QList<int>& parentIds)
+{
+	Q_ASSERT(!parentIds.isEmpty() && parentIds.size() <= maxBatchSize);
+
+	this->parentIds = parentIds;
+
+	QJsonArray idsArray;
+	for (const int id : parentIds)
+	{
+		idsArray.append(id);
+	}
+
+	QJsonObject dataObject;
+	dataObject.insert("ids", idsArray);
+
+	ParamList params;
+	params.append(ParamPair("data",
+		QJsonDocument(dataObject).toJson(QJsonDocument::Compact)));
+
+	doOperation(QNetworkAccessManager::PostOperation, params, HeaderList());
+}
+
+QString GetChildrenBatchResource::path() const
+{
+	return QString("/api/v1/files/getChildrenBatch");
+}
+
+QString GetChildrenBatchResource::service() const
+{
+	return FILES_SERVICE_NAME;
+}
+
+bool GetChildrenBatchResource::restricted() const
+{
+	return true;
+}
+
+bool GetChildrenBatchResource::processPostResponse(int status,
+	const QByteArray& data, const HeaderList&)
+{
+	if (status == 404 || status == 405 || status == 501)
+	{
+		QLOG_INFO() << "Batch listing is not supported by the server";
+		s_rejected = true;
+		emit unsupported(parentIds);
+		return true;
+	}
+
+	if (status != 200)
+	{
+		emit failed();
+		return true;
+	}
+
+	// data: { "<parent id>": [ <file object>, ... ], ... }
+	const QJsonDocument doc = QJsonDocument::fromJson(data);
+	const QJsonObject dataObject = doc.object().value("data").toObject();
+
+	QHash<int, QList<RemoteFileDesc> > children;
+	for (auto it = dataObject.constBegin(); it != dataObject.constEnd(); ++it)
+	{
+		bool ok = false;
+		const int parentId = it.key().toInt(&ok);
+		if (!ok || !it.value().isArray())
+		{
+			continue;
+		}
+
+		QList<RemoteFileDesc>& list = children[parentId];
+		for (const QJsonValue& value : it.value().toArray())
+		{
+			const RemoteFileDesc fileDesc = RemoteFileDesc::fromJson(value.toObject());
+			if (fileDesc.isValid())
+			{
+				list << fileDesc;
+			}
+		}
+	}
+
+	emit succeeded(children);
 
 	return true;
 }
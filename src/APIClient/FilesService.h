@@ -6,6 +6,11 @@
 
 #include <QtCore/QVariantMap>
 #include <QtCore/QStringList>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QPointer>
+
+#include <functional>
 
 class QJsonObject;
 
@@ -122,8 +127,16 @@ class GetChildrenResource : public RestResource
 {
 	Q_OBJECT
 public:
+	// Resolves a remote path to a file object id without the network,
+	// returns false if the path is unknown
+	typedef std::function<bool (const QString& remotePath, int& id)> PathResolver;
+
 	static GetChildrenResourceRef create();
 
+	// getFileObjectId() resolves the longest known prefix of the path with
+	// the resolver and looks up the rest of the path only
+	static void setPathResolver(const PathResolver& resolver);
+
 	void getChildren(const QString& parentId);
 	void getChildren(int parentId);
 
@@ -156,6 +169,8 @@ private:
 	QStringList list;
 	int currentItem;
 	GetChildIdResourceRef res;
+
+	static PathResolver s_pathResolver;
 };
 
 class GetChildIdResource : public RestResource
@@ -164,6 +179,9 @@ class GetChildIdResource : public RestResource
 public:
 	static GetChildIdResourceRef create();
 
+	GetChildIdResource();
+	virtual ~GetChildIdResource();
+
 	void getChildId(const QString& parentId, const QString& fileObjectName);
 	void getChildId(int parentId, const QString& fileObjectName);
 
@@ -178,8 +196,64 @@ signals:
 private:
 	virtual bool processGetResponse(int status, const QByteArray& data, const HeaderList&);
 
+	// Reports the listing of the parent to all the lookups waiting for it
+	static void finishLookups(const QString& parentId,
+		const QHash<QString, int>& children, bool ok);
+	void finishLookup(const QHash<QString, int>& children, bool ok);
+
 	QString parentId;
 	QString fileObjectName;
+	// The listing request is sent by this resource
+	bool listingRequested;
+
+	// Concurrent lookups in the same parent share one listing request
+	struct PendingLookups
+	{
+		QElapsedTimer timer;
+		QList<QPointer<GetChildIdResource> > lookups;
+	};
+
+	// parent id -> lookups waiting for the listing
+	static QHash<QString, PendingLookups> s_pendingLookups;
+};
+
+class GetChildrenBatchResource;
+typedef QSharedPointer<GetChildrenBatchResource> GetChildrenBatchResourceRef;
+
+// Lists the children of several folders in a single request.
+// The endpoint is optional on the server, it is used only when the remote
+// config advertises it and until the server rejects it.
+class GetChildrenBatchResource : public RestResource
+{
+	Q_OBJECT
+public:
+	static GetChildrenBatchResourceRef create();
+
+	static bool isSupported();
+
+	static const int maxBatchSize = 50;
+
+	void getChildren(const QList<int>& parentIds);
+
+	virtual QString path() const;
+	virtual QString service() const;
+	virtual bool restricted() const;
+
+signals:
+	// Folders missing in the reply are not listed
+	void succeeded(const QHash<int, QList<Drive::RemoteFileDesc> >& children);
+	void failed();
+	// The server has no batch endpoint, the folders should be listed
+	// one by one
+	void unsupported(const QList<int>& parentIds);
+
+private:
+	virtual bool processPostResponse(int status, const QByteArray& data,
+		const HeaderList&);
+
+	QList<int> parentIds;
+
+	static bool s_rejected;
 };
 
 class MoveRestResource;
@@ -1,19 +1,61 @@
 ﻿#include "NotificationService.h"
+#include "NotificationStream.h"
 
 #include "Application/AppController.h"
 #include "APIClient/ApiTypes.h"
+#include "Network/RestDispatcher.h"
 
 #include "QsLog/QsLog.h"
 
 #include <QtCore/QJsonDocument>
 #include <QtCore/QJsonArray>
+#include <QtCore/QDateTime>
 #include <QtCore/QJsonObject>
+#include <QtCore/QTimer>
 
 using namespace std;
 
 namespace Drive
 {
 
+namespace
+{
+
+// Failures in a row after which the stream is given up for long polling
+const int s_maxStreamFailures = 3;
+const int s_streamRetryDelayMSec = 2000;
+// The stream is tried again after this time of long polling
+const qint64 s_longPollTimeMSec = 10 * 60 * 1000;
+
+// The notification server keeps this many latest events of a channel,
+// and drops the channel history after it has been idle for an hour
+const int s_historyLength = 30;
+const uint s_historyTimeSec = 3600;
+
+uint cursorTime(const QString& cursor)
+{
+	return cursor.section(QLatin1Char('.'), 0, 0).toUInt();
+}
+
+}
+
+NotificationResource::NotificationResource()
+	: m_stream(new NotificationStream(this))
+	, m_streamFailures(0)
+	, m_stopped(false)
+	, m_catchingUp(false)
+	, m_catchUpStarted(false)
+	, m_catchUpEvents(0)
+	, m_catchUpSince(0)
+{
+	connect(m_stream, &NotificationStream::received,
+			this, &NotificationResource::processEvent);
+	connect(m_stream, &NotificationStream::ended,
+			this, &NotificationResource::onStreamEnded);
+	connect(m_stream, &NotificationStream::failed,
+			this, &NotificationResource::onStreamFailed);
+}
+
 NotificationResourceRef NotificationResource::create()
 {
 	NotificationResourceRef resource =
@@ -24,15 +66,132 @@ NotificationResourceRef NotificationResource::create()
 
 void NotificationResource::listenRemoteFileEvents()
 {
-	string idValue = AppController::instance().serviceChannel().toStdString();
-	if (!lastEventTimestamp.toStdString().empty())
+	ParamList params;
+	params.append(ParamPair("identifier", identifier().toUtf8()));
+
+	m_stopped = false;
+	checkCatchUpStart();
+
+	if (canStream())
 	{
-		idValue = lastEventTimestamp.toStdString() + ":" + idValue;
+		m_streamingSelf = self();
+		m_stream->open(GeneralRestDispatcher::instance().buildUrl(
+			service(), path(), params));
+		return;
 	}
 
-	ParamList params;
-	params.append(ParamPair("identifier", QByteArray(idValue.c_str(), idValue.size())));
 	doOperation(QNetworkAccessManager::GetOperation, params, HeaderList());
+
+	// The request holds the resource now
+	m_streamingSelf.clear();
+}
+
+void NotificationResource::stopListening()
+{
+	m_stopped = true;
+	m_stream->close();
+	m_streamingSelf.clear();
+}
+
+QString NotificationResource::identifier() const
+{
+	// The server sends the events which came after the cursor
+	const QString channel = AppController::instance().serviceChannel();
+	return m_lastEventTimestamp.isEmpty()
+		? channel : m_lastEventTimestamp + ":" + channel;
+}
+
+bool NotificationResource::canStream() const
+{
+	// The service address is known once the services are received,
+	// the long poll request is queued until then
+	return GeneralRestDispatcher::instance().hasService(service())
+		&& (m_streamFailures < s_maxStreamFailures
+			|| m_longPollTimer.hasExpired(s_longPollTimeMSec));
+}
+
+void NotificationResource::checkCatchUpStart()
+{
+	if (!m_catchingUp || m_catchUpStarted)
+	{
+		return;
+	}
+
+	m_catchUpStarted = true;
+
+	const uint now = QDateTime::currentDateTimeUtc().toTime_t();
+	if (now > m_catchUpSince + s_historyTimeSec)
+	{
+		QLOG_INFO() << "Notification cursor is" << now - m_catchUpSince
+			<< "seconds old, the server history is gone.";
+		m_catchingUp = false;
+		Q_EMIT historyGap(m_catchUpSince);
+	}
+}
+
+void NotificationResource::checkCatchUpEnd()
+{
+	if (!m_catchingUp)
+	{
+		return;
+	}
+
+	m_catchingUp = false;
+
+	// A full history means older events may have been dropped
+	QLOG_INFO() << "Caught up on" << m_catchUpEvents << "missed events.";
+	if (m_catchUpEvents >= s_historyLength)
+	{
+		Q_EMIT historyGap(m_catchUpSince);
+	}
+}
+
+void NotificationResource::onStreamEnded()
+{
+	m_streamFailures = 0;
+	checkCatchUpEnd();
+	listenRemoteFileEvents();
+}
+
+void NotificationResource::onStreamFailed()
+{
+	if (++m_streamFailures == s_maxStreamFailures)
+	{
+		QLOG_INFO() << "Notification stream failed" << m_streamFailures
+			<< "times in a row, falling back to long polling.";
+	}
+
+	if (m_streamFailures >= s_maxStreamFailures)
+	{
+		// Long polling until the time is up, then the stream is tried again
+		m_longPollTimer.start();
+		listenRemoteFileEvents();
+		return;
+	}
+
+	QTimer::singleShot(s_streamRetryDelayMSec * m_streamFailures, this,
+		[this]
+		{
+			if (!m_stopped && !m_stream->isOpen())
+			{
+				listenRemoteFileEvents();
+			}
+		});
+}
+
+QString NotificationResource::lastEventTimestamp() const
+{
+	return m_lastEventTimestamp;
+}
+
+void NotificationResource::setLastEventTimestamp(const QString& timestamp)
+{
+	m_lastEventTimestamp = timestamp;
+
+	m_catchingUp = !timestamp.isEmpty();
+	m_catchUpStarted = false;
+	m_catchUpEvents = 0;
+	m_catchUpSince = cursorTime(timestamp);
 }
 
 QString NotificationResource::path() const
@@ -62,6 +221,7 @@ bool NotificationResource::processGetResponse(int status,
 
 	if (data.trimmed().isEmpty())
 	{
+		checkCatchUpEnd();
 		listenRemoteFileEvents();
 		return true;
 	}
@@ -71,6 +231,7 @@ bool NotificationResource::processGetResponse(int status,
 	{
 		QLOG_ERROR()
 				<< "[NotificationResource]: Received data is not a JSON array.";
+		checkCatchUpEnd();
 		listenRemoteFileEvents();
 		return true;
 	}
@@ -93,28 +254,39 @@ bool NotificationResource::processGetResponse(int status,
 
         if (value.type() == QJsonValue::Object)
 		{
-			QJsonObject obj = value.toObject();
-			RemoteFileEvent remoteEvent(RemoteFileEvent::fromJson(obj));
-
-			remoteEvent.log();
-
-			if (remoteEvent.isValid())
-			{
-				emit newRemoteFileEvent(remoteEvent);
-				lastEventTimestamp = remoteEvent.timestamp;
-			}
-			else
-			{
-				QLOG_ERROR() << "NotificationResource: remote event is not valid";
-			}
+			processEvent(value.toObject());
 		}
 	}
 
     QLOG_TRACE() << "NotificationResource::processGetResponse(): END logging JSON response:";
 
+	checkCatchUpEnd();
     listenRemoteFileEvents();
 
 	return true;
 }
 
+void NotificationResource::processEvent(const QJsonObject& object)
+{
+	RemoteFileEvent remoteEvent(RemoteFileEvent::fromJson(object));
+
+	remoteEvent.log();
+
+	if (remoteEvent.isValid())
+	{
+		if (m_catchingUp)
+		{
+			++m_catchUpEvents;
+		}
+
+		emit newRemoteFileEvent(remoteEvent);
+		// The next request starts after the event
+		m_lastEventTimestamp = remoteEvent.timestamp;
+	}
+	else
+	{
+		QLOG_ERROR() << "NotificationResource: remote event is not valid";
+	}
+}
+
 }
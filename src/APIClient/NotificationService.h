@@ -3,36 +3,87 @@
 
 #include "Network/RestResource.h"
 
+#include <QtCore/QElapsedTimer>
+
+class QJsonObject;
+
 #define NOTIFICATION_SERVICE_NAME "NotificationService"
 
 namespace Drive
 {
 
 struct RemoteFileEvent;
+class NotificationStream;
 
 class NotificationResource;
 typedef QSharedPointer<NotificationResource> NotificationResourceRef;
 
+//
+// Listens to the remote events of the workspace. The events come by a
+// NotificationStream on a connection of its own. After a few failures in
+// a row the stream is given up for a while and the events are requested
+// by long polling through the REST dispatcher.
+//
+// Listening from a saved cursor catches up on the events missed since
+// then. The server keeps a short history only, historyGap() reports that
+// some of the events have been lost.
+//
 class NotificationResource : public RestResource
 {
 	Q_OBJECT
 public:
+	NotificationResource();
 
 	static NotificationResourceRef create();
 
 	void listenRemoteFileEvents();
 
+	// Closes the stream, the long poll requests are cancelled
+	// with the rest of the dispatcher requests
+	void stopListening();
+
+	// Timestamp of the last received event, the next request
+	// asks the server only for the events which came after it.
+	// Setting it starts a catch-up from the timestamp.
+	QString lastEventTimestamp() const;
+	void setLastEventTimestamp(const QString& timestamp);
+
 	virtual QString path() const;
 	virtual QString service() const;
 	virtual bool restricted() const;
 
 signals:
 	void newRemoteFileEvent(const RemoteFileEvent& event);
+	// The events after the time are not all available
+	void historyGap(uint since);
 
 private:
     virtual bool processGetResponse(int status, const QByteArray& data, const HeaderList&headers);
 
-	QString lastEventTimestamp;
+	QString identifier() const;
+	bool canStream() const;
+	void checkCatchUpStart();
+	void checkCatchUpEnd();
+	void processEvent(const QJsonObject& object);
+	void onStreamEnded();
+	void onStreamFailed();
+
+	QString m_lastEventTimestamp;
+
+	NotificationStream* m_stream;
+	// Keeps the resource alive while it streams, as a request in the
+	// dispatcher queue does while it polls
+	RestResourceRef m_streamingSelf;
+	int m_streamFailures;
+	bool m_stopped;
+	// Since the stream has been given up
+	QElapsedTimer m_longPollTimer;
+
+	// The first response after setLastEventTimestamp() is awaited
+	bool m_catchingUp;
+	bool m_catchUpStarted;
+	int m_catchUpEvents;
+	uint m_catchUpSince;
 };
 
 }
@@ -0,0 +1,207 @@
+﻿#include "NotificationStream.h"
+
+#include "QsLog/QsLog.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QJsonDocument>
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QNetworkRequest>
+
+namespace Drive
+{
+
+namespace
+{
+
+// The server ends an idle response in 5 minutes,
+// a silent connection lasting longer is dead
+const int s_idleTimeoutMSec = 330 * 1000;
+
+}
+
+NotificationStream::NotificationStream(QObject* parent)
+	: QObject(parent)
+	, m_nam(new QNetworkAccessManager(this))
+	, m_reply(nullptr)
+	, m_watchDog([this]
+		{
+			QLOG_ERROR() << "Notification stream is silent for too long.";
+			if (m_reply)
+			{
+				m_reply->abort();
+			}
+		}, s_idleTimeoutMSec)
+	, m_depth(0)
+	, m_inString(false)
+	, m_escaped(false)
+{
+}
+
+NotificationStream::~NotificationStream()
+{
+	close();
+}
+
+void NotificationStream::open(const QUrl& url)
+{
+	close();
+
+	m_depth = 0;
+	m_inString = false;
+	m_escaped = false;
+	m_object.clear();
+
+	QNetworkRequest request(url);
+	request.setRawHeader("User-Agent",
+		QString("Desktop client %1").arg(QCoreApplication::applicationVersion()).toUtf8());
+
+	m_reply = m_nam->get(request);
+	connect(m_reply, &QNetworkReply::readyRead,
+			this, &NotificationStream::onReadyRead);
+	connect(m_reply, &QNetworkReply::finished,
+			this, &NotificationStream::onFinished);
+
+	m_watchDog.restart();
+}
+
+void NotificationStream::close()
+{
+	m_watchDog.stop();
+
+	if (m_reply)
+	{
+		QNetworkReply* reply = m_reply;
+		m_reply = nullptr;
+		reply->disconnect(this);
+		reply->abort();
+		reply->deleteLater();
+	}
+}
+
+bool NotificationStream::isOpen() const
+{
+	return m_reply != nullptr;
+}
+
+void NotificationStream::onReadyRead()
+{
+	m_watchDog.restart();
+	if (!parse(m_reply->readAll()))
+	{
+		close();
+		Q_EMIT failed();
+	}
+}
+
+void NotificationStream::onFinished()
+{
+	QNetworkReply* reply = m_reply;
+	m_reply = nullptr;
+	m_watchDog.stop();
+	reply->deleteLater();
+
+	const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+	if (reply->error() != QNetworkReply::NoError || status != 200)
+	{
+		QLOG_ERROR() << "Notification stream failed, network error:" << reply->error()
+			<< "HTTP status:" << status;
+		Q_EMIT failed();
+		return;
+	}
+
+	if (!parse(reply->readAll()))
+	{
+		Q_EMIT failed();
+		return;
+	}
+
+	Q_EMIT ended();
+}
+
+bool NotificationStream::parse(const QByteArray& data)
+{
+	for (const char c : data)
+	{
+		// Nothing but the arrays of notifications is expected at the top,
+		// an error page or the like is not a stream to be read
+		if (m_depth == 0)
+		{
+			if (c == '[')
+			{
+				m_depth = 1;
+			}
+			else if (c != ' ' && c != '\t' && c != '\r' && c != '\n')
+			{
+				QLOG_ERROR() << "Notification stream is not a JSON array,"
+					<< "unexpected character:" << c;
+				return false;
+			}
+			continue;
+		}
+
+		// Only the objects in the top array are kept, the separators
+		// and the whitespace around them are skipped
+		if (m_depth >= 2)
+		{
+			m_object.append(c);
+		}
+
+		if (m_inString)
+		{
+			if (m_escaped)
+			{
+				m_escaped = false;
+			}
+			else if (c == '\\')
+			{
+				m_escaped = true;
+			}
+			else if (c == '"')
+			{
+				m_inString = false;
+			}
+			continue;
+		}
+
+		switch (c)
+		{
+		case '"':
+			m_inString = true;
+			break;
+
+		case '[':
+		case '{':
+			if (++m_depth == 2)
+			{
+				m_object = QByteArray(1, c);
+			}
+			break;
+
+		case ']':
+		case '}':
+			if (--m_depth == 1)
+			{
+				QJsonParseError error;
+				const QJsonDocument doc = QJsonDocument::fromJson(m_object, &error);
+				if (doc.isObject())
+				{
+					Q_EMIT received(doc.object());
+				}
+				else if (error.error != QJsonParseError::NoError)
+				{
+					QLOG_ERROR() << "Notification is not valid JSON:" << error.errorString();
+				}
+				m_object.clear();
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	return true;
+}
+
+}
@@ -0,0 +1,64 @@
+﻿#ifndef NOTIFICATION_STREAM_H
+#define NOTIFICATION_STREAM_H
+
+#include "Util/watchdog.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QJsonObject>
+#include <QtCore/QObject>
+#include <QtCore/QUrl>
+
+class QNetworkAccessManager;
+class QNetworkReply;
+
+namespace Drive
+{
+
+//
+// Receives the notifications on a connection of its own, apart from the
+// REST requests. The response is parsed as it arrives: every object of
+// the JSON arrays received is reported as soon as its closing brace is
+// read, the response as a whole is never buffered.
+//
+// A server holding the response open delivers all the batches on a single
+// request. A server ending the response after a batch, as the realplexor
+// does, reports ended() and the owner asks again with the new cursor.
+//
+class NotificationStream : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit NotificationStream(QObject* parent = nullptr);
+	virtual ~NotificationStream();
+
+	void open(const QUrl& url);
+	void close();
+	bool isOpen() const;
+
+	Q_SIGNAL void received(const QJsonObject& object);
+	// The response is over, everything in it has been received
+	Q_SIGNAL void ended();
+	Q_SIGNAL void failed();
+
+private:
+	void onReadyRead();
+	void onFinished();
+	// False once the data isn't a JSON array of objects
+	bool parse(const QByteArray& data);
+
+private:
+	QNetworkAccessManager* m_nam;
+	QNetworkReply* m_reply;
+	WatchDog m_watchDog;
+
+	// Nesting of the JSON value being read, 1 inside of the top array
+	int m_depth;
+	bool m_inString;
+	bool m_escaped;
+	QByteArray m_object;
+};
+
+}
+
+#endif // NOTIFICATION_STREAM_H
@@ -0,0 +1,185 @@
+﻿#include "UploadSession.h"
+
+#include "QsLog/QsLog.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QUuid>
+
+namespace Drive
+{
+
+namespace
+{
+
+const QString s_filePath = QLatin1String("filePath");
+const QString s_folderId = QLatin1String("folderId");
+const QString s_fileSize = QLatin1String("fileSize");
+const QString s_modifiedAt = QLatin1String("modifiedAt");
+const QString s_uuid = QLatin1String("uuid");
+const QString s_chunkSize = QLatin1String("chunkSize");
+const QString s_chunksDone = QLatin1String("chunksDone");
+
+}
+
+UploadSession::UploadSession()
+	: m_folderId(0)
+	, m_fileSize(0)
+	, m_modifiedAt(0)
+	, m_chunkSize(0)
+{
+}
+
+UploadSession UploadSession::load(const QString& filePath, const int folderId,
+	const qint64 fileSize, const uint modifiedAt)
+{
+	QFile file(sessionFilePath(filePath, folderId));
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		return UploadSession();
+	}
+
+	const QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+	if (!doc.isObject())
+	{
+		return UploadSession();
+	}
+
+	const QJsonObject obj = doc.object();
+
+	UploadSession session;
+	session.m_filePath = obj.value(s_filePath).toString();
+	session.m_folderId = obj.value(s_folderId).toInt();
+	session.m_fileSize = static_cast<qint64>(obj.value(s_fileSize).toDouble());
+	session.m_modifiedAt = static_cast<uint>(obj.value(s_modifiedAt).toDouble());
+	session.m_uuid = obj.value(s_uuid).toString();
+	session.m_chunkSize = static_cast<qint64>(obj.value(s_chunkSize).toDouble());
+
+	Q_FOREACH(const QJsonValue& value, obj.value(s_chunksDone).toArray())
+	{
+		session.m_chunksDone.insert(value.toInt());
+	}
+
+	if (session.m_filePath != filePath
+		|| session.m_folderId != folderId
+		|| session.m_fileSize != fileSize
+		|| session.m_modifiedAt != modifiedAt
+		|| !session.isValid())
+	{
+		// The file has been changed, the uploaded chunks are useless
+		session.remove();
+		return UploadSession();
+	}
+
+	return session;
+}
+
+UploadSession UploadSession::create(const QString& filePath, const int folderId,
+	const qint64 fileSize, const uint modifiedAt, const qint64 chunkSize)
+{
+	Q_ASSERT(chunkSize > 0);
+
+	UploadSession session;
+	session.m_filePath = filePath;
+	session.m_folderId = folderId;
+	session.m_fileSize = fileSize;
+	session.m_modifiedAt = modifiedAt;
+	session.m_uuid = QUuid::createUuid().toString();
+	session.m_chunkSize = chunkSize;
+	return session;
+}
+
+bool UploadSession::isValid() const
+{
+	return !m_uuid.isEmpty() && m_chunkSize > 0;
+}
+
+QString UploadSession::uuid() const
+{
+	return m_uuid;
+}
+
+qint64 UploadSession::chunkSize() const
+{
+	return m_chunkSize;
+}
+
+int UploadSession::chunksTotal() const
+{
+	Q_ASSERT(m_chunkSize > 0);
+
+	// An empty file is uploaded as a single empty chunk
+	return qMax<qint64>(1, (m_fileSize + m_chunkSize - 1) / m_chunkSize);
+}
+
+bool UploadSession::isChunkDone(const int chunkIndex) const
+{
+	return m_chunksDone.contains(chunkIndex);
+}
+
+void UploadSession::setChunkDone(const int chunkIndex)
+{
+	m_chunksDone.insert(chunkIndex);
+}
+
+int UploadSession::chunksDone() const
+{
+	return m_chunksDone.size();
+}
+
+bool UploadSession::save() const
+{
+	Q_ASSERT(isValid());
+
+	QJsonArray chunksDone;
+	Q_FOREACH(const int chunkIndex, m_chunksDone)
+	{
+		chunksDone.append(chunkIndex);
+	}
+
+	QJsonObject obj;
+	obj.insert(s_filePath, m_filePath);
+	obj.insert(s_folderId, m_folderId);
+	obj.insert(s_fileSize, static_cast<double>(m_fileSize));
+	obj.insert(s_modifiedAt, static_cast<double>(m_modifiedAt));
+	obj.insert(s_uuid, m_uuid);
+	obj.insert(s_chunkSize, static_cast<double>(m_chunkSize));
+	obj.insert(s_chunksDone, chunksDone);
+
+	QSaveFile file(sessionFilePath(m_filePath, m_folderId));
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		QLOG_ERROR() << "Can't save upload session: " << file.errorString();
+		return false;
+	}
+
+	file.write(QJsonDocument(obj).toJson(QJsonDocument::Compact));
+	return file.commit();
+}
+
+void UploadSession::remove() const
+{
+	QFile::remove(sessionFilePath(m_filePath, m_folderId));
+}
+
+QString UploadSession::sessionFilePath(const QString& filePath, const int folderId)
+{
+	const QString dirPath = QDir(QStandardPaths::writableLocation(
+		QStandardPaths::DataLocation)).filePath(QLatin1String("uploads"));
+	QDir dir;
+	dir.mkpath(dirPath);
+
+	const QByteArray key = QCryptographicHash::hash(
+		QString("%1:%2").arg(folderId).arg(filePath).toUtf8(),
+		QCryptographicHash::Md5).toHex();
+
+	return QDir(dirPath).filePath(QString::fromLatin1(key) + ".json");
+}
+
+}
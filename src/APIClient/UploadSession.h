@@ -0,0 +1,56 @@
+﻿#ifndef UPLOAD_SESSION_H
+#define UPLOAD_SESSION_H
+
+#include <QtCore/QString>
+#include <QtCore/QSet>
+
+namespace Drive
+{
+
+//
+// Persistent state of a chunked upload: the upload uuid, the chunk size and
+// the indexes of the chunks acknowledged by the server. An interrupted
+// upload of an unchanged file resumes from the acknowledged chunks.
+//
+class UploadSession
+{
+public:
+	UploadSession();
+
+	// Returns an invalid session if there is no saved session for the file
+	// or the file has been changed since the session was saved.
+	static UploadSession load(const QString& filePath, int folderId,
+			qint64 fileSize, uint modifiedAt);
+
+	static UploadSession create(const QString& filePath, int folderId,
+			qint64 fileSize, uint modifiedAt, qint64 chunkSize);
+
+	bool isValid() const;
+
+	QString uuid() const;
+	qint64 chunkSize() const;
+	int chunksTotal() const;
+
+	bool isChunkDone(int chunkIndex) const;
+	void setChunkDone(int chunkIndex);
+	int chunksDone() const;
+
+	bool save() const;
+	void remove() const;
+
+private:
+	static QString sessionFilePath(const QString& filePath, int folderId);
+
+	QString m_filePath;
+	int m_folderId;
+	qint64 m_fileSize;
+	uint m_modifiedAt;
+
+	QString m_uuid;
+	qint64 m_chunkSize;
+	QSet<int> m_chunksDone;
+};
+
+}
+
+#endif // UPLOAD_SESSION_H
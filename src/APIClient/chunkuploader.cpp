@@ -4,11 +4,13 @@
 
 #include "Application/AppController.h"
 #include "Network/RestResource.h"
+#include "Util/FileRegionDevice.h"
 
-#include <QtCore/QUuid>
+#include <QtCore/QCoreApplication>
 #include <QtCore/QFileInfo>
 #include <QtCore/QJsonDocument>
 #include <QtCore/QJsonObject>
+#include <QtCore/QTimer>
 
 #include <QtNetwork/QHttpMultiPart>
 #include <QtNetwork/QHttpPart>
@@ -37,6 +39,14 @@ QNetworkRequest createRequest()
 	return request;
 }
 
+QNetworkAccessManager& network()
+{
+	// All the chunks share the connection pool of one manager
+	static QNetworkAccessManager* s_network =
+			new QNetworkAccessManager(QCoreApplication::instance());
+	return *s_network;
+}
+
 QHttpPart createHttpPart(const char* name, const QVariant& body)
 {
 	static const auto s_header = QString::fromLatin1("form-data; name=\"%1\"");
@@ -52,21 +62,32 @@ QHttpPart createHttpPart(const char* name, const QVariant& body)
 }
 
 ChunkUploader::ChunkUploader(const QString& uuid,
-		QFile& file, const int offset, const int size,
+		const QString& filePath, const qint64 fileSize,
+		const qint64 offset, const qint64 size,
 		const int chunkIndex, const int totalChunks,
 		const int folderId, QObject* parent)
 	: QObject(parent)
 	, m_uuid(uuid)
-	, m_file(file)
+	, m_filePath(filePath)
+	, m_fileSize(fileSize)
 	, m_offset(offset)
 	, m_size(size)
 	, m_folderId(folderId)
 	, m_chunkIndex(chunkIndex)
 	, m_chunksTotal(totalChunks)
+	, m_baseFileId(0)
+	, m_baseOffset(-1)
 	, m_networkReply(nullptr)
+	, m_httpStatus(0)
+	, m_elapsed(0)
 	, m_watchDog([this] { QLOG_ERROR() << "Connection has been lost."; m_networkReply->abort(); })
 {
-	Q_ASSERT(m_file.isOpen());
+}
+
+void ChunkUploader::setBase(const int baseFileId, const qint64 baseOffset)
+{
+	m_baseFileId = baseFileId;
+	m_baseOffset = baseOffset;
 }
 
 void ChunkUploader::start()
@@ -75,67 +96,115 @@ void ChunkUploader::start()
 			"%1 Chunk uploading started.");
 	QLOG_INFO() << s_message.arg(state());
 
+	Q_ASSERT(!m_networkReply);
+
 	const auto request = createRequest();
 	const auto multiPart = createHttpMultiPart();
+	if (!multiPart)
+	{
+		// Let the owner connect to the signals before the failure
+		QTimer::singleShot(0, this, [this]
+			{
+				Q_EMIT error(QNetworkReply::ContentAccessDenied);
+			});
+		return;
+	}
 
-	m_networkReply = m_network.post(request, multiPart);
+	m_timer.start();
+	m_networkReply = network().post(request, multiPart);
 	Q_ASSERT(m_networkReply);
 
 	// delete the multiPart with the reply
 	multiPart->setParent(m_networkReply);
 
+	// QNetworkReply::error is always followed by QNetworkReply::finished,
+	// so the errors are handled in onFinished only
 	connect(m_networkReply, &QNetworkReply::finished,
 			this, &ChunkUploader::onFinished);
 
-	connect(m_networkReply, static_cast<void (QNetworkReply::*)(QNetworkReply::NetworkError)>(&QNetworkReply::error),
-			this, &ChunkUploader::onError);
+	connect(m_networkReply, &QNetworkReply::uploadProgress,
+			this, &ChunkUploader::onUploadProgress);
 
-	connect(m_networkReply, &QNetworkReply::finished,
-			&m_watchDog, &WatchDog::stop);
-	connect(m_networkReply, static_cast<void (QNetworkReply::*)(QNetworkReply::NetworkError)>(&QNetworkReply::error),
-			&m_watchDog, &WatchDog::stop);
+	m_watchDog.restart();
+}
+
+void ChunkUploader::abort()
+{
+	m_watchDog.stop();
+
+	if (m_networkReply)
+	{
+		QNetworkReply* networkReply = m_networkReply;
+		m_networkReply = nullptr;
+
+		networkReply->disconnect(this);
+		networkReply->abort();
+		networkReply->deleteLater();
+	}
+}
+
+qint64 ChunkUploader::size() const
+{
+	return m_size;
+}
+
+int ChunkUploader::httpStatus() const
+{
+	return m_httpStatus;
+}
+
+qint64 ChunkUploader::elapsed() const
+{
+	return m_elapsed;
+}
 
+void ChunkUploader::onUploadProgress(qint64, qint64)
+{
+	// A slow but alive connection mustn't be treated as a lost one
 	m_watchDog.restart();
 }
 
 void ChunkUploader::onFinished()
 {
-	const auto status = m_networkReply->attribute(
+	Q_ASSERT(m_networkReply);
+
+	m_watchDog.stop();
+	m_elapsed = m_timer.elapsed();
+
+	QNetworkReply* networkReply = m_networkReply;
+	m_networkReply = nullptr;
+	networkReply->deleteLater();
+
+	m_httpStatus = networkReply->attribute(
 			QNetworkRequest::HttpStatusCodeAttribute).toInt();
 
-	if (status == 200)
+	const QNetworkReply::NetworkError code = networkReply->error();
+
+	if (code == QNetworkReply::NoError && m_httpStatus == 200)
 	{
 		static const auto s_message = QString::fromLatin1(
-				"%1 Chunk uploading finished successfully."
-				" Network reply data received: '%2'.");
-		const QByteArray replyData = m_networkReply->readAll();
-		QLOG_INFO() << s_message.arg(state(), QString(replyData));
+				"%1 Chunk uploading finished successfully in %2 ms."
+				" Network reply data received: '%3'.");
+		const QByteArray replyData = networkReply->readAll();
+		QLOG_INFO() << s_message.arg(state(), QString::number(m_elapsed),
+				QString(replyData));
 		Q_EMIT finished(replyData);
 	}
-	else
+	else if (m_httpStatus != 0)
 	{
 		static const auto s_message = QString::fromLatin1(
 				"%1 Chunk uploading failed with http status %2.");
-		QLOG_ERROR() << s_message.arg(state(), QString::number(status));
-		onError(m_networkReply->error());
+		QLOG_ERROR() << s_message.arg(state(), QString::number(m_httpStatus));
+		Q_EMIT error(code != QNetworkReply::NoError
+				? code : QNetworkReply::UnknownContentError);
+	}
+	else
+	{
+		static const auto s_message = QString::fromLatin1(
+				"%1 Chunk uploading failed with network error %2.");
+		QLOG_ERROR() << s_message.arg(state(), QString::number(code));
+		Q_EMIT error(code);
 	}
-}
-
-void ChunkUploader::onError(const QNetworkReply::NetworkError code)
-{
-	static const auto s_message = QString::fromLatin1(
-			"%1 Chunk uploading failed with network error %2.");
-	QLOG_ERROR() << s_message.arg(state(), QString::number(code));
-	Q_EMIT error(code);
-}
-
-QByteArray ChunkUploader::read() const
-{
-	Q_ASSERT(m_file.isOpen());
-	Q_ASSERT(m_file.seek(m_offset));
-	const QByteArray data = m_file.read(m_size);
-	Q_ASSERT(data.size() == m_size);
-	return data;
 }
 
 QHttpMultiPart* ChunkUploader::createHttpMultiPart() const
@@ -145,16 +214,43 @@ QHttpMultiPart* ChunkUploader::createHttpMultiPart() const
 	data.insert(s_folderId, m_folderId);
 	const auto dataJson = QJsonDocument(data).toJson(QJsonDocument::Compact);
 
-	const QFileInfo fileInfo(m_file);
+	const QFileInfo fileInfo(m_filePath);
+
+	// A reference to the base file carries no data
+	const bool hasData = m_baseOffset < 0;
+
+	// The chunk is streamed from the file by the network access manager
+	auto body = new FileRegionDevice(m_filePath, m_offset, hasData ? m_size : 0);
+	if (!body->open(QIODevice::ReadOnly))
+	{
+		static const auto s_message = QString::fromLatin1(
+				"%1 Can't read the chunk: %2.");
+		QLOG_ERROR() << s_message.arg(state(), body->errorString());
+		delete body;
+		return nullptr;
+	}
 
 	QHttpMultiPart* multiPart =
 		new QHttpMultiPart(QHttpMultiPart::FormDataType);
+
+	// delete the body with the multiPart
+	body->setParent(multiPart);
+
+	if (m_baseFileId != 0)
+	{
+		multiPart->append(createHttpPart("qqbasefileid", m_baseFileId));
+		if (!hasData)
+		{
+			multiPart->append(createHttpPart("qqbaseoffset", m_baseOffset));
+		}
+	}
+
 	multiPart->append(createHttpPart("data", dataJson));
 	multiPart->append(createHttpPart("qqpartindex", m_chunkIndex));
 	multiPart->append(createHttpPart("qqpartbyteoffset", m_offset));
 	multiPart->append(createHttpPart("qqchunksize", m_size));
 	multiPart->append(createHttpPart("qqtotalparts", m_chunksTotal));
-	multiPart->append(createHttpPart("qqtotalfilesize", m_file.size()));
+	multiPart->append(createHttpPart("qqtotalfilesize", m_fileSize));
 	multiPart->append(createHttpPart("qqfilename", fileInfo.fileName()));
 	multiPart->append(createHttpPart("qquuid", m_uuid));
 	multiPart->append(createHttpPart("createdAt", fileInfo.created().toTime_t()));
@@ -165,7 +261,7 @@ QHttpMultiPart* ChunkUploader::createHttpMultiPart() const
 	QHttpPart qqfilePart;
 	qqfilePart.setHeader(QNetworkRequest::ContentDispositionHeader,
 			QVariant(s_qqfile.arg(fileInfo.fileName())));
-	qqfilePart.setBody(read());
+	qqfilePart.setBodyDevice(body);
 	multiPart->append(qqfilePart);
 
 	return multiPart;
@@ -173,9 +269,11 @@ QHttpMultiPart* ChunkUploader::createHttpMultiPart() const
 
 QString ChunkUploader::state() const
 {
-	static const auto s_message = QString::fromLatin1("[%1:%2:%3]");
+	static const auto s_message = QString::fromLatin1("[%1:%2/%3:%4:%5]");
 	return s_message.arg(
-			QFileInfo(m_file).fileName(),
+			QFileInfo(m_filePath).fileName(),
+			QString::number(m_chunkIndex + 1),
+			QString::number(m_chunksTotal),
 			QString::number(m_offset),
 			QString::number(m_size));
 }
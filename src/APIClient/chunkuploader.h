@@ -4,7 +4,7 @@
 #include "APIClient/ApiTypes.h"
 #include "watchdog.h"
 
-#include <QtCore/QFile>
+#include <QtCore/QElapsedTimer>
 #include <QtNetwork/QNetworkReply>
 
 namespace Drive
@@ -16,37 +16,58 @@ class ChunkUploader: public QObject
 
 public:
 	ChunkUploader(const QString& uuid,
-			QFile& file, const int offset, const int size,
+			const QString& filePath, const qint64 fileSize,
+			const qint64 offset, const qint64 size,
 			const int chunkIndex, const int totalChunks,
 			const int folderId, QObject* parent = nullptr);
 
+	// Makes the chunk a part of a delta upload against the base file.
+	// A chunk with a non-negative baseOffset carries no data, the server
+	// takes it from the base file at baseOffset.
+	void setBase(int baseFileId, qint64 baseOffset);
+
 	Q_SLOT void start();
 
+	// Cancels the request silently, neither finished nor error is emitted
+	void abort();
+
+	qint64 size() const;
+
+	// Http status of the last reply, 0 if the server hasn't replied
+	int httpStatus() const;
+
+	// Time spent on the request in milliseconds
+	qint64 elapsed() const;
+
 	Q_SIGNAL void finished(const QByteArray& replyData);
 	Q_SIGNAL void error(QNetworkReply::NetworkError);
 
-public:
+private:
 	Q_SLOT void onFinished();
-	Q_SLOT void onError(const QNetworkReply::NetworkError code);
+	Q_SLOT void onUploadProgress(qint64 bytesSent, qint64 bytesTotal);
 
-private:
-	QByteArray read() const;
 	QHttpMultiPart* createHttpMultiPart() const;
 	QString state() const;
 
 private:
 	const QString m_uuid;
 
-	QFile& m_file;
-	const int m_offset;
-	const int m_size;
+	const QString m_filePath;
+	const qint64 m_fileSize;
+	const qint64 m_offset;
+	const qint64 m_size;
 	const int m_folderId;
 
 	const int m_chunkIndex;
 	const int m_chunksTotal;
 
-	QNetworkAccessManager m_network;
+	int m_baseFileId;
+	qint64 m_baseOffset;
+
 	QNetworkReply* m_networkReply;
+	int m_httpStatus;
+	qint64 m_elapsed;
+	QElapsedTimer m_timer;
 
 	WatchDog m_watchDog;
 };
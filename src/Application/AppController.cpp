@@ -24,6 +24,7 @@
 #include "Events/FileEventDispatcher.h"
 #include "Events/Syncer.h"
 #include "Events/Cache.h"
+#include "Events/RemoteTreeCrawler.h"
 
 #include "APIClient/NotificationService.h"
 #include "APIClient/FilesService.h"
@@ -33,10 +34,26 @@
 #include <QtCore/QFile>
 #include <QtCore/QDir>
 #include <QtCore/QFileInfo>
+#include <QtCore/QDateTime>
+#include <QtCore/QStandardPaths>
 
 namespace Drive
 {
 
+namespace
+{
+
+// LocalCache meta data keys
+const QString cacheNotificationCursor = QLatin1String("notificationCursor");
+const QString cacheFolderPath = QLatin1String("folderPath");
+const QString cacheSyncStartCursor = QLatin1String("syncStartCursor");
+
+// Notification cursors are server timestamps, the cursor taken before
+// a full sync steps back a bit to tolerate the clock skew.
+const uint cursorClockSkew = 60;
+
+}
+
 void TrayMenu::showEvent(QShowEvent *event)
 {
     if (!show)
@@ -61,6 +78,7 @@ AppController::AppController(QWidget *parent)
 	: QMainWindow(parent)
 	, currentState(NotAuthorized)
 	, currentAuthToken(QString())
+	, m_syncFinished(false)
 	, m_remoteConfig(new RemoteConfig(Settings::instance().get(Settings::remoteConfig).toString()))
 {
 	GeneralRestDispatcher& dispatcher = GeneralRestDispatcher::instance();
@@ -69,6 +87,17 @@ AppController::AppController(QWidget *parent)
 	connect(m_remoteConfig.get(), &RemoteConfig::services,
 			&dispatcher, &GeneralRestDispatcher::onServices);
 
+	// Remote path lookups start from the deepest folder already cached
+	GetChildrenResource::setPathResolver([] (const QString& remotePath, int& id)
+	{
+		const RemoteFileDesc fileDesc = LocalCache::instance().file(remotePath);
+		if (!fileDesc.isValid())
+			return false;
+
+		id = fileDesc.id;
+		return true;
+	});
+
 	createFolder();
 	createActions();
 	createSettingsWidget();
@@ -131,6 +160,11 @@ const QString AppController::serviceChannel() const
 	return profileData().defaultWorkspace().serviceNotificationChannel();
 }
 
+bool AppController::hasRemoteFeature(const QString& feature) const
+{
+	return m_remoteConfig->hasFeature(feature);
+}
+
 void AppController::setTrayIcon(const QPointer<TrayIcon>& trayIcon)
 {
 	m_trayIcon = trayIcon;
@@ -372,7 +406,8 @@ void AppController::on_actionExit_triggered()
 	QLOG_TRACE() << "Exiting";
 	FileEventDispatcher::instance().cancelAll();
 	LocalFileEventNotifier::instance().stop();
-	LocalCache::instance().clear();
+	LocalCache::instance().close();
+	stopRemoteNotifier();
 	GeneralRestDispatcher::instance().cancelAll();
 	LoginController::instance().closeAll();
     close();
@@ -413,6 +448,7 @@ void AppController::on_settingsWidget_logout()
 	FileEventDispatcher::instance().cancelAll();
 	LocalFileEventNotifier::instance().stop();
 	LocalCache::instance().clear();
+	stopRemoteNotifier();
     GeneralRestDispatcher::instance().cancelAll();
 
     // Wait for events processing to finish
@@ -477,16 +513,63 @@ void AppController::onLoginFinishedImpl(const bool restartFSWatcher)
 				&eventDispatcher, &FileEventDispatcher::addLocalFileEvent);
 	}
 
+	// The stream of the previous notifier isn't cancelled with the requests
+	stopRemoteNotifier();
+
 	NotificationResourceRef remoteNotifier = NotificationResource::create();
 	{
 		connect(remoteNotifier.data(), &NotificationResource::newRemoteFileEvent,
 				&eventDispatcher, &FileEventDispatcher::addRemoteFileEvent);
+		connect(remoteNotifier.data(), &NotificationResource::historyGap,
+				this, &AppController::onNotificationHistoryGap);
 	}
 
-	m_syncer.reset(new Syncer());
+	m_remoteNotifier = remoteNotifier;
+
+	m_syncer.reset(new Syncer(QDir(
+		QStandardPaths::writableLocation(QStandardPaths::DataLocation))
+		.filePath(QString("snapshot_%1.bin")
+			.arg(profileData().defaultWorkspace().id))));
 
 	LocalCache &localCache = LocalCache::instance();
 
+	// Resume from the persistent cache if it describes a completed sync
+	// of the same folder, otherwise walk the whole remote tree.
+	const QString folderPath = QDir::cleanPath(
+		Settings::instance().get(Settings::folderPath).toString());
+	const bool cacheOpened =
+		localCache.open(QString::number(profileData().defaultWorkspace().id));
+	const bool sameFolder = localCache.meta(cacheFolderPath) == folderPath;
+	const bool cacheRestored = cacheOpened && sameFolder
+		&& !localCache.meta(cacheNotificationCursor).isEmpty();
+	// An interrupted full sync goes on from the folders it has not listed yet
+	const bool syncResumed = !cacheRestored && sameFolder
+		&& !localCache.meta(cacheSyncStartCursor).isEmpty()
+		&& RemoteTreeCrawler::hasSavedProgress();
+
+	m_syncFinished = false;
+	m_syncStartCursor = QString::number(
+		QDateTime::currentDateTimeUtc().toTime_t() - cursorClockSkew);
+
+	if (cacheRestored)
+	{
+		remoteNotifier->setLastEventTimestamp(
+			localCache.meta(cacheNotificationCursor));
+	}
+	else if (syncResumed)
+	{
+		// Changes in the folders listed before the interruption
+		// come as notifications
+		m_syncStartCursor = localCache.meta(cacheSyncStartCursor);
+		remoteNotifier->setLastEventTimestamp(m_syncStartCursor);
+	}
+	else
+	{
+		localCache.clear();
+		localCache.setMeta(cacheFolderPath, folderPath);
+		localCache.setMeta(cacheSyncStartCursor, m_syncStartCursor);
+	}
+
 	connect(m_syncer.get(), &Syncer::newRoot, &localCache, &LocalCache::addRoot);
 	connect(m_syncer.get(), &Syncer::newFile, &localCache, &LocalCache::addFile);
 
@@ -494,8 +577,22 @@ void AppController::onLoginFinishedImpl(const bool restartFSWatcher)
 			&eventDispatcher, &FileEventDispatcher::addRemoteFileEvent);
 	connect(m_syncer.get(), &Syncer::newLocalEvent,
 			&eventDispatcher, &FileEventDispatcher::addLocalFileEvent);
+	connect(m_syncer.get(), &Syncer::finished,
+			this, &AppController::onSyncFinished);
 
-	m_syncer->fullSync();
+	if (cacheRestored)
+	{
+		QLOG_INFO() << "Local cache restored, starting incremental sync.";
+		m_syncer->incrementalSync();
+	}
+	else
+	{
+		if (syncResumed)
+		{
+			QLOG_INFO() << "Resuming interrupted full sync.";
+		}
+		m_syncer->fullSync();
+	}
 
 	if (restartFSWatcher)
 	{
@@ -514,9 +611,56 @@ void AppController::onQueueFinished()
     if (LoginController::instance().isLoggedIn())
     {
         setState(Drive::Synced);
+        saveNotificationCursor();
     }
 }
 
+void AppController::onSyncFinished()
+{
+	m_syncFinished = true;
+}
+
+void AppController::onNotificationHistoryGap(const uint since)
+{
+	// A full sync lists everything anyway
+	if (!m_syncFinished || !m_syncer)
+	{
+		return;
+	}
+
+	// The cursor isn't saved until the resync is over, an interrupted
+	// resync starts over from the same cursor
+	m_syncFinished = false;
+	m_syncer->resync(since);
+}
+
+void AppController::saveNotificationCursor()
+{
+	// Every received event has been processed at this point, so the next
+	// start may resume from the cursor instead of syncing everything.
+	if (!m_syncFinished)
+	{
+		return;
+	}
+
+	QSharedPointer<NotificationResource> remoteNotifier =
+		m_remoteNotifier.toStrongRef();
+	if (remoteNotifier.isNull())
+	{
+		return;
+	}
+
+	const QString cursor = remoteNotifier->lastEventTimestamp();
+	LocalCache::instance().setMeta(cacheNotificationCursor,
+		cursor.isEmpty() ? m_syncStartCursor : cursor);
+	LocalCache::instance().setMeta(cacheSyncStartCursor, QString());
+
+	if (m_syncer)
+	{
+		m_syncer->saveLocalSnapshot();
+	}
+}
+
 void AppController::onProcessingProgress(int currentPos, int totalEvents)
 {
 	emit processingProgress(currentPos, totalEvents);
@@ -569,10 +713,21 @@ void AppController::restart()
 
 void AppController::restartRemotesOnly()
 {
+	// The cache is kept, the events missed since the saved cursor are
+	// caught up, the queued ones are dropped and come again
 	FileEventDispatcher::instance().cancelAll();
-	LocalCache::instance().clear();
 	GeneralRestDispatcher::instance().cancelAll();
 	onLoginFinishedImpl(false);
 }
 
+void AppController::stopRemoteNotifier()
+{
+	QSharedPointer<NotificationResource> remoteNotifier =
+		m_remoteNotifier.toStrongRef();
+	if (!remoteNotifier.isNull())
+	{
+		remoteNotifier->stopListening();
+	}
+}
+
 }
@@ -26,6 +26,7 @@ class SettingsWidget;
 class Syncer;
 class LocalCache;
 class RemoteConfig;
+class NotificationResource;
 
 
 class TrayMenu: public QMenu
@@ -56,6 +57,8 @@ public:
 
 	const QString serviceChannel() const;
 
+	bool hasRemoteFeature(const QString& feature) const;
+
 	void setTrayIcon(const QPointer<TrayIcon>& trayIcon);
 
 	void createFolder();
@@ -99,6 +102,8 @@ private slots:
 	void onLoginFinished();
 	void onQueueProcessing();
 	void onQueueFinished();
+	void onSyncFinished();
+	void onNotificationHistoryGap(uint since);
 
 	void onProcessingProgress(int, int);
 
@@ -116,6 +121,9 @@ private:
 
 	void onLoginFinishedImpl(bool restartFSWatcher);
 
+	void saveNotificationCursor();
+	void stopRemoteNotifier();
+
 
 	QPointer<TrayIcon> m_trayIcon;
 
@@ -140,6 +148,9 @@ private:
 	QString currentAuthToken;
 
 	std::unique_ptr<Syncer> m_syncer;
+	bool m_syncFinished;
+	QString m_syncStartCursor;
+	QWeakPointer<NotificationResource> m_remoteNotifier;
 	std::unique_ptr<RemoteConfig> m_remoteConfig;
 };
 
@@ -24,6 +24,11 @@ QString RemoteConfig::updateUrl() const
 	return m_updateUrl;
 }
 
+bool RemoteConfig::hasFeature(const QString& feature) const
+{
+	return m_features.contains(feature);
+}
+
 void RemoteConfig::start()
 {
 	m_downloader.reset(new SimpleDownloader(m_configUrl, SimpleDownloader::Data, this));
@@ -41,6 +46,7 @@ void RemoteConfig::onDownloadFinished(const QByteArray& data)
 	auto doc = QJsonDocument::fromJson(data, &error);
 	if (error.error == QJsonParseError::NoError)
 	{
+		parseFeatures(doc);
 		parseServices(doc);
 		parseUpdate(doc);
 	}
@@ -91,6 +97,24 @@ void RemoteConfig::parseUpdate(const QJsonDocument& doc)
 	}
 }
 
+void RemoteConfig::parseFeatures(const QJsonDocument& doc)
+{
+	static const auto dataKey = QString::fromLatin1("data");
+	static const auto environmentKey = QString::fromLatin1("environment");
+	static const auto featuresKey = QString::fromLatin1("features");
+
+	const QJsonArray featuresArray = doc.object()
+			.value(dataKey).toObject()
+			.value(environmentKey).toObject()
+			.value(featuresKey).toArray();
+
+	m_features.clear();
+	for (const auto& feature: featuresArray)
+	{
+		m_features.insert(feature.toString());
+	}
+}
+
 }
 
 
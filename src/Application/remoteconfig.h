@@ -23,6 +23,9 @@ public:
 
 	QString updateUrl() const;
 
+	// Optional server capabilities listed in environment/features
+	bool hasFeature(const QString& feature) const;
+
 private:
 	void start();
 
@@ -30,12 +33,14 @@ private:
 
 	void parseServices(const QJsonDocument& doc);
 	void parseUpdate(const QJsonDocument& doc);
+	void parseFeatures(const QJsonDocument& doc);
 
 private:
 	std::unique_ptr<SimpleDownloader> m_downloader;
 	QTimer m_timer;
 	QString m_configUrl;
 	QString m_updateUrl;
+	QSet<QString> m_features;
 };
 
 }
@@ -3,6 +3,8 @@
 #include "QsLog/QsLog.h"
 
 #include <QtCore/QMutexLocker>
+#include <QtCore/QDir>
+#include <QtCore/QStandardPaths>
 
 #define DLOG QLOG_DEBUG() << this->toString() << ": "
 #define ERRLOG QLOG_ERROR() << this->toString() << ": "
@@ -17,10 +19,114 @@ LocalCache& LocalCache::instance()
 	return myself;
 }
 
+bool LocalCache::open(const QString& name)
+{
+	LOCK_MUTEX;
+
+	m_journal.close();
+	m_files.clear();
+	m_children.clear();
+	m_paths.clear();
+	m_checkSums.clear();
+	m_meta.clear();
+
+	const QString dirPath =
+		QStandardPaths::writableLocation(QStandardPaths::DataLocation);
+	QDir dir;
+	dir.mkpath(dirPath);
+
+	const QString fileName =
+		QDir(dirPath).filePath(QString("cache_%1.journal").arg(name));
+
+	const bool opened = m_journal.open(fileName,
+		[this](const CacheJournal::Record& record)
+		{
+			applyJournalRecordImpl(record);
+		});
+
+	if (!opened)
+	{
+		return false;
+	}
+
+	DLOG << "Restored " << m_files.size() << " descriptors from "
+		<< fileName << ".";
+
+	compactJournalImpl();
+	return !m_files.isEmpty();
+}
+
+void LocalCache::close()
+{
+	LOCK_MUTEX;
+	compactJournalImpl();
+	m_journal.close();
+	m_files.clear();
+	m_children.clear();
+	m_paths.clear();
+	m_checkSums.clear();
+	m_meta.clear();
+}
+
 void LocalCache::clear()
 {
 	LOCK_MUTEX;
 	m_files.clear();
+	m_children.clear();
+	m_paths.clear();
+	m_checkSums.clear();
+	m_meta.clear();
+	m_journal.reset();
+}
+
+QList<RemoteFileDesc> LocalCache::files() const
+{
+	LOCK_MUTEX;
+	return filesImpl();
+}
+
+QString LocalCache::meta(const QString& key) const
+{
+	LOCK_MUTEX;
+	return m_meta.value(key);
+}
+
+void LocalCache::setMeta(const QString& key, const QString& value)
+{
+	LOCK_MUTEX;
+
+	auto it = m_meta.constFind(key);
+	if (it != m_meta.constEnd() ? it.value() == value : value.isEmpty())
+	{
+		return;
+	}
+
+	if (value.isEmpty())
+	{
+		m_meta.remove(key);
+	}
+	else
+	{
+		m_meta.insert(key, value);
+	}
+
+	m_journal.appendMeta(key, value);
+}
+
+QStringList LocalCache::metaKeys(const QString& prefix) const
+{
+	LOCK_MUTEX;
+
+	QStringList result;
+	for (auto it = m_meta.constBegin(); it != m_meta.constEnd(); ++it)
+	{
+		if (it.key().startsWith(prefix))
+		{
+			result << it.key();
+		}
+	}
+
+	return result;
 }
 
 RemoteFileDesc LocalCache::file(const QString& remotePath, const bool forParent) const
@@ -29,18 +135,16 @@ RemoteFileDesc LocalCache::file(const QString& remotePath, const bool forParent)
 
 	{
 		LOCK_MUTEX;
-		auto it = m_files.find(path);
-		if (it != m_files.end())
+		auto pathIt = m_paths.constFind(path);
+		if (pathIt != m_paths.constEnd())
 		{
-			return it->second;
+			auto it = m_files.constFind(pathIt.value());
+			Q_ASSERT(it != m_files.constEnd());
+			return it->desc;
 		}
 	}
 
-	RemoteFileDesc invalidDesc;
-	invalidDesc.id = 0;
-	invalidDesc.parentId = 0;
-	invalidDesc.name = QString::null;
-	return invalidDesc;
+	return invalidDesc();
 }
 
 RemoteFileDesc LocalCache::file(const int id, const bool forParent) const
@@ -79,143 +183,338 @@ void LocalCache::addRoot(const RemoteFileDesc& file)
 
 bool LocalCache::addFile(const RemoteFileDesc& file)
 {
-	removeById(file.id);
-	const QString path = fullPath(file);
+	LOCK_MUTEX;
 
-    if (!path.isNull())
+	if (!addFileImpl(file))
 	{
-        {
-            LOCK_MUTEX;
-            m_files[path] = file;
-        }
-        return true;
+		return false;
 	}
-    else
-    {
-        QLOG_ERROR() << "LocalCache::addFile() did not add file " << file.name
-                       << " (LocalCache::fullPath() returned null path string)";
-        return false;
-    }
+
+	m_journal.appendPut(file);
+	compactJournalImpl();
+	return true;
+}
+
+bool LocalCache::addFileImpl(const RemoteFileDesc& file)
+{
+	removeByIdImpl(file.id);
+	const QString path = fullPathImpl(file);
+
+	if (path.isNull())
+	{
+		QLOG_ERROR() << "LocalCache::addFile() did not add file " << file.name
+					<< " (parent file not found)";
+		return false;
+	}
+
+	// Another descriptor may still occupy the same path
+	// (e.g. a file which has been trashed and uploaded again).
+	auto shadowedIt = m_paths.constFind(path);
+	if (shadowedIt != m_paths.constEnd())
+	{
+		removeByIdImpl(shadowedIt.value());
+	}
+
+	Node node;
+	node.desc = file;
+	node.path = path;
+	m_files.insert(file.id, node);
+	m_children[file.parentId].insert(file.id);
+	m_paths.insert(path, file.id);
+	if (file.type == RemoteFileDesc::File && !file.checkSum.isEmpty())
+	{
+		m_checkSums.insert(file.checkSum.toLower(), file.id);
+	}
+	return true;
 }
 
 void LocalCache::removeFile(const RemoteFileDesc& file)
 {
-    // Q_ASSERT(file.parentId != -1); ?
+	// Q_ASSERT(file.parentId != -1); ?
 	Q_ASSERT(removeById(file.id));
 }
 
 QString LocalCache::fullPath(const RemoteFileDesc& d) const
 {
-    QString result = QString::null;
-	RemoteFileDesc currentFile = d;
-	for (;;)
+	LOCK_MUTEX;
+	const QString result = fullPathImpl(d);
+	if (result.isNull())
 	{
-		result.prepend(currentFile.name);
-		result.prepend(QLatin1String("/"));
-		if(currentFile.parentId == -1)
+		QLOG_ERROR() << "LocalCache::fullPath() did not find parent file for path "
+					<< QLatin1String("/") + d.name;
+	}
+	return result;
+}
+
+QString LocalCache::findPath(const RemoteFileDesc& d) const
+{
+	LOCK_MUTEX;
+	return fullPathImpl(d);
+}
+
+QString LocalCache::findPath(const int id) const
+{
+	LOCK_MUTEX;
+	auto it = m_files.constFind(id);
+	return it != m_files.constEnd() ? it->path : QString::null;
+}
+
+QVector<QPair<QString, RemoteFileDesc> > LocalCache::filesUnder(
+	const QString& pathPrefix) const
+{
+	LOCK_MUTEX;
+
+	QVector<QPair<QString, RemoteFileDesc> > result;
+
+	// The prefix is a folder path, walk only its subtree
+	QString folderPath = pathPrefix;
+	const bool withFolder = !folderPath.endsWith(QLatin1Char('/'));
+	if (!withFolder)
+	{
+		folderPath.chop(1);
+	}
+
+	auto pathIt = m_paths.constFind(folderPath);
+	if (pathIt == m_paths.constEnd())
+	{
+		return result;
+	}
+
+	QVector<int> pending;
+	pending << pathIt.value();
+	while (!pending.isEmpty())
+	{
+		const int id = pending.takeLast();
+		auto it = m_files.constFind(id);
+		if (it == m_files.constEnd())
+		{
+			continue;
+		}
+
+		if (id != pathIt.value() || withFolder)
 		{
-			result.prepend(QLatin1String("#root"));
-			break;
+			result << qMakePair(it->path, it->desc);
 		}
-		currentFile = fileById(currentFile.parentId);
 
-        if (currentFile.id == 0 && currentFile.parentId ==0 &&
-                currentFile.name == QString::null)
-        {
-            QLOG_ERROR() << "LocalCache::fullPath() did not find parent file for path "
-                       << result;
-            return QString::null;
-        }
+		Q_FOREACH(const int childId, m_children.value(id))
+		{
+			pending << childId;
+		}
 	}
+
 	return result;
 }
 
-RemoteFileDesc LocalCache::fileById(const int id) const
+QList<RemoteFileDesc> LocalCache::children(const int parentId) const
 {
+	LOCK_MUTEX;
+
+	QList<RemoteFileDesc> result;
+	Q_FOREACH(const int id, m_children.value(parentId))
 	{
-		LOCK_MUTEX;
+		auto it = m_files.constFind(id);
+		if (it != m_files.constEnd())
+		{
+			result << it->desc;
+		}
+	}
+	return result;
+}
+
+QList<RemoteFileDesc> LocalCache::filesByCheckSum(const QString& checkSum) const
+{
+	LOCK_MUTEX;
+
+	QList<RemoteFileDesc> result;
+	if (checkSum.isEmpty())
+	{
+		return result;
+	}
 
-        /* for (auto it = m_files.begin(); it != m_files.end(); ++it)
+	auto it = m_checkSums.constFind(checkSum.toLower());
+	for (; it != m_checkSums.constEnd() && it.key() == checkSum.toLower(); ++it)
+	{
+		auto nodeIt = m_files.constFind(it.value());
+		if (nodeIt != m_files.constEnd())
 		{
-			if (it->second.id == id)
-			{
-				return it->second;
-			}
-        } */
+			result << nodeIt->desc;
+		}
+	}
+	return result;
+}
 
-		std::map<QString, RemoteFileDesc>::const_iterator end = m_files.cend();
-        for (std::map<QString, RemoteFileDesc>::const_iterator it = m_files.cbegin();
-             it != end;
-             it++)
-        {
-            if (it->second.id == id)
-            {
-                return it->second;
-            }
-        }
+QString LocalCache::fullPathImpl(const RemoteFileDesc& d) const
+{
+	if (d.parentId == -1)
+	{
+		return QLatin1String("#root/") + d.name;
 	}
 
-	RemoteFileDesc invalidDesc;
-	invalidDesc.id = 0;
-	invalidDesc.parentId = 0;
-	invalidDesc.name = QString::null;
-	return invalidDesc;
+	// Every cached node keeps its own full path,
+	// so only the direct parent has to be looked up.
+	auto parentIt = m_files.constFind(d.parentId);
+	if (parentIt == m_files.constEnd())
+	{
+		return QString::null;
+	}
+
+	return parentIt->path + QLatin1String("/") + d.name;
 }
 
-RemoteFileDesc LocalCache::fileByParentId(const int id) const
+RemoteFileDesc LocalCache::fileById(const int id) const
 {
 	{
 		LOCK_MUTEX;
-		for (auto it = m_files.begin(); it != m_files.end(); ++it)
+		auto it = m_files.constFind(id);
+		if (it != m_files.constEnd())
 		{
-			if (it->second.parentId == id)
-			{
-				return it->second;
-			}
+			return it->desc;
 		}
 	}
 
-	RemoteFileDesc invalidDesc;
-	invalidDesc.id = 0;
-	invalidDesc.parentId = 0;
-	invalidDesc.name = QString::null;
-	return invalidDesc;
+	return invalidDesc();
 }
 
 bool LocalCache::removeById(const int id)
 {
-	return removeByIdImpl(id);
+	LOCK_MUTEX;
+
+	if (!removeByIdImpl(id))
+	{
+		return false;
+	}
+
+	m_journal.appendRemove(id);
+	compactJournalImpl();
+	return true;
 }
 
-bool LocalCache::removeByIdImpl(int id)
+bool LocalCache::removeByIdImpl(const int id)
 {
-	auto result = false;
+	auto it = m_files.find(id);
+	if (it == m_files.end())
+	{
+		return false;
+	}
 
-	for (;;)
+	auto siblingsIt = m_children.find(it->desc.parentId);
+	if (siblingsIt != m_children.end())
 	{
-		const auto desc = fileByParentId(id);
-		if (!desc.isValid())
+		siblingsIt->remove(id);
+		if (siblingsIt->isEmpty())
 		{
-			break;
+			m_children.erase(siblingsIt);
 		}
-		Q_ASSERT(removeByIdImpl(desc.id));
 	}
 
+	// Walk the subtree explicitly instead of recursing,
+	// deep trees should not exhaust the stack.
+	QList<int> pending;
+	pending << id;
+	while (!pending.isEmpty())
 	{
-		LOCK_MUTEX;
-		for (auto it = m_files.begin(); it != m_files.end(); ++it)
+		const int currentId = pending.takeLast();
+
+		auto childrenIt = m_children.find(currentId);
+		if (childrenIt != m_children.end())
 		{
-			if (it->second.id == id)
+			Q_FOREACH(const int childId, childrenIt.value())
 			{
-				m_files.erase(it);
-				result = true;
-				break;
+				pending << childId;
 			}
+			m_children.erase(childrenIt);
+		}
+
+		auto nodeIt = m_files.find(currentId);
+		if (nodeIt != m_files.end())
+		{
+			m_paths.remove(nodeIt->path);
+			if (!nodeIt->desc.checkSum.isEmpty())
+			{
+				m_checkSums.remove(nodeIt->desc.checkSum.toLower(), currentId);
+			}
+			m_files.erase(nodeIt);
 		}
 	}
+
+	return true;
+}
+
+QList<RemoteFileDesc> LocalCache::filesImpl() const
+{
+	QList<RemoteFileDesc> result;
+	result.reserve(m_files.size());
+
+	// Breadth-first from the roots, so parents always come first.
+	QList<int> level = m_children.value(-1).toList();
+	while (!level.isEmpty())
+	{
+		QList<int> nextLevel;
+		Q_FOREACH(const int id, level)
+		{
+			auto it = m_files.constFind(id);
+			if (it != m_files.constEnd())
+			{
+				result << it->desc;
+			}
+			nextLevel << m_children.value(id).toList();
+		}
+		level.swap(nextLevel);
+	}
+
 	return result;
 }
 
+void LocalCache::applyJournalRecordImpl(const CacheJournal::Record& record)
+{
+	switch (record.operation)
+	{
+	case CacheJournal::PutFile:
+		addFileImpl(record.fileDesc);
+		break;
+	case CacheJournal::RemoveFile:
+		removeByIdImpl(record.id);
+		break;
+	case CacheJournal::SetMeta:
+		if (record.value.isEmpty())
+		{
+			m_meta.remove(record.key);
+		}
+		else
+		{
+			m_meta.insert(record.key, record.value);
+		}
+		break;
+	}
+}
+
+void LocalCache::compactJournalImpl()
+{
+	if (!m_journal.isOpen())
+	{
+		return;
+	}
+
+	// Keep the log within a small multiple of the live data,
+	// so replaying it stays proportional to the tree size.
+	const int liveRecords = m_files.size() + m_meta.size();
+	if (m_journal.recordCount() > 2 * liveRecords + 4096)
+	{
+		DLOG << "Compacting journal: " << m_journal.recordCount()
+			<< " records, " << liveRecords << " live.";
+		m_journal.rewrite(filesImpl(), m_meta);
+	}
+}
+
+RemoteFileDesc LocalCache::invalidDesc()
+{
+	RemoteFileDesc invalidDesc;
+	invalidDesc.id = 0;
+	invalidDesc.parentId = 0;
+	invalidDesc.name = QString::null;
+	return invalidDesc;
+}
+
 QString LocalCache::toString() const
 {
 	QString result;
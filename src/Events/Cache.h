@@ -3,8 +3,13 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QMutex>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
 
 #include "APIClient/ApiTypes.h"
+#include "Events/CacheJournal.h"
 
 namespace Drive
 {
@@ -19,8 +24,24 @@ public:
 	RemoteFileDesc file(const QString& remotePath, bool forParent = false) const;
 	RemoteFileDesc file(int id, bool forParent = false) const;
 
+	// Restores the cache from its on-disk journal and keeps
+	// the journal updated from now on.
+	// Returns false if there was nothing to restore.
+	bool open(const QString& name);
+	// Drops the in-memory data, the journal is kept on disk.
+	void close();
+
+	// Drops the cached data both in memory and on disk.
 	void clear();
 
+	// All the descriptors, every parent precedes its children.
+	QList<RemoteFileDesc> files() const;
+
+	QString meta(const QString& key) const;
+	void setMeta(const QString& key, const QString& value);
+	// Meta data keys starting with the prefix.
+	QStringList metaKeys(const QString& prefix) const;
+
 	void addRoot(const RemoteFileDesc&);
     bool addFile(const RemoteFileDesc&);
 
@@ -28,21 +49,64 @@ public:
 
 	QString fullPath(const RemoteFileDesc&) const;
 
+	// Same as fullPath(), but silently returns a null string
+	// if the path can't be resolved.
+	QString findPath(const RemoteFileDesc&) const;
+	// Path of a cached file, null string if the file is not cached.
+	QString findPath(int id) const;
+
+	// Cached files below the folder path together with their full paths.
+	// With a trailing slash the folder itself is left out.
+	// Costs as much as the size of the subtree.
+	QVector<QPair<QString, RemoteFileDesc> > filesUnder(const QString& pathPrefix) const;
+
+	// Cached direct children of the folder.
+	QList<RemoteFileDesc> children(int parentId) const;
+
+	// Cached files with the given content checksum.
+	QList<RemoteFileDesc> filesByCheckSum(const QString& checkSum) const;
+
 private:
 	Q_DISABLE_COPY(LocalCache)
 	LocalCache() {}
 
+	// Cached descriptor together with its full remote path.
+	// The path string is shared with the key of the path index.
+	struct Node
+	{
+		RemoteFileDesc desc;
+		QString path;
+	};
+
 	RemoteFileDesc fileById(int id) const;
-	RemoteFileDesc fileByParentId(int id) const;
 
+	// The *Impl methods expect m_mutex to be locked by the caller.
+	QString fullPathImpl(const RemoteFileDesc&) const;
+	bool addFileImpl(const RemoteFileDesc&);
 	bool removeById(int id);
 	bool removeByIdImpl(int id);
+	QList<RemoteFileDesc> filesImpl() const;
+	void applyJournalRecordImpl(const CacheJournal::Record&);
+	void compactJournalImpl();
+
+	static RemoteFileDesc invalidDesc();
 
 	QString toString() const;
 
 private:
 	mutable QMutex m_mutex;
-	std::map<QString, RemoteFileDesc> m_files;
+
+	// id -> node
+	QHash<int, Node> m_files;
+	// parent id -> ids of the direct children
+	QHash<int, QSet<int> > m_children;
+	// full remote path -> id
+	QHash<QString, int> m_paths;
+	// lowercase checksum -> ids of the files
+	QMultiHash<QString, int> m_checkSums;
+
+	QHash<QString, QString> m_meta;
+	CacheJournal m_journal;
 };
 
 }
@@ -0,0 +1,354 @@
+﻿#include "CacheJournal.h"
+
+#include "Util/FileUtils.h"
+#include "QsLog/QsLog.h"
+
+#include <QtCore/QDataStream>
+#include <QtCore/QSaveFile>
+
+#define JOURNAL_MAGIC 0x5444434a // "TDCJ"
+#define JOURNAL_VERSION 1
+
+namespace Drive
+{
+
+namespace
+{
+
+const qint64 headerSize = 2 * sizeof(quint32);
+const quint32 maxRecordSize = 16 * 1024 * 1024;
+// Records appended between two syncs to disk
+const int syncInterval = 4096;
+
+void writeFileDesc(QDataStream& stream, const RemoteFileDesc& d)
+{
+	stream << qint32(d.id) << qint32(d.parentId) << qint32(d.type)
+		<< d.name << d.size
+		<< d.createdAt << d.modifiedAt << d.deletedAt
+		<< d.checkSum
+		<< d.isFavourite << d.hasChildren << d.hasSubfolders << d.isUploaded
+		<< d.linkId << d.originalPath;
+}
+
+void readFileDesc(QDataStream& stream, RemoteFileDesc& d)
+{
+	qint32 id, parentId, type;
+	stream >> id >> parentId >> type
+		>> d.name >> d.size
+		>> d.createdAt >> d.modifiedAt >> d.deletedAt
+		>> d.checkSum
+		>> d.isFavourite >> d.hasChildren >> d.hasSubfolders >> d.isUploaded
+		>> d.linkId >> d.originalPath;
+
+	d.id = id;
+	d.parentId = parentId;
+	d.type = static_cast<RemoteFileDesc::FileType>(type);
+}
+
+}
+
+CacheJournal::CacheJournal()
+	: m_recordCount(0)
+	, m_unsyncedCount(0)
+{
+}
+
+CacheJournal::~CacheJournal()
+{
+	close();
+}
+
+bool CacheJournal::open(const QString& fileName,
+		const std::function<void(const Record&)>& visitor)
+{
+	close();
+
+	m_file.setFileName(fileName);
+	if (!m_file.open(QIODevice::ReadWrite))
+	{
+		QLOG_ERROR() << "CacheJournal: can't open " << fileName
+			<< ": " << m_file.errorString();
+		return false;
+	}
+
+	QDataStream stream(&m_file);
+	quint32 magic = 0, version = 0;
+	stream >> magic >> version;
+
+	if (magic != JOURNAL_MAGIC || version != JOURNAL_VERSION)
+	{
+		if (m_file.size() != 0)
+		{
+			QLOG_INFO() << "CacheJournal: " << fileName
+				<< " has unknown format, starting from scratch.";
+		}
+		reset();
+		return m_file.isOpen();
+	}
+
+	qint64 validSize = headerSize;
+	for (;;)
+	{
+		quint32 size = 0;
+		quint16 checksum = 0;
+		stream >> size >> checksum;
+		if (stream.status() != QDataStream::Ok || size > maxRecordSize)
+		{
+			break;
+		}
+
+		const QByteArray payload = m_file.read(size);
+		Record record;
+		if (payload.size() != static_cast<int>(size)
+			|| qChecksum(payload.constData(), payload.size()) != checksum
+			|| !deserialize(payload, record))
+		{
+			break;
+		}
+
+		visitor(record);
+		++m_recordCount;
+		validSize = m_file.pos();
+	}
+
+	if (validSize != m_file.size())
+	{
+		QLOG_INFO() << "CacheJournal: dropping torn tail of " << fileName
+			<< " (" << m_file.size() - validSize << " bytes).";
+		m_file.resize(validSize);
+	}
+
+	m_file.seek(validSize);
+	return true;
+}
+
+void CacheJournal::close()
+{
+	if (m_file.isOpen())
+	{
+		sync();
+		m_file.close();
+	}
+	m_recordCount = 0;
+}
+
+bool CacheJournal::isOpen() const
+{
+	return m_file.isOpen();
+}
+
+void CacheJournal::appendPut(const RemoteFileDesc& fileDesc)
+{
+	Record record;
+	record.operation = PutFile;
+	record.fileDesc = fileDesc;
+	record.id = fileDesc.id;
+	append(record);
+}
+
+void CacheJournal::appendRemove(const int id)
+{
+	Record record;
+	record.operation = RemoveFile;
+	record.id = id;
+	append(record);
+}
+
+void CacheJournal::appendMeta(const QString& key, const QString& value)
+{
+	Record record;
+	record.operation = SetMeta;
+	record.id = 0;
+	record.key = key;
+	record.value = value;
+	append(record);
+}
+
+void CacheJournal::reset()
+{
+	if (!m_file.isOpen())
+	{
+		return;
+	}
+
+	m_file.resize(0);
+	m_file.seek(0);
+	writeHeader(m_file);
+	m_file.flush();
+	m_recordCount = 0;
+	m_unsyncedCount = 0;
+}
+
+bool CacheJournal::rewrite(const QList<RemoteFileDesc>& files,
+		const QHash<QString, QString>& meta)
+{
+	if (!m_file.isOpen())
+	{
+		return false;
+	}
+
+	const QString fileName = m_file.fileName();
+
+	QSaveFile snapshot(fileName);
+	if (!snapshot.open(QIODevice::WriteOnly))
+	{
+		QLOG_ERROR() << "CacheJournal: can't compact " << fileName
+			<< ": " << snapshot.errorString();
+		return false;
+	}
+
+	bool ok = writeHeader(snapshot);
+
+	Record record;
+	record.operation = PutFile;
+	Q_FOREACH(const RemoteFileDesc& fileDesc, files)
+	{
+		record.fileDesc = fileDesc;
+		record.id = fileDesc.id;
+		ok = ok && writeRecord(snapshot, record);
+	}
+
+	record.operation = SetMeta;
+	record.id = 0;
+	for (auto it = meta.constBegin(); it != meta.constEnd(); ++it)
+	{
+		record.key = it.key();
+		record.value = it.value();
+		ok = ok && writeRecord(snapshot, record);
+	}
+
+	if (!ok || !snapshot.commit())
+	{
+		QLOG_ERROR() << "CacheJournal: failed to write snapshot "
+			<< fileName << ": " << snapshot.errorString();
+		return false;
+	}
+
+	m_file.close();
+	m_file.setFileName(fileName);
+	if (!m_file.open(QIODevice::ReadWrite | QIODevice::Append))
+	{
+		QLOG_ERROR() << "CacheJournal: can't reopen " << fileName
+			<< ": " << m_file.errorString();
+		m_recordCount = 0;
+		return false;
+	}
+
+	// QSaveFile has synced the snapshot before renaming it
+	m_recordCount = files.size() + meta.size();
+	m_unsyncedCount = 0;
+	return true;
+}
+
+int CacheJournal::recordCount() const
+{
+	return m_recordCount;
+}
+
+bool CacheJournal::writeHeader(QIODevice& device) const
+{
+	QDataStream stream(&device);
+	stream << quint32(JOURNAL_MAGIC) << quint32(JOURNAL_VERSION);
+	return stream.status() == QDataStream::Ok;
+}
+
+QByteArray CacheJournal::serialize(const Record& record)
+{
+	QByteArray payload;
+	QDataStream stream(&payload, QIODevice::WriteOnly);
+	stream.setVersion(QDataStream::Qt_5_0);
+	stream << quint8(record.operation);
+
+	switch (record.operation)
+	{
+	case PutFile:
+		writeFileDesc(stream, record.fileDesc);
+		break;
+	case RemoveFile:
+		stream << qint32(record.id);
+		break;
+	case SetMeta:
+		stream << record.key << record.value;
+		break;
+	}
+
+	return payload;
+}
+
+bool CacheJournal::deserialize(const QByteArray& payload, Record& record)
+{
+	QDataStream stream(payload);
+	stream.setVersion(QDataStream::Qt_5_0);
+	quint8 operation = 0;
+	qint32 id = 0;
+	stream >> operation;
+
+	switch (operation)
+	{
+	case PutFile:
+		readFileDesc(stream, record.fileDesc);
+		record.id = record.fileDesc.id;
+		break;
+	case RemoveFile:
+		stream >> id;
+		record.id = id;
+		break;
+	case SetMeta:
+		stream >> record.key >> record.value;
+		break;
+	default:
+		return false;
+	}
+
+	record.operation = static_cast<Operation>(operation);
+	return stream.status() == QDataStream::Ok;
+}
+
+bool CacheJournal::writeRecord(QIODevice& device, const Record& record)
+{
+	const QByteArray payload = serialize(record);
+
+	QDataStream stream(&device);
+	stream << quint32(payload.size())
+		<< qChecksum(payload.constData(), payload.size());
+
+	return stream.status() == QDataStream::Ok
+		&& device.write(payload) == payload.size();
+}
+
+void CacheJournal::append(const Record& record)
+{
+	if (!m_file.isOpen())
+	{
+		return;
+	}
+
+	if (!writeRecord(m_file, record))
+	{
+		QLOG_ERROR() << "CacheJournal: failed to append record to "
+			<< m_file.fileName() << ": " << m_file.errorString();
+		return;
+	}
+
+	// Hand the record over to the OS right away, a crash of the
+	// application must not lose it.
+	m_file.flush();
+	++m_recordCount;
+
+	// A power failure may still lose the records not synced yet
+	if (++m_unsyncedCount >= syncInterval)
+	{
+		sync();
+	}
+}
+
+void CacheJournal::sync()
+{
+	if (m_unsyncedCount > 0)
+	{
+		FileSystemHelper::syncFile(m_file);
+		m_unsyncedCount = 0;
+	}
+}
+
+}
@@ -0,0 +1,89 @@
+﻿#ifndef CACHE_JOURNAL_H
+#define CACHE_JOURNAL_H
+
+#include "APIClient/ApiTypes.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QString>
+
+#include <functional>
+
+namespace Drive
+{
+
+//
+// Append-only on-disk log of LocalCache modifications.
+//
+// Every record is stored as [payload size][checksum][payload], so a record
+// torn by a crash is detected on the next start and the log is cut right
+// before it. The log is rewritten as a compact snapshot when it has grown
+// much larger than the data it describes.
+//
+// Records are flushed to the OS one by one but synced to disk in groups,
+// so a power failure loses up to a few thousand of the last ones. The log
+// is cut at the first bad record, so it stays a consistent older state
+// with its own cursors, and the lost changes are fetched again from them.
+//
+class CacheJournal
+{
+public:
+	enum Operation
+	{
+		PutFile = 1,
+		RemoveFile,
+		SetMeta
+	};
+
+	struct Record
+	{
+		Operation operation;
+		RemoteFileDesc fileDesc;
+		int id;
+		QString key;
+		QString value;
+	};
+
+	CacheJournal();
+	~CacheJournal();
+
+	// Opens (or creates) the log and passes every valid record to the visitor.
+	bool open(const QString& fileName,
+			const std::function<void(const Record&)>& visitor);
+	void close();
+	bool isOpen() const;
+
+	void appendPut(const RemoteFileDesc&);
+	void appendRemove(int id);
+	void appendMeta(const QString& key, const QString& value);
+
+	// Drops all the records.
+	void reset();
+
+	// Replaces the log with the given state.
+	// Files must be ordered so that every parent precedes its children.
+	bool rewrite(const QList<RemoteFileDesc>& files,
+			const QHash<QString, QString>& meta);
+
+	// Number of records written since the log was last compacted.
+	int recordCount() const;
+
+private:
+	Q_DISABLE_COPY(CacheJournal)
+
+	bool writeHeader(QIODevice& device) const;
+	static QByteArray serialize(const Record&);
+	static bool deserialize(const QByteArray&, Record&);
+	static bool writeRecord(QIODevice& device, const Record&);
+	void append(const Record&);
+	void sync();
+
+	QFile m_file;
+	int m_recordCount;
+	int m_unsyncedCount;
+};
+
+}
+
+#endif // CACHE_JOURNAL_H
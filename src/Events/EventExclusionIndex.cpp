@@ -0,0 +1,392 @@
+﻿#include "EventExclusionIndex.h"
+
+#include "Util/FileUtils.h"
+
+#include "QsLog/QsLog.h"
+
+#include <QtCore/QStringList>
+
+// An exclusion is expected to match an event shortly after it is added,
+// the ones which did not match anything within this time are dropped.
+#define EXCLUSION_TTL (60 * 60 * 1000) // ms
+
+namespace Drive
+{
+
+namespace
+{
+
+template <typename Entry>
+int firstAlive(const QList<Entry>& entries, qint64 now)
+{
+	for (int i = 0; i < entries.size(); ++i)
+	{
+		if (entries.at(i).expiresAt > now)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+}
+
+//
+// LocalFileEventExclusionIndex
+//
+
+LocalFileEventExclusionIndex::LocalFileEventExclusionIndex()
+	: m_size(0)
+	, m_nextSequence(0)
+	, m_nextPurge(EXCLUSION_TTL)
+{
+	m_clock.start();
+}
+
+LocalFileEventExclusionIndex::~LocalFileEventExclusionIndex()
+{
+}
+
+void LocalFileEventExclusionIndex::add(const LocalFileEventExclusion& exclusion)
+{
+	purgeExpired();
+
+	Entry entry;
+	entry.eventType = exclusion.eventType();
+	entry.sequence = m_nextSequence++;
+	entry.expiresAt = m_clock.elapsed() + EXCLUSION_TTL;
+
+	switch (exclusion.matchType())
+	{
+	case LocalFileEventExclusion::FullMatch:
+		m_fullMatch[FullMatchKey(entry.eventType, exclusion.path())] << entry;
+		break;
+	case LocalFileEventExclusion::PartialMatch:
+		addPartial(exclusion.path(), entry);
+		break;
+	default:
+		Q_ASSERT(false);
+		return;
+	}
+
+	++m_size;
+}
+
+bool LocalFileEventExclusionIndex::consume(const LocalFileEvent& event)
+{
+	if (m_size == 0)
+	{
+		return false;
+	}
+
+	const qint64 now = m_clock.elapsed();
+	const QString path = event.localPath();
+
+	// The oldest matching exclusion wins, wherever it is stored
+	QList<Entry>* bestList = nullptr;
+	int bestIndex = -1;
+
+	auto fullIt = m_fullMatch.find(FullMatchKey(event.type(), path));
+	if (fullIt != m_fullMatch.end())
+	{
+		bestIndex = firstAlive(fullIt.value(), now);
+		if (bestIndex != -1)
+		{
+			bestList = &fullIt.value();
+		}
+	}
+
+	Node* node = &m_partialMatch;
+	Q_FOREACH(const QString& segment, segments(path))
+	{
+		node = node->children.value(segment);
+		if (!node)
+		{
+			break;
+		}
+
+		for (int i = 0; i < node->entries.size(); ++i)
+		{
+			const Entry& entry = node->entries.at(i);
+			if (entry.eventType != event.type() || entry.expiresAt <= now)
+			{
+				continue;
+			}
+
+			if (!bestList || entry.sequence < bestList->at(bestIndex).sequence)
+			{
+				bestList = &node->entries;
+				bestIndex = i;
+			}
+			break;
+		}
+	}
+
+	if (!bestList)
+	{
+		return false;
+	}
+
+	bestList->removeAt(bestIndex);
+	if (fullIt != m_fullMatch.end() && fullIt.value().isEmpty())
+	{
+		m_fullMatch.erase(fullIt);
+	}
+	--m_size;
+
+	return true;
+}
+
+void LocalFileEventExclusionIndex::clear()
+{
+	m_fullMatch.clear();
+	qDeleteAll(m_partialMatch.children);
+	m_partialMatch.children.clear();
+	m_partialMatch.entries.clear();
+	m_size = 0;
+}
+
+int LocalFileEventExclusionIndex::size() const
+{
+	return m_size;
+}
+
+QStringList LocalFileEventExclusionIndex::segments(const QString& path)
+{
+	return path.split(Utils::separator(), QString::SkipEmptyParts);
+}
+
+void LocalFileEventExclusionIndex::addPartial(
+	const QString& path, const Entry& entry)
+{
+	Node* node = &m_partialMatch;
+	Q_FOREACH(const QString& segment, segments(path))
+	{
+		Node*& child = node->children[segment];
+		if (!child)
+		{
+			child = new Node;
+		}
+		node = child;
+	}
+	node->entries << entry;
+}
+
+void LocalFileEventExclusionIndex::purgeExpired()
+{
+	const qint64 now = m_clock.elapsed();
+	if (now < m_nextPurge)
+	{
+		return;
+	}
+	m_nextPurge = now + EXCLUSION_TTL;
+
+	const int sizeBefore = m_size;
+
+	for (auto it = m_fullMatch.begin(); it != m_fullMatch.end(); )
+	{
+		QList<Entry>& entries = it.value();
+		for (int i = entries.size() - 1; i >= 0; --i)
+		{
+			if (entries.at(i).expiresAt <= now)
+			{
+				entries.removeAt(i);
+				--m_size;
+			}
+		}
+
+		it = entries.isEmpty() ? m_fullMatch.erase(it) : it + 1;
+	}
+
+	// Collect the live partial entries and rebuild the trie,
+	// so empty branches do not pile up
+	QList<QPair<QStringList, Entry> > alive;
+	QList<QPair<QStringList, Node*> > stack;
+	stack << qMakePair(QStringList(), &m_partialMatch);
+	while (!stack.isEmpty())
+	{
+		const QPair<QStringList, Node*> current = stack.takeLast();
+		Q_FOREACH(const Entry& entry, current.second->entries)
+		{
+			if (entry.expiresAt > now)
+			{
+				alive << qMakePair(current.first, entry);
+			}
+			else
+			{
+				--m_size;
+			}
+		}
+
+		for (auto it = current.second->children.constBegin();
+			it != current.second->children.constEnd(); ++it)
+		{
+			stack << qMakePair(current.first + QStringList(it.key()), it.value());
+		}
+	}
+
+	qDeleteAll(m_partialMatch.children);
+	m_partialMatch.children.clear();
+	m_partialMatch.entries.clear();
+
+	for (int i = 0; i < alive.size(); ++i)
+	{
+		addPartial(alive.at(i).first.join(Utils::separator()), alive.at(i).second);
+	}
+
+	if (m_size != sizeBefore)
+	{
+		QLOG_DEBUG() << "Expired local file event exclusions: "
+			<< sizeBefore - m_size;
+	}
+}
+
+//
+// RemoteFileEventExclusionIndex
+//
+
+RemoteFileEventExclusionIndex::RemoteFileEventExclusionIndex()
+	: m_size(0)
+	, m_nextSequence(0)
+	, m_nextPurge(EXCLUSION_TTL)
+{
+	m_clock.start();
+}
+
+void RemoteFileEventExclusionIndex::add(const RemoteFileEventExclusion& exclusion)
+{
+	purgeExpired();
+
+	Entry entry;
+	entry.sequence = m_nextSequence++;
+	entry.expiresAt = m_clock.elapsed() + EXCLUSION_TTL;
+
+	const Key key(exclusion.eventType(), exclusion.id());
+
+	switch (exclusion.matchType())
+	{
+	case RemoteFileEventExclusion::SelfId:
+		m_selfId[key] << entry;
+		break;
+	case RemoteFileEventExclusion::ParentId:
+		m_parentId[key] << entry;
+		break;
+	default:
+		Q_ASSERT(false);
+		return;
+	}
+
+	++m_size;
+}
+
+bool RemoteFileEventExclusionIndex::consume(const RemoteFileEvent& event)
+{
+	if (m_size == 0)
+	{
+		return false;
+	}
+
+	if (!event.fileDesc.isValid())
+	{
+		QLOG_ERROR()
+				<< "Skipping event exclusion check, as file descriptor is not valid:"
+				<< event.fileDesc.toString();
+		return false;
+	}
+
+	const qint64 now = m_clock.elapsed();
+
+	auto selfIt = m_selfId.find(Key(event.type, event.fileDesc.id));
+	auto parentIt = m_parentId.find(Key(event.type, event.fileDesc.parentId));
+
+	const int selfIndex = selfIt != m_selfId.end()
+		? firstAlive(selfIt.value(), now) : -1;
+	const int parentIndex = parentIt != m_parentId.end()
+		? firstAlive(parentIt.value(), now) : -1;
+
+	// The oldest matching exclusion wins
+	bool useSelf = selfIndex != -1;
+	if (useSelf && parentIndex != -1)
+	{
+		useSelf = selfIt.value().at(selfIndex).sequence
+			< parentIt.value().at(parentIndex).sequence;
+	}
+
+	if (useSelf)
+	{
+		selfIt.value().removeAt(selfIndex);
+		if (selfIt.value().isEmpty())
+		{
+			m_selfId.erase(selfIt);
+		}
+	}
+	else if (parentIndex != -1)
+	{
+		parentIt.value().removeAt(parentIndex);
+		if (parentIt.value().isEmpty())
+		{
+			m_parentId.erase(parentIt);
+		}
+	}
+	else
+	{
+		return false;
+	}
+
+	--m_size;
+	return true;
+}
+
+void RemoteFileEventExclusionIndex::clear()
+{
+	m_selfId.clear();
+	m_parentId.clear();
+	m_size = 0;
+}
+
+int RemoteFileEventExclusionIndex::size() const
+{
+	return m_size;
+}
+
+void RemoteFileEventExclusionIndex::purgeExpired()
+{
+	const qint64 now = m_clock.elapsed();
+	if (now < m_nextPurge)
+	{
+		return;
+	}
+	m_nextPurge = now + EXCLUSION_TTL;
+
+	const int sizeBefore = m_size;
+
+	purgeExpired(m_selfId, now, m_size);
+	purgeExpired(m_parentId, now, m_size);
+
+	if (m_size != sizeBefore)
+	{
+		QLOG_DEBUG() << "Expired remote file event exclusions: "
+			<< sizeBefore - m_size;
+	}
+}
+
+void RemoteFileEventExclusionIndex::purgeExpired(
+	EntryMap& entries, const qint64 now, int& size)
+{
+	for (auto it = entries.begin(); it != entries.end(); )
+	{
+		QList<Entry>& list = it.value();
+		for (int i = list.size() - 1; i >= 0; --i)
+		{
+			if (list.at(i).expiresAt <= now)
+			{
+				list.removeAt(i);
+				--size;
+			}
+		}
+
+		it = list.isEmpty() ? entries.erase(it) : it + 1;
+	}
+}
+
+}
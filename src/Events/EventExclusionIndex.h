@@ -0,0 +1,113 @@
+﻿#ifndef EVENT_EXCLUSION_INDEX_H
+#define EVENT_EXCLUSION_INDEX_H
+
+#include "APIClient/ApiTypes.h"
+#include "LocalFileEvent.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QElapsedTimer>
+
+namespace Drive
+{
+
+//
+// Local file event exclusions indexed by path.
+//
+// Full match exclusions are kept in a hash, partial match exclusions
+// in a trie of path segments. An event consumes the oldest exclusion
+// it matches. Exclusions which did not match anything for a long time
+// expire.
+//
+class LocalFileEventExclusionIndex
+{
+public:
+	LocalFileEventExclusionIndex();
+	~LocalFileEventExclusionIndex();
+
+	void add(const LocalFileEventExclusion& exclusion);
+
+	// Removes the matching exclusion, returns false if there was none.
+	bool consume(const LocalFileEvent& event);
+
+	void clear();
+	int size() const;
+
+private:
+	Q_DISABLE_COPY(LocalFileEventExclusionIndex)
+
+	struct Entry
+	{
+		LocalFileEvent::Type eventType;
+		quint64 sequence;
+		qint64 expiresAt;
+	};
+
+	struct Node
+	{
+		~Node() { qDeleteAll(children); }
+
+		QHash<QString, Node*> children;
+		QList<Entry> entries;
+	};
+
+	typedef QPair<int, QString> FullMatchKey;
+
+	static QStringList segments(const QString& path);
+	void addPartial(const QString& path, const Entry& entry);
+	void purgeExpired();
+
+	QHash<FullMatchKey, QList<Entry> > m_fullMatch;
+	Node m_partialMatch;
+
+	int m_size;
+	quint64 m_nextSequence;
+	qint64 m_nextPurge;
+	QElapsedTimer m_clock;
+};
+
+//
+// Remote file event exclusions indexed by the event type and file id
+// (or parent id). An event consumes the oldest exclusion it matches.
+//
+class RemoteFileEventExclusionIndex
+{
+public:
+	RemoteFileEventExclusionIndex();
+
+	void add(const RemoteFileEventExclusion& exclusion);
+
+	// Removes the matching exclusion, returns false if there was none.
+	bool consume(const RemoteFileEvent& event);
+
+	void clear();
+	int size() const;
+
+private:
+	Q_DISABLE_COPY(RemoteFileEventExclusionIndex)
+
+	struct Entry
+	{
+		quint64 sequence;
+		qint64 expiresAt;
+	};
+
+	typedef QPair<int, int> Key; // event type, id
+	typedef QHash<Key, QList<Entry> > EntryMap;
+
+	void purgeExpired();
+	static void purgeExpired(EntryMap& entries, qint64 now, int& size);
+
+	EntryMap m_selfId;
+	EntryMap m_parentId;
+
+	int m_size;
+	quint64 m_nextSequence;
+	qint64 m_nextPurge;
+	QElapsedTimer m_clock;
+};
+
+}
+
+#endif // EVENT_EXCLUSION_INDEX_H
@@ -1,6 +1,30 @@
 #include "EventHandlerBase.h"
 #include "FileUtils.h"
 #include "Events/LocalFileEvent.h"
+#include "QsLog/QsLog.h"
+
+void Drive::EventHandlerBase::runEventHandlingPrivate()
+{
+    QLOG_DEBUG() << "Event handler " << this << " started in "
+        << m_timer.nsecsElapsed() / 1000 << " us";
+
+    runEventHandling();
+}
+
+void Drive::EventHandlerBase::finish()
+{
+    // Some handlers request finishing more than once
+    if (m_finished)
+    {
+        return;
+    }
+    m_finished = true;
+
+    QLOG_DEBUG() << "Event handler " << this << " finished in "
+        << m_timer.elapsed() << " ms";
+
+    emit finished(this);
+}
 
 void Drive::EventHandlerBase::markSyncing(const QString &fileName)
 {
@@ -2,8 +2,8 @@
 #define EVENT_HANDLER_BASE
 
 #include <QtCore/QPointer>
-#include <QtCore/QThread>
-#include <QtCore/QCoreApplication>
+#include <QtCore/QObject>
+#include <QtCore/QElapsedTimer>
 
 #include "FileUtils.h"
 
@@ -17,30 +17,30 @@ class LocalFileEvent;
 
 class LocalFileEventExclusion;
 
-class EventHandlerBase : public QThread
+class EventHandlerBase : public QObject
 {
     Q_OBJECT
 
     int syncronizationState;
 
-    // File or folder name handled by this thread.
+    // File or folder name handled by this handler.
     // Empty by default.
     QString fileName;
 
 public:
 	// TODO: remove parent param
-	// The object cannot be moved to thread if it has a parent.
-	// see also QObject::moveToThread docs.
+	// Handlers are deleted by the dispatcher when they finish,
+	// so they should not have a parent.
     EventHandlerBase(QObject*) :
-        QThread(nullptr)
+        QObject(nullptr),
+        m_finished(false)
 	{
-        this->syncronizationState = 0;
         this->syncronizationState = FOLDER_STATE_NOT_SET;
 
-        connect(this, &QThread::started, this, &EventHandlerBase::runEventHandlingPrivate, Qt::QueuedConnection);
-        connect(this, &EventHandlerBase::quitThread, this, &QThread::quit, Qt::QueuedConnection);
-
-        // moveToThread(this);
+        // Handlers run as continuations on the event loop of the
+        // dispatcher's thread, finishing is deferred until the current
+        // continuation returns.
+        connect(this, &EventHandlerBase::quitHandler, this, &EventHandlerBase::finish, Qt::QueuedConnection);
     }
 
     virtual ~EventHandlerBase() { }
@@ -59,13 +59,13 @@ signals:
 
 public:
 
-    void startThread()
+    void start()
 	{
 		beforeStart();
-        connect(this, &QThread::finished, this, &EventHandlerBase::sendFinished, Qt::QueuedConnection);
-        connect(this, &QThread::finished, this, &QObject::deleteLater, Qt::QueuedConnection);
         connect(this, &EventHandlerBase::cancel, this, &EventHandlerBase::processEventsAndQuit, Qt::QueuedConnection);
-        start();
+
+        m_timer.start();
+        QMetaObject::invokeMethod(this, "runEventHandlingPrivate", Qt::QueuedConnection);
 	}
 
 protected:
@@ -74,20 +74,12 @@ protected:
 
     virtual void processEventsAndQuit()
     {
-        Q_EMIT quitThread();
-        QCoreApplication::processEvents();
+        Q_EMIT quitHandler();
     }
 
 private slots:
-    void runEventHandlingPrivate()
-    {
-        runEventHandling();
-    }
-
-    void sendFinished()
-    {
-        emit finished(this);
-    }
+    void runEventHandlingPrivate();
+    void finish();
 
 signals:
     void finished(EventHandlerBase *handler);
@@ -105,8 +97,11 @@ signals:
 	void newRemoteFileEventExclusion(const RemoteFileEventExclusion& remoteExclusion);
 
     void cancel();
-    void quitThread();
+    void quitHandler();
 
+private:
+    bool m_finished;
+    QElapsedTimer m_timer;
 };
 
 }
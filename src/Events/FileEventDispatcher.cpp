@@ -1,19 +1,30 @@
 ﻿#include "FileEventDispatcher.h"
 
 #include "LocalFileEventNotifier.h"
+#include "LocalEventCoalescer.h"
 
 #include "RemoteEventHandlers.h"
 #include "LocalEventHandlers.h"
 #include "AppController.h"
+#include "Cache.h"
+
+#include "Settings/settings.h"
+#include "Util/FileUtils.h"
 
 #include "QsLog/QsLog.h"
 
-#include <QtCore/QThread>
 #include <QtCore/QDir>
 #include <QtCore/QStandardPaths>
 
 #define DATETIME_TO_STRING_FORMAT "yyyy-MM-dd hh:mm:ss"
 
+// How many queued events are looked through to find
+// one which does not conflict with the running ones
+#define SCHEDULING_WINDOW 64
+
+// How long a local deletion is remembered as the evidence of a move
+#define RECENT_DELETION_TTL (10 * 60 * 1000)
+
 namespace Drive
 {
 
@@ -29,8 +40,9 @@ FileEventDispatcher::FileEventDispatcher(QObject *parent)
 	, currentPosition(0)
 	, totalCount(0)
 	, globalCounter(0)
-	, dontIncrementTotalCount(false)
-	, dontIncrementCurrentPosition(false)
+	, dontIncrementTotalCount(0)
+	, dontIncrementCurrentPosition(0)
+	, nextDeletionPurge(RECENT_DELETION_TTL)
 {
 	eventLogFile = new QFile(this);
 
@@ -46,6 +58,12 @@ FileEventDispatcher::FileEventDispatcher(QObject *parent)
 
 	eventLogFile->remove();
 	eventLogFile->open(QIODevice::WriteOnly | QIODevice::Text);
+
+	deletionClock.start();
+
+	localEventCoalescer = new LocalEventCoalescer(this);
+	connect(localEventCoalescer, &LocalEventCoalescer::settled,
+			this, &FileEventDispatcher::onLocalFileEventSettled);
 }
 
 FileEventDispatcher::~FileEventDispatcher()
@@ -78,17 +96,25 @@ void FileEventDispatcher::addLocalFileEvent(Drive::LocalFileEvent localEvent)
 		logIgnored();
 	}
 	else
-	if (shouldBeGrouped(localEvent))
 	{
-		logGrouped();
-	}
-	else
-	{
-		localEvents.enqueue(localEvent);
-		proceed();
+		noteLocalDeletion(localEvent);
+		localEventCoalescer->add(localEvent);
+
+		// Folded away with a held event, nothing settles to finish the queue
+		if (state == Processing)
+		{
+			next();
+		}
 	}
 }
 
+void FileEventDispatcher::onLocalFileEventSettled(
+	const Drive::LocalFileEvent& localEvent)
+{
+	localEvents.enqueue(localEvent);
+	proceed();
+}
+
 void FileEventDispatcher
 	::addPriorityRemoteFileEvent(Drive::RemoteFileEvent remoteEvent)
 {
@@ -116,6 +142,7 @@ void FileEventDispatcher
 	}
 	else
 	{
+		noteLocalDeletion(localEvent);
 		priorityLocalEvents.enqueue(localEvent);
 		proceed();
 	}
@@ -130,19 +157,28 @@ void FileEventDispatcher::start()
 	}
 }
 
-void FileEventDispatcher::proceed()
+bool FileEventDispatcher::takeSkip(QAtomicInt& counter)
 {
-	if (dontIncrementTotalCount)
+	for (int value = counter.load(); value > 0; value = counter.load())
 	{
-		dontIncrementTotalCount = false;
+		if (counter.testAndSetOrdered(value, value - 1))
+		{
+			return true;
+		}
 	}
-	else
+
+	return false;
+}
+
+void FileEventDispatcher::proceed()
+{
+	if (!takeSkip(dontIncrementTotalCount))
 	{
 		totalCount++;
 		processProgress();
 	}
 
-	if (state == Finished)
+	if (state == Finished || state == Processing)
 	{
 		next();
 	}
@@ -152,8 +188,8 @@ void FileEventDispatcher::finish()
 {
 	currentPosition = 0;
 	totalCount = 0;
-	dontIncrementTotalCount = false;
-	dontIncrementCurrentPosition = false;
+	dontIncrementTotalCount.store(0);
+	dontIncrementCurrentPosition.store(0);
 	state = Finished;
 	emit finished();
 }
@@ -165,155 +201,339 @@ void FileEventDispatcher::next()
 		return;
 	}
 
-	if (priorityLocalEvents.isEmpty()
-		&& priorityRemoteEvents.isEmpty()
-		&& remoteEvents.isEmpty()
-		&& localEvents.isEmpty())
+	const int maxHandlers = maxParallelEvents();
+	while (queuesSize() > 0 && eventHandlers.size() < maxHandlers)
+	{
+		if (!startNextEvent())
+		{
+			break;
+		}
+	}
+
+	if (queuesSize() == 0 && eventHandlers.isEmpty())
 	{
 		finish();
-		return;
+	}
+}
+
+bool FileEventDispatcher::startNextEvent()
+{
+	// Events are looked through in the order they would be handled
+	// sequentially: priority queues first, local and remote events
+	// merged by their timestamps. An event may overtake the queued ones
+	// only if it does not touch the paths they touch.
+
+	QList<EventScope> blockedScopes;
+	int scanned = 0;
+
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		QQueue<LocalFileEvent>& locals =
+			pass == 0 ? priorityLocalEvents : localEvents;
+		QQueue<RemoteFileEvent>& remotes =
+			pass == 0 ? priorityRemoteEvents : remoteEvents;
+
+		int localIndex = 0;
+		int remoteIndex = 0;
+
+		while ((localIndex < locals.size() || remoteIndex < remotes.size())
+			&& scanned < SCHEDULING_WINDOW)
+		{
+			++scanned;
+
+			const bool isLocal = remoteIndex >= remotes.size()
+				|| (localIndex < locals.size()
+					&& locals.at(localIndex).timeStamp()
+						< remotes.at(remoteIndex).unixtime);
+
+			const EventScope scope = isLocal
+				? eventScope(locals.at(localIndex))
+				: eventScope(remotes.at(remoteIndex));
+
+			if (canStart(scope, blockedScopes))
+			{
+				beginEvent();
+
+				EventHandlerBase *handler = isLocal
+					? handleEvent(locals.takeAt(localIndex))
+					: handleEvent(remotes.takeAt(remoteIndex));
+
+				startHandler(handler, scope);
+				return true;
+			}
+
+			if (scope.exclusive)
+			{
+				// Nothing may overtake an event with unknown scope
+				return false;
+			}
+
+			blockedScopes << scope;
+
+			if (isLocal)
+			{
+				++localIndex;
+			}
+			else
+			{
+				++remoteIndex;
+			}
+		}
 	}
 
+	return false;
+}
+
+bool FileEventDispatcher::canStart(const EventScope& scope,
+	const QList<EventScope>& blockedScopes) const
+{
+	if (scope.exclusive)
+	{
+		return eventHandlers.isEmpty() && blockedScopes.isEmpty();
+	}
+
+	Q_FOREACH(const EventScope& runningScope, eventHandlerScopes)
+	{
+		if (scope.conflictsWith(runningScope))
+		{
+			return false;
+		}
+	}
+
+	Q_FOREACH(const EventScope& blockedScope, blockedScopes)
+	{
+		if (scope.conflictsWith(blockedScope))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void FileEventDispatcher::beginEvent()
+{
 	state = Processing;
 	emit processing();
 
-	if (!dontIncrementCurrentPosition)
+	if (!takeSkip(dontIncrementCurrentPosition))
 	{
 		currentPosition++;
 		processProgress();
 	}
-	else
+}
+
+FileEventDispatcher::EventScope FileEventDispatcher::eventScope(
+	const RemoteFileEvent& remoteEvent) const
+{
+	EventScope scope;
+	LocalCache& localCache = LocalCache::instance();
+
+	// The path the file has after the event ...
+	const QString path = localCache.findPath(remoteEvent.fileDesc);
+	if (path.isNull())
 	{
-		dontIncrementCurrentPosition = false;
+		scope.exclusive = true;
+		return scope;
 	}
+	scope.paths << path;
 
-	// High priority queues
-
-	if (!priorityRemoteEvents.isEmpty() && !priorityLocalEvents.isEmpty())
+	// ... and the path it had before, if the file is already known
+	const QString cachedPath = localCache.findPath(remoteEvent.fileDesc.id);
+	if (!cachedPath.isNull() && cachedPath != path)
 	{
-		// both queues are not empty, handle the earliest event
+		scope.paths << cachedPath;
+	}
+
+	return scope;
+}
+
+FileEventDispatcher::EventScope FileEventDispatcher::eventScope(
+	const LocalFileEvent& localEvent) const
+{
+	EventScope scope;
 
-		const LocalFileEvent& localEvent = priorityLocalEvents.head();
-		const RemoteFileEvent& remoteEvent = priorityRemoteEvents.head();
+	QStringList localPaths;
+	localPaths << localEvent.localPath();
+	if (!localEvent.oldLocalPath().isEmpty())
+	{
+		localPaths << localEvent.oldLocalPath();
+	}
 
-		if (localEvent.timeStamp() < remoteEvent.unixtime)
+	Q_FOREACH(const QString& localPath, localPaths)
+	{
+		const QString path = Utils::toRemotePath(localPath);
+		if (path.isEmpty())
 		{
-			handleEvent(priorityLocalEvents.dequeue());
+			scope.exclusive = true;
+			break;
 		}
-		else
+		scope.paths << path;
+	}
+
+	return scope;
+}
+
+bool FileEventDispatcher::extendEventScope(
+	EventHandlerBase* handler, const QString& remotePath)
+{
+	auto scopeIt = eventHandlerScopes.find(handler);
+	if (scopeIt == eventHandlerScopes.end())
+	{
+		return false;
+	}
+
+	EventScope extension;
+	extension.paths << remotePath;
+
+	for (auto it = eventHandlerScopes.constBegin();
+		it != eventHandlerScopes.constEnd(); ++it)
+	{
+		if (it.key() != handler && extension.conflictsWith(it.value()))
 		{
-			handleEvent(priorityRemoteEvents.dequeue());
+			return false;
 		}
-		return;
 	}
-	else if (!priorityLocalEvents.isEmpty())
+
+	scopeIt->paths << remotePath;
+	return true;
+}
+
+bool FileEventDispatcher::wasDeletedLocally(const QString& localPath) const
+{
+	const qint64 now = deletionClock.elapsed();
+
+	for (QString path = QDir::cleanPath(localPath); !path.isEmpty();)
 	{
-		handleEvent(priorityLocalEvents.dequeue());
-		return;
+		auto it = recentLocalDeletions.constFind(path);
+		if (it != recentLocalDeletions.constEnd()
+			&& now - it.value() < RECENT_DELETION_TTL)
+		{
+			return true;
+		}
+
+		const int slash = path.lastIndexOf(QLatin1Char('/'));
+		path = slash > 0 ? path.left(slash) : QString();
 	}
-	else if (!priorityRemoteEvents.isEmpty())
+
+	return false;
+}
+
+void FileEventDispatcher::noteLocalDeletion(const LocalFileEvent& localEvent)
+{
+	if (localEvent.type() != LocalFileEvent::Deleted)
 	{
-		handleEvent(priorityRemoteEvents.dequeue());
 		return;
 	}
 
-	// Normal priority queues
+	const qint64 now = deletionClock.elapsed();
 
-	if (!remoteEvents.isEmpty() && !localEvents.isEmpty())
+	if (now >= nextDeletionPurge)
 	{
-		// both queues are not empty, handle the earliest event
-
-		const LocalFileEvent& localEvent = localEvents.head();
-		const RemoteFileEvent& remoteEvent = remoteEvents.head();
-
-		if (localEvent.timeStamp() < remoteEvent.unixtime)
+		auto it = recentLocalDeletions.begin();
+		while (it != recentLocalDeletions.end())
 		{
-			handleEvent(localEvents.dequeue());
-		}
-		else
-		{
-			handleEvent(remoteEvents.dequeue());
+			if (now - it.value() < RECENT_DELETION_TTL)
+			{
+				++it;
+			}
+			else
+			{
+				it = recentLocalDeletions.erase(it);
+			}
 		}
+
+		nextDeletionPurge = now + RECENT_DELETION_TTL;
 	}
-	else if (!localEvents.isEmpty())
+
+	recentLocalDeletions.insert(QDir::cleanPath(localEvent.localPath()), now);
+}
+
+bool FileEventDispatcher::EventScope::conflictsWith(
+	const EventScope& other) const
+{
+	if (exclusive || other.exclusive)
 	{
-		handleEvent(localEvents.dequeue());
+		return true;
 	}
-	else if (!remoteEvents.isEmpty())
+
+	// Paths conflict if they are equal or one of them is an ancestor
+	// of the other one
+	Q_FOREACH(const QString& path, paths)
 	{
-		handleEvent(remoteEvents.dequeue());
+		Q_FOREACH(const QString& otherPath, other.paths)
+		{
+			const QString& shorter =
+				path.size() <= otherPath.size() ? path : otherPath;
+			const QString& longer =
+				path.size() <= otherPath.size() ? otherPath : path;
+
+			if (longer.startsWith(shorter)
+				&& (longer.size() == shorter.size()
+					|| longer.at(shorter.size()) == QLatin1Char('/')))
+			{
+				return true;
+			}
+		}
 	}
+
+	return false;
 }
 
-void FileEventDispatcher::handleEvent(const RemoteFileEvent& remoteEvent)
+int FileEventDispatcher::maxParallelEvents() const
 {
-	dontIncrementTotalCount = false;
+	return qMax(1,
+		Settings::instance().get(Settings::maxParallelEvents).toInt());
+}
 
+EventHandlerBase* FileEventDispatcher::handleEvent(
+	const RemoteFileEvent& remoteEvent)
+{
 	if (remoteFileEventShouldBeIgnored(remoteEvent))
 	{
 		logEvent(remoteEvent, "Previously queued REMOTE event: ");
 		logIgnored();
-		next();
-		return;
+		return nullptr;
 	}
 
-	// first check if the event in remoteFileEventExclusions
-
-	// UPDATE: exclusion check moved to eventAdded handlers
-
-//	RemoteFileEventExclusion exclusion;
-//	exclusion.id = remoteEvent.fileDesc.id;
-//	exclusion.type = remoteEvent.type;
-//
-//	int index = remoteFileEventExclusions.indexOf(exclusion);
-//
-//	if (index != -1)
-//	{
-//		QLOG_TRACE() << this << "Remote file event exclusion found for the current event, skipping it.";
-//		remoteFileEventExclusions.removeAt(index);
-//		next();
-//		return;
-//	}
-
-	EventHandlerBase *handlerThread = nullptr;
+	EventHandlerBase *handler = nullptr;
 
 	switch (remoteEvent.type)
 	{
 	case RemoteFileEvent::Created:
-		handlerThread = new RemoteFolderCreatedEventHandler(remoteEvent);
+		handler = new RemoteFolderCreatedEventHandler(remoteEvent);
 		break;
 	case RemoteFileEvent::Uploaded:
-		handlerThread = new RemoteFileUploadedEventHandler(remoteEvent);
+		handler = new RemoteFileUploadedEventHandler(remoteEvent);
 		break;
 	case RemoteFileEvent::Restored:
-		handlerThread = new RemoteFileOrFolderRestoredEventHandler(remoteEvent);
-		dontIncrementTotalCount = true;
-		dontIncrementCurrentPosition = true;
+		handler = new RemoteFileOrFolderRestoredEventHandler(remoteEvent);
+		dontIncrementTotalCount.ref();
+		dontIncrementCurrentPosition.ref();
 		break;
 	case RemoteFileEvent::Renamed:
 	case RemoteFileEvent::Moved:
-		handlerThread = new RemoteFileRenamedEventHandler(remoteEvent);
+		handler = new RemoteFileRenamedEventHandler(remoteEvent);
 		break;
 	case RemoteFileEvent::Trashed:
-		handlerThread = new RemoteFileTrashedEventHandler(remoteEvent);
+		handler = new RemoteFileTrashedEventHandler(remoteEvent);
 		break;
 	case RemoteFileEvent::Copied:
-		//handlerThread = new RemoteFileCopiedEventHandler(remoteEvent);
+		//handler = new RemoteFileCopiedEventHandler(remoteEvent);
 		break;
 	default:
 		break;
 	}
 
-	startHandlerThreadOrProcessNext(handlerThread);
+	return handler;
 }
 
-void FileEventDispatcher::handleEvent(const LocalFileEvent& localEvent)
+EventHandlerBase* FileEventDispatcher::handleEvent(
+	const LocalFileEvent& localEvent)
 {
 	QLOG_TRACE() << "FileEventDispatcher::handleEvent CURRENT POS:"
 		<< currentPosition;
 
-	dontIncrementTotalCount = false;
-
 	QString fileName = localEvent.localPath().
 		split(QDir::separator(), QString::SkipEmptyParts).last();
 
@@ -324,76 +544,72 @@ void FileEventDispatcher::handleEvent(const LocalFileEvent& localEvent)
 			QLOG_TRACE() << "Skipping local file event, because of temp file:"
 				<< fileName;
 
-			next();
-			return;
+			return nullptr;
 		}
 	}
 
-	EventHandlerBase *handlerThread = 0;
+	EventHandlerBase *handler = 0;
 
 	switch (localEvent.type())
 	{
 	case LocalFileEvent::Added:
 	case LocalFileEvent::Modified:
-		handlerThread = new LocalFileOrFolderAddedEventHandler(localEvent);
+		handler = new LocalFileOrFolderAddedEventHandler(localEvent);
 		break;
 	case LocalFileEvent::Deleted:
-		handlerThread = new LocalFileOrFolderDeletedEventHandler(localEvent);
+		handler = new LocalFileOrFolderDeletedEventHandler(localEvent);
 		break;
 	case LocalFileEvent::Moved:
-		handlerThread = new LocalFileOrFolderRenamedEventHandler(localEvent);
+		handler = new LocalFileOrFolderRenamedEventHandler(localEvent);
 		break;
 	default :
 		break;
 	}
 
-	startHandlerThreadOrProcessNext(handlerThread);
+	return handler;
 }
 
-void FileEventDispatcher::startHandlerThreadOrProcessNext(
-	EventHandlerBase* handlerThread)
+void FileEventDispatcher::startHandler(
+	EventHandlerBase* handler, const EventScope& scope)
 {
-	if (handlerThread)
+	if (handler)
 	{
-		connect(handlerThread, &EventHandlerBase::finished,
+		connect(handler, &EventHandlerBase::finished,
                 this, &FileEventDispatcher::onFinishProcessingEvent,
                 Qt::QueuedConnection);
 
-		connect(handlerThread, &EventHandlerBase::failed,
+		connect(handler, &EventHandlerBase::failed,
                 this, &FileEventDispatcher::onEventHandlerFailed,
                 Qt::QueuedConnection);
 
-		connect(handlerThread, &EventHandlerBase::newLocalFileEventExclusion,
+		connect(handler, &EventHandlerBase::newLocalFileEventExclusion,
 				this, &FileEventDispatcher::onNewLocalFileEventExclusion,
                 Qt::QueuedConnection);
 
-		connect(handlerThread, &EventHandlerBase::newRemoteFileEventExclusion,
+		connect(handler, &EventHandlerBase::newRemoteFileEventExclusion,
 				this, &FileEventDispatcher::onNewRemoteFileEventExclusion,
                 Qt::QueuedConnection);
 
-		connect(handlerThread, &EventHandlerBase::newRemoteFileEvent,
+		connect(handler, &EventHandlerBase::newRemoteFileEvent,
 				this, &FileEventDispatcher::addRemoteFileEvent,
                 Qt::QueuedConnection);
 
-		connect(handlerThread, &EventHandlerBase::newLocalFileEvent,
+		connect(handler, &EventHandlerBase::newLocalFileEvent,
 				this, &FileEventDispatcher::addLocalFileEvent,
                 Qt::QueuedConnection);
 
-		connect(handlerThread, &EventHandlerBase::newPriorityRemoteFileEvent,
+		connect(handler, &EventHandlerBase::newPriorityRemoteFileEvent,
 				this, &FileEventDispatcher::addPriorityRemoteFileEvent,
                 Qt::QueuedConnection);
 
-		connect(handlerThread, &EventHandlerBase::newPriorityLocalFileEvent,
+		connect(handler, &EventHandlerBase::newPriorityLocalFileEvent,
 				this, &FileEventDispatcher::addPriorityLocalFileEvent,
                 Qt::QueuedConnection);
 
-		eventHandlers << handlerThread;
+		eventHandlers << handler;
+		eventHandlerScopes.insert(handler, scope);
 
-        handlerThread->startThread();
-	}
-	else
-	{
-		next();
+        handler->start();
 	}
 }
 
@@ -410,6 +626,7 @@ void FileEventDispatcher::cancelAll()
 
 	remoteEvents.clear();
 	localEvents.clear();
+	localEventCoalescer->clear();
 
 	QListIterator<EventHandlerBase*> i(eventHandlers);
 	while (i.hasNext())
@@ -437,29 +654,21 @@ void FileEventDispatcher::onFinishProcessingEvent(EventHandlerBase *handler)
     Q_ASSERT(handler);
     handler->markOk();
     eventHandlers.removeOne(handler);
+    eventHandlerScopes.remove(handler);
+    handler->deleteLater();
     next();
 }
 
 void FileEventDispatcher::onNewLocalFileEventExclusion(const LocalFileEventExclusion &localExclusion)
 {
 	QMutexLocker locker(&localExclusionsMutex);
-	localFileEventExclusions << localExclusion;
+	localFileEventExclusions.add(localExclusion);
 }
 
 bool FileEventDispatcher::localFileEventShouldBeIgnored(const LocalFileEvent &event)
 {
-	for (int i = 0; i < localFileEventExclusions.size(); ++i)
-	{
-		const LocalFileEventExclusion& localFileEventExclusion =
-				localFileEventExclusions.at(i);
-		if (localFileEventExclusion.matches(event))
-		{
-			localFileEventExclusions.removeAt(i);
-			return true;
-		}
-	}
-
-	return false;
+	QMutexLocker locker(&localExclusionsMutex);
+	return localFileEventExclusions.consume(event);
 }
 
 void FileEventDispatcher::onNewRemoteFileEventExclusion(
@@ -467,62 +676,14 @@ void FileEventDispatcher::onNewRemoteFileEventExclusion(
 {
 	QMutexLocker locker(&remoteExclusionsMutex);
 	remoteExclusion.log();
-	remoteFileEventExclusions.append(remoteExclusion);
+	remoteFileEventExclusions.add(remoteExclusion);
 }
 
 bool FileEventDispatcher::remoteFileEventShouldBeIgnored(
 	const RemoteFileEvent &event)
 {
-	for (int i = 0; i < remoteFileEventExclusions.size(); ++i)
-	{
-		RemoteFileEventExclusion exclusion = remoteFileEventExclusions.at(i);
-		if (exclusion.matches(event))
-		{
-			remoteFileEventExclusions.removeAt(i);
-			return true;
-		}
-	}
-
-	return false;
-}
-
-bool FileEventDispatcher::shouldBeGrouped(const LocalFileEvent &event)
-{
-	// Grouping events EEs with some another event E means that EEs
-	// should be ignored because semantically EEs will be processed
-	// by E handler. So executing EEs handlers would be useless
-	// ---
-	// Grouping rules:
-	// 1. not processed "modified" event should be grouped with
-	//	a *prior* and not processed "added" event
-	// 2. not processed "modified" event should be grouped with
-	//	a *prior* and not processed "modified" event
-
-	// 3. not processed "deleted" event should be grouped with
-	//	a *latter* "deleted" event.
-
-	// 3old. not processed "added" and "modified" events should be grouped with
-	//	a *latter* "deleted" event.
-	//	OTOH: user would have not the current version of a file in the trash
-
-	if (event.type() == LocalFileEvent::Modified)
-	{
-		for (int i = 0; i < localEvents.size(); ++i)
-		{
-			LocalFileEvent queuedEvent(localEvents.at(i));
-
-			// Rules 1 and 2:
-
-			if ( (queuedEvent.type() == LocalFileEvent::Added
-				|| queuedEvent.type() == LocalFileEvent::Modified)
-				&& queuedEvent.localPath() == event.localPath())
-			{
-				return true;
-			}
-		}
-	}
-
-	return false;
+	QMutexLocker locker(&remoteExclusionsMutex);
+	return remoteFileEventExclusions.consume(event);
 }
 
 QString FileEventDispatcher::stateToString()
@@ -549,12 +710,20 @@ void FileEventDispatcher::processProgress() const
 		emit progress(currentPosition, totalCount);
 }
 
+int FileEventDispatcher::pendingEvents() const
+{
+	return queuesSize();
+}
+
 int FileEventDispatcher::queuesSize() const
 {
+	// Held local events are pending too, the queue isn't finished
+	// (and the sync state isn't saved) before they are handled
 	return priorityLocalEvents.size()
 		+ priorityRemoteEvents.size()
 		+ remoteEvents.size()
-		+ localEvents.size();
+		+ localEvents.size()
+		+ localEventCoalescer->size();
 }
 
 void FileEventDispatcher::logEvent(const RemoteFileEvent &event, const QString &prefix)
@@ -608,11 +777,4 @@ void FileEventDispatcher::logIgnored() const
 	eventLogFile->flush();
 }
 
-void FileEventDispatcher::logGrouped() const
-{
-	QString line("  - GROUPED with another event\n");
-	eventLogFile->write(line.toUtf8());
-	eventLogFile->flush();
-}
-
 }
@@ -3,12 +3,17 @@
 
 #include "APIClient/APITypes.h"
 #include "LocalFileEvent.h"
+#include "EventExclusionIndex.h"
 
 #include <QtCore/QObject>
 #include <QtCore/QQueue>
 #include <QtCore/QMap>
+#include <QtCore/QHash>
+#include <QtCore/QStringList>
 #include <QtCore/QMutex>
+#include <QtCore/QAtomicInt>
 #include <QtCore/QFile>
+#include <QtCore/QElapsedTimer>
 #include <QtNetwork/QNetworkCookie>
 
 namespace Drive
@@ -19,9 +24,8 @@ namespace Drive
 // struct LocalFileEvent;
 // class LocalFileEventExclusion;
 
-typedef QList<LocalFileEventExclusion> LocalFileEventExclusionList;
-
 class EventHandlerBase;
+class LocalEventCoalescer;
 
 class FileEventDispatcher : public QObject
 {
@@ -44,6 +48,19 @@ public:
 	void pause();
 	void cancelAll();
 
+	// Number of queued events which are not being handled yet,
+	// including the local events held until their paths settle.
+	int pendingEvents() const;
+
+	// Adds a remote path to the scope of a running handler, the events
+	// touching it wait for the handler from now on. Returns false if
+	// another running handler touches the path.
+	bool extendEventScope(EventHandlerBase* handler, const QString& remotePath);
+
+	// True if a local Deleted event was queued lately for the path or one
+	// of its folders, whether it is still pending or handled already.
+	bool wasDeletedLocally(const QString& localPath) const;
+
 public slots:
 	void addRemoteFileEvent(Drive::RemoteFileEvent remoteEvent);
 	void addLocalFileEvent(Drive::LocalFileEvent localEvent);
@@ -62,6 +79,8 @@ private slots:
 
     void onFinishProcessingEvent(EventHandlerBase *handler);
 
+	void onLocalFileEventSettled(const Drive::LocalFileEvent& localEvent);
+
 	void onNewLocalFileEventExclusion(const LocalFileEventExclusion &localExclusion);
 	void onNewRemoteFileEventExclusion(const RemoteFileEventExclusion &remoteExclusion);
 
@@ -72,18 +91,39 @@ private:
 	explicit FileEventDispatcher(QObject *parent = 0);
 	Q_DISABLE_COPY(FileEventDispatcher)
 
+	// Remote paths touched by an event. Events with overlapping scopes
+	// are handled one by one in the order they were queued.
+	struct EventScope
+	{
+		EventScope() : exclusive(false) {}
+
+		bool conflictsWith(const EventScope& other) const;
+
+		QStringList paths;
+		// The paths are unknown, the event conflicts with any other one
+		bool exclusive;
+	};
+
+	static bool takeSkip(QAtomicInt& counter);
 	void proceed();
 	void finish();
 	void next();
-	void handleEvent(const RemoteFileEvent& remoteEvent);
-	void handleEvent(const LocalFileEvent& remoteEvent);
-	void startHandlerThreadOrProcessNext(EventHandlerBase* handlerThread);
+	bool startNextEvent();
+	bool canStart(const EventScope& scope,
+			const QList<EventScope>& blockedScopes) const;
+	void beginEvent();
+	EventScope eventScope(const RemoteFileEvent& remoteEvent) const;
+	EventScope eventScope(const LocalFileEvent& localEvent) const;
+	EventHandlerBase* handleEvent(const RemoteFileEvent& remoteEvent);
+	EventHandlerBase* handleEvent(const LocalFileEvent& localEvent);
+	void startHandler(EventHandlerBase* handler, const EventScope& scope);
+	int maxParallelEvents() const;
+
+	void noteLocalDeletion(const LocalFileEvent& localEvent);
 
 	bool localFileEventShouldBeIgnored(const LocalFileEvent &event);
 	bool remoteFileEventShouldBeIgnored(const RemoteFileEvent &event);
 
-	bool shouldBeGrouped(const LocalFileEvent &event);
-
 	void log();
 	QString stateToString();
 	void processProgress() const;
@@ -92,20 +132,23 @@ private:
 	void logEvent(const LocalFileEvent &event, const QString &prefix = QString());
 
 	void logIgnored() const;
-	void logGrouped() const;
 
 	State state;
 
 	QQueue<RemoteFileEvent> remoteEvents;
 	QQueue<LocalFileEvent> localEvents;
 
+	// Local events wait here until their paths settle down
+	LocalEventCoalescer *localEventCoalescer;
+
 	QQueue<RemoteFileEvent> priorityRemoteEvents;
 	QQueue<LocalFileEvent> priorityLocalEvents;
 
 	QList<EventHandlerBase*> eventHandlers;
+	QHash<EventHandlerBase*, EventScope> eventHandlerScopes;
 
-	LocalFileEventExclusionList localFileEventExclusions;
-	QList<RemoteFileEventExclusion> remoteFileEventExclusions;
+	LocalFileEventExclusionIndex localFileEventExclusions;
+	RemoteFileEventExclusionIndex remoteFileEventExclusions;
 
 	QMutex remoteExclusionsMutex;
 	QMutex localExclusionsMutex;
@@ -115,10 +158,17 @@ private:
 
 	int globalCounter;
 
-	bool dontIncrementTotalCount; // if currently processing event is restore
-	bool dontIncrementCurrentPosition; // if last processed event was restore
+	// Restore events whose follow-up is not counted, the events run in
+	// parallel so each one takes a single skip
+	QAtomicInt dontIncrementTotalCount;
+	QAtomicInt dontIncrementCurrentPosition;
 	bool lastSuccessfullyHandled;
 
+	// Local path -> when its Deleted event was queued
+	QHash<QString, qint64> recentLocalDeletions;
+	QElapsedTimer deletionClock;
+	qint64 nextDeletionPurge;
+
 	QFile *eventLogFile;
 };
 
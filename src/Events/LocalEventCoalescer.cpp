@@ -0,0 +1,293 @@
+﻿#include "LocalEventCoalescer.h"
+#include "Cache.h"
+
+#include "Settings/settings.h"
+#include "Util/FileUtils.h"
+
+#include <QtCore/QSet>
+#include <QtCore/QStringList>
+
+namespace Drive
+{
+
+LocalEventCoalescer::LocalEventCoalescer(QObject *parent)
+	: QObject(parent)
+	, m_nextOrder(0)
+{
+	m_clock.start();
+
+	m_timer.setSingleShot(true);
+	connect(&m_timer, &QTimer::timeout,
+			this, &LocalEventCoalescer::releaseSettled);
+}
+
+void LocalEventCoalescer::add(const LocalFileEvent& event)
+{
+	const qint64 now = m_clock.elapsed();
+
+	if (event.type() == LocalFileEvent::Moved
+		&& !event.oldLocalPath().isEmpty())
+	{
+		addMove(event, now);
+		scheduleRelease();
+		return;
+	}
+
+	const QString path = event.localPath();
+	auto it = m_pending.find(path);
+
+	if (it == m_pending.end())
+	{
+		insert(event, now);
+	}
+	else if (it->event.type() == LocalFileEvent::Moved)
+	{
+		// Renames are not folded with content changes
+		release(path);
+		insert(event, now);
+	}
+	else
+	{
+		const LocalFileEvent::Type pendingType = it->event.type();
+		LocalFileEvent::Type type = event.type();
+
+		switch (event.type())
+		{
+		case LocalFileEvent::Deleted:
+			if (pendingType == LocalFileEvent::Added && !isKnownRemotely(path))
+			{
+				// Created and deleted before it settled: nothing to sync
+				remove(path);
+				scheduleRelease();
+				return;
+			}
+			break;
+		case LocalFileEvent::Modified:
+			if (pendingType != LocalFileEvent::Modified)
+			{
+				// Modification of a new or re-created file
+				type = LocalFileEvent::Added;
+			}
+			break;
+		default:
+			break;
+		}
+
+		it->event = event.copyTo(type);
+		it->lastTouched = now;
+	}
+
+	scheduleRelease();
+}
+
+void LocalEventCoalescer::clear()
+{
+	m_timer.stop();
+	m_pending.clear();
+	m_order.clear();
+}
+
+int LocalEventCoalescer::size() const
+{
+	return m_pending.size();
+}
+
+void LocalEventCoalescer::addMove(const LocalFileEvent& event, const qint64 now)
+{
+	const QString newPath = event.localPath();
+	const QString oldPath = event.oldLocalPath();
+
+	auto oldIt = m_pending.find(oldPath);
+	if (oldIt != m_pending.end())
+	{
+		const LocalFileEvent previous = oldIt->event;
+
+		if (previous.type() == LocalFileEvent::Added && !isKnownRemotely(oldPath))
+		{
+			// Created and renamed before it settled:
+			// the file is just created under the new name
+			remove(oldPath);
+			if (m_pending.contains(newPath))
+			{
+				release(newPath);
+			}
+			insert(LocalFileEvent(LocalFileEvent::Added,
+				event.dir(), event.fileName()), now);
+			rebaseDescendants(oldPath, newPath);
+			return;
+		}
+
+		if (previous.type() == LocalFileEvent::Moved
+			&& previous.dir() == event.dir())
+		{
+			// Rename chain a -> b -> c collapses to a -> c,
+			// a -> b -> a disappears
+			remove(oldPath);
+			if (m_pending.contains(newPath))
+			{
+				release(newPath);
+			}
+			if (previous.oldLocalPath() != newPath)
+			{
+				insert(LocalFileEvent(LocalFileEvent::Moved, event.dir(),
+					event.fileName(), previous.oldFileName()), now);
+			}
+			rebaseDescendants(oldPath, newPath);
+			return;
+		}
+
+		release(oldPath);
+	}
+
+	if (m_pending.contains(newPath))
+	{
+		release(newPath);
+	}
+
+	insert(event, now);
+	rebaseDescendants(oldPath, newPath);
+}
+
+void LocalEventCoalescer::insert(const LocalFileEvent& event, const qint64 now)
+{
+	const QString path = event.localPath();
+	Q_ASSERT(!m_pending.contains(path));
+
+	PendingEvent pending;
+	pending.event = event;
+	pending.lastTouched = now;
+	pending.order = m_nextOrder++;
+
+	m_pending.insert(path, pending);
+	m_order.insert(pending.order, path);
+}
+
+void LocalEventCoalescer::remove(const QString& path)
+{
+	auto it = m_pending.find(path);
+	if (it != m_pending.end())
+	{
+		m_order.remove(it->order);
+		m_pending.erase(it);
+	}
+}
+
+void LocalEventCoalescer::release(const QString& path)
+{
+	auto it = m_pending.find(path);
+	if (it != m_pending.end())
+	{
+		const LocalFileEvent event = it->event;
+		remove(path);
+		emit settled(event);
+	}
+}
+
+void LocalEventCoalescer::rebaseDescendants(
+	const QString& oldPath, const QString& newPath)
+{
+	// Pending events under a renamed folder refer to paths which do not
+	// exist anymore. Move them to the new location and queue them after
+	// the rename itself, so the remote folder is renamed first.
+	const QString prefix = oldPath + Utils::separator();
+
+	QList<PendingEvent> descendants;
+	for (auto it = m_order.begin(); it != m_order.end(); )
+	{
+		if (it.value().startsWith(prefix))
+		{
+			descendants << m_pending.take(it.value());
+			it = m_order.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	Q_FOREACH(const PendingEvent& pending, descendants)
+	{
+		const LocalFileEvent& event = pending.event;
+		const LocalFileEvent rebased(event.type(),
+			newPath + event.dir().mid(oldPath.size()),
+			event.fileName(), event.oldFileName());
+
+		if (m_pending.contains(rebased.localPath()))
+		{
+			release(rebased.localPath());
+		}
+		insert(rebased, pending.lastTouched);
+	}
+}
+
+void LocalEventCoalescer::releaseSettled()
+{
+	const qint64 now = m_clock.elapsed();
+	const int debounce = debounceInterval();
+
+	// Paths of the pending events which are still changing
+	QSet<QString> heldPaths;
+	QStringList settledPaths;
+
+	for (auto it = m_order.constBegin(); it != m_order.constEnd(); ++it)
+	{
+		const QString& path = it.value();
+		const PendingEvent& pending = m_pending[path];
+
+		bool held = now - pending.lastTouched < debounce;
+
+		// An event may not overtake a pending event for its ancestor
+		for (int pos = path.lastIndexOf(Utils::separator());
+			!held && pos > 0;
+			pos = path.lastIndexOf(Utils::separator(), pos - 1))
+		{
+			held = heldPaths.contains(path.left(pos));
+		}
+
+		if (!held)
+		{
+			settledPaths << path;
+			continue;
+		}
+
+		heldPaths.insert(path);
+		if (pending.event.type() == LocalFileEvent::Moved)
+		{
+			heldPaths.insert(pending.event.oldLocalPath());
+		}
+	}
+
+	Q_FOREACH(const QString& path, settledPaths)
+	{
+		release(path);
+	}
+
+	scheduleRelease();
+}
+
+bool LocalEventCoalescer::isKnownRemotely(const QString& localPath) const
+{
+	const QString remotePath = Utils::toRemotePath(localPath);
+	return !remotePath.isEmpty()
+		&& LocalCache::instance().file(remotePath).isValid();
+}
+
+void LocalEventCoalescer::scheduleRelease()
+{
+	if (m_pending.isEmpty())
+	{
+		m_timer.stop();
+	}
+	else if (!m_timer.isActive())
+	{
+		m_timer.start(debounceInterval());
+	}
+}
+
+int LocalEventCoalescer::debounceInterval() const
+{
+	return qMax(0,
+		Settings::instance().get(Settings::localEventsDebounce).toInt());
+}
+
+}
@@ -0,0 +1,72 @@
+﻿#ifndef LOCAL_EVENT_COALESCER_H
+#define LOCAL_EVENT_COALESCER_H
+
+#include "LocalFileEvent.h"
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QTimer>
+
+namespace Drive
+{
+
+//
+// Holds local file events until their paths settle down and folds
+// event sequences for the same path into their net effect, e.g.
+// added + modified -> added, added + deleted -> nothing,
+// a -> b -> c renames -> a -> c.
+//
+// Settled events are emitted in the order their paths were first touched,
+// an event is held back while an event for its ancestor is still pending.
+//
+class LocalEventCoalescer : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit LocalEventCoalescer(QObject *parent = 0);
+
+	void add(const LocalFileEvent& event);
+	void clear();
+
+	int size() const;
+
+signals:
+	void settled(const Drive::LocalFileEvent& event);
+
+private slots:
+	void releaseSettled();
+
+private:
+	struct PendingEvent
+	{
+		LocalFileEvent event;
+		qint64 lastTouched;
+		quint64 order;
+	};
+
+	void addMove(const LocalFileEvent& event, qint64 now);
+	void insert(const LocalFileEvent& event, qint64 now);
+	void remove(const QString& path);
+	void release(const QString& path);
+	void rebaseDescendants(const QString& oldPath, const QString& newPath);
+
+	bool isKnownRemotely(const QString& localPath) const;
+	void scheduleRelease();
+	int debounceInterval() const;
+
+	// path -> net event for the path
+	QHash<QString, PendingEvent> m_pending;
+	// arrival order -> path
+	QMap<quint64, QString> m_order;
+	quint64 m_nextOrder;
+
+	QElapsedTimer m_clock;
+	QTimer m_timer;
+};
+
+}
+
+#endif // LOCAL_EVENT_COALESCER_H
@@ -2,10 +2,13 @@
 
 #include "Application/factoriesstorage.h"
 #include "Cache.h"
+#include "FileEventDispatcher.h"
 
 #include "Util/FileUtils.h"
 #include "QsLog/QsLog.h"
+#include "Util/FileHasher.h"
 #include "APIClient/FileUploader.h"
+#include "APIClient/DownloadSession.h"
 
 #include <QtCore/QFileInfo>
 #include <QtCore/QDir>
@@ -34,6 +37,7 @@ LocalFileOrFolderAddedEventHandler::LocalFileOrFolderAddedEventHandler(
 	: LocalEventHandlerBase(localEvent, parent)
 	, m_parentId(0)
 	, m_remotePath(Utils::toRemotePath(localEvent.localPath()))
+	, m_deltaUpload(false)
 {
 }
 
@@ -51,7 +55,8 @@ void LocalFileOrFolderAddedEventHandler::runEventHandling()
 		return;
 	}
 
-	if (QFileInfo(localEvent.localPath()).isHidden())
+	if (QFileInfo(localEvent.localPath()).isHidden()
+		|| DownloadSession::isTempFileName(localEvent.fileName()))
 	{
 		processEventsAndQuit();
 		return;
@@ -133,17 +138,15 @@ void LocalFileOrFolderAddedEventHandler::onGetFileObjectSucceeded(
 		{
 			processEventsAndQuit();
 		}
+		else if (!fileDesc.checkSum.isEmpty()
+			&& fileDesc.size == static_cast<quint64>(fileInfo.size()))
+		{
+			// The file may have been touched or saved unchanged
+			hashLocalFile();
+		}
 		else
 		{
-			TrashRestResourceRef trashRes = TrashRestResource::create();
-
-			connect(trashRes.data(), &TrashRestResource::succeeded,
-				this, &LocalFileOrFolderAddedEventHandler::onTrashSucceeded);
-
-			connect(trashRes.data(), &TrashRestResource::failed,
-				this, &LocalFileOrFolderAddedEventHandler::onTrashFailed);
-
-			trashRes->trash(fileDesc.id);
+			replaceRemoteFile();
 		}
 	}
 }
@@ -155,6 +158,8 @@ void LocalFileOrFolderAddedEventHandler::onGetFileObjectFailed(const QString&)
 
 void LocalFileOrFolderAddedEventHandler::onGetFileObjectParentIdSucceeded(int id)
 {
+	m_parentId = id;
+
 	const QFileInfo fileInfo(localEvent.localPath());
 	if (fileInfo.isDir())
 	{
@@ -172,13 +177,8 @@ void LocalFileOrFolderAddedEventHandler::onGetFileObjectParentIdSucceeded(int id
 	{
 		if (QFileInfo::exists(localEvent.localPath()))
 		{
-			FileUploader *uploader = new FileUploader(id, localEvent.localPath(), this);
-
-			connect(uploader, &FileUploader::succeeded,
-				this, &LocalFileOrFolderAddedEventHandler::onUploadSucceeded);
-
-			connect(uploader, &FileUploader::failed,
-				this, &LocalFileOrFolderAddedEventHandler::onUploadFailed);
+			// The content may be on the server already under another name
+			hashLocalFile();
 		}
 		else
 		{
@@ -235,10 +235,203 @@ void LocalFileOrFolderAddedEventHandler::
 
 void LocalFileOrFolderAddedEventHandler::onUploadFailed(const QString& error)
 {
+	if (m_deltaUpload)
+	{
+		QLOG_ERROR() << "Delta upload of" << localEvent.localPath()
+			<< "failed:" << error << ", uploading it as a whole";
+		m_deltaUpload = false;
+		trashRemoteFile();
+		return;
+	}
+
     Q_EMIT failed((EventHandlerBase*) this, error);
 	processEventsAndQuit();
 }
 
+void LocalFileOrFolderAddedEventHandler::hashLocalFile()
+{
+	connect(&FileHasher::instance(), &FileHasher::hashed,
+		this, &LocalFileOrFolderAddedEventHandler::onFileHashed);
+
+	FileHasher::instance().hash(localEvent.localPath());
+}
+
+void LocalFileOrFolderAddedEventHandler::onFileHashed(
+	const QString& filePath, const QString& hash)
+{
+	if (filePath != localEvent.localPath())
+	{
+		return;
+	}
+
+	disconnect(&FileHasher::instance(), &FileHasher::hashed,
+		this, &LocalFileOrFolderAddedEventHandler::onFileHashed);
+
+	if (m_remoteFileDesc.isValid())
+	{
+		if (FileHasher::sameHash(hash, m_remoteFileDesc.checkSum))
+		{
+			QLOG_INFO() << "Content of" << localEvent.localPath()
+				<< "is unchanged, skipping upload";
+			processEventsAndQuit();
+		}
+		else
+		{
+			replaceRemoteFile();
+		}
+		return;
+	}
+
+	m_movedFileDesc = findMovedFile(hash);
+	if (!m_movedFileDesc.isValid())
+	{
+		uploadFile();
+		return;
+	}
+
+	// Events for the old path mustn't trash or download the file while it moves
+	const QString movedPath = LocalCache::instance().findPath(m_movedFileDesc.id);
+	if (movedPath.isNull()
+		|| !FileEventDispatcher::instance().extendEventScope(this, movedPath))
+	{
+		QLOG_INFO() << "Remote file" << m_movedFileDesc.id
+			<< "is busy, uploading" << localEvent.localPath();
+		m_movedFileDesc = RemoteFileDesc();
+		uploadFile();
+		return;
+	}
+
+	QLOG_INFO() << "File" << localEvent.localPath()
+		<< "has the same content as the missing remote file"
+		<< m_movedFileDesc.id << ", moving it instead of upload";
+
+	MoveRestResourceRef moveResource = MoveRestResource::create();
+
+	connect(moveResource.data(), &MoveRestResource::succeeded,
+		this, &LocalFileOrFolderAddedEventHandler::onMoveSucceeded);
+
+	connect(moveResource.data(), &MoveRestResource::failed,
+		this, &LocalFileOrFolderAddedEventHandler::onMoveFailed);
+
+	moveResource->move(m_movedFileDesc.id, localEvent.fileName(), m_parentId);
+}
+
+RemoteFileDesc LocalFileOrFolderAddedEventHandler::findMovedFile(
+	const QString& hash) const
+{
+	if (hash.isEmpty())
+	{
+		return RemoteFileDesc();
+	}
+
+	const quint64 size = QFileInfo(localEvent.localPath()).size();
+
+	LocalCache& localCache = LocalCache::instance();
+	for (const RemoteFileDesc& fileDesc : localCache.filesByCheckSum(hash))
+	{
+		if (fileDesc.size != size)
+		{
+			continue;
+		}
+
+		const QString remotePath = localCache.findPath(fileDesc);
+		if (remotePath.isNull() || remotePath == m_remotePath)
+		{
+			continue;
+		}
+
+		// A copy if the old path was not deleted: the file may be yet to
+		// download, or the content kept in two folders
+		const QString oldLocalPath = Utils::toLocalPath(remotePath);
+		if (!QFileInfo::exists(oldLocalPath)
+			&& FileEventDispatcher::instance().wasDeletedLocally(oldLocalPath))
+		{
+			return fileDesc;
+		}
+	}
+
+	return RemoteFileDesc();
+}
+
+void LocalFileOrFolderAddedEventHandler::onMoveSucceeded()
+{
+	RemoteFileDesc fileDesc = m_movedFileDesc;
+	const bool renamed = fileDesc.name != localEvent.fileName();
+	fileDesc.parentId = m_parentId;
+	fileDesc.name = localEvent.fileName();
+
+	if (LocalCache::instance().addFile(fileDesc))
+	{
+		Q_EMIT newRemoteFileEventExclusion(
+				RemoteFileEventExclusion(RemoteFileEvent::Moved, fileDesc.id));
+		if (renamed)
+		{
+			Q_EMIT newRemoteFileEventExclusion(
+					RemoteFileEventExclusion(RemoteFileEvent::Renamed, fileDesc.id));
+		}
+	}
+
+	processEventsAndQuit();
+}
+
+void LocalFileOrFolderAddedEventHandler::onMoveFailed(const QString& error)
+{
+	QLOG_ERROR() << "Moving of remote file" << m_movedFileDesc.id
+		<< "failed:" << error << ", uploading it";
+	uploadFile();
+}
+
+void LocalFileOrFolderAddedEventHandler::replaceRemoteFile()
+{
+	if (!FileUploader::canUploadDelta(localEvent.localPath(), m_remoteFileDesc))
+	{
+		trashRemoteFile();
+		return;
+	}
+
+	// The remote file is updated in place with the changed blocks only
+	m_deltaUpload = true;
+
+	FileUploader *uploader = new FileUploader(m_remoteFileDesc.parentId,
+		localEvent.localPath(), m_remoteFileDesc, this);
+
+	connect(uploader, &FileUploader::succeeded,
+		this, &LocalFileOrFolderAddedEventHandler::onUploadSucceeded);
+
+	connect(uploader, &FileUploader::failed,
+		this, &LocalFileOrFolderAddedEventHandler::onUploadFailed);
+}
+
+void LocalFileOrFolderAddedEventHandler::trashRemoteFile()
+{
+	TrashRestResourceRef trashRes = TrashRestResource::create();
+
+	connect(trashRes.data(), &TrashRestResource::succeeded,
+		this, &LocalFileOrFolderAddedEventHandler::onTrashSucceeded);
+
+	connect(trashRes.data(), &TrashRestResource::failed,
+		this, &LocalFileOrFolderAddedEventHandler::onTrashFailed);
+
+	trashRes->trash(m_remoteFileDesc.id);
+}
+
+void LocalFileOrFolderAddedEventHandler::uploadFile()
+{
+	if (!QFileInfo::exists(localEvent.localPath()))
+	{
+		processEventsAndQuit();
+		return;
+	}
+
+	FileUploader *uploader = new FileUploader(m_parentId, localEvent.localPath(), this);
+
+	connect(uploader, &FileUploader::succeeded,
+		this, &LocalFileOrFolderAddedEventHandler::onUploadSucceeded);
+
+	connect(uploader, &FileUploader::failed,
+		this, &LocalFileOrFolderAddedEventHandler::onUploadFailed);
+}
+
 void LocalFileOrFolderAddedEventHandler::onTrashSucceeded()
 {
 	FilesRestResourceRef filesRestResource = FilesRestResource::create();
@@ -262,6 +455,8 @@ void LocalFileOrFolderAddedEventHandler::onTrashFailed(const QString&)
 
 void LocalFileOrFolderAddedEventHandler::onRemoveSucceeded()
 {
+	// The file is uploaded anew from now on
+	m_remoteFileDesc = RemoteFileDesc();
 	onGetFileObjectIdFailed();
 }
 
@@ -53,10 +53,27 @@ private slots:
 	void onRemoveSucceeded();
 	void onRemoveFailed(const QString&);
 
+	void onFileHashed(const QString& filePath, const QString& hash);
+
+	void onMoveSucceeded();
+	void onMoveFailed(const QString& error);
+
+private:
+	void hashLocalFile();
+	void replaceRemoteFile();
+	void trashRemoteFile();
+	void uploadFile();
+
+	// A cached remote file with the same content whose local copy has been
+	// deleted lately, i.e. the file has been moved locally
+	RemoteFileDesc findMovedFile(const QString& hash) const;
+
 private:
 	int m_parentId;
 	const QString m_remotePath;
 	RemoteFileDesc m_remoteFileDesc;
+	RemoteFileDesc m_movedFileDesc;
+	bool m_deltaUpload;
 	GetChildrenResourceRef m_getChildrenResource;
 };
 
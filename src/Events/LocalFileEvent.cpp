@@ -59,12 +59,22 @@ uint LocalFileEvent::timeStamp() const
 	return m_timeStamp;
 }
 
+QString LocalFileEvent::dir() const
+{
+	return m_dir;
+}
+
 QString LocalFileEvent::fileName() const
 {
 	Q_ASSERT(!m_filePath.isEmpty());
 	return m_filePath.split(Utils::separator(), QString::SkipEmptyParts).last();
 }
 
+QString LocalFileEvent::oldFileName() const
+{
+	return m_oldFileName;
+}
+
 QString LocalFileEvent::localPath() const
 {
 	return m_dir + Utils::separator() + m_filePath;
@@ -28,7 +28,9 @@ public:
     QString typeString() const;
     uint timeStamp() const;
 
+	QString dir() const;
 	QString fileName() const;
+	QString oldFileName() const;
 	QString localPath() const;
 	QString oldLocalPath() const;
 
@@ -3,17 +3,30 @@
 #include <iostream>
 #include <QtCore/QDir>
 #include <QtCore/QDateTime>
+#include <QtCore/QStringList>
 
 #include "QsLog/QsLog.h"
 
 #include "LocalFileEvent.h"
 #include "Settings/settings.h"
+#include "Util/DirectoryScanner.h"
 #include "Util/FileUtils.h"
+#include "APIClient/DownloadSession.h"
 
 
 namespace Drive
 {
 
+namespace
+{
+
+// Room for a burst while the listener thread catches up
+const int s_actionCapacity = 32 * 1024;
+// Actions turned into events per pass, the rest is left for the next one
+const int s_batchSize = 1024;
+
+}
+
 
 LocalFileEventNotifier& LocalFileEventNotifier::instance()
 {
@@ -23,11 +36,20 @@ LocalFileEventNotifier& LocalFileEventNotifier::instance()
 
 LocalFileEventNotifier::LocalFileEventNotifier(QObject *parent)
 	: QObject(parent)
-	, m_listener(new LocalListener(this))
+	, m_listener(new LocalListener())
 	, m_watchID(0)
 {
-	connect(m_listener.get(), &LocalListener::newLocalFileEvent,
-		this, &LocalFileEventNotifier::newLocalFileEvent);
+	m_listener->moveToThread(&m_listenerThread);
+	connect(m_listener.get(), &LocalListener::newLocalFileEvents,
+		this, &LocalFileEventNotifier::onLocalFileEvents);
+
+	m_listenerThread.start();
+}
+
+LocalFileEventNotifier::~LocalFileEventNotifier()
+{
+	m_listenerThread.quit();
+	m_listenerThread.wait();
 }
 
 void LocalFileEventNotifier::resetFolder()
@@ -49,6 +71,29 @@ void LocalFileEventNotifier::stop()
 	m_watchID = 0;
 }
 
+int LocalFileEventNotifier::droppedEvents() const
+{
+	return m_listener->droppedEvents();
+}
+
+int LocalFileEventNotifier::coalescedEvents() const
+{
+	return m_listener->coalescedEvents();
+}
+
+int LocalFileEventNotifier::overflows() const
+{
+	return m_listener->overflows();
+}
+
+void LocalFileEventNotifier::onLocalFileEvents(const QList<LocalFileEvent>& events)
+{
+	Q_FOREACH(const LocalFileEvent& event, events)
+	{
+		emit newLocalFileEvent(event);
+	}
+}
+
 // ============================================================================
 
 
@@ -70,40 +115,46 @@ bool eventShouldBeIgnored(const LocalFileEvent& event)
     return result;
 }
 
-}
-
-LocalListener::LocalListener(QObject *parent)
-	: QObject(parent)
-	, efsw::FileWatchListener()
-{
-}
-
-void LocalListener::handleFileAction(efsw::WatchID,
-									const std::string& dir,
-									const std::string& filename,
-									efsw::Action action,
-									std::string oldFilename)
+bool isIgnoredFileName(const QString& fileName)
 {
 
 #ifdef Q_OS_DARWIN
 
     // Ignore system Icon file events for folder
-    if (filename == "Icon\r" || filename == ".DS_Store")
+    if (fileName == "Icon\r" || fileName == ".DS_Store")
     {
-        return;
+        return true;
     }
 
 #endif
 #ifdef Q_OS_WIN
 
     // Ignore desktop.ini file events for folder
-    if (filename == "desktop.ini")
+    if (fileName == "desktop.ini")
     {
-        return;
+        return true;
     }
 
 #endif
 
+	// Partial downloads
+	return DownloadSession::isTempFileName(fileName);
+}
+
+// False if the action is of no interest.
+bool makeLocalFileEvent(const std::string& dir,
+						const std::string& filename,
+						efsw::Action action,
+						const std::string& oldFilename,
+						LocalFileEvent& result)
+{
+	// Including the final rename of partial downloads
+	if (isIgnoredFileName(QString::fromStdString(filename))
+		|| DownloadSession::isTempFileName(QString::fromStdString(oldFilename)))
+	{
+		return false;
+	}
+
     if (action == efsw::Actions::Modified)
     {
         // Prevent reaction to icon changed event
@@ -115,7 +166,7 @@ void LocalListener::handleFileAction(efsw::WatchID,
         bool isLastCount = FolderIconController::instance().getCounter(fullFileNameStr);
         if (!isLastCount)
         {
-            return;
+            return false;
         }
     }
 
@@ -136,20 +187,195 @@ void LocalListener::handleFileAction(efsw::WatchID,
 		break;
 	default:
 		Q_ASSERT(false);
-		return;
+		return false;
 	}
 
-	const LocalFileEvent localEvent(type,
+	result = LocalFileEvent(type,
 			QDir::cleanPath(QString::fromStdString(dir)),
 			QDir::cleanPath(QString::fromStdString(filename)),
 			QDir::cleanPath(QString::fromStdString(oldFilename)));
 
-	if (eventShouldBeIgnored(localEvent))
+	return !eventShouldBeIgnored(result);
+}
+
+}
+
+LocalListener::LocalListener(QObject *parent)
+	: QObject(parent)
+	, efsw::FileWatchListener()
+	, m_actions(s_actionCapacity)
+{
+}
+
+void LocalListener::handleFileAction(efsw::WatchID,
+									const std::string& dir,
+									const std::string& filename,
+									efsw::Action action,
+									std::string oldFilename)
+{
+	FileAction fileAction;
+	fileAction.dir = dir;
+	fileAction.filename = filename;
+	fileAction.oldFilename = std::move(oldFilename);
+	fileAction.action = action;
+
+	if (!m_actions.push(std::move(fileAction)))
+	{
+		m_dropped.ref();
+		addRescan(dir);
+	}
+
+	scheduleDrain();
+}
+
+void LocalListener::handleMissedFileActions(efsw::WatchID,
+											const std::string& dir)
+{
+	m_overflows.ref();
+	addRescan(dir);
+	scheduleDrain();
+}
+
+int LocalListener::droppedEvents() const
+{
+	return m_dropped.load();
+}
+
+int LocalListener::coalescedEvents() const
+{
+	return m_coalesced.load();
+}
+
+int LocalListener::overflows() const
+{
+	return m_overflows.load();
+}
+
+void LocalListener::addRescan(const std::string& dir)
+{
+	const QString path = QDir::cleanPath(QString::fromStdString(dir));
+
+	QMutexLocker locker(&m_rescanMutex);
+	m_rescanDirs.insert(path);
+}
+
+void LocalListener::scheduleDrain()
+{
+	// One queued call covers everything pushed until it runs
+	if (m_drainScheduled.testAndSetOrdered(0, 1))
+	{
+		QMetaObject::invokeMethod(this, "drain", Qt::QueuedConnection);
+	}
+}
+
+void LocalListener::drain()
+{
+	// Cleared first: whatever is pushed from now on schedules another pass
+	m_drainScheduled.storeRelease(0);
+
+	QList<LocalFileEvent> events;
+	// Paths added or modified earlier in the batch
+	QSet<QString> changed;
+
+	FileAction action;
+	for (int i = 0; i < s_batchSize && m_actions.pop(action); ++i)
+	{
+		LocalFileEvent event;
+		if (!makeLocalFileEvent(action.dir, action.filename,
+				action.action, action.oldFilename, event))
+		{
+			continue;
+		}
+
+		const QString path = event.localPath();
+		switch (event.type())
+		{
+		case LocalFileEvent::Modified:
+			if (changed.contains(path))
+			{
+				m_coalesced.ref();
+				continue;
+			}
+			changed.insert(path);
+			break;
+		case LocalFileEvent::Added:
+			changed.insert(path);
+			break;
+		default:
+			changed.remove(path);
+			changed.remove(event.oldLocalPath());
+			break;
+		}
+
+		events << event;
+	}
+
+	// Rescans follow the events received before them
+	if (m_actions.isEmpty())
 	{
-		return;
+		rescan(events);
+	}
+	else
+	{
+		scheduleDrain();
 	}
 
-	emit newLocalFileEvent(localEvent);
+	if (!events.isEmpty())
+	{
+		emit newLocalFileEvents(events);
+	}
+}
+
+void LocalListener::rescan(QList<LocalFileEvent>& events)
+{
+	QStringList dirs;
+	{
+		QMutexLocker locker(&m_rescanMutex);
+		dirs = m_rescanDirs.toList();
+		m_rescanDirs.clear();
+	}
+
+	// Ancestors first, a folder is covered by the scan of its ancestor
+	dirs.sort();
+
+	QStringList scanned;
+	Q_FOREACH(const QString& dir, dirs)
+	{
+		bool covered = false;
+		Q_FOREACH(const QString& root, scanned)
+		{
+			if (dir == root || dir.startsWith(root + QLatin1Char('/')))
+			{
+				covered = true;
+				break;
+			}
+		}
+
+		if (covered)
+		{
+			continue;
+		}
+
+		scanned << dir;
+
+		QLOG_WARN() << "Local events lost (" << droppedEvents() << "dropped,"
+			<< overflows() << "queue overflows ), rescanning" << dir;
+
+		const LocalSnapshot snapshot = DirectoryScanner::scan(dir);
+		Q_FOREACH(const LocalSnapshot::Entry& entry, snapshot.entries())
+		{
+			const int slash = entry.path.lastIndexOf(QLatin1Char('/'));
+			const QString fileName = entry.path.mid(slash + 1);
+			if (isIgnoredFileName(fileName))
+			{
+				continue;
+			}
+
+			events << LocalFileEvent(LocalFileEvent::Added,
+				slash < 0 ? dir : dir + QLatin1Char('/') + entry.path.left(slash),
+				fileName);
+		}
+	}
 }
 
 }
@@ -3,13 +3,18 @@
 
 #include <iostream>
 #include <memory>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
+#include <QtCore/QSet>
+#include <QtCore/QThread>
 #include "3rdparty/efsw/include/efsw/efsw.hpp"
+#include "Util/SpscRing.h"
+#include "LocalFileEvent.h"
 
 namespace Drive
 {
 
-class LocalFileEvent;
 class LocalListener;
 
 class LocalFileEventNotifier: public QObject
@@ -18,22 +23,46 @@ class LocalFileEventNotifier: public QObject
 
 public:
 	static LocalFileEventNotifier& instance();
+	~LocalFileEventNotifier();
 
 	Q_SLOT void resetFolder();
 	Q_SLOT void stop();
 
+	// Events lost because the listener thread was behind.
+	int droppedEvents() const;
+	// Modifications folded into an earlier event of the same batch.
+	int coalescedEvents() const;
+	// Overflows of the system event queue.
+	int overflows() const;
+
 	Q_SIGNAL void newLocalFileEvent(const LocalFileEvent& event);
 
 private:
 	LocalFileEventNotifier(QObject* parent = nullptr);
 	Q_DISABLE_COPY(LocalFileEventNotifier)
 
+	void onLocalFileEvents(const QList<Drive::LocalFileEvent>& events);
+
 private:
-	efsw::FileWatcher m_fileWatcher;
+	QThread m_listenerThread;
 	std::auto_ptr<LocalListener> m_listener;
+	// Destroyed first, its thread calls the listener
+	efsw::FileWatcher m_fileWatcher;
 	efsw::WatchID m_watchID;
 };
 
+//
+// Receives the efsw callbacks on the watcher thread and hands them over to
+// its own thread through a lock-free ring, so the watcher is back to reading
+// the system queue at once. The events are filtered and emitted in batches
+// on the listener thread.
+//
+// An event refused by the full ring is lost, as are the events of a system
+// queue overflow. The folders they concerned are rescanned once the ring is
+// empty and every entry found is reported as added, the handlers skip the
+// ones that didn't change. Deletions in between are only caught by the next
+// incremental sync.
+//
 class LocalListener : public QObject, public efsw::FileWatchListener
 {
 	Q_OBJECT
@@ -45,7 +74,40 @@ public:
 			const std::string& dir, const std::string& filename,
 			efsw::Action action, std::string oldFilename = "") override;
 
-	Q_SIGNAL void newLocalFileEvent(const LocalFileEvent& localFileEvent);
+	virtual void handleMissedFileActions(efsw::WatchID watchid,
+			const std::string& dir) override;
+
+	int droppedEvents() const;
+	int coalescedEvents() const;
+	int overflows() const;
+
+	Q_SIGNAL void newLocalFileEvents(const QList<Drive::LocalFileEvent>& localFileEvents);
+
+private:
+	struct FileAction
+	{
+		std::string dir;
+		std::string filename;
+		std::string oldFilename;
+		efsw::Action action;
+	};
+
+	void addRescan(const std::string& dir);
+	void scheduleDrain();
+	Q_SLOT void drain();
+	void rescan(QList<LocalFileEvent>& events);
+
+private:
+	SpscRing<FileAction> m_actions;
+	QAtomicInt m_drainScheduled;
+
+	QAtomicInt m_dropped;
+	QAtomicInt m_coalesced;
+	QAtomicInt m_overflows;
+
+	// Folders to rescan, only touched when events are lost
+	QMutex m_rescanMutex;
+	QSet<QString> m_rescanDirs;
 };
 
 }
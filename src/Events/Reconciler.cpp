@@ -0,0 +1,257 @@
+﻿#include "Reconciler.h"
+#include "Cache.h"
+#include "QsLog/QsLog.h"
+
+#include <algorithm>
+
+namespace Drive
+{
+
+namespace
+{
+
+const QString diskRootPath = QLatin1String("#root/#disk/");
+
+QString parentOf(const QString& path)
+{
+	const int slash = path.lastIndexOf(QLatin1Char('/'));
+	return slash < 0 ? QString() : path.left(slash);
+}
+
+QString fileNameOf(const QString& path)
+{
+	return path.mid(path.lastIndexOf(QLatin1Char('/')) + 1);
+}
+
+}
+
+Reconciler::Reconciler(const LocalSnapshot& local, const LocalSnapshot& base)
+	: m_local(local)
+	, m_base(base)
+	, m_allowDeletes(true)
+{
+	m_remote = LocalCache::instance().filesUnder(diskRootPath);
+	for (int i = 0; i < m_remote.size(); ++i)
+	{
+		m_remote[i].first = m_remote.at(i).first.mid(diskRootPath.size());
+	}
+
+	std::sort(m_remote.begin(), m_remote.end(),
+		[] (const QPair<QString, RemoteFileDesc>& lhs,
+			const QPair<QString, RemoteFileDesc>& rhs)
+		{
+			return lhs.first < rhs.first;
+		});
+
+	// An empty folder which had files is rather unmounted than wiped,
+	// nothing is deleted remotely then.
+	if (m_local.isEmpty() && !m_base.isEmpty())
+	{
+		QLOG_WARN() << "The local folder is empty, remote files will be"
+			<< "downloaded instead of being deleted.";
+		m_allowDeletes = false;
+	}
+}
+
+void Reconciler::reconcile(QList<LocalFileEvent>& localEvents,
+	QList<RemoteFileEvent>& remoteEvents)
+{
+	mergePaths();
+	findMoves();
+
+	int unchanged = 0;
+
+	for (int i = 0; i < m_items.size(); ++i)
+	{
+		const Item& item = m_items.at(i);
+
+		if (item.local)
+		{
+			if (m_moves.contains(i))
+			{
+				const Item& source = m_items.at(m_moves.value(i));
+				if (parentOf(source.path) == parentOf(item.path))
+				{
+					localEvents << localEvent(LocalFileEvent::Moved,
+						item.path, source.path);
+				}
+				else
+				{
+					localEvents << localEvent(LocalFileEvent::Added, item.path);
+				}
+			}
+			else if (item.remote < 0 || changedLocally(item))
+			{
+				localEvents << localEvent(LocalFileEvent::Added, item.path);
+			}
+			else if (changedRemotely(item) && !item.local->isDir)
+			{
+				remoteEvents << RemoteFileEvent::syncEvent(
+					m_remote.at(item.remote).second);
+			}
+			else
+			{
+				++unchanged;
+			}
+		}
+		else if (item.remote >= 0)
+		{
+			if (m_moveSources.contains(i))
+			{
+				// Handled together with its move target
+				continue;
+			}
+
+			if (deletedLocally(item))
+			{
+				if (!underDeletedFolder(item.path))
+				{
+					localEvents << localEvent(LocalFileEvent::Deleted, item.path);
+				}
+
+				if (item.base->isDir)
+				{
+					m_deletedFolders.insert(item.path);
+				}
+			}
+			else
+			{
+				remoteEvents << RemoteFileEvent::syncEvent(
+					m_remote.at(item.remote).second);
+			}
+		}
+	}
+
+	QLOG_INFO() << "Reconciled" << m_items.size() << "paths: local events:"
+		<< localEvents.size() << ", remote events:" << remoteEvents.size()
+		<< ", unchanged:" << unchanged;
+}
+
+void Reconciler::mergePaths()
+{
+	const QVector<LocalSnapshot::Entry>& local = m_local.entries();
+	const QVector<LocalSnapshot::Entry>& base = m_base.entries();
+
+	int l = 0;
+	int b = 0;
+	int r = 0;
+
+	m_items.reserve(qMax(local.size(), m_remote.size()));
+
+	while (l < local.size() || b < base.size() || r < m_remote.size())
+	{
+		// The smallest of the three current paths
+		const QString* path = nullptr;
+		if (l < local.size())
+			path = &local.at(l).path;
+		if (b < base.size() && (!path || base.at(b).path < *path))
+			path = &base.at(b).path;
+		if (r < m_remote.size() && (!path || m_remote.at(r).first < *path))
+			path = &m_remote.at(r).first;
+
+		Item item;
+		item.path = *path;
+
+		if (l < local.size() && local.at(l).path == item.path)
+			item.local = &local.at(l++);
+		if (b < base.size() && base.at(b).path == item.path)
+			item.base = &base.at(b++);
+		if (r < m_remote.size() && m_remote.at(r).first == item.path)
+			item.remote = r++;
+
+		// Paths left on the base side only need nothing
+		if (item.local || item.remote >= 0)
+		{
+			m_items << item;
+		}
+	}
+}
+
+void Reconciler::findMoves()
+{
+	// Files gone locally and unchanged remotely, by inode
+	QHash<quint64, int> sources;
+	for (int i = 0; i < m_items.size(); ++i)
+	{
+		const Item& item = m_items.at(i);
+		if (!item.local && item.base && !item.base->isDir && deletedLocally(item))
+		{
+			sources.insert(item.base->inode, i);
+		}
+	}
+
+	if (sources.isEmpty())
+	{
+		return;
+	}
+
+	for (int i = 0; i < m_items.size(); ++i)
+	{
+		const Item& item = m_items.at(i);
+		if (!item.local || item.local->isDir || item.base || item.remote >= 0)
+		{
+			continue;
+		}
+
+		auto it = sources.find(item.local->inode);
+		if (it == sources.end())
+		{
+			continue;
+		}
+
+		const LocalSnapshot::Entry* source = m_items.at(it.value()).base;
+		if (source->size == item.local->size
+			&& source->modifiedAt == item.local->modifiedAt)
+		{
+			m_moves.insert(i, it.value());
+			m_moveSources.insert(it.value());
+			sources.erase(it);
+		}
+	}
+}
+
+bool Reconciler::changedLocally(const Item& item) const
+{
+	return !item.base || !item.local->sameAs(*item.base);
+}
+
+bool Reconciler::changedRemotely(const Item& item) const
+{
+	const RemoteFileDesc& remote = m_remote.at(item.remote).second;
+	return !item.base
+		|| item.base->remoteId != remote.id
+		|| item.base->remoteModifiedAt != remote.modifiedAt;
+}
+
+bool Reconciler::deletedLocally(const Item& item) const
+{
+	return m_allowDeletes && !item.local && item.base && item.remote >= 0
+		&& !changedRemotely(item);
+}
+
+bool Reconciler::underDeletedFolder(const QString& path) const
+{
+	for (QString parent = parentOf(path); !parent.isEmpty(); parent = parentOf(parent))
+	{
+		if (m_deletedFolders.contains(parent))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+LocalFileEvent Reconciler::localEvent(const LocalFileEvent::Type type,
+	const QString& path, const QString& oldPath) const
+{
+	const QString parent = parentOf(path);
+	const QString dir = parent.isEmpty()
+		? m_local.rootPath()
+		: m_local.rootPath() + QLatin1Char('/') + parent;
+
+	return LocalFileEvent(type, dir, fileNameOf(path),
+		oldPath.isEmpty() ? QString() : fileNameOf(oldPath));
+}
+
+}
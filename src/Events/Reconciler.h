@@ -0,0 +1,77 @@
+﻿#ifndef RECONCILER_H
+#define RECONCILER_H
+
+#include "APIClient/ApiTypes.h"
+#include "Events/LocalFileEvent.h"
+#include "Util/LocalSnapshot.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QSet>
+#include <QtCore/QVector>
+
+namespace Drive
+{
+
+//
+// Three-way comparison of the local folder, the remote tree in the
+// LocalCache and the state both were in after the last completed sync.
+//
+// Only the paths changed on either side since that sync become events:
+//  - changed locally or missing remotely: local Added (uploaded or
+//    resolved by the handler),
+//  - changed remotely only: remote Created/Uploaded (downloaded),
+//  - deleted locally, unchanged remotely: local Deleted,
+//  - moved locally (same inode, size and mtime): local Moved for renames
+//    within a folder, otherwise only local Added at the new path which the
+//    handler turns into a remote move.
+//
+class Reconciler
+{
+public:
+	// The base is the local snapshot saved after the last completed sync
+	// together with the remote state of every entry at that moment.
+	Reconciler(const LocalSnapshot& local, const LocalSnapshot& base);
+
+	void reconcile(QList<LocalFileEvent>& localEvents,
+			QList<RemoteFileEvent>& remoteEvents);
+
+private:
+	struct Item
+	{
+		Item() : local(nullptr), base(nullptr), remote(-1) {}
+
+		QString path;
+		const LocalSnapshot::Entry* local;
+		const LocalSnapshot::Entry* base;
+		// Index in m_remote, -1 if there is no remote file
+		int remote;
+	};
+
+	void mergePaths();
+	void findMoves();
+
+	bool changedLocally(const Item& item) const;
+	bool changedRemotely(const Item& item) const;
+	bool deletedLocally(const Item& item) const;
+	bool underDeletedFolder(const QString& path) const;
+
+	LocalFileEvent localEvent(LocalFileEvent::Type type, const QString& path,
+			const QString& oldPath = QString()) const;
+
+	const LocalSnapshot& m_local;
+	const LocalSnapshot& m_base;
+	// (path relative to the disk root, descriptor) sorted by path
+	QVector<QPair<QString, RemoteFileDesc> > m_remote;
+
+	QVector<Item> m_items;
+	// Index of the move target item -> index of the move source item
+	QHash<int, int> m_moves;
+	QSet<int> m_moveSources;
+	QSet<QString> m_deletedFolders;
+	bool m_allowDeletes;
+};
+
+}
+
+#endif // RECONCILER_H
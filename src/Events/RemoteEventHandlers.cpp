@@ -6,9 +6,13 @@
 #include "QsLog/QsLog.h"
 #include "APIClient/FilesService.h"
 #include "APIClient/FileDownloader.h"
+#include "APIClient/DownloadSession.h"
 #include "Util/FileUtils.h"
+#include "Util/FileHasher.h"
 
 #include <QtCore/QDir>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
 
 namespace Drive
 {
@@ -33,6 +37,7 @@ void RemoteFolderCreatedEventHandler::runEventHandling()
 	if (!m_remoteEvent.isValid())
 	{
 		QLOG_ERROR() << "remote event is not valid";
+		processEventsAndQuit();
 		return;
 	}
 
@@ -40,12 +45,14 @@ void RemoteFolderCreatedEventHandler::runEventHandling()
 	{
 		QLOG_ERROR() << "remote event type:" << m_remoteEvent.type
 			<< ", should be" << RemoteFileEvent::Created;
+		processEventsAndQuit();
 		return;
 	}
 
 	if (m_remoteEvent.fileDesc.type == RemoteFileDesc::File)
 	{
 		QLOG_ERROR() << "Remote event 'created' contains a file, not a folder";
+		processEventsAndQuit();
 		return;
 	}
 
@@ -122,12 +129,14 @@ void RemoteFileRenamedEventHandler::runEventHandling()
 {
 	if (!m_remoteEvent.isValid())
 	{
+		processEventsAndQuit();
 		return;
 	}
 
 	if (m_remoteEvent.type != RemoteFileEvent::Renamed
 		&& m_remoteEvent.type != RemoteFileEvent::Moved)
 	{
+		processEventsAndQuit();
 		return;
 	}
 
@@ -224,10 +233,16 @@ RemoteFileTrashedEventHandler::RemoteFileTrashedEventHandler(
 void RemoteFileTrashedEventHandler::runEventHandling()
 {
 	if (!m_remoteEvent.isValid())
+	{
+		processEventsAndQuit();
 		return;
+	}
 
 	if (m_remoteEvent.type != RemoteFileEvent::Trashed)
+	{
+		processEventsAndQuit();
 		return;
+	}
 
 	onGetAncestorsSucceeded(m_remoteEvent.fileDesc.originalPath);
 }
@@ -249,7 +264,8 @@ void RemoteFileTrashedEventHandler::onGetAncestorsSucceeded(
 	QFileInfo fileInfo(m_localPath);
 	if (!fileInfo.exists())
 	{
-		Q_EMIT quitThread();
+		processEventsAndQuit();
+		return;
 	}
 
     markSyncing(m_localPath);
@@ -274,13 +290,13 @@ void RemoteFileTrashedEventHandler::onGetAncestorsSucceeded(
 
     markDeleted();
 
-	Q_EMIT quitThread();
+	processEventsAndQuit();
 }
 
 void RemoteFileTrashedEventHandler::onGetAncestorsFailed()
 {
     emit failed((EventHandlerBase*) this, "Failed to get the remote file object path");
-	Q_EMIT quitThread();
+	processEventsAndQuit();
 }
 
 // ===========================================================================
@@ -303,16 +319,21 @@ void RemoteFileUploadedEventHandler::runEventHandling()
 	{
 		QLOG_ERROR() << "Remote file event is not valid:";
 		m_remoteEvent.logCompact();
+		processEventsAndQuit();
 		return;
 	}
 
 	if (m_remoteEvent.type != RemoteFileEvent::Uploaded)
+	{
+		processEventsAndQuit();
 		return;
+	}
 
 	if (m_remoteEvent.fileDesc.type == RemoteFileDesc::Dir)
 	{
 		QLOG_ERROR() <<
 			"Remote event 'uploaded' contains a folder, not a file";
+		processEventsAndQuit();
 		return;
 	}
 
@@ -364,8 +385,42 @@ void RemoteFileUploadedEventHandler::onGetAncestorsSucceeded(
 		}
 	}
 
+	// The content may be available locally already: the file has been
+	// touched or the same content lives under another name
+	const RemoteFileDesc& fileDesc = m_remoteEvent.fileDesc;
+	if (!fileDesc.checkSum.isEmpty())
+	{
+		if (fileInfo.exists())
+		{
+			if (fileInfo.isFile()
+				&& static_cast<quint64>(fileInfo.size()) == fileDesc.size)
+			{
+				m_hashedFilePath = m_localFilePath;
+			}
+		}
+		else
+		{
+			m_hashedFilePath = findCopySource();
+		}
+	}
+
+	if (!m_hashedFilePath.isEmpty())
+	{
+		connect(&FileHasher::instance(), &FileHasher::hashed,
+				this, &RemoteFileUploadedEventHandler::onFileHashed);
+
+		FileHasher::instance().hash(m_hashedFilePath);
+		return;
+	}
+
+	download();
+}
+
+void RemoteFileUploadedEventHandler::download()
+{
 	m_downloader = new FileDownloader(m_remoteEvent.fileDesc.id,
-		m_localFilePath, m_remoteEvent.fileDesc.modifiedAt, this);
+		m_localFilePath, m_remoteEvent.fileDesc.modifiedAt,
+		m_remoteEvent.fileDesc.size, this);
 
 	connect(m_downloader, &FileDownloader::succeeded,
 			this, &RemoteFileUploadedEventHandler::onDownloadSucceeded);
@@ -373,16 +428,170 @@ void RemoteFileUploadedEventHandler::onGetAncestorsSucceeded(
 	connect(m_downloader, &FileDownloader::failed,
 			this, &RemoteFileUploadedEventHandler::onDownloadFailed);
 
-	Q_EMIT newLocalFileEventExclusion(LocalFileEventExclusion(
-			LocalFileEvent::Added, m_localFilePath));
-	Q_EMIT newLocalFileEventExclusion(LocalFileEventExclusion(
-			LocalFileEvent::Modified, m_localFilePath));
-	Q_EMIT newLocalFileEventExclusion(LocalFileEventExclusion(
-			LocalFileEvent::Modified, m_localFilePath));
-
-	m_downloader->limitSpeed(50);
+	// No exclusions, the watcher events of the temp file and of its final
+	// rename are dropped by the notifier
 	m_downloader->download();
+}
+
+QString RemoteFileUploadedEventHandler::findCopySource() const
+{
+	const RemoteFileDesc& fileDesc = m_remoteEvent.fileDesc;
+
+	LocalCache& localCache = LocalCache::instance();
+	for (const RemoteFileDesc& candidate : localCache.filesByCheckSum(fileDesc.checkSum))
+	{
+		if (candidate.id == fileDesc.id || candidate.size != fileDesc.size)
+		{
+			continue;
+		}
+
+		const QString remotePath = localCache.findPath(candidate);
+		if (remotePath.isNull())
+		{
+			continue;
+		}
+
+		const QString localPath = Utils::toLocalPath(remotePath);
+		const QFileInfo candidateInfo(localPath);
+		if (candidateInfo.isFile()
+			&& static_cast<quint64>(candidateInfo.size()) == fileDesc.size)
+		{
+			return localPath;
+		}
+	}
+
+	return QString();
+}
+
+void RemoteFileUploadedEventHandler::onFileHashed(
+	const QString& filePath, const QString& hash)
+{
+	if (filePath != m_hashedFilePath)
+	{
+		return;
+	}
+
+	disconnect(&FileHasher::instance(), &FileHasher::hashed,
+			this, &RemoteFileUploadedEventHandler::onFileHashed);
 
+	if (!FileHasher::sameHash(hash, m_remoteEvent.fileDesc.checkSum))
+	{
+		download();
+		return;
+	}
+
+	if (m_hashedFilePath == m_localFilePath)
+	{
+		QLOG_INFO() << "Content of" << m_localFilePath
+			<< "is up to date, skipping download";
+		Q_EMIT succeeded();
+		processEventsAndQuit();
+		return;
+	}
+
+	copyLocalFile();
+}
+
+namespace
+{
+
+// Read and written at once by the local copies
+const qint64 s_copyChunkSize = 1024 * 1024;
+
+// Copies a file in the thread pool, the large files
+// mustn't block the event loop
+class CopyFileTask : public QRunnable
+{
+public:
+	CopyFileTask(const QString& source, const QString& target,
+			const uint modifiedAt, FileCopyNotifier* notifier)
+		: m_source(source)
+		, m_target(target)
+		, m_modifiedAt(modifiedAt)
+		, m_notifier(notifier)
+	{
+	}
+
+	virtual void run() override
+	{
+		// Copied like a download, the watcher ignores the temp file
+		// and its rename
+		const QString tempPath = DownloadSession::tempFilePath(m_target);
+
+		bool ok = copyTo(tempPath);
+		if (ok)
+		{
+			FileSystemHelper::setFileModificationTimestamp(tempPath, m_modifiedAt);
+			ok = FileSystemHelper::replaceFile(tempPath, m_target);
+		}
+
+		if (!ok)
+		{
+			QFile::remove(tempPath);
+		}
+
+		Q_EMIT m_notifier->finished(ok);
+		m_notifier->deleteLater();
+	}
+
+private:
+	// QFile::copy() would write a temp file of its own, which the watcher
+	// doesn't ignore
+	bool copyTo(const QString& tempPath) const
+	{
+		QFile source(m_source);
+		QFile temp(tempPath);
+		if (!source.open(QIODevice::ReadOnly)
+			|| !temp.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		{
+			return false;
+		}
+
+		while (!source.atEnd())
+		{
+			const QByteArray chunk = source.read(s_copyChunkSize);
+			if (chunk.isEmpty() || temp.write(chunk) != chunk.size())
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	const QString m_source;
+	const QString m_target;
+	const uint m_modifiedAt;
+	FileCopyNotifier* m_notifier;
+};
+
+}
+
+void RemoteFileUploadedEventHandler::copyLocalFile()
+{
+	QLOG_INFO() << "Copying" << m_hashedFilePath << "to" << m_localFilePath
+		<< "instead of download";
+
+	FileCopyNotifier *notifier = new FileCopyNotifier;
+	connect(notifier, &FileCopyNotifier::finished,
+			this, &RemoteFileUploadedEventHandler::onCopyFinished,
+			Qt::QueuedConnection);
+
+	QThreadPool::globalInstance()->start(new CopyFileTask(m_hashedFilePath,
+			m_localFilePath, m_remoteEvent.fileDesc.modifiedAt, notifier));
+}
+
+void RemoteFileUploadedEventHandler::onCopyFinished(const bool ok)
+{
+	if (!ok)
+	{
+		QLOG_ERROR() << "Copying" << m_hashedFilePath << "to" << m_localFilePath
+			<< "failed, downloading it";
+		download();
+		return;
+	}
+
+	processEventsAndQuit();
 }
 
 void RemoteFileUploadedEventHandler::onGetAncestorsFailed()
@@ -425,11 +634,15 @@ void RemoteFileOrFolderRestoredEventHandler::runEventHandling()
 	{
 		QLOG_ERROR() << "Remote file event is not valid:";
 		m_remoteEvent.logCompact();
+		processEventsAndQuit();
 		return;
 	}
 
 	if (m_remoteEvent.type != RemoteFileEvent::Restored)
+	{
+		processEventsAndQuit();
 		return;
+	}
 
 	if (m_remoteEvent.fileDesc.type == RemoteFileDesc::Dir)
 	{
@@ -519,11 +732,15 @@ void RemoteFileCopiedEventHandler::runEventHandling()
 	{
 		QLOG_ERROR() << "Remote file event is not valid:";
 		m_remoteEvent.logCompact();
+		processEventsAndQuit();
 		return;
 	}
 
 	if (m_remoteEvent.type != RemoteFileEvent::Copied)
+	{
+		processEventsAndQuit();
 		return;
+	}
 
 	// 1. get source remote path
 	// 2. get target file object
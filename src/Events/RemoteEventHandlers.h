@@ -82,6 +82,16 @@ private:
 
 class FileDownloader;
 
+// Reports the end of a file copy running in the thread pool. Lives in the
+// main thread and is connected to the handler, so the report is dropped
+// if the handler is deleted while the file is being copied.
+class FileCopyNotifier : public QObject
+{
+	Q_OBJECT
+signals:
+	void finished(bool ok);
+};
+
 class RemoteFileUploadedEventHandler : public RemoteEventHandlerBase
 {
 	Q_OBJECT
@@ -97,10 +107,20 @@ private slots:
 	void onGetAncestorsFailed();
 	void onDownloadSucceeded();
 	void onDownloadFailed(const QString& error);
+	void onFileHashed(const QString& filePath, const QString& hash);
+	void onCopyFinished(bool ok);
+
+private:
+	void download();
+	void copyLocalFile();
+
+	// Another local file with the content of the remote file
+	QString findCopySource() const;
 
 private:
 	FileDownloader *m_downloader;
 	QString m_localFilePath;
+	QString m_hashedFilePath;
 };
 
 class RemoteFileOrFolderRestoredEventHandler : public RemoteEventHandlerBase
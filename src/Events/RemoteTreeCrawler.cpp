@@ -0,0 +1,273 @@
+﻿#include "RemoteTreeCrawler.h"
+#include "Cache.h"
+#include "FileEventDispatcher.h"
+#include "APIClient/FilesService.h"
+#include "Settings/settings.h"
+#include "QsLog/QsLog.h"
+
+namespace Drive
+{
+
+namespace
+{
+
+// Every queued folder is a "crawlQueue/<id>" meta data key
+const QString crawlQueuePrefix = QLatin1String("crawlQueue/");
+
+// No listings are started while more events wait for the dispatcher
+const int maxEventBacklog = 5000;
+const int backlogCheckMSec = 500;
+
+const int maxListingAttempts = 3;
+const int listingRetryDelayMSec = 2000;
+
+}
+
+RemoteTreeCrawler::RemoteTreeCrawler(QObject *parent)
+	: QObject(parent)
+	, m_requests(0)
+	, m_retries(0)
+{
+	m_backlogTimer.setSingleShot(true);
+	m_backlogTimer.setInterval(backlogCheckMSec);
+	connect(&m_backlogTimer, &QTimer::timeout,
+		this, &RemoteTreeCrawler::next);
+}
+
+void RemoteTreeCrawler::start(const int folderId)
+{
+	m_queue.clear();
+	m_attempts.clear();
+
+	Q_FOREACH(const QString& key, LocalCache::instance().metaKeys(crawlQueuePrefix))
+	{
+		bool ok = false;
+		const int id = key.mid(crawlQueuePrefix.size()).toInt(&ok);
+		if (ok)
+		{
+			m_queue.enqueue(id);
+		}
+	}
+
+	if (m_queue.isEmpty())
+	{
+		enqueue(folderId);
+	}
+	else
+	{
+		QLOG_INFO() << "Resuming remote tree crawl, folders left:"
+			<< m_queue.size();
+	}
+
+	next();
+}
+
+bool RemoteTreeCrawler::hasSavedProgress()
+{
+	return !LocalCache::instance().metaKeys(crawlQueuePrefix).isEmpty();
+}
+
+void RemoteTreeCrawler::setSubfolderFilter(const SubfolderFilter& filter)
+{
+	m_subfolderFilter = filter;
+}
+
+void RemoteTreeCrawler::next()
+{
+	const int maxRequests = qMax(1,
+		Settings::instance().get(Settings::maxParallelListings).toInt());
+
+	while (!m_queue.isEmpty() && m_requests < maxRequests)
+	{
+		if (backlogged())
+		{
+			m_backlogTimer.start();
+			break;
+		}
+
+		if (m_queue.size() > 1 && GetChildrenBatchResource::isSupported())
+		{
+			QList<int> folderIds;
+			while (!m_queue.isEmpty()
+				&& folderIds.size() < GetChildrenBatchResource::maxBatchSize)
+			{
+				folderIds << m_queue.dequeue();
+			}
+			listFolders(folderIds);
+		}
+		else
+		{
+			listFolder(m_queue.dequeue());
+		}
+	}
+
+	if (m_queue.isEmpty() && !m_requests && !m_retries)
+	{
+		QLOG_INFO() << "Remote tree crawl finished.";
+		emit finished();
+	}
+}
+
+bool RemoteTreeCrawler::backlogged() const
+{
+	// Some listings must stay in flight, or the events would never come
+	return m_requests
+		&& FileEventDispatcher::instance().pendingEvents() > maxEventBacklog;
+}
+
+void RemoteTreeCrawler::listFolder(const int folderId)
+{
+	GetChildrenResourceRef getChildrenRes = GetChildrenResource::create();
+
+	connect(getChildrenRes.data(), &GetChildrenResource::succeeded,
+		this, [this, folderId] (const QList<RemoteFileDesc>& children)
+		{
+			onFolderListed(folderId, children);
+		});
+
+	connect(getChildrenRes.data(), &GetChildrenResource::failed,
+		this, [this, folderId] ()
+		{
+			onListingFailed(QList<int>() << folderId);
+		});
+
+	++m_requests;
+	getChildrenRes->getChildren(folderId);
+}
+
+void RemoteTreeCrawler::listFolders(const QList<int>& folderIds)
+{
+	GetChildrenBatchResourceRef batchRes = GetChildrenBatchResource::create();
+
+	connect(batchRes.data(), &GetChildrenBatchResource::succeeded,
+		this, [this, folderIds] (const QHash<int, QList<RemoteFileDesc> >& children)
+		{
+			onFoldersListed(folderIds, children);
+		});
+
+	connect(batchRes.data(), &GetChildrenBatchResource::unsupported,
+		this, &RemoteTreeCrawler::onBatchUnsupported);
+
+	connect(batchRes.data(), &GetChildrenBatchResource::failed,
+		this, [this, folderIds] ()
+		{
+			onListingFailed(folderIds);
+		});
+
+	++m_requests;
+	batchRes->getChildren(folderIds);
+}
+
+void RemoteTreeCrawler::onFolderListed(const int folderId,
+	const QList<RemoteFileDesc>& children)
+{
+	folderListed(folderId, children);
+	requestFinished();
+}
+
+void RemoteTreeCrawler::folderListed(const int folderId,
+	const QList<RemoteFileDesc>& children)
+{
+	// The filter sees the cache as it was before the listing
+	QList<int> subfolders;
+	Q_FOREACH(const RemoteFileDesc& fileDesc, children)
+	{
+		if (fileDesc.type == RemoteFileDesc::Dir && fileDesc.hasChildren
+			&& (!m_subfolderFilter || m_subfolderFilter(fileDesc)))
+		{
+			subfolders << fileDesc.id;
+		}
+	}
+
+	emit listed(folderId, children);
+
+	Q_FOREACH(const int subfolderId, subfolders)
+	{
+		enqueue(subfolderId);
+	}
+
+	// Only now, the children are in the cache and queued
+	dequeue(folderId);
+}
+
+void RemoteTreeCrawler::onFoldersListed(const QList<int>& folderIds,
+	const QHash<int, QList<RemoteFileDesc> >& children)
+{
+	Q_FOREACH(const int folderId, folderIds)
+	{
+		auto it = children.constFind(folderId);
+		if (it == children.constEnd())
+		{
+			// Listed again on its own
+			m_queue.enqueue(folderId);
+			continue;
+		}
+
+		folderListed(folderId, it.value());
+	}
+
+	requestFinished();
+}
+
+void RemoteTreeCrawler::onBatchUnsupported(const QList<int>& folderIds)
+{
+	// The batch endpoint is off from now on, next() lists them one by one
+	Q_FOREACH(const int folderId, folderIds)
+	{
+		m_queue.enqueue(folderId);
+	}
+
+	requestFinished();
+}
+
+void RemoteTreeCrawler::onListingFailed(const QList<int>& folderIds)
+{
+	--m_requests;
+
+	Q_FOREACH(const int folderId, folderIds)
+	{
+		if (++m_attempts[folderId] >= maxListingAttempts)
+		{
+			QLOG_ERROR() << "Remote tree crawl failed to list folder" << folderId;
+			m_backlogTimer.stop();
+			emit failed();
+			return;
+		}
+	}
+
+	QLOG_WARN() << "Folder listing failed, retrying:" << folderIds;
+
+	++m_retries;
+	QTimer::singleShot(listingRetryDelayMSec * m_attempts.value(folderIds.first()),
+		this, [this, folderIds] ()
+		{
+			--m_retries;
+			Q_FOREACH(const int folderId, folderIds)
+			{
+				m_queue.enqueue(folderId);
+			}
+			next();
+		});
+}
+
+void RemoteTreeCrawler::enqueue(const int folderId)
+{
+	m_queue.enqueue(folderId);
+	LocalCache::instance().setMeta(
+		crawlQueuePrefix + QString::number(folderId), QLatin1String("1"));
+}
+
+void RemoteTreeCrawler::dequeue(const int folderId)
+{
+	m_attempts.remove(folderId);
+	LocalCache::instance().setMeta(
+		crawlQueuePrefix + QString::number(folderId), QString());
+}
+
+void RemoteTreeCrawler::requestFinished()
+{
+	--m_requests;
+	next();
+}
+
+}
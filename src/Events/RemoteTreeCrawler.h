@@ -0,0 +1,86 @@
+﻿#ifndef REMOTE_TREE_CRAWLER_H
+#define REMOTE_TREE_CRAWLER_H
+
+#include "APIClient/ApiTypes.h"
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QQueue>
+#include <QtCore/QSet>
+#include <QtCore/QTimer>
+
+#include <functional>
+
+namespace Drive
+{
+
+//
+// Breadth-first walk over the remote folder tree.
+//
+// At most maxParallelListings folder listings are in flight, and no new
+// listing is started while the event dispatcher has a large backlog, so the
+// crawl proceeds at the pace the events are handled. The children of every
+// folder are passed on as soon as they are received.
+//
+// Folders waiting to be listed are kept in the LocalCache meta data, an
+// interrupted crawl goes on from them on the next start.
+//
+class RemoteTreeCrawler : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit RemoteTreeCrawler(QObject *parent = 0);
+
+	// Lists the folder and all its subfolders, or the folders left
+	// by an interrupted crawl if there are any.
+	void start(int folderId);
+
+	// An interrupted crawl has been saved in the LocalCache.
+	static bool hasSavedProgress();
+
+	// Subfolders the filter rejects are not listed, all the subfolders
+	// are listed if there is no filter. The filter is called before the
+	// children of the folder are passed on.
+	typedef std::function<bool (const RemoteFileDesc&)> SubfolderFilter;
+	void setSubfolderFilter(const SubfolderFilter& filter);
+
+signals:
+	// Children of a listed folder, emitted before its subfolders are queued.
+	void listed(int folderId, const QList<Drive::RemoteFileDesc>& children);
+	void finished();
+	void failed();
+
+private:
+	void next();
+	bool backlogged() const;
+	void listFolder(int folderId);
+	void listFolders(const QList<int>& folderIds);
+
+	void onFolderListed(int folderId, const QList<Drive::RemoteFileDesc>& children);
+	void folderListed(int folderId, const QList<Drive::RemoteFileDesc>& children);
+	void onFoldersListed(const QList<int>& folderIds,
+		const QHash<int, QList<Drive::RemoteFileDesc> >& children);
+	void onBatchUnsupported(const QList<int>& folderIds);
+	void onListingFailed(const QList<int>& folderIds);
+
+	void enqueue(int folderId);
+	void dequeue(int folderId);
+	void requestFinished();
+
+private:
+	// Folders to list, the ones being listed are not here
+	QQueue<int> m_queue;
+	// Listing requests in flight, and failed listings waiting for a retry
+	int m_requests;
+	int m_retries;
+	QHash<int, int> m_attempts;
+	SubfolderFilter m_subfolderFilter;
+
+	QTimer m_backlogTimer;
+};
+
+}
+
+#endif // REMOTE_TREE_CRAWLER_H
@@ -4,18 +4,87 @@
 #include "Settings/settings.h"
 #include "QsLog/QsLog.h"
 #include "Events/Cache.h"
+#include "Events/Reconciler.h"
+#include "Util/DirectoryScanner.h"
+#include "Util/FileUtils.h"
 
 #include <QtCore/QDateTime>
 #include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QRunnable>
+#include <QtCore/QSet>
+#include <QtCore/QThreadPool>
 
 namespace Drive
 {
 
-Syncer::Syncer()
+namespace
+{
+
+const QString diskRootPath = QLatin1String("#root/#disk/");
+const int diskId = -2;
+
+// Takes the base snapshot for the next reconciliation: the local folder
+// and the remote file every entry is in sync with.
+class SaveSnapshotTask : public QRunnable
+{
+public:
+	SaveSnapshotTask(const QString& folderPath, const QString& fileName)
+		: m_folderPath(folderPath)
+		, m_fileName(fileName)
+	{
+	}
+
+	virtual void run() override
+	{
+		LocalSnapshot snapshot = DirectoryScanner::scan(m_folderPath);
+
+		QHash<QString, RemoteFileDesc> remoteFiles;
+		typedef QPair<QString, RemoteFileDesc> PathAndDesc;
+		Q_FOREACH(const PathAndDesc& file,
+			LocalCache::instance().filesUnder(diskRootPath))
+		{
+			remoteFiles.insert(file.first.mid(diskRootPath.size()), file.second);
+		}
+
+		for (LocalSnapshot::Entry& entry : snapshot.entries())
+		{
+			auto it = remoteFiles.constFind(entry.path);
+			if (it != remoteFiles.constEnd())
+			{
+				entry.remoteId = it->id;
+				entry.remoteModifiedAt = it->modifiedAt;
+			}
+		}
+
+		if (snapshot.save(m_fileName))
+		{
+			QLOG_INFO() << "Local snapshot saved," << snapshot.entries().size()
+				<< "entries.";
+		}
+	}
+
+private:
+	const QString m_folderPath;
+	const QString m_fileName;
+};
+
+}
+
+Syncer::Syncer(const QString& snapshotFileName)
 	: QObject(nullptr)
 	, m_currentLocalPathPrefix(QString())
-	, m_folderCounter(0)
+	, m_snapshotFileName(snapshotFileName)
+	, m_snapshotPending(false)
+	, m_resyncing(false)
+	, m_crawler(new RemoteTreeCrawler(this))
 {
+	connect(m_crawler, &RemoteTreeCrawler::listed,
+		this, &Syncer::onGetChildrenSucceeded);
+	connect(m_crawler, &RemoteTreeCrawler::finished,
+		this, &Syncer::fireEvents);
+	connect(m_crawler, &RemoteTreeCrawler::failed,
+		this, &Syncer::onGetFailed);
 }
 
 void Syncer::fullSync()
@@ -23,12 +92,152 @@ void Syncer::fullSync()
 	m_localEvents.clear();
 	m_remoteEvents.clear();
 
+	m_resyncing = false;
+	m_crawler->setSubfolderFilter(RemoteTreeCrawler::SubfolderFilter());
+
 	getRoots();
 }
 
-void Syncer::onGetChildrenSucceeded(const QList<RemoteFileDesc>& list)
+void Syncer::incrementalSync()
+{
+	m_localEvents.clear();
+	m_remoteEvents.clear();
+
+	const LocalSnapshot local = DirectoryScanner::scan(
+		Settings::instance().get(Settings::folderPath).toString());
+
+	LocalSnapshot base;
+	if (!m_snapshotFileName.isEmpty()
+		&& base.load(m_snapshotFileName, local.rootPath()))
+	{
+		Reconciler(local, base).reconcile(m_localEvents, m_remoteEvents);
+	}
+	else
+	{
+		// Nothing to compare with, the handlers check every file
+		syncLocalFolder(local);
+		syncMissingLocalFiles();
+	}
+
+	m_snapshotPending = true;
+	fireEvents();
+}
+
+void Syncer::saveLocalSnapshot()
+{
+	if (m_snapshotFileName.isEmpty() || !m_snapshotPending)
+	{
+		return;
+	}
+
+	m_snapshotPending = false;
+	QThreadPool::globalInstance()->start(new SaveSnapshotTask(
+		Settings::instance().get(Settings::folderPath).toString(),
+		m_snapshotFileName));
+}
+
+void Syncer::resync(const uint since)
+{
+	QLOG_INFO() << "Resyncing the remote folders, events lost since" << since;
+
+	m_localEvents.clear();
+	m_remoteEvents.clear();
+	m_resyncListedIds.clear();
+	m_resyncMissing.clear();
+
+	// A folder's modifiedAt isn't known to change with its subtree, so
+	// every folder is listed and only the differences become events
+	m_resyncing = true;
+	m_crawler->setSubfolderFilter(RemoteTreeCrawler::SubfolderFilter());
+	m_crawler->start(diskId);
+}
+
+void Syncer::resyncChildren(const int folderId, const QList<RemoteFileDesc>& list)
+{
+	LocalCache& localCache = LocalCache::instance();
+
+	Q_FOREACH(const RemoteFileDesc& fileDesc, list)
+	{
+		m_resyncListedIds.insert(fileDesc.id);
+
+		const RemoteFileDesc cached = localCache.file(fileDesc.id);
+		const bool contentChanged = cached.isValid()
+			&& (cached.modifiedAt != fileDesc.modifiedAt
+				|| cached.checkSum != fileDesc.checkSum);
+
+		if (cached.isValid()
+			&& (cached.parentId != fileDesc.parentId
+				|| cached.name != fileDesc.name))
+		{
+			// The handler moves the local file from its cached path and
+			// updates the cache itself, a changed content is fetched after
+			// it since both events share the paths
+			RemoteFileEvent event = RemoteFileEvent::syncEvent(fileDesc);
+			event.type = cached.parentId != fileDesc.parentId
+				? RemoteFileEvent::Moved
+				: RemoteFileEvent::Renamed;
+			emit newRemoteEvent(event);
+
+			if (contentChanged && fileDesc.type == RemoteFileDesc::File)
+			{
+				emit newRemoteEvent(RemoteFileEvent::syncEvent(fileDesc));
+			}
+			continue;
+		}
+
+		if (cached.isValid() && !contentChanged)
+		{
+			continue;
+		}
+
+		emit newFile(fileDesc);
+		emit newRemoteEvent(RemoteFileEvent::syncEvent(fileDesc));
+	}
+
+	const QString folderPath = localCache.findPath(folderId);
+	if (folderPath.isNull())
+	{
+		return;
+	}
+
+	// Not listed here, but may be moved to a folder listed later: decided
+	// when the crawl is over
+	Q_FOREACH(const RemoteFileDesc& cached, localCache.children(folderId))
+	{
+		if (m_resyncListedIds.contains(cached.id))
+		{
+			continue;
+		}
+
+		RemoteFileEvent event = RemoteFileEvent::syncEvent(cached);
+		event.type = RemoteFileEvent::Trashed;
+		event.fileDesc.originalPath = folderPath;
+		m_resyncMissing << event;
+	}
+}
+
+void Syncer::resyncTrashed()
+{
+	Q_FOREACH(const RemoteFileEvent& event, m_resyncMissing)
+	{
+		// Trashed while the events were lost
+		if (!m_resyncListedIds.contains(event.fileDesc.id))
+		{
+			m_remoteEvents << event;
+		}
+	}
+
+	m_resyncListedIds.clear();
+	m_resyncMissing.clear();
+}
+
+void Syncer::onGetChildrenSucceeded(const int folderId, const QList<RemoteFileDesc>& list)
 {
-	--m_folderCounter;
+	if (m_resyncing)
+	{
+		resyncChildren(folderId, list);
+		return;
+	}
 
 	Q_FOREACH(RemoteFileDesc fileDesc, list)
 	{
@@ -46,10 +255,8 @@ void Syncer::onGetChildrenSucceeded(const QList<RemoteFileDesc>& list)
 			QLOG_TRACE() << "SYNCER fileDesc: ";
 			event.log();
 
-			//emit newRemoteEvent(event);
-			m_remoteEvents << event;
-
 			emit newFile(fileDesc);
+			emit newRemoteEvent(event);
 		}
 	}
 
@@ -69,36 +276,10 @@ void Syncer::onGetChildrenSucceeded(const QList<RemoteFileDesc>& list)
 			QLOG_TRACE() << "SYNCER folder fileDesc: ";
 			event.log();
 
-			//emit newRemoteEvent(event);
-			m_remoteEvents << event;
-
 			emit newFile(fileDesc);
+			emit newRemoteEvent(event);
 		}
 	}
-
-	Q_FOREACH(RemoteFileDesc fileDesc, list)
-	{
-		if (fileDesc.type == RemoteFileDesc::Dir)
-			if (fileDesc.hasChildren)
-			{
-				GetChildrenResourceRef getChildrenRes =
-					GetChildrenResource::create();
-
-				connect(getChildrenRes.data(), &GetChildrenResource::succeeded,
-					this, &Syncer::onGetChildrenSucceeded);
-
-				connect(getChildrenRes.data(), &GetChildrenResource::failed,
-					this, &Syncer::onGetFailed);
-
-				++m_folderCounter;
-				getChildrenRes->getChildren(fileDesc.id);
-			}
-	}
-
-	if (!m_folderCounter)
-	{
-		fireEvents();
-	}
 }
 
 void Syncer::getRoots()
@@ -117,22 +298,21 @@ void Syncer::getRoots()
 
 void Syncer::getChildren()
 {
-	GetChildrenResourceRef getChildrenRes =
-			GetChildrenResource::create();
-
-	connect(getChildrenRes.data(), &GetChildrenResource::succeeded,
-		this, &Syncer::onGetChildrenSucceeded);
-
-	connect(getChildrenRes.data(), &GetChildrenResource::failed,
-		this, &Syncer::onGetFailed);
-
-	++m_folderCounter;
-
-	const int diskId = -2;
-	getChildrenRes->getChildren(diskId);
+	// The crawl goes on from the saved folders after an interruption,
+	// files listed before it may still be missing locally.
+	const bool resumed = RemoteTreeCrawler::hasSavedProgress();
+
+	syncLocalFolder(DirectoryScanner::scan(
+		Settings::instance().get(Settings::folderPath).toString()));
+	m_snapshotPending = true;
+	if (resumed)
+	{
+		syncMissingLocalFiles();
+	}
 
-	syncLocalFolder(
-		Settings::instance().get(Settings::folderPath).toString());
+	// The events are held until the crawl is over: the local ones need the
+	// cached ids of their remote folders
+	m_crawler->start(diskId);
 }
 
 void Syncer::onGetRootsSucceeded(const QList<RemoteFileDesc>& roots)
@@ -151,48 +331,45 @@ void Syncer::onGetFailed() const
 	AppController::instance().restartRemotesOnly();
 }
 
-void Syncer::syncLocalFolder(const QString& localFolderPath)
+void Syncer::syncLocalFolder(const LocalSnapshot& snapshot)
 {
-	QDir dir(localFolderPath);
+	const QString rootPath = snapshot.rootPath();
 
-	if (dir.exists())
+	Q_FOREACH(const LocalSnapshot::Entry& entry, snapshot.entries())
 	{
-		Q_FOREACH(QFileInfo info,
-			dir.entryInfoList(QDir::NoDotAndDotDot
-			| QDir::System
-			//| QDir::Hidden
-			| QDir::AllDirs
-			| QDir::Files, QDir::DirsFirst))
-		{
-//			if (notifyLocalWatcher)
-//			{
-//				LocalFileEventNotifier::instance()
-//					.addExclusion(info.absoluteFilePath());
-//			}
+		const int slash = entry.path.lastIndexOf(QLatin1Char('/'));
+		const QString dir = slash < 0
+			? rootPath
+			: rootPath + QLatin1Char('/') + entry.path.left(slash);
 
-			if (info.isDir())
-			{
-				if (QDir::cleanPath(info.absoluteFilePath())
-					!= QDir::cleanPath(Settings::instance().get(Settings::folderPath).toString()))
-				{
-					m_localEvents << LocalFileEvent(LocalFileEvent::Added,
-							QDir::cleanPath(info.absolutePath()),
-							info.fileName());
-					syncLocalFolder(info.absoluteFilePath());
-				}
-			}
-			else
-			{
-				m_localEvents << LocalFileEvent(LocalFileEvent::Added,
-						QDir::cleanPath(info.absolutePath()),
-						info.fileName());
-			}
+		m_localEvents << LocalFileEvent(LocalFileEvent::Added,
+				dir, entry.path.mid(slash + 1));
+	}
+}
 
+void Syncer::syncMissingLocalFiles()
+{
+	// Cached files that are absent locally would have been downloaded
+	// by the full sync, keep the same behavior here.
+	LocalCache& localCache = LocalCache::instance();
+	Q_FOREACH(const RemoteFileDesc& fileDesc, localCache.files())
+	{
+		const QString remotePath = localCache.fullPath(fileDesc);
+		if (!remotePath.startsWith(diskRootPath))
+		{
+			continue;
+		}
+
+		if (QFileInfo::exists(Utils::toLocalPath(remotePath)))
+		{
+			continue;
 		}
+
+		m_remoteEvents << RemoteFileEvent::syncEvent(fileDesc);
 	}
 }
 
-void Syncer::fireEvents()
+void Syncer::emitEvents()
 {
 	for (int i = 0; i < m_localEvents.size(); ++i)
 	{
@@ -203,6 +380,20 @@ void Syncer::fireEvents()
 	{
 		emit newRemoteEvent(m_remoteEvents.at(i));
 	}
+
+	m_localEvents.clear();
+	m_remoteEvents.clear();
+}
+
+void Syncer::fireEvents()
+{
+	if (m_resyncing)
+	{
+		resyncTrashed();
+	}
+
+	emitEvents();
+	emit finished();
 }
 
 }
@@ -3,8 +3,11 @@
 
 #include "APIClient/ApiTypes.h"
 #include "Events/LocalFileEvent.h"
+#include "Events/RemoteTreeCrawler.h"
+#include "Util/LocalSnapshot.h"
 
 #include <QtCore/QObject>
+#include <QtCore/QSet>
 
 
 namespace Drive
@@ -14,10 +17,25 @@ class Syncer: public QObject
 {
 	Q_OBJECT
 public:
-	Syncer();
+	// The local snapshot of the last completed sync is kept in the file.
+	explicit Syncer(const QString& snapshotFileName = QString());
 
 	void fullSync();
 
+	// Startup with a restored LocalCache: only the local folder is scanned,
+	// remote changes are delivered by the notification service.
+	void incrementalSync();
+
+	// Takes the base for the next incremental sync once the events of this
+	// one have been handled, only what changes since then becomes events.
+	void saveLocalSnapshot();
+
+	// Catch-up after the remote events since the time have been lost: the
+	// whole remote tree is listed and only the differences to the cache
+	// become events. Files gone from their cached folder are trashed once
+	// the crawl is over and they haven't turned up elsewhere.
+	void resync(uint since);
+
 signals:
 	void newRoot(const RemoteFileDesc&);
 	void newFile(const RemoteFileDesc&);
@@ -25,24 +43,41 @@ signals:
 	void newRemoteEvent(RemoteFileEvent event);
 	void newLocalEvent(LocalFileEvent event);
 
+	// All the sync events have been emitted.
+	void finished();
+
 private:
 	void getRoots();
 	void onGetRootsSucceeded(const QList<RemoteFileDesc>&);
 
 	void getChildren();
-	void onGetChildrenSucceeded(const QList<Drive::RemoteFileDesc>&);
+	void onGetChildrenSucceeded(int folderId, const QList<Drive::RemoteFileDesc>&);
+	void resyncChildren(int folderId, const QList<Drive::RemoteFileDesc>&);
+	void resyncTrashed();
 
 	void onGetFailed() const;
 
-	void syncLocalFolder(const QString& localFolderPath);
+	void syncLocalFolder(const LocalSnapshot& snapshot);
+	void syncMissingLocalFiles();
+	void emitEvents();
 	void fireEvents();
 
 private:
 	QString m_currentLocalPathPrefix;
-	int m_folderCounter;
+	const QString m_snapshotFileName;
+	// Set once the sync has scanned the local folder
+	bool m_snapshotPending;
+	// The crawl is a resync
+	bool m_resyncing;
 
 	QList<LocalFileEvent> m_localEvents;
 	QList<RemoteFileEvent> m_remoteEvents;
+
+	// Ids listed by the resync and the cached files missing from their folder
+	QSet<int> m_resyncListedIds;
+	QList<RemoteFileEvent> m_resyncMissing;
+
+	RemoteTreeCrawler* m_crawler;
 };
 
 }
@@ -78,16 +78,18 @@ void GeneralRestDispatcher::cancelAll(const RestResourceRef& restResource)
 void GeneralRestDispatcher::cancelCurrent(RestService *service,
 								const RestResourceRef *restResource)
 {
-	if (!service->m_currentRequest.isNull())
-		if (!restResource || service->m_currentRequest->resource == *restResource)
-		{
-			if (restResource)
-				restResource->data()->requestCancelled();
-			else
-				service->m_currentRequest->resource->requestCancelled();
+	for (const RestService::InFlightRequest& inFlight: service->m_inFlightRequests)
+	{
+		const RestResource::RequestRef& currentRequest = inFlight.request;
+		if (currentRequest->isCanceled)
+			continue;
 
-			service->m_currentRequest->isCanceled = true;
+		if (!restResource || currentRequest->resource == *restResource)
+		{
+			currentRequest->resource->requestCancelled();
+			currentRequest->isCanceled = true;
 		}
+	}
 }
 
 void GeneralRestDispatcher::cancelAll(QQueue<RestResource::RequestRef>& queue,
@@ -157,47 +159,71 @@ void GeneralRestDispatcher::next()
 {
 	QMutexLocker locker(&nextMutex);
 
+	const int maxWindow =
+		Settings::instance().get(Settings::maxParallelRequests).toInt();
+
 	QList<RestService*> serviceList = m_services.values();
 	foreach(RestService* service, serviceList)
 	{
-		while (service->m_currentRequest.isNull()) /// !!!
+		service->setMaxWindow(maxWindow);
+
+		while (service->requestsInFlight() < service->window())
 		{
-		/* If we're Authenticated, then consume the Unauthenticated queue first
-		and then the Authenticated queue. If we're Unauthenticated,
-		then consume the Unauthenticated queue only. */
-			if (mode == Authorized)
-			{
-				if (service->queuesAreEmpty())
-				{
-					break;
-				}
-
-				if (!service->m_unauthenticatedRequests.isEmpty())
-				{
-					service->m_currentRequest =
-						service->m_unauthenticatedRequests.dequeue();
-				}
-				else
-				{
-					service->m_currentRequest =
-						service->m_authenticatedRequests.dequeue();
-				}
+			const RestResource::RequestRef restRequest = takeNextRequest(service);
+			if (restRequest.isNull())
+				break;
 
-			}
-			else // mode == Unauthorized
+			QNetworkReply* networkReply = doOperation(restRequest, service);
+			if (networkReply)
 			{
-				if (service->m_unauthenticatedRequests.isEmpty())
-					break;
-
-				service->m_currentRequest =
-					service->m_unauthenticatedRequests.dequeue();
+				RestService::InFlightRequest& inFlight =
+					service->m_inFlightRequests[networkReply];
+				inFlight.request = restRequest;
+				inFlight.timer.start();
 			}
-
-			doOperation(service->m_currentRequest->operation, service);
 		}
 	}
 }
 
+RestResource::RequestRef GeneralRestDispatcher::takeNextRequest(RestService* service)
+{
+	/* If we're Authenticated, then the Unauthenticated and the Authenticated
+	queues take turns. If we're Unauthenticated, then consume
+	the Unauthenticated queue only. */
+	if (mode == Authorized)
+	{
+		if (service->queuesAreEmpty())
+			return RestResource::RequestRef();
+
+		const bool authenticated = service->m_unauthenticatedRequests.isEmpty()
+			|| (service->m_authenticatedTurn
+				&& !service->m_authenticatedRequests.isEmpty());
+
+		service->m_authenticatedTurn = !authenticated;
+
+		return authenticated
+			? service->m_authenticatedRequests.dequeue()
+			: service->m_unauthenticatedRequests.dequeue();
+	}
+	else // mode == Unauthorized
+	{
+		if (service->m_unauthenticatedRequests.isEmpty())
+			return RestResource::RequestRef();
+
+		return service->m_unauthenticatedRequests.dequeue();
+	}
+}
+
+bool GeneralRestDispatcher::hasRequestsInFlight() const
+{
+	for (const RestService* service: m_services)
+	{
+		if (service->requestsInFlight() != 0)
+			return true;
+	}
+	return false;
+}
+
 void GeneralRestDispatcher::setMode(Mode newMode)
 {
 	if (mode == newMode)
@@ -266,6 +292,11 @@ QUrl GeneralRestDispatcher::buildUrl(const RestResource* restResource)
 	return buildUrl(restResource->service(), restResource->path());
 }
 
+bool GeneralRestDispatcher::hasService(const QString& serviceName) const
+{
+	return m_services.contains(serviceName);
+}
+
 void GeneralRestDispatcher::setAuthToken(const QString& token)
 {
 	authToken = token;
@@ -282,30 +313,31 @@ QList<QNetworkCookie> GeneralRestDispatcher::getCookies()
 	return networkAccessManager->cookieJar()->cookiesForUrl(QUrl(COOKIE_URL));
 }
 
-QNetworkRequest GeneralRestDispatcher::createRequest(RestService* service) const
+QNetworkRequest GeneralRestDispatcher::createRequest(
+	const RestResource::RequestRef& restRequest, RestService* service) const
 {
 	QUrl url;
 	QNetworkRequest request;
 
-	if (service->m_currentRequest->operation
+	if (restRequest->operation
 			== QNetworkAccessManager::PostOperation
-		|| service->m_currentRequest->operation
+		|| restRequest->operation
 			== QNetworkAccessManager::PutOperation
-		|| service->m_currentRequest->operation
+		|| restRequest->operation
 			== QNetworkAccessManager::DeleteOperation)
 	{
 		// no need to handle query params for POST, PUT and DELETE
 		// as they already handled
-		request = QNetworkRequest(buildUrl(service->m_currentRequest->service,
-			service->m_currentRequest->path));
+		request = QNetworkRequest(buildUrl(restRequest->service,
+			restRequest->path));
 	}
 	else
 	{
-		request = QNetworkRequest(buildUrl(service->m_currentRequest->service,
-			service->m_currentRequest->path, service->m_currentRequest->params));
+		request = QNetworkRequest(buildUrl(restRequest->service,
+			restRequest->path, restRequest->params));
 	}
 
-	foreach (RestResource::HeaderPair header, service->m_currentRequest->headers)
+	foreach (RestResource::HeaderPair header, restRequest->headers)
 	{
 		request.setRawHeader(header.first, header.second);
 	}
@@ -341,19 +373,22 @@ QUrlQuery GeneralRestDispatcher::createParams(RestResource::ParamList &params)
 	return urlQuery;
 }
 
-void GeneralRestDispatcher::doOperation(RestResource::Operation operation,
-								RestService* service)
+QNetworkReply* GeneralRestDispatcher::doOperation(
+	const RestResource::RequestRef& restRequest, RestService* service)
 {
+	const RestResource::Operation operation = restRequest->operation;
+	QNetworkReply* networkReply = nullptr;
+
 	if (operation == QNetworkAccessManager::PostOperation
 		|| operation == QNetworkAccessManager::PutOperation
 		|| operation == QNetworkAccessManager::DeleteOperation)
 	{
 		QByteArray bodyData;
 
-		if (!service->m_currentRequest->params.isEmpty())
+		if (!restRequest->params.isEmpty())
 		{
 			QUrlQuery urlQuery =
-				createParams(service->m_currentRequest->params);
+				createParams(restRequest->params);
 
 			if (!urlQuery.isEmpty())
 			{
@@ -363,68 +398,60 @@ void GeneralRestDispatcher::doOperation(RestResource::Operation operation,
 			else
 			{
 				QLOG_ERROR() << "Failed to convert request params.";
-				service->m_currentRequest.clear();
-				return;
-        }
+				return nullptr;
+			}
 		}
 		else
 		{
-			bodyData = service->m_currentRequest->data;
+			bodyData = restRequest->data;
 		}
 		QLOG_INFO() << "Service: " << service->toString();
 		QLOG_INFO() << "Request body: " << bodyData;
 
 		if (operation == QNetworkAccessManager::PostOperation)
 		{
-			networkAccessManager->post(createRequest(service), bodyData);
-			m_watchDog.restart();
+			networkReply = networkAccessManager->post(
+				createRequest(restRequest, service), bodyData);
 		}
 		else if (operation == QNetworkAccessManager::PutOperation)
 		{
-			networkAccessManager->put(createRequest(service), bodyData);
-			m_watchDog.restart();
+			networkReply = networkAccessManager->put(
+				createRequest(restRequest, service), bodyData);
 		}
 		else if (operation == QNetworkAccessManager::DeleteOperation)
 		{
 			QBuffer *buffer =
-				new QBuffer(service->m_currentRequest.data()->resource.data());
+				new QBuffer(restRequest->resource.data());
 
 			buffer->setData(bodyData);
 
-			QNetworkRequest request = createRequest(service);
+			QNetworkRequest request = createRequest(restRequest, service);
 
-			networkAccessManager->sendCustomRequest(request
+			networkReply = networkAccessManager->sendCustomRequest(request
 				, QString("DELETE").toLatin1()
 				, buffer);
-			m_watchDog.restart();
 		}
 
 	}
 	else if (operation == QNetworkAccessManager::GetOperation)
 	{
-		networkAccessManager->get(createRequest(service));
-		m_watchDog.restart();
-	}
-	else if (operation == QNetworkAccessManager::DeleteOperation)
-	{
-		networkAccessManager->deleteResource(createRequest(service));
-		m_watchDog.restart();
+		networkReply = networkAccessManager->get(createRequest(restRequest, service));
 	}
 	else if (operation == QNetworkAccessManager::HeadOperation)
 	{
-		networkAccessManager->head(createRequest(service));
-		m_watchDog.restart();
+		networkReply = networkAccessManager->head(createRequest(restRequest, service));
 	}
-	else if (operation == QNetworkAccessManager::CustomOperation)
+
+	if (networkReply)
 	{
-		service->m_currentRequest.clear();
+		m_watchDog.restart();
 	}
+
+	return networkReply;
 }
 
 void GeneralRestDispatcher::replyFinished(QNetworkReply* networkReply)
 {
-	m_watchDog.stop();
-
 	QObject* originatingObject = networkReply->request().originatingObject();
 
 	if(!originatingObject)
@@ -443,32 +470,54 @@ void GeneralRestDispatcher::replyFinished(QNetworkReply* networkReply)
 		return;
 	}
 
-
-	if (service->m_currentRequest.isNull())
+	const auto inFlightIt = service->m_inFlightRequests.find(networkReply);
+	if (inFlightIt == service->m_inFlightRequests.end())
 	{
 		QLOG_ERROR() <<
-			"Reply discarded because current service request is null.";
+			"Reply discarded because there is no service request for it.";
 
 		next();
 		return;
 	}
 
-	if (!service->m_currentRequest->isCanceled)
+	const RestResource::RequestRef restRequest = inFlightIt->request;
+	const qint64 latency = inFlightIt->timer.elapsed();
+	service->m_inFlightRequests.erase(inFlightIt);
+
+	// Other requests are still waiting for their replies
+	if (hasRequestsInFlight())
+		m_watchDog.restart();
+	else
+		m_watchDog.stop();
+
+	const int httpStatus = networkReply->attribute(
+		QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+	if (networkReply->error() == QNetworkReply::NoError)
+	{
+		service->requestSucceeded(latency);
+	}
+	else if (networkReply->error() != QNetworkReply::OperationCanceledError
+		&& (httpStatus == 0 || httpStatus == 429 || httpStatus >= 500))
+	{
+		// The server or the connection is overloaded
+		service->requestFailed();
+	}
+
+	if (!restRequest->isCanceled)
 	{
 		bool authenticationRequired = false;
 
-		service->m_currentRequest->resource->requestFinished(
+		restRequest->resource->requestFinished(
 			RestResource::ReplyRef(
-				new RestResource::Reply(service->m_currentRequest, networkReply))
+				new RestResource::Reply(restRequest, networkReply))
 			, authenticationRequired);
 
 		if (authenticationRequired)
 		{
 			service->m_authenticatedRequests.insert(
 				service->m_authenticatedRequests.begin()
-				, service->m_currentRequest);
-
-			service->m_currentRequest.clear();
+				, restRequest);
 
 			setMode(Unauthorized);
 			return;
@@ -479,8 +528,6 @@ void GeneralRestDispatcher::replyFinished(QNetworkReply* networkReply)
 		QLOG_INFO() << "Resource request is already canceled.";
 	}
 
-	service->m_currentRequest.clear();
-
 	next();
 }
 
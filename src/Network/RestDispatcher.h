@@ -46,6 +46,9 @@ public:
 	QUrl buildUrl(const QString& serviceName, const QString &path, const RestResource::ParamList &params = RestResource::ParamList()) const;
 	QUrl buildUrl(const RestResource* restResource);
 
+	// The address of the service has been received
+	bool hasService(const QString& serviceName) const;
+
 	void setAuthToken(const QString& token);
 	void setWorkspaceId(int workspaceId);
 
@@ -69,18 +72,23 @@ private:
 	Q_DISABLE_COPY(GeneralRestDispatcher)
 
 	void next();
+	RestResource::RequestRef takeNextRequest(RestService* service);
+	bool hasRequestsInFlight() const;
 	void setMode(Mode newMode);
 
 	void cancelAll(QQueue<RestResource::RequestRef>& queue,
 		const RestResourceRef* restResource = 0);
 
+	// Cancels the requests in flight
 	void cancelCurrent(RestService* service,
 		const RestResourceRef* restResource = 0);
 
-	QNetworkRequest createRequest(RestService* service) const;
+	QNetworkRequest createRequest(const RestResource::RequestRef& restRequest,
+		RestService* service) const;
 	QUrlQuery createParams(RestResource::ParamList &params);
 
-	void doOperation(RestResource::Operation operation, RestService* service);
+	QNetworkReply* doOperation(const RestResource::RequestRef& restRequest,
+		RestService* service);
 
 private:
 	Mode mode;
@@ -8,7 +8,10 @@ RestService::RestService(const QString& name, const QString& address,
 	: QObject(parent)
 	, m_name(name)
 	, m_address(address)
-	, m_currentRequest(0)
+	, m_authenticatedTurn(false)
+	, m_window(1)
+	, m_maxWindow(1)
+	, m_baseLatency(0)
 {
 }
 
@@ -22,6 +25,52 @@ bool RestService::queuesAreEmpty() const
 		&& m_unauthenticatedRequests.isEmpty();
 }
 
+int RestService::window() const
+{
+	return static_cast<int>(m_window);
+}
+
+int RestService::requestsInFlight() const
+{
+	return m_inFlightRequests.size();
+}
+
+void RestService::setMaxWindow(const int maxWindow)
+{
+	m_maxWindow = qMax(1, maxWindow);
+	m_window = qMin(m_window, static_cast<double>(m_maxWindow));
+}
+
+void RestService::requestSucceeded(const qint64 latencyMSec)
+{
+	// The base latency follows the fastest replies and slowly forgets
+	// them, the server load changes over time
+	if (m_baseLatency <= 0 || latencyMSec < m_baseLatency)
+	{
+		m_baseLatency = latencyMSec;
+	}
+	else
+	{
+		m_baseLatency += (latencyMSec - m_baseLatency) / 64;
+	}
+
+	if (latencyMSec > 3 * m_baseLatency + 50)
+	{
+		requestFailed();
+	}
+	else
+	{
+		// Additive increase: one more request per window of replies
+		m_window = qMin(m_window + 1 / m_window, static_cast<double>(m_maxWindow));
+	}
+}
+
+void RestService::requestFailed()
+{
+	// Multiplicative decrease
+	m_window = qMax(1.0, m_window / 2);
+}
+
 const QString& RestService::name() const
 {
 	return m_name;
@@ -40,10 +89,8 @@ QString RestService::toString() const
 	map.insert(MAKE_PAIR(m_name));
 	map.insert(MAKE_PAIR(m_address));
 #undef MAKE_PAIR
-	map.insert(QLatin1String("m_currentRequest"),
-				m_currentRequest.isNull()
-				? QLatin1String("nullptr")
-				: m_currentRequest->toString());
+	map.insert(QLatin1String("m_inFlightRequests"), m_inFlightRequests.size());
+	map.insert(QLatin1String("m_window"), window());
 
 	return QJsonDocument(QJsonObject::fromVariantMap(map)).toJson();
 }
@@ -3,10 +3,13 @@
 
 #include "RestResource.h"
 
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
 #include <QtCore/QObject>
 #include <QtCore/QQueue>
 
 class GeneralRestDispatcher;
+class QNetworkReply;
 
 class RestService : public QObject
 {
@@ -19,18 +22,42 @@ public:
 
 	bool queuesAreEmpty() const;
 
+	// Number of requests which may be in flight at once.
+	// It grows while the replies come as fast as the fastest ones seen
+	// and halves when the latency rises or the server fails.
+	int window() const;
+	int requestsInFlight() const;
+
 	const QString& name() const;
 	const QString& address() const;
 
 	QString toString() const;
 
+private:
+	void setMaxWindow(int maxWindow);
+	void requestSucceeded(qint64 latencyMSec);
+	void requestFailed();
+
+	struct InFlightRequest
+	{
+		RestResource::RequestRef request;
+		QElapsedTimer timer;
+	};
+
 private:
 	const QString m_name;
 	const QString m_address;
-	RestResource::RequestRef m_currentRequest;
+	QHash<QNetworkReply*, InFlightRequest> m_inFlightRequests;
 	QQueue<RestResource::RequestRef> m_authenticatedRequests;
 	QQueue<RestResource::RequestRef> m_unauthenticatedRequests;
 
+	// The queues take turns while both have requests
+	bool m_authenticatedTurn;
+
+	double m_window;
+	int m_maxWindow;
+	double m_baseLatency;
+
 	friend class GeneralRestDispatcher;
 };
 
@@ -31,6 +31,10 @@ const QString Settings::limitDownload("download_limit");
 const QString Settings::limitUpload("upload_limit");
 const QString Settings::downloadSpeed("download_speed");
 const QString Settings::uploadSpeed("upload_speed");
+const QString Settings::maxParallelEvents("max_parallel_events");
+const QString Settings::localEventsDebounce("local_events_debounce");
+const QString Settings::maxParallelRequests("max_parallel_requests");
+const QString Settings::maxParallelListings("max_parallel_listings");
 const QString Settings::proxyUsage("proxy_usage");
 const QString Settings::proxyCustomSettings("proxy_custom_settings");
 const QString Settings::env("environment");
@@ -38,6 +42,10 @@ const QString Settings::remoteConfig("remote_config");
 
 #define DEFAULT_DOWNLOAD_SPEED 50
 #define DEFAULT_UPLOAD_SPEED 50
+#define DEFAULT_MAX_PARALLEL_EVENTS 4
+#define DEFAULT_LOCAL_EVENTS_DEBOUNCE 1000 // ms
+#define DEFAULT_MAX_PARALLEL_REQUESTS 6 // per service
+#define DEFAULT_MAX_PARALLEL_LISTINGS 4 // full sync folder listings
 
 Settings::Settings(QObject *parent)
 	: QObject(parent)
@@ -247,6 +255,18 @@ QVariant Settings::defaultSettingValue(const QString& settingName) const
 	if (settingName == uploadSpeed)
 		return DEFAULT_UPLOAD_SPEED;
 
+	if (settingName == maxParallelEvents)
+		return DEFAULT_MAX_PARALLEL_EVENTS;
+
+	if (settingName == localEventsDebounce)
+		return DEFAULT_LOCAL_EVENTS_DEBOUNCE;
+
+	if (settingName == maxParallelRequests)
+		return DEFAULT_MAX_PARALLEL_REQUESTS;
+
+	if (settingName == maxParallelListings)
+		return DEFAULT_MAX_PARALLEL_LISTINGS;
+
 	if (settingName == proxyUsage)
 		return ProxyUsage::NoProxy;
 
@@ -28,6 +28,10 @@ public:
 	static const QString limitUpload;
 	static const QString downloadSpeed;
 	static const QString uploadSpeed;
+	static const QString maxParallelEvents;
+	static const QString localEventsDebounce;
+	static const QString maxParallelRequests;
+	static const QString maxParallelListings;
 	static const QString proxyUsage;
 	static const QString proxyCustomSettings;
 	static const QString env;
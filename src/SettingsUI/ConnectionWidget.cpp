@@ -12,8 +12,10 @@
 #include <QtWidgets/QCheckBox>
 #include <QtWidgets/QPushButton>
 #include <QtWidgets/QDialogButtonBox>
+#include <QtGui/QIntValidator>
 
 #define MIN_CONNECTION_TAB_LABEL_WIDTH 96
+#define MAX_RATE_LIMIT 999999
 
 namespace Drive
 {
@@ -48,6 +50,8 @@ QBoxLayout* ConnectionWidget::createBandwidthControls()
 	rbDownloadLimit = new QRadioButton(tr("Limit to:"), gbDownload);
 
 	leDownloadLimit = new QLineEdit(gbDownload);
+	leDownloadLimit->setObjectName("downloadLimit");
+	leDownloadLimit->setValidator(new QIntValidator(1, MAX_RATE_LIMIT, leDownloadLimit));
 	leDownloadLimit->setMaximumWidth(48);
 	leDownloadLimit->setAlignment(Qt::AlignRight);
 
@@ -77,6 +81,8 @@ QBoxLayout* ConnectionWidget::createBandwidthControls()
 	rbUploadLimit = new QRadioButton(tr("Limit to:"), gbUpload);
 
 	leUploadLimit = new QLineEdit(gbUpload);
+	leUploadLimit->setObjectName("uploadLimit");
+	leUploadLimit->setValidator(new QIntValidator(1, MAX_RATE_LIMIT, leUploadLimit));
 	leUploadLimit->setMaximumWidth(48);
 	leUploadLimit->setAlignment(Qt::AlignRight);
 
@@ -199,6 +205,16 @@ void ConnectionWidget::on_uploadNoLimit_toggled(bool checked)
 	lUploadLimit->setDisabled(checked);
 }
 
+void ConnectionWidget::on_downloadLimit_editingFinished()
+{
+	Settings::instance().set(Settings::downloadSpeed, leDownloadLimit->text().toInt());
+}
+
+void ConnectionWidget::on_uploadLimit_editingFinished()
+{
+	Settings::instance().set(Settings::uploadSpeed, leUploadLimit->text().toInt());
+}
+
 void ConnectionWidget::on_noProxy_toggled(bool checked)
 {
 	if (checked)
@@ -26,6 +26,8 @@ public:
 private slots:
 	void on_downloadNoLimit_toggled(bool checked);
 	void on_uploadNoLimit_toggled(bool checked);
+	void on_downloadLimit_editingFinished();
+	void on_uploadLimit_editingFinished();
 
 	void on_noProxy_toggled(bool checked);
 	void on_autoProxy_toggled(bool checked);
@@ -0,0 +1,116 @@
+﻿#include "ContentChunker.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QIODevice>
+
+namespace Drive
+{
+
+namespace
+{
+
+const int s_readBlockSize = 1024 * 1024;
+
+// 20 zero bits make the average block about 1 MiB. The high bits of the
+// gear hash depend on all the 64 last bytes.
+const quint64 s_boundaryMask = 0xFFFFF00000000000ULL;
+
+struct GearTable
+{
+	GearTable()
+	{
+		// splitmix64, the table must be the same on every run
+		quint64 state = 0x5444726976654344ULL;
+		for (int i = 0; i < 256; ++i)
+		{
+			quint64 z = (state += 0x9E3779B97F4A7C15ULL);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+			values[i] = z ^ (z >> 31);
+		}
+	}
+
+	quint64 values[256];
+};
+
+const GearTable s_gear;
+
+}
+
+const qint64 ContentChunker::minBlockSize;
+const qint64 ContentChunker::maxBlockSize;
+
+bool ContentChunker::split(QIODevice& device, QVector<Block>& blocks,
+	QString* fileHash)
+{
+	blocks.clear();
+
+	QCryptographicHash blockHash(QCryptographicHash::Md5);
+	QCryptographicHash wholeHash(QCryptographicHash::Md5);
+	QByteArray buffer(s_readBlockSize, Qt::Uninitialized);
+
+	qint64 offset = 0;
+	qint64 blockOffset = 0;
+	quint64 gear = 0;
+
+	for (;;)
+	{
+		const qint64 read = device.read(buffer.data(), buffer.size());
+		if (read < 0)
+		{
+			return false;
+		}
+		if (read == 0)
+		{
+			break;
+		}
+
+		wholeHash.addData(buffer.constData(), read);
+
+		const uchar* data = reinterpret_cast<const uchar*>(buffer.constData());
+		qint64 pending = 0;
+		for (qint64 i = 0; i < read; ++i)
+		{
+			gear = (gear << 1) + s_gear.values[data[i]];
+
+			const qint64 blockSize = offset + i + 1 - blockOffset;
+			if ((blockSize >= minBlockSize && (gear & s_boundaryMask) == 0)
+				|| blockSize >= maxBlockSize)
+			{
+				blockHash.addData(buffer.constData() + pending, i + 1 - pending);
+				pending = i + 1;
+
+				Block block;
+				block.offset = blockOffset;
+				block.size = blockSize;
+				block.hash = blockHash.result();
+				blocks.append(block);
+
+				blockHash.reset();
+				blockOffset += blockSize;
+				gear = 0;
+			}
+		}
+
+		blockHash.addData(buffer.constData() + pending, read - pending);
+		offset += read;
+	}
+
+	if (offset > blockOffset || blocks.isEmpty())
+	{
+		Block block;
+		block.offset = blockOffset;
+		block.size = offset - blockOffset;
+		block.hash = blockHash.result();
+		blocks.append(block);
+	}
+
+	if (fileHash)
+	{
+		*fileHash = QString::fromLatin1(wholeHash.result().toHex());
+	}
+
+	return true;
+}
+
+}
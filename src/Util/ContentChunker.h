@@ -0,0 +1,44 @@
+﻿#ifndef CONTENT_CHUNKER_H
+#define CONTENT_CHUNKER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+class QIODevice;
+
+namespace Drive
+{
+
+//
+// Splits a stream into content-defined blocks with a gear rolling hash.
+// A block boundary depends only on the bytes right before it, so an edit
+// in the middle of a file changes the blocks around the edit only, the
+// blocks after it are found again at their shifted offsets.
+//
+class ContentChunker
+{
+public:
+	struct Block
+	{
+		qint64 offset;
+		qint64 size;
+		// MD5 of the block data
+		QByteArray hash;
+	};
+
+	static const qint64 minBlockSize = 256 * 1024;
+	static const qint64 maxBlockSize = 4096 * 1024;
+
+	// Reads the device to the end. Returns false on a read error.
+	// fileHash receives the lowercase hex MD5 of the whole stream.
+	static bool split(QIODevice& device, QVector<Block>& blocks,
+			QString* fileHash = nullptr);
+
+private:
+	ContentChunker() = delete;
+};
+
+}
+
+#endif // CONTENT_CHUNKER_H
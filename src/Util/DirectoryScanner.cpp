@@ -0,0 +1,257 @@
+﻿#include "DirectoryScanner.h"
+
+#include "QsLog/QsLog.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QRunnable>
+#include <QtCore/QSet>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtCore/QWaitCondition>
+
+#ifdef Q_OS_LINUX
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Drive
+{
+
+class DirectoryScanner::State
+{
+public:
+	State(const QString& rootPath, int threadCount)
+		: rootPath(rootPath)
+		, pendingTasks(0)
+	{
+		pool.setMaxThreadCount(threadCount);
+	}
+
+	void submit(const QString& relativePath);
+	void finishTask(const QVector<LocalSnapshot::Entry>& entries);
+	void waitForAll();
+
+	// A folder reached through symlinks more than once is listed only once
+	bool visit(quint64 device, quint64 inode);
+
+	const QString rootPath;
+
+	QMutex mutex;
+	QWaitCondition allDone;
+	int pendingTasks;
+	QVector<LocalSnapshot::Entry> entries;
+	QSet<QPair<quint64, quint64> > visited;
+
+	// Destroyed first, it waits for the worker threads
+	QThreadPool pool;
+};
+
+class DirectoryScanner::ScanTask : public QRunnable
+{
+public:
+	ScanTask(State* state, const QString& relativePath)
+		: m_state(state)
+		, m_relativePath(relativePath)
+	{
+	}
+
+	virtual void run() override
+	{
+		QVector<LocalSnapshot::Entry> entries;
+		const QString dirPath = m_relativePath.isEmpty()
+			? m_state->rootPath
+			: m_state->rootPath + QLatin1Char('/') + m_relativePath;
+
+#ifdef Q_OS_LINUX
+		scanNative(dirPath, entries);
+#else
+		scanQt(dirPath, entries);
+#endif
+
+		m_state->finishTask(entries);
+	}
+
+private:
+	QString childPath(const QString& name) const
+	{
+		return m_relativePath.isEmpty()
+			? name
+			: m_relativePath + QLatin1Char('/') + name;
+	}
+
+#ifdef Q_OS_LINUX
+	void scanNative(const QString& dirPath, QVector<LocalSnapshot::Entry>& entries)
+	{
+		const int fd = ::open(QFile::encodeName(dirPath).constData(),
+			O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (fd < 0)
+		{
+			QLOG_ERROR() << "Can't open folder" << dirPath;
+			return;
+		}
+
+		DIR* dir = ::fdopendir(fd);
+		if (!dir)
+		{
+			::close(fd);
+			QLOG_ERROR() << "Can't read folder" << dirPath;
+			return;
+		}
+
+		while (const dirent* dirEntry = ::readdir(dir))
+		{
+			// Hidden entries as well as "." and ".."
+			if (dirEntry->d_name[0] == '.')
+			{
+				continue;
+			}
+
+			// Symlinks are followed, the same way QFileInfo does
+			struct stat st;
+			if (::fstatat(fd, dirEntry->d_name, &st, 0) != 0)
+			{
+				continue;
+			}
+
+			LocalSnapshot::Entry entry;
+			entry.path = childPath(QFile::decodeName(dirEntry->d_name));
+			entry.isDir = S_ISDIR(st.st_mode);
+			entry.size = entry.isDir ? 0 : st.st_size;
+			entry.modifiedAt = qint64(st.st_mtim.tv_sec) * 1000
+				+ st.st_mtim.tv_nsec / 1000000;
+			entry.inode = st.st_ino;
+
+			if (entry.isDir && !m_state->visit(st.st_dev, st.st_ino))
+			{
+				continue;
+			}
+
+			if (entry.isDir)
+			{
+				m_state->submit(entry.path);
+			}
+			entries << entry;
+		}
+
+		::closedir(dir);
+	}
+#else
+	void scanQt(const QString& dirPath, QVector<LocalSnapshot::Entry>& entries)
+	{
+		QDir dir(dirPath);
+		Q_FOREACH(const QFileInfo& info,
+			dir.entryInfoList(QDir::NoDotAndDotDot
+			| QDir::System
+			| QDir::AllDirs
+			| QDir::Files))
+		{
+			LocalSnapshot::Entry entry;
+			entry.path = childPath(info.fileName());
+			entry.isDir = info.isDir();
+			entry.size = entry.isDir ? 0 : info.size();
+			entry.modifiedAt = info.lastModified().toMSecsSinceEpoch();
+
+			if (entry.isDir)
+			{
+				// No inodes here, canonical paths break symlink loops
+				const QString canonicalPath = info.canonicalFilePath();
+				if (!m_state->visit(qHash(canonicalPath), 0))
+				{
+					continue;
+				}
+				m_state->submit(entry.path);
+			}
+			entries << entry;
+		}
+	}
+#endif
+
+	State* m_state;
+	const QString m_relativePath;
+};
+
+void DirectoryScanner::State::submit(const QString& relativePath)
+{
+	{
+		QMutexLocker locker(&mutex);
+		++pendingTasks;
+	}
+
+	pool.start(new ScanTask(this, relativePath));
+}
+
+void DirectoryScanner::State::finishTask(const QVector<LocalSnapshot::Entry>& taskEntries)
+{
+	QMutexLocker locker(&mutex);
+
+	entries += taskEntries;
+	if (--pendingTasks == 0)
+	{
+		allDone.wakeAll();
+	}
+}
+
+void DirectoryScanner::State::waitForAll()
+{
+	QMutexLocker locker(&mutex);
+	while (pendingTasks > 0)
+	{
+		allDone.wait(&mutex);
+	}
+}
+
+bool DirectoryScanner::State::visit(const quint64 device, const quint64 inode)
+{
+	QMutexLocker locker(&mutex);
+
+	const QPair<quint64, quint64> key(device, inode);
+	if (visited.contains(key))
+	{
+		return false;
+	}
+
+	visited.insert(key);
+	return true;
+}
+
+LocalSnapshot DirectoryScanner::scan(const QString& rootPath, const int threadCount)
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	const QString cleanRootPath = QDir::cleanPath(rootPath);
+
+	State state(cleanRootPath,
+		threadCount > 0 ? threadCount : qMax(2, QThread::idealThreadCount()));
+
+	const QFileInfo rootInfo(cleanRootPath);
+	if (rootInfo.isDir())
+	{
+#ifdef Q_OS_LINUX
+		struct stat st;
+		if (::stat(QFile::encodeName(cleanRootPath).constData(), &st) == 0)
+		{
+			state.visit(st.st_dev, st.st_ino);
+		}
+#else
+		state.visit(qHash(rootInfo.canonicalFilePath()), 0);
+#endif
+		state.submit(QString());
+		state.waitForAll();
+	}
+
+	QLOG_INFO() << "Scanned" << state.entries.size() << "local entries in"
+		<< timer.elapsed() << "ms.";
+
+	return LocalSnapshot(cleanRootPath, state.entries);
+}
+
+}
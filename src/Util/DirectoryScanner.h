@@ -0,0 +1,31 @@
+﻿#ifndef DIRECTORY_SCANNER_H
+#define DIRECTORY_SCANNER_H
+
+#include "LocalSnapshot.h"
+
+namespace Drive
+{
+
+//
+// Walks a local folder tree in a pool of threads, every folder is listed
+// by its own task so idle threads pick up the folders found by busy ones.
+//
+// On Linux the folders are read with readdir() and the entries are
+// examined with fstatat() relative to the open folder, elsewhere QDir
+// is used. Hidden entries are skipped.
+//
+class DirectoryScanner
+{
+public:
+	// Blocks until the whole tree is scanned.
+	// threadCount <= 0 stands for the number of CPU cores.
+	static LocalSnapshot scan(const QString& rootPath, int threadCount = 0);
+
+private:
+	class State;
+	class ScanTask;
+};
+
+}
+
+#endif // DIRECTORY_SCANNER_H
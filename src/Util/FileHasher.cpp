@@ -0,0 +1,163 @@
+﻿#include "FileHasher.h"
+
+#include "QsLog/QsLog.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+
+namespace Drive
+{
+
+namespace
+{
+
+const int s_maxCachedHashes = 100000;
+const int s_readBlockSize = 1024 * 1024;
+
+qint64 modificationTime(const QFileInfo& fileInfo)
+{
+	return fileInfo.lastModified().toMSecsSinceEpoch();
+}
+
+}
+
+class FileHasher::HashTask : public QRunnable
+{
+public:
+	explicit HashTask(const QString& filePath)
+		: m_filePath(filePath)
+	{
+	}
+
+	virtual void run() override
+	{
+		const QFileInfo before(m_filePath);
+		const QString hash = computeHash();
+		const QFileInfo after(m_filePath);
+
+		const bool changed = before.size() != after.size()
+				|| modificationTime(before) != modificationTime(after);
+
+		QMetaObject::invokeMethod(&FileHasher::instance(), "onHashed",
+				Qt::QueuedConnection,
+				Q_ARG(QString, m_filePath),
+				Q_ARG(qint64, after.size()),
+				Q_ARG(qint64, modificationTime(after)),
+				Q_ARG(QString, changed ? QString() : hash));
+	}
+
+private:
+	QString computeHash() const
+	{
+		QFile file(m_filePath);
+		if (!file.open(QIODevice::ReadOnly))
+		{
+			QLOG_ERROR() << "Can't hash" << m_filePath << ":" << file.errorString();
+			return QString();
+		}
+
+		QCryptographicHash hash(QCryptographicHash::Md5);
+		QByteArray buffer(s_readBlockSize, Qt::Uninitialized);
+		for (;;)
+		{
+			const qint64 read = file.read(buffer.data(), buffer.size());
+			if (read < 0)
+			{
+				QLOG_ERROR() << "Can't hash" << m_filePath << ":" << file.errorString();
+				return QString();
+			}
+			if (read == 0)
+			{
+				break;
+			}
+			hash.addData(buffer.constData(), read);
+		}
+
+		return QString::fromLatin1(hash.result().toHex());
+	}
+
+	const QString m_filePath;
+};
+
+FileHasher::FileHasher()
+	: m_cache(s_maxCachedHashes)
+{
+}
+
+FileHasher& FileHasher::instance()
+{
+	static FileHasher s_instance;
+	return s_instance;
+}
+
+QString FileHasher::cachedHash(const QString& filePath) const
+{
+	const Entry* entry = m_cache.object(filePath);
+	if (!entry)
+	{
+		return QString();
+	}
+
+	const QFileInfo fileInfo(filePath);
+	if (!fileInfo.isFile()
+		|| fileInfo.size() != entry->size
+		|| modificationTime(fileInfo) != entry->modifiedAt)
+	{
+		return QString();
+	}
+
+	return entry->hash;
+}
+
+void FileHasher::hash(const QString& filePath)
+{
+	const QString cached = cachedHash(filePath);
+	if (!cached.isNull())
+	{
+		// Report asynchronously, as if the file were read
+		QMetaObject::invokeMethod(this, "hashed", Qt::QueuedConnection,
+				Q_ARG(QString, filePath), Q_ARG(QString, cached));
+		return;
+	}
+
+	if (m_inProgress.contains(filePath))
+	{
+		return;
+	}
+
+	m_inProgress.insert(filePath);
+	QThreadPool::globalInstance()->start(new HashTask(filePath));
+}
+
+bool FileHasher::sameHash(const QString& lhs, const QString& rhs)
+{
+	return !lhs.isEmpty()
+		&& lhs.compare(rhs, Qt::CaseInsensitive) == 0;
+}
+
+void FileHasher::onHashed(const QString& filePath,
+	const qint64 size, const qint64 modifiedAt, const QString& hash)
+{
+	m_inProgress.remove(filePath);
+
+	if (hash.isNull())
+	{
+		m_cache.remove(filePath);
+	}
+	else
+	{
+		Entry* entry = new Entry;
+		entry->size = size;
+		entry->modifiedAt = modifiedAt;
+		entry->hash = hash;
+		m_cache.insert(filePath, entry);
+	}
+
+	Q_EMIT hashed(filePath, hash);
+}
+
+}
@@ -0,0 +1,63 @@
+﻿#ifndef FILE_HASHER_H
+#define FILE_HASHER_H
+
+#include <QtCore/QCache>
+#include <QtCore/QObject>
+#include <QtCore/QSet>
+
+namespace Drive
+{
+
+//
+// Computes MD5 checksums of local files in the global thread pool. The
+// file is hashed as a stream, it is never loaded into memory as a whole.
+// Checksums are cached per file and stay valid while the size and the
+// modification time of the file are unchanged.
+//
+// Must be used from the main thread only.
+//
+class FileHasher : public QObject
+{
+	Q_OBJECT
+
+public:
+	static FileHasher& instance();
+
+	// Returns the cached checksum if the file hasn't been changed since it
+	// was hashed, a null string otherwise.
+	QString cachedHash(const QString& filePath) const;
+
+	// Starts hashing of the file. The result is reported by hashed(), a file
+	// hashed already is reported without reading it again. Concurrent
+	// requests for the same file share a single read.
+	void hash(const QString& filePath);
+
+	// Checksums reported are lowercase hex strings, a null string means
+	// the file couldn't be read or has been changed while being hashed.
+	Q_SIGNAL void hashed(const QString& filePath, const QString& hash);
+
+	static bool sameHash(const QString& lhs, const QString& rhs);
+
+private:
+	Q_DISABLE_COPY(FileHasher)
+	FileHasher();
+
+	Q_INVOKABLE void onHashed(const QString& filePath,
+			qint64 size, qint64 modifiedAt, const QString& hash);
+
+	class HashTask;
+
+	struct Entry
+	{
+		qint64 size;
+		qint64 modifiedAt;
+		QString hash;
+	};
+
+	QCache<QString, Entry> m_cache;
+	QSet<QString> m_inProgress;
+};
+
+}
+
+#endif // FILE_HASHER_H
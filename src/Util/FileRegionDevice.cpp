@@ -0,0 +1,101 @@
+﻿#include "FileRegionDevice.h"
+
+namespace Drive
+{
+
+FileRegionDevice::FileRegionDevice(const QString& fileName,
+	const qint64 offset, const qint64 size, QObject* parent)
+	: QIODevice(parent)
+	, m_file(fileName)
+	, m_offset(offset)
+	, m_size(size)
+{
+	Q_ASSERT(offset >= 0);
+	Q_ASSERT(size >= 0);
+}
+
+bool FileRegionDevice::open(const OpenMode mode)
+{
+	if (mode != QIODevice::ReadOnly)
+	{
+		setErrorString("FileRegionDevice is read-only");
+		return false;
+	}
+
+	if (!m_file.open(QIODevice::ReadOnly))
+	{
+		setErrorString(m_file.errorString());
+		return false;
+	}
+
+	if (m_file.size() < m_offset + m_size)
+	{
+		setErrorString("The file is shorter than the region");
+		m_file.close();
+		return false;
+	}
+
+	if (!m_file.seek(m_offset))
+	{
+		setErrorString(m_file.errorString());
+		m_file.close();
+		return false;
+	}
+
+	return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+void FileRegionDevice::close()
+{
+	QIODevice::close();
+	m_file.close();
+}
+
+bool FileRegionDevice::isSequential() const
+{
+	return false;
+}
+
+qint64 FileRegionDevice::size() const
+{
+	return m_size;
+}
+
+bool FileRegionDevice::seek(const qint64 pos)
+{
+	if (pos < 0 || pos > m_size || !m_file.seek(m_offset + pos))
+	{
+		return false;
+	}
+
+	return QIODevice::seek(pos);
+}
+
+bool FileRegionDevice::atEnd() const
+{
+	return pos() >= m_size;
+}
+
+qint64 FileRegionDevice::readData(char* data, const qint64 maxSize)
+{
+	const qint64 available = m_size - pos();
+	if (available <= 0)
+	{
+		return -1;
+	}
+
+	const qint64 read = m_file.read(data, qMin(maxSize, available));
+	if (read < 0)
+	{
+		setErrorString(m_file.errorString());
+	}
+
+	return read;
+}
+
+qint64 FileRegionDevice::writeData(const char*, qint64)
+{
+	return -1;
+}
+
+}
@@ -0,0 +1,44 @@
+﻿#ifndef FILE_REGION_DEVICE_H
+#define FILE_REGION_DEVICE_H
+
+#include <QtCore/QFile>
+#include <QtCore/QIODevice>
+
+namespace Drive
+{
+
+//
+// Read-only window over a region of a file. The data is read from the file
+// on demand, so a request body streamed from the device isn't held in
+// memory as a whole. The device opens its own file handle, the readers
+// of different regions of the same file don't share the file position.
+//
+class FileRegionDevice : public QIODevice
+{
+	Q_OBJECT
+
+public:
+	FileRegionDevice(const QString& fileName, qint64 offset, qint64 size,
+			QObject* parent = nullptr);
+
+	virtual bool open(OpenMode mode) override;
+	virtual void close() override;
+
+	virtual bool isSequential() const override;
+	virtual qint64 size() const override;
+	virtual bool seek(qint64 pos) override;
+	virtual bool atEnd() const override;
+
+protected:
+	virtual qint64 readData(char* data, qint64 maxSize) override;
+	virtual qint64 writeData(const char* data, qint64 maxSize) override;
+
+private:
+	QFile m_file;
+	const qint64 m_offset;
+	const qint64 m_size;
+};
+
+}
+
+#endif // FILE_REGION_DEVICE_H
@@ -16,6 +16,13 @@
 #include <QtGui/QIcon>
 
 #include <list>
+#include <cstdio>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 #define DISK_ROOT_PATH QLatin1String("#root/#disk")
 
@@ -185,6 +192,45 @@ bool FileSystemHelper::setFileModificationTimestamp(const QString& localPath, ui
 #endif
 }
 
+bool FileSystemHelper::replaceFile(const QString& sourcePath,
+									const QString& targetPath)
+{
+#ifdef Q_OS_WIN
+	const std::wstring source = QDir::toNativeSeparators(sourcePath).toStdWString();
+	const std::wstring target = QDir::toNativeSeparators(targetPath).toStdWString();
+
+	const BOOL result = MoveFileExW(source.c_str(), target.c_str(),
+		MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+	const bool result = ::rename(QFile::encodeName(sourcePath).constData(),
+		QFile::encodeName(targetPath).constData()) == 0;
+#endif
+
+	if (!result)
+	{
+		QLOG_ERROR() << "Failed to replace" << targetPath << "with" << sourcePath;
+	}
+
+	return result;
+}
+
+bool FileSystemHelper::syncFile(QFile& file)
+{
+#ifdef Q_OS_WIN
+	const HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(file.handle()));
+	const bool result = FlushFileBuffers(handle) != 0;
+#else
+	const bool result = ::fsync(file.handle()) == 0;
+#endif
+
+	if (!result)
+	{
+		QLOG_ERROR() << "Failed to sync" << file.fileName();
+	}
+
+	return result;
+}
+
 bool FileSystemHelper::removeDirWithSubdirs(const QString &dirName,
 											bool notifyLocalWatcher)
 {
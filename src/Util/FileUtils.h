@@ -2,6 +2,7 @@
 #define FILE_UTILS_H
 
 #include <QtCore/QObject>
+#include <QtCore/QFile>
 #include <QtCore/QFileInfo>
 #include <QHash>
 #include <QString>
@@ -42,6 +43,13 @@ public:
 	static bool setFileModificationTimestamp(const QString& localPath,
 											uint modifiedAt);
 
+	// Renames the file replacing the target atomically if it exists.
+	static bool replaceFile(const QString& sourcePath,
+							const QString& targetPath);
+
+	// Flushes the data of the open file from the system cache to disk.
+	static bool syncFile(QFile& file);
+
 	static bool removeDirWithSubdirs(const QString &dirName,
 									bool notifyLocalWatcher = true);
 
@@ -0,0 +1,172 @@
+﻿#include "LocalSnapshot.h"
+
+#include "QsLog/QsLog.h"
+
+#include <QtCore/QDataStream>
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+
+#include <algorithm>
+
+namespace Drive
+{
+
+namespace
+{
+
+const quint32 s_magic = 0x74645332; // "tdS2"
+
+bool entryLess(const LocalSnapshot::Entry& lhs, const LocalSnapshot::Entry& rhs)
+{
+	return lhs.path < rhs.path;
+}
+
+}
+
+bool LocalSnapshot::Entry::sameAs(const Entry& other) const
+{
+	return isDir == other.isDir
+		&& inode == other.inode
+		&& (isDir || (size == other.size && modifiedAt == other.modifiedAt));
+}
+
+LocalSnapshot::LocalSnapshot()
+{
+}
+
+LocalSnapshot::LocalSnapshot(const QString& rootPath, const QVector<Entry>& entries)
+	: m_rootPath(rootPath)
+	, m_entries(entries)
+{
+	std::sort(m_entries.begin(), m_entries.end(), entryLess);
+}
+
+bool LocalSnapshot::isEmpty() const
+{
+	return m_entries.isEmpty();
+}
+
+QString LocalSnapshot::rootPath() const
+{
+	return m_rootPath;
+}
+
+const QVector<LocalSnapshot::Entry>& LocalSnapshot::entries() const
+{
+	return m_entries;
+}
+
+QVector<LocalSnapshot::Entry>& LocalSnapshot::entries()
+{
+	return m_entries;
+}
+
+const LocalSnapshot::Entry* LocalSnapshot::find(const QString& path) const
+{
+	Entry key;
+	key.path = path;
+
+	auto it = std::lower_bound(m_entries.constBegin(), m_entries.constEnd(),
+		key, entryLess);
+	if (it == m_entries.constEnd() || it->path != path)
+	{
+		return nullptr;
+	}
+
+	return &*it;
+}
+
+QVector<LocalSnapshot::Entry> LocalSnapshot::changedSince(const LocalSnapshot& base) const
+{
+	// Both are sorted, a single merge pass is enough
+	QVector<Entry> result;
+
+	auto baseIt = base.m_entries.constBegin();
+	Q_FOREACH(const Entry& entry, m_entries)
+	{
+		while (baseIt != base.m_entries.constEnd() && baseIt->path < entry.path)
+		{
+			++baseIt;
+		}
+
+		if (baseIt == base.m_entries.constEnd()
+			|| baseIt->path != entry.path
+			|| !entry.sameAs(*baseIt))
+		{
+			result << entry;
+		}
+	}
+
+	return result;
+}
+
+bool LocalSnapshot::load(const QString& fileName, const QString& rootPath)
+{
+	m_rootPath = rootPath;
+	m_entries.clear();
+
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		return false;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_0);
+
+	quint32 magic = 0;
+	QString savedRootPath;
+	quint32 count = 0;
+	stream >> magic >> savedRootPath >> count;
+	if (stream.status() != QDataStream::Ok || magic != s_magic
+		|| savedRootPath != rootPath)
+	{
+		return false;
+	}
+
+	QVector<Entry> entries;
+	entries.reserve(count);
+	for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i)
+	{
+		Entry entry;
+		stream >> entry.path >> entry.size >> entry.modifiedAt
+			>> entry.inode >> entry.isDir
+			>> entry.remoteId >> entry.remoteModifiedAt;
+		entries << entry;
+	}
+
+	if (stream.status() != QDataStream::Ok)
+	{
+		QLOG_ERROR() << "Local snapshot is corrupted:" << fileName;
+		return false;
+	}
+
+	m_entries = entries;
+	return true;
+}
+
+bool LocalSnapshot::save(const QString& fileName) const
+{
+	QSaveFile file(fileName);
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		QLOG_ERROR() << "Can't save local snapshot" << fileName
+			<< ":" << file.errorString();
+		return false;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_0);
+
+	stream << s_magic << m_rootPath << quint32(m_entries.size());
+	Q_FOREACH(const Entry& entry, m_entries)
+	{
+		stream << entry.path << entry.size << entry.modifiedAt
+			<< entry.inode << entry.isDir
+			<< entry.remoteId << entry.remoteModifiedAt;
+	}
+
+	return stream.status() == QDataStream::Ok && file.commit();
+}
+
+}
@@ -0,0 +1,64 @@
+﻿#ifndef LOCAL_SNAPSHOT_H
+#define LOCAL_SNAPSHOT_H
+
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+namespace Drive
+{
+
+//
+// State of a local folder tree: one compact entry per file or folder,
+// sorted by path so that every folder precedes its contents.
+//
+class LocalSnapshot
+{
+public:
+	struct Entry
+	{
+		Entry()
+			: size(0), modifiedAt(0), inode(0), isDir(false)
+			, remoteId(0), remoteModifiedAt(0) {}
+
+		// Relative to the snapshot root, "/" separated
+		QString path;
+		qint64 size;
+		// Milliseconds since epoch
+		qint64 modifiedAt;
+		quint64 inode;
+		bool isDir;
+
+		// Remote file the entry was last synced with, 0 if unknown
+		int remoteId;
+		uint remoteModifiedAt;
+
+		// Compares the local state only
+		bool sameAs(const Entry& other) const;
+	};
+
+	LocalSnapshot();
+	LocalSnapshot(const QString& rootPath, const QVector<Entry>& entries);
+
+	bool isEmpty() const;
+	QString rootPath() const;
+	const QVector<Entry>& entries() const;
+	QVector<Entry>& entries();
+
+	// Null if there is no such entry.
+	const Entry* find(const QString& path) const;
+
+	// Entries which are absent or different in the base snapshot.
+	QVector<Entry> changedSince(const LocalSnapshot& base) const;
+
+	// A snapshot of another root is loaded as an empty one.
+	bool load(const QString& fileName, const QString& rootPath);
+	bool save(const QString& fileName) const;
+
+private:
+	QString m_rootPath;
+	QVector<Entry> m_entries;
+};
+
+}
+
+#endif // LOCAL_SNAPSHOT_H
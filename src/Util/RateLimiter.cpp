@@ -0,0 +1,183 @@
+﻿#include "RateLimiter.h"
+
+#include "Settings/settings.h"
+#include "QsLog/QsLog.h"
+
+#include <QtCore/QTimerEvent>
+
+#include <limits>
+
+namespace Drive
+{
+
+namespace
+{
+
+const int s_refillIntervalMSec = 50;
+
+// An idle transfer saves up to this much of its share,
+// enough to smooth the refill ticks out
+const qint64 s_burstMSec = 250;
+
+}
+
+RateLimiter& RateLimiter::downloads()
+{
+	static RateLimiter s_instance(Settings::limitDownload, Settings::downloadSpeed);
+	return s_instance;
+}
+
+RateLimiter& RateLimiter::uploads()
+{
+	static RateLimiter s_instance(Settings::limitUpload, Settings::uploadSpeed);
+	return s_instance;
+}
+
+RateLimiter::RateLimiter(const QString& enabledSetting, const QString& speedSetting)
+	: m_enabledSetting(enabledSetting)
+	, m_speedSetting(speedSetting)
+	, m_limit(0)
+{
+	connect(&Settings::instance(), &Settings::settingChanged,
+			this, &RateLimiter::onSettingChanged);
+
+	readSettings();
+}
+
+qint64 RateLimiter::limit() const
+{
+	return m_limit;
+}
+
+bool RateLimiter::isLimited() const
+{
+	return m_limit > 0;
+}
+
+void RateLimiter::attach(const QObject* transfer)
+{
+	if (m_allowances.contains(transfer))
+	{
+		return;
+	}
+
+	// A new transfer starts with a single tick of its share
+	const qint64 share = m_limit * s_refillIntervalMSec / 1000
+			/ (m_allowances.size() + 1);
+	m_allowances.insert(transfer, share);
+	updateTimer();
+}
+
+void RateLimiter::detach(const QObject* transfer)
+{
+	m_allowances.remove(transfer);
+	updateTimer();
+}
+
+qint64 RateLimiter::available(const QObject* transfer) const
+{
+	if (!isLimited())
+	{
+		return std::numeric_limits<qint64>::max();
+	}
+
+	return qMax<qint64>(0, m_allowances.value(transfer));
+}
+
+void RateLimiter::consume(const QObject* transfer, const qint64 bytes)
+{
+	if (!isLimited())
+	{
+		return;
+	}
+
+	auto it = m_allowances.find(transfer);
+	if (it != m_allowances.end())
+	{
+		it.value() -= bytes;
+	}
+}
+
+void RateLimiter::timerEvent(QTimerEvent* event)
+{
+	if (event->timerId() != m_timer.timerId())
+	{
+		QObject::timerEvent(event);
+		return;
+	}
+
+	if (!isLimited() || m_allowances.isEmpty())
+	{
+		updateTimer();
+		return;
+	}
+
+	const qint64 elapsed = m_lastRefill.restart();
+	const qint64 count = m_allowances.size();
+	const qint64 share = m_limit * elapsed / 1000 / count;
+	const qint64 burst = qMax<qint64>(share, m_limit * s_burstMSec / 1000 / count);
+
+	for (auto it = m_allowances.begin(); it != m_allowances.end(); ++it)
+	{
+		it.value() = qMin(it.value() + share, burst);
+	}
+
+	Q_EMIT refilled();
+}
+
+void RateLimiter::onSettingChanged(const QString& settingName,
+	QVariant /*oldValue*/, QVariant /*newValue*/)
+{
+	if (settingName == m_enabledSetting || settingName == m_speedSetting)
+	{
+		readSettings();
+	}
+}
+
+void RateLimiter::readSettings()
+{
+	const Settings& settings = Settings::instance();
+
+	const qint64 kbPerSecond = settings.get(m_speedSetting).toLongLong();
+	const qint64 limit = settings.get(m_enabledSetting).toBool() && kbPerSecond > 0
+			? kbPerSecond * 1024 : 0;
+
+	if (limit == m_limit)
+	{
+		return;
+	}
+
+	QLOG_INFO() << m_speedSetting << "limit:"
+		<< (limit > 0 ? QString::number(limit / 1024) + " kB/s" : QString("none"));
+
+	m_limit = limit;
+
+	// Debts made under the old limit are forgiven
+	for (auto it = m_allowances.begin(); it != m_allowances.end(); ++it)
+	{
+		it.value() = qMax<qint64>(0, it.value());
+	}
+
+	updateTimer();
+
+	// Transfers waiting for an allowance go on at the new rate or at full speed
+	Q_EMIT refilled();
+}
+
+void RateLimiter::updateTimer()
+{
+	if (isLimited() && !m_allowances.isEmpty())
+	{
+		if (!m_timer.isActive())
+		{
+			m_lastRefill.start();
+			m_timer.start(s_refillIntervalMSec, this);
+		}
+	}
+	else
+	{
+		m_timer.stop();
+	}
+}
+
+}
@@ -0,0 +1,71 @@
+﻿#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <QtCore/QBasicTimer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+#include <QtCore/QVariant>
+
+namespace Drive
+{
+
+//
+// Token bucket shared by all the transfers in one direction. The rate set
+// in the settings is split equally between the transfers attached, each
+// one gets its own allowance refilled on a timer, so a single large file
+// can't starve the others. The limit follows the settings as they change.
+//
+// A transfer asks for available() bytes before moving data and reports
+// what it has moved by consume(). The allowance may go below zero when a
+// transfer can't split its data, it is paid back by the next refills.
+//
+// Must be used from the main thread only.
+//
+class RateLimiter : public QObject
+{
+	Q_OBJECT
+
+public:
+	static RateLimiter& downloads();
+	static RateLimiter& uploads();
+
+	// Bytes per second, 0 if the rate isn't limited
+	qint64 limit() const;
+	bool isLimited() const;
+
+	void attach(const QObject* transfer);
+	void detach(const QObject* transfer);
+
+	// Bytes the transfer may move now, never negative
+	qint64 available(const QObject* transfer) const;
+	void consume(const QObject* transfer, qint64 bytes);
+
+	// The allowances have been refilled, the transfers waiting may go on
+	Q_SIGNAL void refilled();
+
+protected:
+	virtual void timerEvent(QTimerEvent* event) override;
+
+private:
+	Q_DISABLE_COPY(RateLimiter)
+	RateLimiter(const QString& enabledSetting, const QString& speedSetting);
+
+	void onSettingChanged(const QString& settingName, QVariant oldValue,
+			QVariant newValue);
+	void readSettings();
+	void updateTimer();
+
+private:
+	const QString m_enabledSetting;
+	const QString m_speedSetting;
+	qint64 m_limit;
+
+	QHash<const QObject*, qint64> m_allowances;
+	QBasicTimer m_timer;
+	QElapsedTimer m_lastRefill;
+};
+
+}
+
+#endif // RATE_LIMITER_H
@@ -0,0 +1,87 @@
+﻿#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <QtCore/QAtomicInt>
+
+#include <utility>
+#include <vector>
+
+namespace Drive
+{
+
+//
+// Bounded queue between exactly one producer thread and one consumer
+// thread. Neither side blocks or takes a lock: the producer only moves
+// the tail and the consumer only moves the head, an item is published
+// by the release store of the index that covers it.
+//
+// A full ring refuses new items. One slot is always left empty to tell
+// a full ring from an empty one.
+//
+template <typename T>
+class SpscRing
+{
+public:
+	// Rounded up to a power of two.
+	explicit SpscRing(int capacity)
+		: m_mask(0)
+	{
+		int size = 2;
+		while (size < capacity + 1)
+		{
+			size <<= 1;
+		}
+
+		m_items.resize(size);
+		m_mask = size - 1;
+	}
+
+	// Producer thread only.
+	bool push(T&& item)
+	{
+		const int tail = m_tail.load();
+		const int next = (tail + 1) & m_mask;
+		if (next == m_head.loadAcquire())
+		{
+			return false;
+		}
+
+		m_items[tail] = std::move(item);
+		m_tail.storeRelease(next);
+		return true;
+	}
+
+	// Consumer thread only.
+	bool pop(T& item)
+	{
+		const int head = m_head.load();
+		if (head == m_tail.loadAcquire())
+		{
+			return false;
+		}
+
+		item = std::move(m_items[head]);
+		m_head.storeRelease((head + 1) & m_mask);
+		return true;
+	}
+
+	bool isEmpty() const
+	{
+		return m_head.loadAcquire() == m_tail.loadAcquire();
+	}
+
+private:
+	Q_DISABLE_COPY(SpscRing)
+
+	std::vector<T> m_items;
+	int m_mask;
+
+	// Next slot to read, written by the consumer
+	QAtomicInt m_head;
+	// Next slot to write, written by the producer
+	QAtomicInt m_tail;
+};
+
+}
+
+#endif // SPSC_RING_H
@@ -0,0 +1,38 @@
+﻿#include "Benchmarks.h"
+
+#include <QtCore/QtGlobal>
+
+#if defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+namespace Drive
+{
+
+qint64 peakRssKb()
+{
+#if defined(Q_OS_UNIX)
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+	{
+		return -1;
+	}
+
+#if defined(Q_OS_MAC)
+	// Bytes on OS X, kB elsewhere
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+#else
+	return -1;
+#endif
+}
+
+QTextStream& out()
+{
+	static QTextStream s_out(stdout);
+	return s_out;
+}
+
+}
@@ -0,0 +1,40 @@
+﻿#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+
+namespace Drive
+{
+
+//
+// Each benchmark takes the command line arguments after its name, prints
+// its results to the standard output and returns the exit code.
+//
+struct Benchmark
+{
+	const char* name;
+	const char* usage;
+	int (*run)(const QStringList& args);
+};
+
+// Peak resident set size of the process in kB, -1 where it isn't known
+qint64 peakRssKb();
+
+QTextStream& out();
+
+// Streams the chunks of a file the way an upload body is read
+int regionBenchmark(const QStringList& args);
+
+// Sizes the delta uploads of a file after the typical edits
+int deltaBenchmark(const QStringList& args);
+
+// Times the local tree scan at several thread counts
+int scanBenchmark(const QStringList& args);
+
+// Checks the rates the transfers achieve under the upload limit
+int rateBenchmark(const QStringList& args);
+
+}
+
+#endif // BENCHMARKS_H
@@ -0,0 +1,165 @@
+﻿#include "Benchmarks.h"
+
+#include "Util/ContentChunker.h"
+
+#include <QtCore/QBuffer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+
+#include <functional>
+#include <random>
+
+namespace Drive
+{
+
+namespace
+{
+
+const int s_defaultSizeMB = 64;
+
+typedef std::function<QByteArray (const QByteArray&)> Edit;
+
+struct EditPattern
+{
+	const char* name;
+	Edit edit;
+};
+
+QByteArray randomData(const int size, std::mt19937& random)
+{
+	QByteArray data(size, Qt::Uninitialized);
+	for (int i = 0; i < size; ++i)
+	{
+		data[i] = static_cast<char>(random());
+	}
+
+	return data;
+}
+
+bool split(const QByteArray& data, QVector<ContentChunker::Block>& blocks)
+{
+	QBuffer buffer(const_cast<QByteArray*>(&data));
+	return buffer.open(QIODevice::ReadOnly) && ContentChunker::split(buffer, blocks);
+}
+
+// Bytes the delta upload sends as data: the blocks the base doesn't have,
+// the same rule the upload planner follows
+qint64 deltaBytes(const QVector<ContentChunker::Block>& base,
+		const QVector<ContentChunker::Block>& blocks)
+{
+	QHash<QByteArray, qint64> baseSizes;
+	for (const ContentChunker::Block& block : base)
+	{
+		baseSizes.insert(block.hash, block.size);
+	}
+
+	qint64 bytes = 0;
+	for (const ContentChunker::Block& block : blocks)
+	{
+		if (baseSizes.value(block.hash, -1) != block.size)
+		{
+			bytes += block.size;
+		}
+	}
+
+	return bytes;
+}
+
+}
+
+// Splits a file, or random data of the given size, and versions of it with
+// the typical edits into content-defined blocks. Reports for every edit
+// how much of the new version a delta upload sends.
+int deltaBenchmark(const QStringList& args)
+{
+	std::mt19937 random(1);
+
+	QByteArray base;
+	bool sizeGiven = false;
+	const int sizeMB = args.isEmpty() ? s_defaultSizeMB : args.at(0).toInt(&sizeGiven);
+	if (sizeGiven || args.isEmpty())
+	{
+		base = randomData(sizeMB * 1024 * 1024, random);
+	}
+	else
+	{
+		QFile file(args.at(0));
+		if (!file.open(QIODevice::ReadOnly))
+		{
+			out() << "Can't read " << args.at(0) << ": " << file.errorString() << endl;
+			return 1;
+		}
+		base = file.readAll();
+	}
+
+	const int size = base.size();
+	if (size < 2 * 1024 * 1024)
+	{
+		out() << "The data must be at least 2 MB" << endl;
+		return 1;
+	}
+
+	const EditPattern patterns[] =
+	{
+		{ "append 1 MB", [&random] (QByteArray data) -> QByteArray
+			{
+				return data.append(randomData(1024 * 1024, random));
+			} },
+		{ "insert 100 bytes in the middle", [&random] (QByteArray data) -> QByteArray
+			{
+				return data.insert(data.size() / 2, randomData(100, random));
+			} },
+		{ "overwrite 16 pages of 4 KB", [&random] (QByteArray data) -> QByteArray
+			{
+				for (int i = 0; i < 16; ++i)
+				{
+					const int offset = static_cast<int>(random() % (data.size() - 4096));
+					data.replace(offset, 4096, randomData(4096, random));
+				}
+				return data;
+			} },
+		{ "remove the first 1 MB", [] (QByteArray data) -> QByteArray
+			{
+				return data.remove(0, 1024 * 1024);
+			} },
+		{ "rewrite everything", [&random] (const QByteArray& data) -> QByteArray
+			{
+				return randomData(data.size(), random);
+			} },
+	};
+
+	QElapsedTimer timer;
+	timer.start();
+
+	QVector<ContentChunker::Block> baseBlocks;
+	if (!split(base, baseBlocks))
+	{
+		out() << "Can't split the data" << endl;
+		return 1;
+	}
+
+	out() << "base: " << size / 1024 << " kB, " << baseBlocks.size()
+		<< " blocks, split in " << timer.elapsed() << " ms" << endl;
+
+	for (const EditPattern& pattern : patterns)
+	{
+		const QByteArray edited = pattern.edit(base);
+
+		QVector<ContentChunker::Block> blocks;
+		if (!split(edited, blocks))
+		{
+			out() << "Can't split the data" << endl;
+			return 1;
+		}
+
+		const qint64 sent = deltaBytes(baseBlocks, blocks);
+		out() << pattern.name << ": " << sent / 1024 << " kB of "
+			<< edited.size() / 1024 << " kB sent ("
+			<< sent * 100 / qMax(edited.size(), 1) << "%)" << endl;
+	}
+
+	return 0;
+}
+
+}
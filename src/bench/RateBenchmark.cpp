@@ -0,0 +1,157 @@
+﻿#include "Benchmarks.h"
+
+#include "Settings/settings.h"
+#include "Util/RateLimiter.h"
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QEventLoop>
+#include <QtCore/QTimer>
+
+namespace Drive
+{
+
+namespace
+{
+
+const int s_defaultTransfers = 4;
+const int s_defaultSeconds = 10;
+const qint64 s_defaultChunkKb = 16;
+
+// Achieved rates further than this from the limit fail the check
+const qint64 s_tolerancePercent = 10;
+
+// Moves data whenever the limiter allows it, whole chunks at a time as
+// the uploads do, so the allowance may go below zero
+class Transfer : public QObject
+{
+public:
+	Transfer(RateLimiter& limiter, const qint64 chunkSize)
+		: bytes(0)
+		, m_limiter(limiter)
+		, m_chunkSize(chunkSize)
+	{
+		m_limiter.attach(this);
+	}
+
+	virtual ~Transfer()
+	{
+		m_limiter.detach(this);
+	}
+
+	void pump()
+	{
+		while (m_limiter.available(this) > 0)
+		{
+			m_limiter.consume(this, m_chunkSize);
+			bytes += m_chunkSize;
+		}
+	}
+
+	// Moved since the measurement started
+	qint64 bytes;
+
+private:
+	RateLimiter& m_limiter;
+	const qint64 m_chunkSize;
+};
+
+bool measure(const QList<Transfer*>& transfers, const qint64 limitKb,
+	const int seconds)
+{
+	// The limiter follows the setting, as it does in the settings dialog
+	Settings::instance().set(Settings::uploadSpeed, limitKb, Settings::RealSetting);
+
+	for (Transfer* transfer : transfers)
+	{
+		transfer->bytes = 0;
+		transfer->pump();
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+
+	QEventLoop loop;
+	QTimer::singleShot(seconds * 1000, &loop, SLOT(quit()));
+	loop.exec();
+
+	const qint64 elapsed = qMax<qint64>(timer.elapsed(), 1);
+
+	qint64 total = 0;
+	qint64 slowest = -1;
+	qint64 fastest = 0;
+	for (const Transfer* transfer : transfers)
+	{
+		total += transfer->bytes;
+		slowest = slowest < 0 ? transfer->bytes : qMin(slowest, transfer->bytes);
+		fastest = qMax(fastest, transfer->bytes);
+	}
+
+	const qint64 rateKb = total * 1000 / elapsed / 1024;
+	const bool ok = qAbs(rateKb - limitKb) * 100 <= limitKb * s_tolerancePercent;
+
+	out() << "limit " << limitKb << " kB/s: " << rateKb << " kB/s achieved, "
+		<< "transfers " << slowest * 1000 / elapsed / 1024 << " to "
+		<< fastest * 1000 / elapsed / 1024 << " kB/s, "
+		<< (ok ? "ok" : "FAILED") << endl;
+
+	return ok;
+}
+
+}
+
+// Runs transfers against the upload limiter for a while at the limit,
+// then at half of it changed live, and checks the achieved total rate
+// against the limit. The data isn't sent anywhere, so the pacing of the
+// limiter is measured apart from the network.
+int rateBenchmark(const QStringList& args)
+{
+	const qint64 limitKb = args.isEmpty() ? 0 : args.at(0).toLongLong();
+	if (limitKb <= 0)
+	{
+		out() << "No limit given" << endl;
+		return 1;
+	}
+
+	const int transferCount = args.size() > 1 ? args.at(1).toInt() : s_defaultTransfers;
+	const int seconds = args.size() > 2 ? args.at(2).toInt() : s_defaultSeconds;
+	const qint64 chunkSize = (args.size() > 3
+			? args.at(3).toLongLong()
+			: s_defaultChunkKb) * 1024;
+
+	if (transferCount <= 0 || seconds <= 0 || chunkSize <= 0)
+	{
+		out() << "The transfers, the time and the chunk size must be positive" << endl;
+		return 1;
+	}
+
+	Settings& settings = Settings::instance();
+	settings.set(Settings::limitUpload, true, Settings::RealSetting);
+	settings.set(Settings::uploadSpeed, limitKb, Settings::RealSetting);
+
+	RateLimiter& limiter = RateLimiter::uploads();
+
+	QList<Transfer*> transfers;
+	for (int i = 0; i < transferCount; ++i)
+	{
+		transfers << new Transfer(limiter, chunkSize);
+	}
+
+	const QMetaObject::Connection connection = QObject::connect(
+		&limiter, &RateLimiter::refilled, [&transfers]
+		{
+			for (Transfer* transfer : transfers)
+			{
+				transfer->pump();
+			}
+		});
+
+	const bool limited = measure(transfers, limitKb, seconds);
+	const bool changed = measure(transfers, qMax<qint64>(limitKb / 2, 1), seconds);
+
+	QObject::disconnect(connection);
+	qDeleteAll(transfers);
+
+	return limited && changed ? 0 : 1;
+}
+
+}
@@ -0,0 +1,101 @@
+﻿#include "Benchmarks.h"
+
+#include "Util/FileRegionDevice.h"
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+
+namespace Drive
+{
+
+namespace
+{
+
+// The network access manager takes the body of a request in pieces of
+// about this size
+const qint64 s_readSize = 64 * 1024;
+
+const qint64 s_defaultChunkSizeMB = 8;
+
+}
+
+// Reads a file chunk by chunk as the upload bodies do: through a
+// FileRegionDevice per chunk, or with "buffered" the whole chunk at once
+// into memory as the uploader did before. Reports the throughput and the
+// peak memory of the process, which should not follow the chunk size
+// when the chunks are streamed.
+int regionBenchmark(const QStringList& args)
+{
+	if (args.isEmpty())
+	{
+		out() << "No file given" << endl;
+		return 1;
+	}
+
+	const QString fileName = args.at(0);
+	const qint64 chunkSize = (args.size() > 1
+			? args.at(1).toLongLong()
+			: s_defaultChunkSizeMB) * 1024 * 1024;
+	const bool buffered = args.contains(QLatin1String("buffered"));
+	const qint64 fileSize = QFileInfo(fileName).size();
+
+	if (fileSize <= 0 || chunkSize <= 0)
+	{
+		out() << "Nothing to read from " << fileName << endl;
+		return 1;
+	}
+
+	const qint64 rssBefore = peakRssKb();
+	QByteArray buffer(s_readSize, Qt::Uninitialized);
+	qint64 total = 0;
+
+	QElapsedTimer timer;
+	timer.start();
+
+	for (qint64 offset = 0; offset < fileSize; offset += chunkSize)
+	{
+		const qint64 size = qMin(chunkSize, fileSize - offset);
+
+		if (buffered)
+		{
+			QFile file(fileName);
+			if (!file.open(QIODevice::ReadOnly) || !file.seek(offset))
+			{
+				out() << "Can't read " << fileName << ": " << file.errorString() << endl;
+				return 1;
+			}
+
+			total += file.read(size).size();
+			continue;
+		}
+
+		FileRegionDevice device(fileName, offset, size);
+		if (!device.open(QIODevice::ReadOnly))
+		{
+			out() << "Can't read " << fileName << ": " << device.errorString() << endl;
+			return 1;
+		}
+
+		qint64 read = 0;
+		while ((read = device.read(buffer.data(), buffer.size())) > 0)
+		{
+			total += read;
+		}
+	}
+
+	const qint64 elapsed = qMax<qint64>(timer.elapsed(), 1);
+	const qint64 rssAfter = peakRssKb();
+
+	out() << (buffered ? "buffered" : "streamed")
+		<< ": " << total / (1024 * 1024) << " MB"
+		<< " in " << elapsed << " ms, "
+		<< total * 1000 / elapsed / (1024 * 1024) << " MB/s,"
+		<< " chunk " << chunkSize / (1024 * 1024) << " MB,"
+		<< " peak RSS " << rssBefore / 1024 << " MB before, "
+		<< rssAfter / 1024 << " MB after" << endl;
+
+	return total == fileSize ? 0 : 1;
+}
+
+}
@@ -0,0 +1,104 @@
+﻿#include "Benchmarks.h"
+
+#include "Util/DirectoryScanner.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QThread>
+
+namespace Drive
+{
+
+namespace
+{
+
+const int s_dirsPerParent = 100;
+const int s_runs = 3;
+
+// Folders of files under folders of folders, a hundred to each parent
+bool createTree(const QString& rootPath, const int dirs, const int filesPerDir)
+{
+	for (int i = 0; i < dirs; ++i)
+	{
+		const QString dirPath = QString("%1/d%2/d%3").arg(rootPath)
+				.arg(i / s_dirsPerParent).arg(i);
+		if (!QDir().mkpath(dirPath))
+		{
+			out() << "Can't create " << dirPath << endl;
+			return false;
+		}
+
+		for (int j = 0; j < filesPerDir; ++j)
+		{
+			QFile file(QString("%1/f%2").arg(dirPath).arg(j));
+			if (!file.open(QIODevice::WriteOnly))
+			{
+				out() << "Can't create " << file.fileName() << ": "
+					<< file.errorString() << endl;
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+}
+
+// Scans a folder with one thread and with more, doubling up to the number
+// of cores. With the counts given a synthetic tree is created in the
+// folder first. The best of a few runs is reported, the first run of a
+// cold cache is usually much slower.
+int scanBenchmark(const QStringList& args)
+{
+	if (args.isEmpty() || args.size() == 2)
+	{
+		out() << "No folder, or the file count missing" << endl;
+		return 1;
+	}
+
+	const QString rootPath = QDir(args.at(0)).absolutePath();
+	if (args.size() >= 3)
+	{
+		QElapsedTimer timer;
+		timer.start();
+
+		if (!createTree(rootPath, args.at(1).toInt(), args.at(2).toInt()))
+		{
+			return 1;
+		}
+
+		out() << "tree created in " << timer.elapsed() << " ms" << endl;
+	}
+
+	const int maxThreads = qMax(QThread::idealThreadCount(), 1);
+	for (int threads = 1; ; threads = qMin(threads * 2, maxThreads))
+	{
+		qint64 best = -1;
+		int entries = 0;
+
+		for (int run = 0; run < s_runs; ++run)
+		{
+			QElapsedTimer timer;
+			timer.start();
+
+			entries = DirectoryScanner::scan(rootPath, threads).entries().size();
+
+			const qint64 elapsed = timer.elapsed();
+			best = best < 0 ? elapsed : qMin(best, elapsed);
+		}
+
+		out() << threads << " threads: " << entries << " entries in "
+			<< best << " ms" << endl;
+
+		if (threads == maxThreads)
+		{
+			break;
+		}
+	}
+
+	return 0;
+}
+
+}
@@ -0,0 +1,46 @@
+﻿#include "Benchmarks.h"
+
+#include <QtCore/QCoreApplication>
+
+namespace
+{
+
+const Drive::Benchmark s_benchmarks[] =
+{
+	{ "region", "<file> [chunk MB] [buffered]", Drive::regionBenchmark },
+	{ "delta", "[file | size MB]", Drive::deltaBenchmark },
+	{ "scan", "<folder> [dirs files-per-dir]", Drive::scanBenchmark },
+	{ "rate", "<kB/s> [transfers] [seconds] [chunk kB]", Drive::rateBenchmark },
+};
+
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+
+	// The settings the benchmarks change are kept apart from the application's
+	app.setOrganizationName("bench_Drive");
+	app.setApplicationName("bench_Drive");
+
+	QStringList args = app.arguments();
+	args.removeFirst();
+	const QString name = args.isEmpty() ? QString() : args.takeFirst();
+
+	for (const Drive::Benchmark& benchmark : s_benchmarks)
+	{
+		if (name == QLatin1String(benchmark.name))
+		{
+			return benchmark.run(args);
+		}
+	}
+
+	QTextStream err(stderr);
+	err << "Usage:" << endl;
+	for (const Drive::Benchmark& benchmark : s_benchmarks)
+	{
+		err << "  bench_Drive " << benchmark.name << " " << benchmark.usage << endl;
+	}
+
+	return 1;
+}
@@ -0,0 +1,112 @@
+﻿#include "APIClient/DownloadSession.h"
+#include "efsw/efsw.hpp"
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QStringList>
+#include <QtCore/QTemporaryDir>
+#include <QtTest/QtTest>
+
+namespace
+{
+
+// Time for the watcher to report what has been done so far
+const int s_settleMs = 500;
+
+//
+// Records the actions the local file event notifier would turn into
+// events. Like the notifier it drops the actions on the temporary file
+// of a download, including its final rename.
+//
+class ActionRecorder : public efsw::FileWatchListener
+{
+public:
+	virtual void handleFileAction(efsw::WatchID, const std::string&,
+			const std::string& filename, efsw::Action action,
+			std::string oldFilename) override
+	{
+		if (Drive::DownloadSession::isTempFileName(QString::fromStdString(filename))
+			|| Drive::DownloadSession::isTempFileName(QString::fromStdString(oldFilename)))
+		{
+			return;
+		}
+
+		QMutexLocker locker(&m_mutex);
+		m_actions << QString("%1 %2").arg(action).arg(QString::fromStdString(filename));
+	}
+
+	QStringList takeActions()
+	{
+		QMutexLocker locker(&m_mutex);
+		QStringList result = m_actions;
+		m_actions.clear();
+		return result;
+	}
+
+private:
+	QMutex m_mutex;
+	QStringList m_actions;
+};
+
+}
+
+//
+// The download handler registers no local event exclusions, so the
+// watcher must not report anything but the temporary file while a file
+// is downloaded, and must report the changes made to it afterwards.
+//
+class DownloadEventsTest : public QObject
+{
+	Q_OBJECT
+
+private Q_SLOTS:
+	void initTestCase();
+	void modifiedAfterDownload();
+
+private:
+	QTemporaryDir m_dir;
+	ActionRecorder m_recorder;
+	efsw::FileWatcher m_watcher;
+};
+
+void DownloadEventsTest::initTestCase()
+{
+	QVERIFY(m_dir.isValid());
+	QVERIFY(m_watcher.addWatch(QDir(m_dir.path()).absolutePath().toStdString(),
+		&m_recorder, true) > 0);
+	m_watcher.watch();
+	QTest::qWait(s_settleMs);
+}
+
+void DownloadEventsTest::modifiedAfterDownload()
+{
+	const QString localPath = QDir(m_dir.path()).filePath("downloaded.txt");
+	const QString tempPath = Drive::DownloadSession::tempFilePath(localPath);
+
+	// What FileDownloader does: write the temporary file, then rename it
+	QFile temp(tempPath);
+	QVERIFY(temp.open(QIODevice::WriteOnly));
+	QVERIFY(temp.write("downloaded") > 0);
+	temp.close();
+	QVERIFY(QFile::rename(tempPath, localPath));
+
+	QTest::qWait(s_settleMs);
+	QCOMPARE(m_recorder.takeActions(), QStringList());
+
+	// The user's save
+	QFile file(localPath);
+	QVERIFY(file.open(QIODevice::Append));
+	QVERIFY(file.write(" and modified") > 0);
+	file.close();
+
+	const QString modified = QString("%1 %2")
+		.arg(efsw::Actions::Modified).arg("downloaded.txt");
+
+	QStringList actions;
+	QTRY_VERIFY((actions << m_recorder.takeActions()).contains(modified));
+}
+
+QTEST_GUILESS_MAIN(DownloadEventsTest)
+#include "DownloadEventsTest.moc"